@@ -0,0 +1,171 @@
+/*
+Adaptive radix tree against the hashmap: memory per word and counting
+speed.
+
+Usage: bench_art FILE [ROUNDS]
+
+The file is counted ROUNDS times (default 3) by both structures and
+the fastest round is reported, as words counted per second. Memory is
+reported twice: the bytes the structure itself accounts for (buckets,
+index and key strings for the hashmap; nodes and leaves for the tree),
+and with glibc the heap growth measured by mallinfo2(), mmap'd blocks
+included, which adds allocator overhead per key. Counts and top words
+of both are checked to agree.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "art.h"
+#include "bench_util.h"
+#include "count.h"
+#include "hash.h"
+#include "hashmap.h"
+
+#define TOP 100
+
+static uint64_t
+heap_bytes(void)
+{
+#ifdef __GLIBC__
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+static int64_t
+bench_add_word(char* word, uint64_t len, void* ctx)
+{
+    return art_increment(ctx, word, len, 1);
+}
+
+typedef struct check_ctx
+{
+    hashmap_map_t* map;
+    uint64_t mismatches;
+} check_ctx_t;
+
+static int64_t
+check_word(const char* key, int64_t value, void* ctx)
+{
+    check_ctx_t* check = ctx;
+    int64_t expected = 0;
+    hashmap_get_shared(check->map, key, check->map->hashf(key), &expected);
+    check->mismatches += (value != expected);
+    return 0;
+}
+
+static void
+print_row(const char* name, uint64_t words, uint64_t distinct, double time,
+          uint64_t bytes, uint64_t heap)
+{
+    printf("%-8s %10.3f %12.0f %14"PRIu64" %10.1f %10.1f\n", name, time,
+           (double) words / time, bytes,
+           (double) bytes / (double) distinct,
+           (double) heap / (double) distinct);
+}
+
+int
+main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s FILE [ROUNDS]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t rounds = (argc > 2) ? strtoull(argv[2], NULL, 10) : 3;
+    rounds = rounds ? rounds : 1;
+
+    uint64_t len = 0;
+    char* buf = bench_read_file(argv[1], &len);
+    if (!buf)
+    {
+        return EXIT_FAILURE;
+    }
+
+    uint64_t wordcount = 0;
+    uint64_t charcount = 0;
+    double map_time = 0;
+    double art_time = 0;
+    uint64_t map_heap = 0;
+    uint64_t art_heap = 0;
+    hashmap_map_t* map = NULL;
+    art_t* t = NULL;
+    for (uint64_t r = 0; r < rounds; ++r)
+    {
+        hashmap_free(map);
+        art_free(t);
+
+        uint64_t before = heap_bytes();
+        double start = bench_now();
+        map = hashmap_init(hash_djb2);
+        wordcount = 0;
+        count_buffer(buf, len, map, &wordcount, &charcount);
+        double time = bench_now() - start;
+        map_time = (r == 0 || time < map_time) ? time : map_time;
+        map_heap = heap_bytes() - before;
+
+        before = heap_bytes();
+        start = bench_now();
+        t = art_init();
+        wordcount = 0;
+        count_buffer_each(buf, len, bench_add_word, t, &wordcount, &charcount);
+        time = bench_now() - start;
+        art_time = (r == 0 || time < art_time) ? time : art_time;
+        art_heap = heap_bytes() - before;
+
+        if (!map || !t)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Every bucket holds a key string, empty ones a single byte.
+    uint64_t map_bytes = map->capacity * (sizeof(hashmap_bucket_t)
+                                          + sizeof(uint64_t));
+    for (uint64_t i = 0; i < map->capacity; ++i)
+    {
+        map_bytes += strlen(map->buckets[i].key) + 1;
+    }
+
+    check_ctx_t check = {.map = map, .mismatches = 0};
+    art_each(t, check_word, &check);
+    check.mismatches += (t->size != map->size);
+
+    const hashmap_bucket_t* map_top[TOP];
+    const art_leaf_t* art_top[TOP];
+    uint64_t n = hashmap_top_k(map, TOP, map_top);
+    if (art_top_k(t, TOP, art_top) != n)
+    {
+        check.mismatches++;
+    }
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        check.mismatches += (strcmp(map_top[i]->key, art_top[i]->key) != 0);
+    }
+
+    printf("words=%"PRIu64" distinct=%"PRIu64" rounds=%"PRIu64"\n",
+           wordcount, map->size, rounds);
+    printf("art: node4=%"PRIu64" node16=%"PRIu64" node48=%"PRIu64" "
+           "node256=%"PRIu64"\n", t->nodes[0], t->nodes[1], t->nodes[2],
+           t->nodes[3]);
+    printf("%-8s %10s %12s %14s %10s %10s\n", "", "time", "words/s", "bytes",
+           "bytes/key", "heap/key");
+    print_row("hashmap", wordcount, map->size, map_time, map_bytes, map_heap);
+    print_row("art", wordcount, t->size, art_time, t->bytes, art_heap);
+    printf("mismatches=%"PRIu64"\n", check.mismatches);
+
+    art_free(t);
+    hashmap_free(map);
+    free(buf);
+    return check.mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,136 @@
+/*
+Count-Min sketch accuracy vs memory against the exact hashmap.
+
+Usage: bench_cms FILE [DEPTH] [TOP]
+
+The file is counted exactly once, then once per sketch size from
+64 KiB to 64 MiB. For every size the estimates of all distinct words
+are compared to the exact counts and the heavy hitters are compared
+to the exact top words.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "bench_util.h"
+#include "cms.h"
+#include "count.h"
+#include "hash.h"
+#include "hashmap.h"
+
+static int64_t
+bench_add_word(char* word, uint64_t len, void* ctx)
+{
+    (void) len;
+    return cms_add(ctx, word);
+}
+
+int
+main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s FILE [DEPTH] [TOP]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t depth = (argc > 2) ? strtoull(argv[2], NULL, 10)
+                                : CMS_DEFAULT_DEPTH;
+    uint64_t k = (argc > 3) ? strtoull(argv[3], NULL, 10) : 100;
+
+    uint64_t len = 0;
+    char* buf = bench_read_file(argv[1], &len);
+    if (!buf)
+    {
+        return EXIT_FAILURE;
+    }
+
+    uint64_t wordcount = 0;
+    uint64_t charcount = 0;
+    hashmap_map_t* map = hashmap_init(hash_djb2);
+    const hashmap_bucket_t** exact_top = calloc(k, sizeof(void*));
+    const cms_heavy_t** top = calloc(k, sizeof(void*));
+    if (!map || !exact_top || !top)
+    {
+        return EXIT_FAILURE;
+    }
+
+    double start = bench_now();
+    count_buffer(buf, len, map, &wordcount, &charcount);
+    double exact_time = bench_now() - start;
+    uint64_t exact_k = hashmap_top_k(map, k, exact_top);
+    uint64_t exact_bytes = map->capacity * sizeof(hashmap_bucket_t);
+    for (uint64_t i = 0; i < map->capacity; ++i)
+    {
+        if (map->buckets[i].in_use)
+        {
+            exact_bytes += strlen(map->buckets[i].key) + 1;
+        }
+    }
+
+    printf("words=%"PRIu64" distinct=%"PRIu64" depth=%"PRIu64" top=%"PRIu64"\n",
+           wordcount, map->size, depth, k);
+    printf("exact: bytes=%"PRIu64" time=%f\n", exact_bytes, exact_time);
+    printf("%10s %10s %8s %12s %12s %12s %10s %8s\n", "bytes", "width",
+           "time", "mean_err", "max_err", "bound", "exact_pct", "recall");
+
+    for (uint64_t bytes = 64U * 1024U; bytes <= 64U * 1024U * 1024U; bytes *= 4)
+    {
+        uint64_t sketch_words = 0;
+        uint64_t sketch_chars = 0;
+        cms_t* cms = cms_init_memory(hash_djb2, bytes, depth, k);
+        if (!cms)
+        {
+            return EXIT_FAILURE;
+        }
+
+        start = bench_now();
+        count_buffer_each(buf, len, bench_add_word, cms, &sketch_words,
+                          &sketch_chars);
+        double time = bench_now() - start;
+
+        // Error over distinct words, i.e. not weighted by frequency.
+        uint64_t exact_words = 0;
+        uint64_t max_err = 0;
+        double sum_err = 0;
+        for (uint64_t i = 0; i < map->capacity; ++i)
+        {
+            const hashmap_bucket_t* bucket = &map->buckets[i];
+            if (!bucket->in_use)
+            {
+                continue;
+            }
+            uint64_t err = cms_estimate(cms, bucket->key)
+                           - (uint64_t) bucket->value;
+            sum_err += (double) err;
+            max_err = (err > max_err) ? err : max_err;
+            exact_words += (err == 0);
+        }
+
+        uint64_t n = cms_heavy_hitters(cms, top);
+        uint64_t hits = 0;
+        for (uint64_t i = 0; i < n; ++i)
+        {
+            for (uint64_t j = 0; j < exact_k; ++j)
+            {
+                hits += (strcmp(top[i]->key, exact_top[j]->key) == 0);
+            }
+        }
+
+        printf("%10"PRIu64" %10"PRIu64" %8.3f %12.3f %12"PRIu64" %12.1f "
+               "%9.2f%% %7.2f%%\n", bytes, cms->width, time,
+               sum_err / (double) map->size, max_err, cms_error_bound(cms),
+               100.0 * (double) exact_words / (double) map->size,
+               exact_k ? 100.0 * (double) hits / (double) exact_k : 100.0);
+
+        cms_free(cms);
+    }
+
+    free(top);
+    free(exact_top);
+    hashmap_free(map);
+    free(buf);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,204 @@
+/*
+Compile-time specialized maps of hashmap_template.h against the
+function pointer hashmap.
+
+Usage: bench_hashmap FILE [ROUNDS]
+
+The file is tokenized once into a word list, so only map operations
+are timed: every map counts the whole list ROUNDS times (default 3)
+from empty and the fastest round is reported. The hashmap is called
+through hashmap_increment() with map->hashf set at runtime, the
+specialized maps call their hash function directly. Counts of every
+map are checked against the hashmap.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "bench_util.h"
+#include "count.h"
+#include "hash.h"
+#include "hashmap.h"
+#include "hashmap_template.h"
+
+// DJB2 with the MurmurHash3 finalizer, for linear probing.
+static inline hash_t
+bench_hash_mixed(const char* key, uint64_t len)
+{
+    hash_t hash = hash_djb2_len(key, len);
+    hash ^= hash >> 33U;
+    hash *= 0xFF51AFD7ED558CCDLU;
+    hash ^= hash >> 33U;
+    return hash;
+}
+
+DEFINE_HASHMAP(map_i64, hash_djb2_len, int64_t, 0.75, HASHMAP_PROBE_PERTURB)
+DEFINE_HASHMAP(map_u32, hash_djb2_len, uint32_t, 0.75, HASHMAP_PROBE_PERTURB)
+DEFINE_HASHMAP(map_u32_linear, bench_hash_mixed, uint32_t, 0.5,
+               HASHMAP_PROBE_LINEAR)
+
+// All words, null-terminated one after another.
+typedef struct word_list
+{
+    char* data;
+    uint64_t size;
+    uint64_t capacity;
+    uint64_t count;
+} word_list_t;
+
+static int64_t
+list_add_word(char* word, uint64_t len, void* ctx)
+{
+    word_list_t* list = ctx;
+    if (list->size + len + 1 > list->capacity)
+    {
+        uint64_t capacity = list->capacity ? list->capacity * 2 : 1U << 20U;
+        char* data = realloc(list->data, capacity);
+        if (!data)
+        {
+            fprintf(stderr, "list_add_word(): error: realloc(): data\n");
+            return -1;
+        }
+        list->data = data;
+        list->capacity = capacity;
+    }
+    memcpy(list->data + list->size, word, len + 1);
+    list->size += len + 1;
+    list->count++;
+    return 0;
+}
+
+typedef struct check_ctx
+{
+    const hashmap_map_t* map;
+    uint64_t mismatches;
+} check_ctx_t;
+
+static int64_t
+check_i64(const char* key, int64_t value, void* ctx)
+{
+    check_ctx_t* check = ctx;
+    int64_t expected = 0;
+    hashmap_get_shared(check->map, key, check->map->hashf(key), &expected);
+    check->mismatches += (value != expected);
+    return 0;
+}
+
+static int64_t
+check_u32(const char* key, uint32_t value, void* ctx)
+{
+    return check_i64(key, (int64_t) value, ctx);
+}
+
+static void
+print_row(const char* name, double time, uint64_t words, uint64_t entry_size,
+          uint64_t capacity, uint64_t collisions, double base)
+{
+    printf("%-16s %8.3f %12.0f %6"PRIu64" %12"PRIu64" %12"PRIu64" %7.2fx\n",
+           name, time, (double) words / time, entry_size, capacity,
+           collisions, base / time);
+}
+
+// Time ROUNDS runs of counting the list into a fresh map of each kind.
+#define BENCH_MAP(name, check_fn) \
+{ \
+    double best = 0; \
+    name##_t* m = NULL; \
+    for (uint64_t r = 0; r < rounds; ++r) \
+    { \
+        name##_free(m); \
+        double start = bench_now(); \
+        m = name##_init(); \
+        const char* w = list.data; \
+        for (uint64_t i = 0; i < list.count && m; ++i) \
+        { \
+            uint64_t len = strlen(w); \
+            name##_increment(m, w, len, 1); \
+            w += len + 1; \
+        } \
+        double time = bench_now() - start; \
+        best = (r == 0 || time < best) ? time : best; \
+    } \
+    if (!m) \
+    { \
+        return EXIT_FAILURE; \
+    } \
+    print_row(#name, best, list.count, sizeof(name##_entry_t), m->capacity, \
+              m->collisions, base); \
+    check.mismatches += (m->size != map->size); \
+    name##_each(m, check_fn, &check); \
+    name##_free(m); \
+}
+
+int
+main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s FILE [ROUNDS]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t rounds = (argc > 2) ? strtoull(argv[2], NULL, 10) : 3;
+    rounds = rounds ? rounds : 1;
+
+    uint64_t len = 0;
+    char* buf = bench_read_file(argv[1], &len);
+    if (!buf)
+    {
+        return EXIT_FAILURE;
+    }
+
+    word_list_t list = {0};
+    uint64_t wordcount = 0;
+    uint64_t charcount = 0;
+    if (count_buffer_each(buf, len, list_add_word, &list, &wordcount,
+                          &charcount) != 0)
+    {
+        return EXIT_FAILURE;
+    }
+    free(buf);
+
+    // Every loop takes word lengths with strlen(), so the loops only
+    // differ in the map.
+    double base = 0;
+    hashmap_map_t* map = NULL;
+    for (uint64_t r = 0; r < rounds; ++r)
+    {
+        hashmap_free(map);
+        double start = bench_now();
+        map = hashmap_init(hash_djb2);
+        char* w = list.data;
+        for (uint64_t i = 0; i < list.count && map; ++i)
+        {
+            uint64_t word_len = strlen(w);
+            hashmap_increment(map, w, 1);
+            w += word_len + 1;
+        }
+        double time = bench_now() - start;
+        base = (r == 0 || time < base) ? time : base;
+    }
+    if (!map)
+    {
+        return EXIT_FAILURE;
+    }
+
+    printf("words=%"PRIu64" distinct=%"PRIu64" rounds=%"PRIu64"\n",
+           list.count, map->size, rounds);
+    printf("%-16s %8s %12s %6s %12s %12s %8s\n", "", "time", "words/s",
+           "entry", "capacity", "collisions", "speedup");
+    print_row("hashmap", base, list.count, sizeof(hashmap_bucket_t),
+              map->capacity, map->collisions, base);
+
+    check_ctx_t check = {.map = map, .mismatches = 0};
+    BENCH_MAP(map_i64, check_i64)
+    BENCH_MAP(map_u32, check_u32)
+    BENCH_MAP(map_u32_linear, check_u32)
+    printf("mismatches=%"PRIu64"\n", check.mismatches);
+
+    hashmap_free(map);
+    free(list.data);
+    return check.mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,326 @@
+/*
+Latency and throughput of the word count server under mixed load.
+
+Usage: bench_server FILE [INGESTERS] [QUERIERS] [SECONDS] [DOC_BYTES]
+
+A server is started in process on a temporary socket and exercised
+through the socket like any other client. Ingesters send FILE in
+documents of about DOC_BYTES (default 4096, cut at whitespace) over
+and over. Queriers send count queries of words taken from FILE, with
+every 10th query a distinct query and every 100th a top 10 query.
+Per operation latency percentiles and throughput are printed after
+SECONDS (default 5).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "bench_util.h"
+#include "server.h"
+#include "util.h"
+
+enum
+{
+    BENCH_INGEST,
+    BENCH_COUNT,
+    BENCH_TOPK,
+    BENCH_DISTINCT,
+    BENCH_OPS,
+};
+
+static const char* BENCH_OP_NAMES[BENCH_OPS] = {
+    "ingest", "count", "topk", "distinct"
+};
+
+typedef struct bench_samples
+{
+    double* values; // Latencies in microseconds.
+    uint64_t count;
+    uint64_t capacity;
+} bench_samples_t;
+
+typedef struct bench_worker
+{
+    const char* socket_path;
+    const char* text;
+    uint64_t len;
+    uint64_t doc_bytes;
+    bool ingester;
+    uint64_t seed;
+    atomic_bool* stop;
+
+    bench_samples_t samples[BENCH_OPS];
+    uint64_t bytes;
+    uint64_t words;
+    bool failed;
+} bench_worker_t;
+
+static void
+bench_record(bench_samples_t* samples, double seconds)
+{
+    if (samples->count == samples->capacity)
+    {
+        uint64_t capacity = samples->capacity ? samples->capacity * 2 : 4096;
+        double* values = realloc(samples->values, capacity * sizeof(double));
+        if (!values)
+        {
+            return;
+        }
+        samples->values = values;
+        samples->capacity = capacity;
+    }
+    samples->values[samples->count++] = seconds * 1000000.0;
+}
+
+static uint64_t
+bench_next(uint64_t* state)
+{
+    // xorshift64*
+    *state ^= *state >> 12U;
+    *state ^= *state << 25U;
+    *state ^= *state >> 27U;
+    return *state * 0x2545F4914F6CDD1DLU;
+}
+
+// Find a word around a random offset of text.
+static uint64_t
+bench_random_word(const bench_worker_t* w, uint64_t* state, const char** word)
+{
+    uint64_t pos = bench_next(state) % w->len;
+    while (pos < w->len && !is_word_char(w->text[pos]))
+    {
+        pos++;
+    }
+    while (pos > 0 && is_word_char(w->text[pos - 1]))
+    {
+        pos--;
+    }
+
+    uint64_t end = pos;
+    while (end < w->len && is_word_char(w->text[end]))
+    {
+        end++;
+    }
+    *word = w->text + pos;
+    return end - pos;
+}
+
+static void*
+bench_worker_run(void* arg)
+{
+    bench_worker_t* w = arg;
+    int fd = server_connect(w->socket_path);
+    if (fd < 0)
+    {
+        w->failed = true;
+        return NULL;
+    }
+
+    uint64_t state = w->seed;
+    uint64_t pos = w->ingester ? bench_next(&state) % w->len : 0;
+    uint64_t n = 0;
+
+    while (!atomic_load(w->stop))
+    {
+        uint32_t op;
+        uint32_t arg = 0;
+        const char* payload = NULL;
+        uint64_t length = 0;
+
+        if (w->ingester)
+        {
+            op = SERVER_OP_INGEST;
+            if (pos >= w->len)
+            {
+                pos = 0;
+            }
+            uint64_t end = pos + w->doc_bytes;
+            end = (end > w->len) ? w->len : end;
+            while (end < w->len && is_word_char(w->text[end]))
+            {
+                end++;
+            }
+            payload = w->text + pos;
+            length = end - pos;
+            pos = end;
+        }
+        else if (++n % 100 == 0)
+        {
+            op = SERVER_OP_TOPK;
+            arg = 10;
+        }
+        else if (n % 10 == 0)
+        {
+            op = SERVER_OP_DISTINCT;
+        }
+        else
+        {
+            op = SERVER_OP_COUNT;
+            length = bench_random_word(w, &state, &payload);
+        }
+
+        server_response_t response;
+        void* out = NULL;
+        double begin = bench_now();
+        int64_t status = server_call(fd, op, arg, payload, length, &response,
+                                     &out);
+        double elapsed = bench_now() - begin;
+        free(out);
+
+        if (status != SERVER_OK)
+        {
+            w->failed = true;
+            break;
+        }
+
+        bench_record(&w->samples[op - SERVER_OP_INGEST], elapsed);
+        if (op == SERVER_OP_INGEST)
+        {
+            w->bytes += length;
+            w->words += response.value;
+        }
+    }
+
+    close(fd);
+    return NULL;
+}
+
+static int
+bench_compare(const void* a, const void* b)
+{
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+static void*
+bench_serve(void* arg)
+{
+    server_run(arg);
+    return NULL;
+}
+
+int
+main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s FILE [INGESTERS] [QUERIERS] [SECONDS] "
+                        "[DOC_BYTES]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t ingesters = (argc > 2) ? strtoull(argv[2], NULL, 10) : 2;
+    uint64_t queriers = (argc > 3) ? strtoull(argv[3], NULL, 10) : 2;
+    double seconds = (argc > 4) ? strtod(argv[4], NULL) : 5.0;
+    uint64_t doc_bytes = (argc > 5) ? strtoull(argv[5], NULL, 10) : 4096;
+
+    uint64_t len = 0;
+    char* text = bench_read_file(argv[1], &len);
+    if (!text || len == 0 || doc_bytes == 0)
+    {
+        free(text);
+        return EXIT_FAILURE;
+    }
+
+    char socket_path[64];
+    sprintf(socket_path, "/tmp/bench_server_%ld.sock", (long) getpid());
+    server_t* server = server_init(socket_path, hash_djb2);
+    if (!server)
+    {
+        free(text);
+        return EXIT_FAILURE;
+    }
+
+    pthread_t serve_thread;
+    pthread_create(&serve_thread, NULL, bench_serve, server);
+
+    uint64_t worker_count = ingesters + queriers;
+    bench_worker_t* workers = calloc(worker_count, sizeof(bench_worker_t));
+    pthread_t* threads = calloc(worker_count, sizeof(pthread_t));
+    atomic_bool stop = false;
+
+    for (uint64_t i = 0; i < worker_count; ++i)
+    {
+        workers[i].socket_path = socket_path;
+        workers[i].text = text;
+        workers[i].len = len;
+        workers[i].doc_bytes = doc_bytes;
+        workers[i].ingester = i < ingesters;
+        // Ingesters start at different places of the file.
+        workers[i].seed = 0x9E3779B97F4A7C15LU * (i + 1);
+        workers[i].stop = &stop;
+        pthread_create(&threads[i], NULL, bench_worker_run, &workers[i]);
+    }
+
+    double begin = bench_now();
+    usleep((useconds_t) (seconds * 1000000.0));
+    atomic_store(&stop, true);
+    for (uint64_t i = 0; i < worker_count; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = bench_now() - begin;
+
+    printf("file=%s bytes=%"PRIu64" ingesters=%"PRIu64" queriers=%"PRIu64" "
+           "doc_bytes=%"PRIu64" seconds=%.2f\n", argv[1], len, ingesters,
+           queriers, doc_bytes, elapsed);
+    printf("%-10s %12s %12s %10s %10s %10s %10s\n", "op", "ops", "ops/s",
+           "p50_us", "p90_us", "p99_us", "max_us");
+
+    uint64_t bytes = 0;
+    uint64_t words = 0;
+    bool failed = false;
+    for (uint64_t op = 0; op < BENCH_OPS; ++op)
+    {
+        bench_samples_t all = {0};
+        for (uint64_t i = 0; i < worker_count; ++i)
+        {
+            bench_samples_t* s = &workers[i].samples[op];
+            for (uint64_t j = 0; j < s->count; ++j)
+            {
+                bench_record(&all, s->values[j] / 1000000.0);
+            }
+        }
+        if (all.count == 0)
+        {
+            continue;
+        }
+
+        qsort(all.values, all.count, sizeof(double), bench_compare);
+        printf("%-10s %12"PRIu64" %12.0f %10.1f %10.1f %10.1f %10.1f\n",
+               BENCH_OP_NAMES[op], all.count, (double) all.count / elapsed,
+               all.values[all.count / 2], all.values[all.count * 9 / 10],
+               all.values[all.count * 99 / 100], all.values[all.count - 1]);
+        free(all.values);
+    }
+
+    for (uint64_t i = 0; i < worker_count; ++i)
+    {
+        bytes += workers[i].bytes;
+        words += workers[i].words;
+        failed |= workers[i].failed;
+        for (uint64_t op = 0; op < BENCH_OPS; ++op)
+        {
+            free(workers[i].samples[op].values);
+        }
+    }
+
+    uint64_t served = atomic_load(&server->wordcount);
+    printf("ingest: %.1f MB/s, %.0f words/s, server word_count=%"PRIu64" %s\n",
+           (double) bytes / elapsed / 1000000.0, (double) words / elapsed,
+           served, (served == words && !failed) ? "ok" : "MISMATCH");
+
+    server_stop(server);
+    pthread_join(serve_thread, NULL);
+    server_free(server);
+    free(workers);
+    free(threads);
+    free(text);
+    return (served == words && !failed) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,41 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "bench_util.h"
+
+double
+bench_now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1000000000.0;
+}
+
+char*
+bench_read_file(const char* path, uint64_t* len)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f)
+    {
+        fprintf(stderr, "bench_read_file(): error: fopen(): %s\n", path);
+        return NULL;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    char* buf = malloc(size > 0 ? (size_t) size : 1);
+    if (!buf || fread(buf, 1, (size_t) size, f) != (size_t) size)
+    {
+        fprintf(stderr, "bench_read_file(): error: reading %s\n", path);
+        free(buf);
+        fclose(f);
+        return NULL;
+    }
+
+    fclose(f);
+    *len = (uint64_t) size;
+    return buf;
+}
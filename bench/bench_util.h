@@ -0,0 +1,20 @@
+#ifndef MAPWORDS_BENCH_UTIL_H
+#define MAPWORDS_BENCH_UTIL_H
+
+#include <inttypes.h>
+
+/*
+Helpers shared by the benchmarks: wall clock time and reading a whole
+input file into memory, so only the measured structure is timed.
+*/
+
+// Wall clock time in seconds.
+double
+bench_now(void);
+
+// Read whole file at path into a malloc'd buffer and store its length
+// in len. Return NULL on error.
+char*
+bench_read_file(const char* path, uint64_t* len);
+
+#endif //MAPWORDS_BENCH_UTIL_H
@@ -13,6 +13,7 @@ import re
 import subprocess
 from argparse import Namespace
 from dataclasses import dataclass
+from dataclasses import fields
 from typing import Sequence
 
 import matplotlib.pyplot as plt
@@ -29,6 +30,8 @@ class Stats(object):
     char_count: int = 0
     duration: float = 0
     hashf: str = ""
+    backend: str = "hashmap"
+    bytes: int = 0
 
     def __post_init__(self):
         self.word_count = int(self.word_count)
@@ -36,12 +39,33 @@ class Stats(object):
         self.map_size = int(self.map_size)
         self.char_count = int(self.char_count)
         self.duration = float(self.duration)
+        self.bytes = int(self.bytes)
+
+    @classmethod
+    def parse(cls, output: str) -> "Stats":
+        """Parse stats lines, ignoring those of other modes."""
+        names = {f.name for f in fields(cls)}
+        d = {}
+        for match in STATS_PATTERN.finditer(output):
+            key = match.groups()[0].strip()
+            if key in names:
+                d[key] = match.groups()[1].strip()
+        return cls(**d)
+
+    @property
+    def label(self) -> str:
+        if self.hashf == "none":
+            return self.backend
+        return f"{self.backend}/{self.hashf}"
 
 
 def parse_args() -> Namespace:
     ap = argparse.ArgumentParser()
     ap.add_argument("mapwords", help="path to mapwords")
     ap.add_argument("-f", "--file", help="path to text file", nargs="+")
+    ap.add_argument("-b", "--backend", nargs="+",
+                    help="counting backends to compare, see "
+                         "'mapwords --backend'; default mode if not given")
 
     args = ap.parse_args()
     if platform.system() == "Windows":
@@ -60,26 +84,29 @@ def plot_complexities(stats: Sequence[Stats], elements: int):
 
     data = {}
     for stat in stats:
-        data[stat.hashf] = {}
-        data[stat.hashf]["s_x"] = []
-        data[stat.hashf]["s_y"] = []
+        data[stat.label] = {}
+        data[stat.label]["s_x"] = []
+        data[stat.label]["s_y"] = []
 
     wps = []
     for stat in stats:
-        data[stat.hashf]["s_x"].append(stat.word_count)
-        data[stat.hashf]["s_y"].append(stat.duration)
+        data[stat.label]["s_x"].append(stat.word_count)
+        data[stat.label]["s_y"].append(stat.duration)
         w = stat.word_count / stat.duration
         wps.append(w)
-        print(f"{stat.hashf}: {w} words per second")
+        line = f"{stat.label}: {w} words per second"
+        if stat.bytes and stat.map_size:
+            line += f", {stat.bytes / stat.map_size:.1f} bytes per word"
+        print(line)
 
-    for hashf in data:
-        data[hashf]["s_x"].sort()
-        data[hashf]["s_y"].sort()
+    for label in data:
+        data[label]["s_x"].sort()
+        data[label]["s_y"].sort()
 
         axs[1].plot(
-            data[hashf]["s_x"],
-            data[hashf]["s_y"],
-            label=hashf,
+            data[label]["s_x"],
+            data[label]["s_y"],
+            label=label,
         )
 
     print(f"words per second: min={min(wps)}, "
@@ -104,20 +131,23 @@ def main():
         "hash_java",
     ]
 
+    backends = args.backend or [None]
+
     outputs = []
     for f in args.file:
-        for hf in hash_functions:
-            print(f"analyzing: '{f}' ({hf})")
-            out = subprocess.check_output([args.mapwords, "-f", f, "-h", hf])
-            outputs.append(out.decode("utf-8"))
-
-    stats = []
-    for o in outputs:
-        d = {}
-        for match in STATS_PATTERN.finditer(o):
-            d[match.groups()[0].strip()] = match.groups()[1].strip()
-        s = Stats(**d)
-        stats.append(s)
+        for backend in backends:
+            for hf in hash_functions:
+                cmd = [args.mapwords, "-f", f, "-h", hf]
+                if backend:
+                    cmd += ["--backend", backend]
+                print(f"analyzing: '{f}' ({backend or 'default'}, {hf})")
+                out = subprocess.check_output(cmd).decode("utf-8")
+                outputs.append(out)
+                # Backends not hashing words run once.
+                if Stats.parse(out).hashf == "none":
+                    break
+
+    stats = [Stats.parse(o) for o in outputs]
 
     plot_complexities(stats=stats, elements=1000)
 
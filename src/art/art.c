@@ -0,0 +1,693 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "art.h"
+#include "topk.h"
+
+#define ART_NODE4 0U
+#define ART_NODE16 1U
+#define ART_NODE48 2U
+#define ART_NODE256 3U
+
+// Leaves are tagged by the lowest pointer bit.
+#define ART_IS_LEAF(p) (((uintptr_t) (p)) & 1U)
+#define ART_LEAF(p) ((art_leaf_t*) (((uintptr_t) (p)) & ~(uintptr_t) 1U))
+#define ART_TAG(l) ((void*) (((uintptr_t) (l)) | 1U))
+
+typedef struct art_node
+{
+    uint8_t type;
+    uint16_t count; // Children.
+    uint32_t prefix_len; // Whole compressed prefix length.
+    unsigned char prefix[ART_MAX_PREFIX];
+} art_node_t;
+
+typedef struct art_node4
+{
+    art_node_t n;
+    unsigned char keys[4];
+    void* children[4];
+} art_node4_t;
+
+typedef struct art_node16
+{
+    art_node_t n;
+    unsigned char keys[16];
+    void* children[16];
+} art_node16_t;
+
+typedef struct art_node48
+{
+    art_node_t n;
+    unsigned char index[256]; // Child slot + 1, 0 if none.
+    void* children[48];
+} art_node48_t;
+
+typedef struct art_node256
+{
+    art_node_t n;
+    void* children[256];
+} art_node256_t;
+
+static const uint64_t art_node_sizes[4] = {
+    sizeof(art_node4_t),
+    sizeof(art_node16_t),
+    sizeof(art_node48_t),
+    sizeof(art_node256_t),
+};
+
+static inline uint64_t
+art_min(uint64_t a, uint64_t b)
+{
+    return (a < b) ? a : b;
+}
+
+static art_node_t*
+art_alloc_node(art_t* t, uint8_t type)
+{
+    art_node_t* n = calloc(1, art_node_sizes[type]);
+    if (!n)
+    {
+        fprintf(stderr, "art_alloc_node(): error: calloc(): node\n");
+        return NULL;
+    }
+    n->type = type;
+    t->bytes += art_node_sizes[type];
+    t->nodes[type]++;
+    return n;
+}
+
+static void
+art_free_node(art_t* t, art_node_t* n)
+{
+    t->bytes -= art_node_sizes[n->type];
+    t->nodes[n->type]--;
+    free(n);
+}
+
+static art_leaf_t*
+art_alloc_leaf(art_t* t, const unsigned char* key, uint64_t len, int64_t value)
+{
+    uint64_t bytes = sizeof(art_leaf_t) + len + 1;
+    art_leaf_t* l = malloc(bytes);
+    if (!l)
+    {
+        fprintf(stderr, "art_alloc_leaf(): error: malloc(): leaf\n");
+        return NULL;
+    }
+    l->value = value;
+    l->len = (uint32_t) len;
+    memcpy(l->key, key, len + 1);
+    t->bytes += bytes;
+    t->size++;
+    return l;
+}
+
+art_t*
+art_init(void)
+{
+    art_t* t = calloc(1, sizeof(art_t));
+    if (!t)
+    {
+        fprintf(stderr, "art_init(): error: calloc(): t\n");
+    }
+    return t;
+}
+
+static void
+art_free_tree(void* p)
+{
+    if (p == NULL)
+    {
+        return;
+    }
+    if (ART_IS_LEAF(p))
+    {
+        free(ART_LEAF(p));
+        return;
+    }
+
+    art_node_t* n = p;
+    switch (n->type)
+    {
+        case ART_NODE4:
+            for (uint16_t i = 0; i < n->count; ++i)
+            {
+                art_free_tree(((art_node4_t*) n)->children[i]);
+            }
+            break;
+        case ART_NODE16:
+            for (uint16_t i = 0; i < n->count; ++i)
+            {
+                art_free_tree(((art_node16_t*) n)->children[i]);
+            }
+            break;
+        case ART_NODE48:
+            for (uint16_t i = 0; i < 48; ++i)
+            {
+                art_free_tree(((art_node48_t*) n)->children[i]);
+            }
+            break;
+        default:
+            for (uint16_t i = 0; i < 256; ++i)
+            {
+                art_free_tree(((art_node256_t*) n)->children[i]);
+            }
+            break;
+    }
+    free(n);
+}
+
+void
+art_free(art_t* t)
+{
+    if (t != NULL)
+    {
+        art_free_tree(t->root);
+        free(t);
+    }
+}
+
+// Return the child slot of n for key byte c, NULL if none.
+static inline void**
+art_find_child(art_node_t* n, unsigned char c)
+{
+    switch (n->type)
+    {
+        case ART_NODE4:
+        {
+            art_node4_t* n4 = (art_node4_t*) n;
+            for (uint16_t i = 0; i < n->count; ++i)
+            {
+                if (n4->keys[i] == c)
+                {
+                    return &n4->children[i];
+                }
+            }
+            return NULL;
+        }
+        case ART_NODE16:
+        {
+            art_node16_t* n16 = (art_node16_t*) n;
+            for (uint16_t i = 0; i < n->count; ++i)
+            {
+                if (n16->keys[i] == c)
+                {
+                    return &n16->children[i];
+                }
+            }
+            return NULL;
+        }
+        case ART_NODE48:
+        {
+            art_node48_t* n48 = (art_node48_t*) n;
+            return n48->index[c] ? &n48->children[n48->index[c] - 1] : NULL;
+        }
+        default:
+        {
+            art_node256_t* n256 = (art_node256_t*) n;
+            return n256->children[c] ? &n256->children[c] : NULL;
+        }
+    }
+}
+
+// Return the leaf with the smallest key below p.
+static const art_leaf_t*
+art_minimum(const void* p)
+{
+    while (!ART_IS_LEAF(p))
+    {
+        const art_node_t* n = p;
+        switch (n->type)
+        {
+            case ART_NODE4:
+                p = ((const art_node4_t*) n)->children[0];
+                break;
+            case ART_NODE16:
+                p = ((const art_node16_t*) n)->children[0];
+                break;
+            case ART_NODE48:
+            {
+                const art_node48_t* n48 = (const art_node48_t*) n;
+                uint16_t c = 0;
+                while (!n48->index[c])
+                {
+                    c++;
+                }
+                p = n48->children[n48->index[c] - 1];
+                break;
+            }
+            default:
+            {
+                const art_node256_t* n256 = (const art_node256_t*) n;
+                uint16_t c = 0;
+                while (!n256->children[c])
+                {
+                    c++;
+                }
+                p = n256->children[c];
+                break;
+            }
+        }
+    }
+    return ART_LEAF(p);
+}
+
+// Insert child into sorted keys and children of a node4 or node16
+// with room for it.
+static void
+art_insert_sorted(unsigned char* keys, void** children, uint16_t count,
+                  unsigned char c, void* child)
+{
+    uint16_t i = 0;
+    while (i < count && keys[i] < c)
+    {
+        i++;
+    }
+    memmove(keys + i + 1, keys + i, count - i);
+    memmove(children + i + 1, children + i, (count - i) * sizeof(void*));
+    keys[i] = c;
+    children[i] = child;
+}
+
+// Add child for key byte c to node *ref, growing the node into the
+// next size if it is full.
+static int64_t
+art_add_child(art_t* t, void** ref, unsigned char c, void* child)
+{
+    art_node_t* n = *ref;
+    switch (n->type)
+    {
+        case ART_NODE4:
+        {
+            art_node4_t* n4 = (art_node4_t*) n;
+            if (n->count < 4)
+            {
+                art_insert_sorted(n4->keys, n4->children, n->count, c, child);
+                n->count++;
+                return ART_OK;
+            }
+
+            art_node16_t* n16 = (art_node16_t*) art_alloc_node(t, ART_NODE16);
+            if (!n16)
+            {
+                return ART_ERROR;
+            }
+            n16->n = *n;
+            n16->n.type = ART_NODE16;
+            memcpy(n16->keys, n4->keys, sizeof(n4->keys));
+            memcpy(n16->children, n4->children, sizeof(n4->children));
+            art_free_node(t, n);
+            *ref = n16;
+            return art_add_child(t, ref, c, child);
+        }
+        case ART_NODE16:
+        {
+            art_node16_t* n16 = (art_node16_t*) n;
+            if (n->count < 16)
+            {
+                art_insert_sorted(n16->keys, n16->children, n->count, c,
+                                  child);
+                n->count++;
+                return ART_OK;
+            }
+
+            art_node48_t* n48 = (art_node48_t*) art_alloc_node(t, ART_NODE48);
+            if (!n48)
+            {
+                return ART_ERROR;
+            }
+            n48->n = *n;
+            n48->n.type = ART_NODE48;
+            for (uint16_t i = 0; i < 16; ++i)
+            {
+                n48->index[n16->keys[i]] = (unsigned char) (i + 1);
+                n48->children[i] = n16->children[i];
+            }
+            art_free_node(t, n);
+            *ref = n48;
+            return art_add_child(t, ref, c, child);
+        }
+        case ART_NODE48:
+        {
+            art_node48_t* n48 = (art_node48_t*) n;
+            if (n->count < 48)
+            {
+                uint16_t slot = 0;
+                while (n48->children[slot])
+                {
+                    slot++;
+                }
+                n48->children[slot] = child;
+                n48->index[c] = (unsigned char) (slot + 1);
+                n->count++;
+                return ART_OK;
+            }
+
+            art_node256_t* n256 = (art_node256_t*) art_alloc_node(t,
+                                                                 ART_NODE256);
+            if (!n256)
+            {
+                return ART_ERROR;
+            }
+            n256->n = *n;
+            n256->n.type = ART_NODE256;
+            for (uint16_t i = 0; i < 256; ++i)
+            {
+                if (n48->index[i])
+                {
+                    n256->children[i] = n48->children[n48->index[i] - 1];
+                }
+            }
+            art_free_node(t, n);
+            *ref = n256;
+            return art_add_child(t, ref, c, child);
+        }
+        default:
+        {
+            art_node256_t* n256 = (art_node256_t*) n;
+            n256->children[c] = child;
+            n->count++;
+            return ART_OK;
+        }
+    }
+}
+
+// Return number of leading bytes of the prefix of n matching key of
+// len bytes (terminator included) from depth.
+static uint64_t
+art_prefix_mismatch(const art_node_t* n, const unsigned char* key,
+                    uint64_t len, uint64_t depth)
+{
+    uint64_t max = art_min(art_min(n->prefix_len, ART_MAX_PREFIX),
+                           len - depth);
+    uint64_t i = 0;
+    for (; i < max; ++i)
+    {
+        if (n->prefix[i] != key[depth + i])
+        {
+            return i;
+        }
+    }
+
+    // Bytes past the stored prefix are those of any leaf below.
+    if (n->prefix_len > ART_MAX_PREFIX)
+    {
+        const art_leaf_t* l = art_minimum(n);
+        const unsigned char* lkey = (const unsigned char*) l->key;
+        max = art_min(art_min(l->len + 1, len) - depth, n->prefix_len);
+        for (; i < max; ++i)
+        {
+            if (lkey[depth + i] != key[depth + i])
+            {
+                return i;
+            }
+        }
+    }
+    return i;
+}
+
+// Find or add key of len bytes (terminator included) and add delta to
+// its count, or set its count to delta with set.
+static int64_t
+art_upsert(art_t* t, const unsigned char* key, uint64_t len, int64_t delta,
+           bool set)
+{
+    void** ref = &t->root;
+    uint64_t depth = 0;
+    while (true)
+    {
+        void* p = *ref;
+        if (p == NULL)
+        {
+            art_leaf_t* l = art_alloc_leaf(t, key, len - 1, delta);
+            if (!l)
+            {
+                return ART_ERROR;
+            }
+            *ref = ART_TAG(l);
+            return ART_OK;
+        }
+
+        if (ART_IS_LEAF(p))
+        {
+            art_leaf_t* l = ART_LEAF(p);
+            const unsigned char* lkey = (const unsigned char*) l->key;
+            if (l->len + 1 == len && memcmp(lkey + depth, key + depth,
+                                            len - depth) == 0)
+            {
+                l->value = set ? delta : l->value + delta;
+                return ART_OK;
+            }
+
+            // Split the leaf: keys differ before either terminator.
+            uint64_t common = 0;
+            while (lkey[depth + common] == key[depth + common])
+            {
+                common++;
+            }
+
+            art_node_t* n = art_alloc_node(t, ART_NODE4);
+            art_leaf_t* new_leaf = n ? art_alloc_leaf(t, key, len - 1, delta)
+                                     : NULL;
+            if (!new_leaf)
+            {
+                if (n)
+                {
+                    art_free_node(t, n);
+                }
+                return ART_ERROR;
+            }
+            n->prefix_len = (uint32_t) common;
+            memcpy(n->prefix, key + depth, art_min(common, ART_MAX_PREFIX));
+            *ref = n;
+            art_add_child(t, ref, lkey[depth + common], p);
+            art_add_child(t, ref, key[depth + common], ART_TAG(new_leaf));
+            return ART_OK;
+        }
+
+        art_node_t* n = p;
+        if (n->prefix_len > 0)
+        {
+            uint64_t mismatch = art_prefix_mismatch(n, key, len, depth);
+            if (mismatch < n->prefix_len)
+            {
+                // Split the prefix with a node4 above n.
+                art_node_t* parent = art_alloc_node(t, ART_NODE4);
+                art_leaf_t* new_leaf = parent ? art_alloc_leaf(t, key, len - 1,
+                                                               delta)
+                                              : NULL;
+                if (!new_leaf)
+                {
+                    if (parent)
+                    {
+                        art_free_node(t, parent);
+                    }
+                    return ART_ERROR;
+                }
+                parent->prefix_len = (uint32_t) mismatch;
+                memcpy(parent->prefix, n->prefix,
+                       art_min(mismatch, ART_MAX_PREFIX));
+                *ref = parent;
+
+                unsigned char c;
+                uint32_t rest = n->prefix_len - (uint32_t) mismatch - 1;
+                if (n->prefix_len <= ART_MAX_PREFIX)
+                {
+                    c = n->prefix[mismatch];
+                    memmove(n->prefix, n->prefix + mismatch + 1, rest);
+                }
+                else
+                {
+                    const art_leaf_t* l = art_minimum(n);
+                    const unsigned char* lkey = (const unsigned char*) l->key;
+                    c = lkey[depth + mismatch];
+                    memcpy(n->prefix, lkey + depth + mismatch + 1,
+                           art_min(rest, ART_MAX_PREFIX));
+                }
+                n->prefix_len = rest;
+
+                art_add_child(t, ref, c, n);
+                art_add_child(t, ref, key[depth + mismatch],
+                              ART_TAG(new_leaf));
+                return ART_OK;
+            }
+            depth += n->prefix_len;
+        }
+
+        void** child = art_find_child(n, key[depth]);
+        if (child)
+        {
+            ref = child;
+            depth++;
+            continue;
+        }
+
+        art_leaf_t* l = art_alloc_leaf(t, key, len - 1, delta);
+        if (!l)
+        {
+            return ART_ERROR;
+        }
+        if (art_add_child(t, ref, key[depth], ART_TAG(l)) != ART_OK)
+        {
+            t->bytes -= sizeof(art_leaf_t) + len;
+            t->size--;
+            free(l);
+            return ART_ERROR;
+        }
+        return ART_OK;
+    }
+}
+
+int64_t
+art_increment(art_t* t, const char* word, uint64_t len, int64_t delta)
+{
+    return art_upsert(t, (const unsigned char*) word, len + 1, delta, false);
+}
+
+int64_t
+art_update(art_t* t, const char* word, uint64_t len, int64_t value)
+{
+    return art_upsert(t, (const unsigned char*) word, len + 1, value, true);
+}
+
+int64_t
+art_get(const art_t* t, const char* word)
+{
+    const unsigned char* key = (const unsigned char*) word;
+    uint64_t len = strlen(word) + 1;
+    uint64_t depth = 0;
+    void* p = t->root;
+    while (p != NULL)
+    {
+        if (ART_IS_LEAF(p))
+        {
+            const art_leaf_t* l = ART_LEAF(p);
+            return (l->len + 1 == len && memcmp(l->key, word, len) == 0)
+                   ? l->value : 0;
+        }
+
+        // Optimistic: skip prefix bytes that are not stored, the leaf
+        // compares the whole key.
+        art_node_t* n = p;
+        uint64_t stored = art_min(n->prefix_len, ART_MAX_PREFIX);
+        if (n->prefix_len > 0)
+        {
+            if (depth + stored > len
+                || memcmp(n->prefix, key + depth, stored) != 0)
+            {
+                return 0;
+            }
+            depth += n->prefix_len;
+        }
+        if (depth >= len)
+        {
+            return 0;
+        }
+
+        void** child = art_find_child(n, key[depth++]);
+        p = child ? *child : NULL;
+    }
+    return 0;
+}
+
+static int64_t
+art_each_node(const void* p, art_each_fn fn, void* ctx)
+{
+    if (ART_IS_LEAF(p))
+    {
+        const art_leaf_t* l = ART_LEAF(p);
+        return fn(l->key, l->value, ctx);
+    }
+
+    const art_node_t* n = p;
+    int64_t status = 0;
+    switch (n->type)
+    {
+        case ART_NODE4:
+            for (uint16_t i = 0; i < n->count && status == 0; ++i)
+            {
+                status = art_each_node(((const art_node4_t*) n)->children[i],
+                                       fn, ctx);
+            }
+            break;
+        case ART_NODE16:
+            for (uint16_t i = 0; i < n->count && status == 0; ++i)
+            {
+                status = art_each_node(((const art_node16_t*) n)->children[i],
+                                       fn, ctx);
+            }
+            break;
+        case ART_NODE48:
+        {
+            const art_node48_t* n48 = (const art_node48_t*) n;
+            for (uint16_t c = 0; c < 256 && status == 0; ++c)
+            {
+                if (n48->index[c])
+                {
+                    status = art_each_node(n48->children[n48->index[c] - 1],
+                                           fn, ctx);
+                }
+            }
+            break;
+        }
+        default:
+        {
+            const art_node256_t* n256 = (const art_node256_t*) n;
+            for (uint16_t c = 0; c < 256 && status == 0; ++c)
+            {
+                if (n256->children[c])
+                {
+                    status = art_each_node(n256->children[c], fn, ctx);
+                }
+            }
+            break;
+        }
+    }
+    return status;
+}
+
+int64_t
+art_each(const art_t* t, art_each_fn fn, void* ctx)
+{
+    return t->root ? art_each_node(t->root, fn, ctx) : 0;
+}
+
+// Check if leaf a ranks below leaf b in top-k order.
+static bool
+art_ranks_below(const void* a, const void* b, const void* ctx)
+{
+    (void) ctx;
+    const art_leaf_t* x = a;
+    const art_leaf_t* y = b;
+    if (x->value != y->value)
+    {
+        return x->value < y->value;
+    }
+    return strcmp(x->key, y->key) > 0;
+}
+
+static int64_t
+art_top_visit(const char* key, int64_t value, void* ctx)
+{
+    (void) value;
+
+    // Keys passed by art_each() are those of the leaves.
+    topk_push(ctx, key - offsetof(art_leaf_t, key));
+    return 0;
+}
+
+uint64_t
+art_top_k(const art_t* t, uint64_t k, const art_leaf_t** out)
+{
+    topk_t top;
+    topk_init(&top, (const void**) out, k, art_ranks_below, NULL);
+    if (k > 0)
+    {
+        art_each(t, art_top_visit, &top);
+    }
+    return topk_sort(&top);
+}
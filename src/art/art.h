@@ -0,0 +1,89 @@
+#ifndef MAPWORDS_ART_H
+#define MAPWORDS_ART_H
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+/*
+Adaptive radix tree (ART) word counter, an ordered alternative to the
+hash map. See Leis et al., "The Adaptive Radix Tree: ARTful Indexing
+for Main-Memory Databases", ICDE 2013.
+
+Inner nodes branch on one key byte and come in four sizes, grown as
+children are added: node4 and node16 keep sorted key bytes next to
+their children, node48 maps all 256 bytes to 48 child slots and
+node256 is a plain child array. Chains of single-child nodes are
+collapsed into a compressed prefix stored in the node. Only the first
+ART_MAX_PREFIX bytes are stored, longer prefixes are checked against
+the key of the smallest leaf below the node (pessimistic on insert,
+optimistic on lookup where the leaf compares the whole key anyway).
+
+Leaves hold the count and the whole key and are told apart from
+inner nodes by the lowest bit of the child pointer. The terminating
+'\0' of a word is part of its key, so no key is a prefix of another
+and every word ends in a leaf of its own.
+
+Shared prefixes are stored once and there are no empty slots or key
+pointers, so memory per word is mostly its leaf. Children are kept
+in byte order, so art_each() visits words in key order with no sort,
+and art_top_k() needs a single pass.
+*/
+
+#define ART_ERROR -1
+#define ART_OK 0
+
+// Compressed prefix bytes stored in a node.
+#define ART_MAX_PREFIX 8U
+
+typedef struct art_leaf
+{
+    int64_t value;
+    uint32_t len; // Not counting the terminating '\0'.
+    char key[]; // Null-terminated.
+} art_leaf_t;
+
+typedef struct art
+{
+    void* root; // Inner node or tagged leaf, NULL if empty.
+    uint64_t size; // Number of words.
+    uint64_t bytes; // Allocated for nodes and leaves.
+    uint64_t nodes[4]; // Inner nodes by type, node4 to node256.
+} art_t;
+
+// Called for every word by art_each(). Any return value other than 0
+// stops the iteration and is passed on.
+typedef int64_t (* art_each_fn)(const char* key, int64_t value, void* ctx);
+
+// Allocate empty tree.
+art_t*
+art_init(void);
+
+// Free tree and all its nodes and leaves.
+void
+art_free(art_t* t);
+
+// Add delta to the count of null-terminated word of len bytes, adding
+// the word with delta as count if it is not in the tree.
+int64_t
+art_increment(art_t* t, const char* word, uint64_t len, int64_t delta);
+
+// Set count of null-terminated word of len bytes, adding the word if
+// it is not in the tree.
+int64_t
+art_update(art_t* t, const char* word, uint64_t len, int64_t value);
+
+// Get count of null-terminated word, 0 if not seen.
+int64_t
+art_get(const art_t* t, const char* word);
+
+// Call fn for every word in key order.
+int64_t
+art_each(const art_t* t, art_each_fn fn, void* ctx);
+
+// Select k words with the largest counts in descending order, ties
+// broken by key in ascending order. 'out' must have room for k
+// leaves. Return number of leaves written, or 0 on error.
+uint64_t
+art_top_k(const art_t* t, uint64_t k, const art_leaf_t** out);
+
+#endif //MAPWORDS_ART_H
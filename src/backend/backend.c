@@ -0,0 +1,262 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "art.h"
+#include "backend.h"
+#include "hashmap.h"
+#include "packed.h"
+
+// Open addressing string hash map, see hashmap.h.
+
+static void*
+backend_hashmap_init(hash_t (* hashf)(const char*))
+{
+    return hashmap_init(hashf);
+}
+
+static void
+backend_hashmap_free(void* counter)
+{
+    hashmap_free(counter);
+}
+
+static int64_t
+backend_hashmap_increment(void* counter, char* word, uint64_t len,
+                          int64_t delta)
+{
+    (void) len;
+    return hashmap_increment(counter, word, delta);
+}
+
+static int64_t
+backend_hashmap_each(const void* counter, backend_each_fn fn, void* ctx)
+{
+    const hashmap_map_t* map = counter;
+    for (uint64_t i = 0; i < map->capacity; ++i)
+    {
+        if (map->buckets[i].in_use)
+        {
+            int64_t status = fn(map->buckets[i].key, map->buckets[i].value,
+                                ctx);
+            if (status != 0)
+            {
+                return status;
+            }
+        }
+    }
+    return 0;
+}
+
+static uint64_t
+backend_hashmap_top_k(const void* counter, uint64_t k, backend_word_t* out)
+{
+    const hashmap_bucket_t** top = malloc((k + 1) * sizeof(void*));
+    if (!top)
+    {
+        fprintf(stderr, "backend_hashmap_top_k(): error: malloc(): top\n");
+        return 0;
+    }
+
+    uint64_t n = hashmap_top_k(counter, k, top);
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        out[i].key = top[i]->key;
+        out[i].value = top[i]->value;
+    }
+    free(top);
+    return n;
+}
+
+static void
+backend_hashmap_stats(const void* counter, backend_stats_t* out)
+{
+    const hashmap_map_t* map = counter;
+    out->size = map->size;
+    out->collisions = map->collisions;
+    out->rehashes = map->rehashes;
+    out->capacity = map->capacity;
+
+    // Every bucket holds a key string, empty ones a single byte.
+    out->bytes = map->capacity * sizeof(hashmap_bucket_t);
+    for (uint64_t i = 0; i < map->capacity; ++i)
+    {
+        out->bytes += strlen(map->buckets[i].key) + 1;
+    }
+}
+
+static const backend_t backend_hashmap = {
+    .name = "hashmap",
+    .hashes = true,
+    .init = backend_hashmap_init,
+    .free = backend_hashmap_free,
+    .increment = backend_hashmap_increment,
+    .each = backend_hashmap_each,
+    .top_k = backend_hashmap_top_k,
+    .stats = backend_hashmap_stats,
+};
+
+// Short words packed into integer keys, see packed.h.
+
+static void*
+backend_packed_init(hash_t (* hashf)(const char*))
+{
+    return packed_init(hashf);
+}
+
+static void
+backend_packed_free(void* counter)
+{
+    packed_free(counter);
+}
+
+static int64_t
+backend_packed_increment(void* counter, char* word, uint64_t len,
+                         int64_t delta)
+{
+    return packed_increment(counter, word, len, delta);
+}
+
+static int64_t
+backend_packed_each(const void* counter, backend_each_fn fn, void* ctx)
+{
+    return packed_each(counter, fn, ctx);
+}
+
+static uint64_t
+backend_packed_top_k(const void* counter, uint64_t k, backend_word_t* out)
+{
+    packed_word_t* top = malloc((k + 1) * sizeof(packed_word_t));
+    if (!top)
+    {
+        fprintf(stderr, "backend_packed_top_k(): error: malloc(): top\n");
+        return 0;
+    }
+
+    uint64_t n = packed_top_k(counter, k, top);
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        out[i].value = top[i].value;
+        if (top[i].key == top[i].short_key)
+        {
+            strcpy(out[i].short_key, top[i].short_key);
+            out[i].key = out[i].short_key;
+        }
+        else
+        {
+            out[i].key = top[i].key;
+        }
+    }
+    free(top);
+    return n;
+}
+
+static void
+backend_packed_stats(const void* counter, backend_stats_t* out)
+{
+    const packed_t* p = counter;
+    backend_hashmap_stats(p->long_words, out);
+    out->size += p->short_words->size;
+    out->collisions += p->short_words->collisions;
+    out->rehashes += p->short_words->rehashes;
+    out->capacity += p->short_words->capacity;
+    out->bytes += p->short_words->capacity * sizeof(u64map_entry_t);
+}
+
+static const backend_t backend_packed = {
+    .name = "packed",
+    .hashes = true,
+    .init = backend_packed_init,
+    .free = backend_packed_free,
+    .increment = backend_packed_increment,
+    .each = backend_packed_each,
+    .top_k = backend_packed_top_k,
+    .stats = backend_packed_stats,
+};
+
+// Adaptive radix tree, see art.h.
+
+static void*
+backend_art_init(hash_t (* hashf)(const char*))
+{
+    (void) hashf;
+    return art_init();
+}
+
+static void
+backend_art_free(void* counter)
+{
+    art_free(counter);
+}
+
+static int64_t
+backend_art_increment(void* counter, char* word, uint64_t len, int64_t delta)
+{
+    return art_increment(counter, word, len, delta);
+}
+
+static int64_t
+backend_art_each(const void* counter, backend_each_fn fn, void* ctx)
+{
+    return art_each(counter, fn, ctx);
+}
+
+static uint64_t
+backend_art_top_k(const void* counter, uint64_t k, backend_word_t* out)
+{
+    const art_leaf_t** top = malloc((k + 1) * sizeof(void*));
+    if (!top)
+    {
+        fprintf(stderr, "backend_art_top_k(): error: malloc(): top\n");
+        return 0;
+    }
+
+    uint64_t n = art_top_k(counter, k, top);
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        out[i].key = top[i]->key;
+        out[i].value = top[i]->value;
+    }
+    free(top);
+    return n;
+}
+
+static void
+backend_art_stats(const void* counter, backend_stats_t* out)
+{
+    const art_t* t = counter;
+    memset(out, 0, sizeof(backend_stats_t));
+    out->size = t->size;
+    out->bytes = t->bytes;
+}
+
+static const backend_t backend_art = {
+    .name = "art",
+    .hashes = false,
+    .init = backend_art_init,
+    .free = backend_art_free,
+    .increment = backend_art_increment,
+    .each = backend_art_each,
+    .top_k = backend_art_top_k,
+    .stats = backend_art_stats,
+};
+
+const backend_t* const backend_list[] = {
+    &backend_hashmap,
+    &backend_packed,
+    &backend_art,
+    NULL,
+};
+
+const backend_t*
+backend_find(const char* name)
+{
+    for (uint64_t i = 0; backend_list[i] != NULL; ++i)
+    {
+        if (strcmp(backend_list[i]->name, name) == 0)
+        {
+            return backend_list[i];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,87 @@
+#ifndef MAPWORDS_BACKEND_H
+#define MAPWORDS_BACKEND_H
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "hash.h"
+
+/*
+Counting backends behind a common interface, so engines can be swapped
+at runtime and compared by the same counting loop.
+
+A backend is a table of operations on an opaque counter: init, free,
+increment, each (iterate all words), top_k and stats. The counting
+loop only calls increment for every word and top_k for the results;
+each lets results of any backend be copied into a hashmap, e.g. for
+snapshots. Backends that ignore hashf (those not hashing whole
+strings) report it as "none".
+
+A new engine is added by writing its adapter functions in backend.c
+and listing its table in backend_list. It is then selectable by name
+with --backend and reported as "stats: backend=NAME" for driver.py.
+*/
+
+#define BACKEND_ERROR -1
+#define BACKEND_OK 0
+
+// Longest key a backend may store inline in backend_word_t.
+#define BACKEND_SHORT_KEY 15U
+
+// Word and count selected by top_k.
+typedef struct backend_word
+{
+    const char* key; // Into short_key, or owned by the counter.
+    int64_t value;
+    char short_key[BACKEND_SHORT_KEY + 1];
+} backend_word_t;
+
+// Counter statistics, zero where they do not apply.
+typedef struct backend_stats
+{
+    uint64_t size; // Distinct words.
+    uint64_t collisions;
+    uint64_t rehashes;
+    uint64_t capacity;
+    uint64_t bytes; // Memory held for words and counts.
+} backend_stats_t;
+
+// Called for every word by each. Any return value other than 0 stops
+// the iteration and is passed on.
+typedef int64_t (* backend_each_fn)(const char* key, int64_t value,
+                                    void* ctx);
+
+typedef struct backend
+{
+    const char* name;
+    bool hashes; // Uses hashf.
+
+    // Allocate empty counter, NULL on error.
+    void* (* init)(hash_t (* hashf)(const char*));
+
+    void (* free)(void* counter);
+
+    // Add delta to the count of null-terminated word of len bytes.
+    int64_t (* increment)(void* counter, char* word, uint64_t len,
+                          int64_t delta);
+
+    // Call fn for every word in any order.
+    int64_t (* each)(const void* counter, backend_each_fn fn, void* ctx);
+
+    // Select k words with the largest counts in descending order, ties
+    // broken by key in ascending order, into out of k words. Return
+    // number of words written, or 0 on error.
+    uint64_t (* top_k)(const void* counter, uint64_t k, backend_word_t* out);
+
+    void (* stats)(const void* counter, backend_stats_t* out);
+} backend_t;
+
+// All backends, NULL terminated. The first one is the default, used
+// for plain counting when no --backend is given.
+extern const backend_t* const backend_list[];
+
+// Find backend by name, NULL if there is none.
+const backend_t*
+backend_find(const char* name);
+
+#endif //MAPWORDS_BACKEND_H
@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bloom.h"
+#include "hash.h"
+
+// Seeds for hash_mix(), any distinct constants work.
+#define BLOOM_BLOCK_SEED 0x2545F4914F6CDD1DLU
+#define BLOOM_BITS_SEED 0x9FB21C651E98DF25LU
+
+// Bit offsets within a 512-bit block.
+#define BLOOM_OFFSET_BITS 9U
+#define BLOOM_OFFSET_MASK ((1U << BLOOM_OFFSET_BITS) - 1U)
+
+bloom_t*
+bloom_init(uint64_t bytes, uint64_t k)
+{
+    if (k == 0 || k > BLOOM_MAX_K)
+    {
+        fprintf(stderr, "bloom_init(): error: invalid k: %"PRIu64"\n", k);
+        return NULL;
+    }
+
+    bloom_t* bloom = calloc(1, sizeof(bloom_t));
+    if (!bloom)
+    {
+        fprintf(stderr, "bloom_init(): error: calloc(): bloom\n");
+        return NULL;
+    }
+
+    bloom->blocks = 1;
+    while (bloom->blocks * 2 * BLOOM_BLOCK_BYTES <= bytes)
+    {
+        bloom->blocks *= 2;
+    }
+    bloom->k = k;
+
+    bloom->bits = aligned_alloc(BLOOM_BLOCK_BYTES,
+                                bloom->blocks * BLOOM_BLOCK_BYTES);
+    if (!bloom->bits)
+    {
+        fprintf(stderr, "bloom_init(): error: aligned_alloc(): bits\n");
+        free(bloom);
+        return NULL;
+    }
+    memset(bloom->bits, 0, bloom->blocks * BLOOM_BLOCK_BYTES);
+
+    return bloom;
+}
+
+void
+bloom_free(bloom_t* bloom)
+{
+    if (bloom != NULL)
+    {
+        free(bloom->bits);
+        free(bloom);
+    }
+}
+
+static inline uint64_t*
+bloom_block(const bloom_t* bloom, hash_t hash)
+{
+    uint64_t block = hash_mix(hash, BLOOM_BLOCK_SEED) & (bloom->blocks - 1);
+    return &bloom->bits[block * BLOOM_BLOCK_WORDS];
+}
+
+bool
+bloom_test_and_add(bloom_t* bloom, hash_t hash)
+{
+    uint64_t* block = bloom_block(bloom, hash);
+    uint64_t offsets = hash_mix(hash, BLOOM_BITS_SEED);
+    bool present = true;
+
+    for (uint64_t i = 0; i < bloom->k; ++i)
+    {
+        uint64_t bit = offsets & BLOOM_OFFSET_MASK;
+        uint64_t mask = 1LU << (bit & 63U);
+        present &= (block[bit >> 6U] & mask) != 0;
+        block[bit >> 6U] |= mask;
+        offsets >>= BLOOM_OFFSET_BITS;
+    }
+
+    return present;
+}
+
+void
+bloom_add(bloom_t* bloom, hash_t hash)
+{
+    bloom_test_and_add(bloom, hash);
+}
+
+bool
+bloom_test(const bloom_t* bloom, hash_t hash)
+{
+    const uint64_t* block = bloom_block(bloom, hash);
+    uint64_t offsets = hash_mix(hash, BLOOM_BITS_SEED);
+
+    for (uint64_t i = 0; i < bloom->k; ++i)
+    {
+        uint64_t bit = offsets & BLOOM_OFFSET_MASK;
+        if ((block[bit >> 6U] & (1LU << (bit & 63U))) == 0)
+        {
+            return false;
+        }
+        offsets >>= BLOOM_OFFSET_BITS;
+    }
+
+    return true;
+}
+
+uint64_t
+bloom_bytes(const bloom_t* bloom)
+{
+    return bloom->blocks * BLOOM_BLOCK_BYTES;
+}
@@ -0,0 +1,65 @@
+#ifndef MAPWORDS_BLOOM_H
+#define MAPWORDS_BLOOM_H
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "hash.h"
+
+/*
+Blocked Bloom filter (Putze, Sanders & Singler 2007).
+
+The filter is an array of 512-bit blocks, each one cache line. A hash
+selects one block and k bits inside it, so a lookup or insert touches
+a single cache line instead of k random ones. The price is a slightly
+higher false positive rate than a classic Bloom filter of equal size.
+
+Block and bit positions come from two hash_mix() values of the word
+hash: the first selects the block (block count is a power of two),
+the second supplies k 9-bit bit offsets, hence k <= BLOOM_MAX_K.
+
+There are no false negatives: a hash that was added always tests
+positive.
+*/
+
+#define BLOOM_ERROR -1
+#define BLOOM_OK 0
+
+#define BLOOM_BLOCK_BYTES 64U
+#define BLOOM_BLOCK_WORDS (BLOOM_BLOCK_BYTES / sizeof(uint64_t))
+#define BLOOM_MAX_K 7U
+#define BLOOM_DEFAULT_K 6U
+
+typedef struct bloom
+{
+    uint64_t blocks; // Power of two.
+    uint64_t k;
+    uint64_t* bits;
+} bloom_t;
+
+// Allocate filter of at most bytes (at least one block) with k bits
+// per item.
+bloom_t*
+bloom_init(uint64_t bytes, uint64_t k);
+
+// Free all memory allocated for filter.
+void
+bloom_free(bloom_t* bloom);
+
+// Add hash to filter.
+void
+bloom_add(bloom_t* bloom, hash_t hash);
+
+// Check if hash was (probably) added.
+bool
+bloom_test(const bloom_t* bloom, hash_t hash);
+
+// Add hash to filter and return whether it was (probably) present.
+bool
+bloom_test_and_add(bloom_t* bloom, hash_t hash);
+
+// Filter size in bytes.
+uint64_t
+bloom_bytes(const bloom_t* bloom);
+
+#endif //MAPWORDS_BLOOM_H
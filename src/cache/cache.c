@@ -0,0 +1,174 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "hash.h"
+#include "hashmap.h"
+#include "hashmap_snapshot.h"
+#include "snapshot.h"
+
+cache_t*
+cache_init(const char* dir)
+{
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "cache_init(): error: mkdir(): %s\n", dir);
+        return NULL;
+    }
+
+    cache_t* cache = calloc(1, sizeof(cache_t));
+    if (!cache)
+    {
+        fprintf(stderr, "cache_init(): error: calloc(): cache\n");
+        return NULL;
+    }
+
+    cache->dir = strdup(dir);
+    if (!cache->dir)
+    {
+        fprintf(stderr, "cache_init(): error: strdup(): dir\n");
+        free(cache);
+        return NULL;
+    }
+    atomic_init(&cache->hits, 0);
+    atomic_init(&cache->misses, 0);
+
+    return cache;
+}
+
+void
+cache_free(cache_t* cache)
+{
+    if (cache != NULL)
+    {
+        free(cache->dir);
+        free(cache);
+    }
+}
+
+// Checksum len bytes of fd at offset into h.
+static int64_t
+cache_fingerprint_range(int fd, uint64_t offset, uint64_t len, char* buf,
+                        uint64_t* h)
+{
+    uint64_t done = 0;
+    while (done < len)
+    {
+        ssize_t n = pread(fd, buf + done, len - done, (off_t) (offset + done));
+        if (n <= 0)
+        {
+            fprintf(stderr, "cache_fingerprint_range(): error: pread()\n");
+            return CACHE_ERROR;
+        }
+        done += (uint64_t) n;
+    }
+
+    *h = snapshot_checksum(buf, len, *h ^ offset);
+    return CACHE_OK;
+}
+
+int64_t
+cache_key(int fd, hash_t (* hashf)(const char*), cache_key_t* key)
+{
+    struct stat st;
+    const char* hashf_name = get_hashf_name(hashf);
+    if (fstat(fd, &st) != 0 || !hashf_name)
+    {
+        fprintf(stderr, "cache_key(): error: fstat()\n");
+        return CACHE_ERROR;
+    }
+
+    key->size = (uint64_t) st.st_size;
+    key->mtime_sec = st.st_mtim.tv_sec;
+    key->mtime_nsec = st.st_mtim.tv_nsec;
+
+    uint64_t id = snapshot_checksum(hashf_name, strlen(hashf_name), 0);
+    uint64_t fields[5] = {
+        (uint64_t) st.st_dev, (uint64_t) st.st_ino, key->size,
+        (uint64_t) key->mtime_sec, (uint64_t) key->mtime_nsec
+    };
+    key->identity = snapshot_checksum(fields, sizeof(fields), id);
+
+    char buf[CACHE_EDGE_BYTES];
+    uint64_t h = key->size;
+    int64_t status;
+    if (key->size <= 2 * CACHE_EDGE_BYTES)
+    {
+        status = cache_fingerprint_range(fd, 0, key->size, buf, &h);
+    }
+    else
+    {
+        status = cache_fingerprint_range(fd, 0, CACHE_EDGE_BYTES, buf, &h);
+
+        uint64_t middle = key->size - 2 * CACHE_EDGE_BYTES;
+        for (uint64_t i = 1; i <= CACHE_SAMPLES && status == CACHE_OK; ++i)
+        {
+            uint64_t offset = CACHE_EDGE_BYTES
+                              + middle / (CACHE_SAMPLES + 1) * i;
+            uint64_t len = key->size - CACHE_EDGE_BYTES - offset;
+            len = (len < CACHE_SAMPLE_BYTES) ? len : CACHE_SAMPLE_BYTES;
+            status = cache_fingerprint_range(fd, offset, len, buf, &h);
+        }
+
+        if (status == CACHE_OK)
+        {
+            status = cache_fingerprint_range(
+                fd, key->size - CACHE_EDGE_BYTES, CACHE_EDGE_BYTES, buf, &h);
+        }
+    }
+    key->content = h;
+
+    return status;
+}
+
+static void
+cache_entry_path(const cache_t* cache, const cache_key_t* key, char* out)
+{
+    sprintf(out, "%s/%016"PRIx64"-%016"PRIx64".snap", cache->dir,
+            key->identity, key->content);
+}
+
+int64_t
+cache_lookup(cache_t* cache, const cache_key_t* key, snapshot_t** out)
+{
+    char path[strlen(cache->dir) + CACHE_NAME_LENGTH + 2];
+    cache_entry_path(cache, key, path);
+
+    *out = NULL;
+    if (access(path, R_OK) == 0)
+    {
+        // A damaged entry is a miss and gets rewritten.
+        *out = snapshot_open(path, true);
+    }
+
+    if (*out)
+    {
+        atomic_fetch_add(&cache->hits, 1);
+        return CACHE_HIT;
+    }
+
+    atomic_fetch_add(&cache->misses, 1);
+    return CACHE_MISS;
+}
+
+int64_t
+cache_store(cache_t* cache, const cache_key_t* key, int fd,
+            const hashmap_map_t* map)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t) st.st_size != key->size
+        || st.st_mtim.tv_sec != key->mtime_sec
+        || st.st_mtim.tv_nsec != key->mtime_nsec)
+    {
+        // File changed while counted, its counts match no key.
+        return CACHE_OK;
+    }
+
+    char path[strlen(cache->dir) + CACHE_NAME_LENGTH + 2];
+    cache_entry_path(cache, key, path);
+    return (hashmap_save(map, path) == HASHMAP_OK) ? CACHE_OK : CACHE_ERROR;
+}
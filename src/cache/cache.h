@@ -0,0 +1,83 @@
+#ifndef MAPWORDS_CACHE_H
+#define MAPWORDS_CACHE_H
+
+#include <stdatomic.h>
+#include <inttypes.h>
+
+#include "hash.h"
+#include "hashmap.h"
+#include "snapshot.h"
+
+/*
+On-disk cache of per-file counts.
+
+Each cached file is stored as a snapshot (see snapshot.h) in the
+cache directory, named after two 64-bit keys:
+  - identity: device, inode, size and modification time of the file
+    and the hash function, so the snapshot's stored hashes are usable,
+  - content: a fingerprint of the first and last CACHE_EDGE_BYTES and
+    CACHE_SAMPLES evenly spaced CACHE_SAMPLE_BYTES blocks in between.
+    Small files are fingerprinted whole.
+A changed file gets new keys and misses, stale entries are never
+read again. The fingerprint guards against identities reused by
+editors or tools that restore timestamps; it is not a full content
+hash.
+
+Entries are written atomically by the snapshot writer and only if
+the file did not change while it was counted, so concurrent runs
+sharing a cache directory are safe.
+*/
+
+#define CACHE_ERROR -1
+#define CACHE_OK 0
+#define CACHE_HIT 1
+#define CACHE_MISS 2
+
+#define CACHE_EDGE_BYTES (16U * 1024U)
+#define CACHE_SAMPLE_BYTES (4U * 1024U)
+#define CACHE_SAMPLES 4U
+
+// Length of a cache entry name, "<16 hex>-<16 hex>.snap".
+#define CACHE_NAME_LENGTH 38U
+
+typedef struct cache
+{
+    char* dir;
+    atomic_uint_fast64_t hits;
+    atomic_uint_fast64_t misses;
+} cache_t;
+
+// Identity and content of a file when it was looked up.
+typedef struct cache_key
+{
+    uint64_t identity;
+    uint64_t content;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+} cache_key_t;
+
+// Open cache in directory, which is created if missing.
+cache_t*
+cache_init(const char* dir);
+
+// Free cache handle. Entries stay on disk.
+void
+cache_free(cache_t* cache);
+
+// Compute cache key of open file fd for maps using hashf.
+int64_t
+cache_key(int fd, hash_t (* hashf)(const char*), cache_key_t* key);
+
+// Open cached snapshot of key into out.
+// Return CACHE_HIT or CACHE_MISS and count it.
+int64_t
+cache_lookup(cache_t* cache, const cache_key_t* key, snapshot_t** out);
+
+// Store map as the entry of key, unless file fd changed since key
+// was computed.
+int64_t
+cache_store(cache_t* cache, const cache_key_t* key, int fd,
+            const hashmap_map_t* map);
+
+#endif //MAPWORDS_CACHE_H
@@ -0,0 +1,350 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+
+#include "cms.h"
+#include "hash.h"
+
+// Row seed generator increment (SplitMix64).
+#define CMS_SEED_STEP 0x9E3779B97F4A7C15LU
+
+cms_t*
+cms_init(hash_t (* hashf)(const char*), uint64_t width, uint64_t depth,
+         uint64_t heavy)
+{
+    if (hashf == NULL || width == 0 || depth == 0 || depth > CMS_MAX_DEPTH
+        || heavy >= CMS_NONE / 2)
+    {
+        fprintf(stderr, "cms_init(): error: invalid arguments\n");
+        return NULL;
+    }
+
+    cms_t* cms = calloc(1, sizeof(cms_t));
+    if (!cms)
+    {
+        fprintf(stderr, "cms_init(): error: calloc(): cms\n");
+        return NULL;
+    }
+
+    cms->width = 1;
+    while (cms->width * 2 <= width)
+    {
+        cms->width *= 2;
+    }
+    cms->depth = depth;
+    cms->hashf = hashf;
+
+    uint64_t seed = 0;
+    for (uint64_t i = 0; i < depth; ++i)
+    {
+        seed += CMS_SEED_STEP;
+        cms->seeds[i] = hash_mix(seed, i);
+    }
+
+    uint64_t table_size = 2;
+    while (table_size < 2 * heavy)
+    {
+        table_size *= 2;
+    }
+
+    cms->heavy_capacity = heavy;
+    cms->table_mask = table_size - 1;
+    cms->counters = calloc(cms->width * depth, sizeof(uint64_t));
+    cms->heap = calloc(heavy + 1, sizeof(cms_heavy_t));
+    cms->table = malloc(table_size * sizeof(uint32_t));
+    if (!cms->counters || !cms->heap || !cms->table)
+    {
+        fprintf(stderr, "cms_init(): error: allocating tables\n");
+        cms_free(cms);
+        return NULL;
+    }
+    memset(cms->table, 0xFF, table_size * sizeof(uint32_t));
+
+    return cms;
+}
+
+cms_t*
+cms_init_memory(hash_t (* hashf)(const char*), uint64_t bytes,
+                uint64_t depth, uint64_t heavy)
+{
+    if (depth == 0)
+    {
+        return cms_init(hashf, 0, 0, heavy);
+    }
+    return cms_init(hashf, bytes / (depth * sizeof(uint64_t)), depth, heavy);
+}
+
+void
+cms_free(cms_t* cms)
+{
+    if (cms == NULL)
+    {
+        return;
+    }
+
+    for (uint64_t i = 0; cms->heap && i < cms->heavy_size; ++i)
+    {
+        free(cms->heap[i].key);
+    }
+    free(cms->counters);
+    free(cms->heap);
+    free(cms->table);
+    free(cms);
+}
+
+static inline uint64_t
+cms_column(const cms_t* cms, hash_t hash, uint64_t row)
+{
+    return row * cms->width + (hash_mix(hash, cms->seeds[row]) & (cms->width - 1));
+}
+
+uint64_t
+cms_estimate_knownhash(const cms_t* cms, hash_t hash)
+{
+    uint64_t estimate = UINT64_MAX;
+    for (uint64_t row = 0; row < cms->depth; ++row)
+    {
+        uint64_t c = cms->counters[cms_column(cms, hash, row)];
+        estimate = (c < estimate) ? c : estimate;
+    }
+    return estimate;
+}
+
+uint64_t
+cms_estimate(const cms_t* cms, const char* key)
+{
+    return cms_estimate_knownhash(cms, cms->hashf(key));
+}
+
+double
+cms_error_bound(const cms_t* cms)
+{
+    return M_E / (double) cms->width * (double) cms->words;
+}
+
+// Find table slot of heavy hitter key, or the empty slot ending the probe.
+static uint64_t
+cms_table_slot(const cms_t* cms, const char* key, hash_t hash)
+{
+    uint64_t slot = hash & cms->table_mask;
+    while (cms->table[slot] != CMS_NONE)
+    {
+        const cms_heavy_t* h = &cms->heap[cms->table[slot]];
+        if (h->hash == hash && strcmp(h->key, key) == 0)
+        {
+            break;
+        }
+        slot = (slot + 1) & cms->table_mask;
+    }
+    return slot;
+}
+
+// Find table slot pointing to heap position pos.
+static uint64_t
+cms_table_slot_of(const cms_t* cms, uint64_t pos)
+{
+    uint64_t slot = cms->heap[pos].hash & cms->table_mask;
+    while (cms->table[slot] != pos)
+    {
+        slot = (slot + 1) & cms->table_mask;
+    }
+    return slot;
+}
+
+// Remove slot with backward shift deletion, no tombstones.
+static void
+cms_table_remove(cms_t* cms, uint64_t slot)
+{
+    uint64_t mask = cms->table_mask;
+    uint64_t next = (slot + 1) & mask;
+
+    while (cms->table[next] != CMS_NONE)
+    {
+        uint64_t home = cms->heap[cms->table[next]].hash & mask;
+
+        // Entry at 'next' may move into the hole if its home slot
+        // is not cyclically within (slot, next].
+        if (((next - home) & mask) >= ((next - slot) & mask))
+        {
+            cms->table[slot] = cms->table[next];
+            slot = next;
+        }
+        next = (next + 1) & mask;
+    }
+    cms->table[slot] = CMS_NONE;
+}
+
+static void
+cms_heap_swap(cms_t* cms, uint64_t a, uint64_t b)
+{
+    // Look up both slots before writing either, once slot_a names b
+    // a lookup of b could find it instead of slot_b.
+    uint64_t slot_a = cms_table_slot_of(cms, a);
+    uint64_t slot_b = cms_table_slot_of(cms, b);
+    cms->table[slot_a] = (uint32_t) b;
+    cms->table[slot_b] = (uint32_t) a;
+
+    cms_heavy_t temp = cms->heap[a];
+    cms->heap[a] = cms->heap[b];
+    cms->heap[b] = temp;
+}
+
+static void
+cms_heap_sift_down(cms_t* cms, uint64_t i)
+{
+    while (true)
+    {
+        uint64_t lowest = i;
+        uint64_t left = 2 * i + 1;
+        uint64_t right = left + 1;
+
+        if (left < cms->heavy_size
+            && cms->heap[left].estimate < cms->heap[lowest].estimate)
+        {
+            lowest = left;
+        }
+        if (right < cms->heavy_size
+            && cms->heap[right].estimate < cms->heap[lowest].estimate)
+        {
+            lowest = right;
+        }
+        if (lowest == i)
+        {
+            return;
+        }
+
+        cms_heap_swap(cms, i, lowest);
+        i = lowest;
+    }
+}
+
+static void
+cms_heap_sift_up(cms_t* cms, uint64_t i)
+{
+    while (i > 0 && cms->heap[i].estimate < cms->heap[(i - 1) / 2].estimate)
+    {
+        cms_heap_swap(cms, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static int64_t
+cms_heavy_update(cms_t* cms, const char* key, hash_t hash, uint64_t estimate)
+{
+    uint64_t slot = cms_table_slot(cms, key, hash);
+    if (cms->table[slot] != CMS_NONE)
+    {
+        // Estimates never decrease, so only sinking is needed.
+        uint64_t pos = cms->table[slot];
+        cms->heap[pos].estimate = estimate;
+        cms_heap_sift_down(cms, pos);
+        return CMS_OK;
+    }
+
+    if (cms->heavy_size < cms->heavy_capacity)
+    {
+        uint64_t pos = cms->heavy_size;
+        cms->heap[pos].key = strdup(key);
+        if (!cms->heap[pos].key)
+        {
+            fprintf(stderr, "cms_heavy_update(): error: strdup()\n");
+            return CMS_ERROR;
+        }
+        cms->heap[pos].hash = hash;
+        cms->heap[pos].estimate = estimate;
+        cms->heavy_size++;
+        cms->table[slot] = (uint32_t) pos;
+        cms_heap_sift_up(cms, pos);
+        return CMS_OK;
+    }
+
+    if (cms->heavy_size == 0 || estimate <= cms->heap[0].estimate)
+    {
+        return CMS_OK;
+    }
+
+    // Replace the smallest heavy hitter.
+    cms_heavy_t* root = &cms->heap[0];
+    uint64_t len = strlen(key);
+    char* new_key = realloc(root->key, len + 1);
+    if (!new_key)
+    {
+        fprintf(stderr, "cms_heavy_update(): error: realloc()\n");
+        return CMS_ERROR;
+    }
+
+    cms_table_remove(cms, cms_table_slot_of(cms, 0));
+    memcpy(new_key, key, len + 1);
+    root->key = new_key;
+    root->hash = hash;
+    root->estimate = estimate;
+    cms->table[cms_table_slot(cms, key, hash)] = 0;
+    cms_heap_sift_down(cms, 0);
+    return CMS_OK;
+}
+
+int64_t
+cms_add(cms_t* cms, const char* key)
+{
+    return cms_add_knownhash(cms, key, cms->hashf(key));
+}
+
+int64_t
+cms_add_knownhash(cms_t* cms, const char* key, hash_t hash)
+{
+    uint64_t columns[CMS_MAX_DEPTH];
+    uint64_t estimate = UINT64_MAX;
+
+    for (uint64_t row = 0; row < cms->depth; ++row)
+    {
+        columns[row] = cms_column(cms, hash, row);
+        uint64_t c = cms->counters[columns[row]];
+        estimate = (c < estimate) ? c : estimate;
+    }
+
+    // Conservative update: raise counters only up to the new estimate.
+    estimate++;
+    for (uint64_t row = 0; row < cms->depth; ++row)
+    {
+        if (cms->counters[columns[row]] < estimate)
+        {
+            cms->counters[columns[row]] = estimate;
+        }
+    }
+    cms->words++;
+
+    if (cms->heavy_capacity == 0)
+    {
+        return CMS_OK;
+    }
+    return cms_heavy_update(cms, key, hash, estimate);
+}
+
+static int
+cms_heavy_cmp(const void* a, const void* b)
+{
+    const cms_heavy_t* ha = *(const cms_heavy_t* const*) a;
+    const cms_heavy_t* hb = *(const cms_heavy_t* const*) b;
+    if (ha->estimate != hb->estimate)
+    {
+        return (ha->estimate < hb->estimate) ? 1 : -1;
+    }
+    return strcmp(ha->key, hb->key);
+}
+
+uint64_t
+cms_heavy_hitters(cms_t* cms, const cms_heavy_t** out)
+{
+    // Other words may have raised shared counters since the last
+    // update of a heavy hitter, so estimates are refreshed first.
+    for (uint64_t i = 0; i < cms->heavy_size; ++i)
+    {
+        cms->heap[i].estimate = cms_estimate_knownhash(cms, cms->heap[i].hash);
+        out[i] = &cms->heap[i];
+    }
+
+    qsort(out, cms->heavy_size, sizeof(cms_heavy_t*), cms_heavy_cmp);
+    return cms->heavy_size;
+}
@@ -0,0 +1,104 @@
+#ifndef MAPWORDS_CMS_H
+#define MAPWORDS_CMS_H
+
+#include <inttypes.h>
+
+#include "hash.h"
+
+/*
+Count-Min sketch (Cormode & Muthukrishnan 2005) with conservative
+update, plus a small heap of heavy hitters.
+
+The sketch is a depth x width matrix of counters. Row i maps a word
+to column hash_mix(hash, seed_i) & (width - 1), where hash is the
+word hash from the configured hash function and seeds are fixed
+and distinct per row. Width is a power of two.
+
+Conservative update only raises the counters of a word up to the
+new minimum (estimate + 1) instead of incrementing all of them,
+which reduces overestimation without breaking the guarantees:
+  - estimate >= true count,
+  - estimate <= true count + epsilon * n with probability
+    at least 1 - delta, where epsilon = e / width and
+    delta = exp(-depth).
+
+Heavy hitters are tracked in a min-heap of k words ordered by
+estimate, indexed by a small linear probing table for membership
+checks. A word enters the heap when its estimate exceeds the
+smallest estimate in a full heap.
+*/
+
+#define CMS_ERROR -1
+#define CMS_OK 0
+
+#define CMS_MAX_DEPTH 16U
+#define CMS_DEFAULT_DEPTH 4U
+
+#define CMS_NONE UINT32_MAX
+
+typedef struct cms_heavy
+{
+    char* key;
+    hash_t hash;
+    uint64_t estimate;
+} cms_heavy_t;
+
+typedef struct cms
+{
+    uint64_t width;
+    uint64_t depth;
+    uint64_t words; // Words added, n.
+    uint64_t seeds[CMS_MAX_DEPTH];
+    uint64_t* counters;
+    hash_t (* hashf)(const char*);
+
+    // Heavy hitter min-heap and its index.
+    uint64_t heavy_capacity;
+    uint64_t heavy_size;
+    cms_heavy_t* heap;
+    uint64_t table_mask;
+    uint32_t* table;
+} cms_t;
+
+// Allocate sketch with given width (rounded down to a power of two),
+// depth and number of heavy hitters to track.
+cms_t*
+cms_init(hash_t (* hashf)(const char*), uint64_t width, uint64_t depth,
+         uint64_t heavy);
+
+// Allocate sketch with the widest counter matrix fitting bytes.
+cms_t*
+cms_init_memory(hash_t (* hashf)(const char*), uint64_t bytes,
+                uint64_t depth, uint64_t heavy);
+
+// Free all memory allocated for sketch.
+void
+cms_free(cms_t* cms);
+
+// Count one occurrence of key.
+int64_t
+cms_add(cms_t* cms, const char* key);
+
+// Count one occurrence of key with known hash.
+int64_t
+cms_add_knownhash(cms_t* cms, const char* key, hash_t hash);
+
+// Estimate count of key (never below the true count).
+uint64_t
+cms_estimate(const cms_t* cms, const char* key);
+
+// Estimate count of key with known hash.
+uint64_t
+cms_estimate_knownhash(const cms_t* cms, hash_t hash);
+
+// Additive error bound epsilon * n of estimates.
+double
+cms_error_bound(const cms_t* cms);
+
+// Refresh heavy hitter estimates and sort them in descending order
+// (ties by key) into out, which must have room for heavy_size
+// pointers. Return number of heavy hitters.
+uint64_t
+cms_heavy_hitters(cms_t* cms, const cms_heavy_t** out);
+
+#endif //MAPWORDS_CMS_H
@@ -0,0 +1,92 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "count.h"
+#include "hashmap.h"
+#include "util.h"
+
+int64_t
+count_buffer_each(const char* buf, uint64_t len, count_word_fn fn,
+                  void* ctx, uint64_t* wordcount, uint64_t* charcount)
+{
+    char word[WORD_SIZE];
+    uint64_t pos = 0;
+    uint64_t n;
+
+    while ((n = buffer_next_word(buf, len, &pos, word, WORD_SIZE)) > 0)
+    {
+        (*wordcount)++;
+        *charcount += n;
+
+        int64_t status = fn(word, n, ctx);
+        if (status != 0)
+        {
+            return status;
+        }
+    }
+
+    return 0;
+}
+
+int64_t
+count_stream_each(FILE* f, count_word_fn fn, void* ctx,
+                  uint64_t* wordcount, uint64_t* charcount)
+{
+    char* buf = malloc(COUNT_BUFFER_SIZE);
+    if (!buf)
+    {
+        fprintf(stderr, "count_stream_each(): error: malloc(): buf\n");
+        return -1;
+    }
+
+    int64_t status = 0;
+    uint64_t carry = 0;
+    bool eof = false;
+
+    while (!eof && status == 0)
+    {
+        uint64_t len = read_word_block(f, buf, COUNT_BUFFER_SIZE, &carry,
+                                       &eof);
+        if (ferror(f))
+        {
+            fprintf(stderr, "count_stream_each(): error: fread()\n");
+            status = -1;
+            break;
+        }
+
+        status = count_buffer_each(buf, len, fn, ctx, wordcount, charcount);
+        memmove(buf, buf + len, carry);
+    }
+
+    free(buf);
+    return status;
+}
+
+static int64_t
+count_map_word(char* word, uint64_t len, void* ctx)
+{
+    (void) len;
+    int64_t status = hashmap_increment(ctx, word, 1);
+    if (status != HASHMAP_OK)
+    {
+        fprintf(stderr, "count_map_word(): error: hashmap_increment(): "
+                        "%"PRId64", word: %s\n", status, word);
+    }
+    return status;
+}
+
+int64_t
+count_buffer(const char* buf, uint64_t len, hashmap_map_t* map,
+             uint64_t* wordcount, uint64_t* charcount)
+{
+    return count_buffer_each(buf, len, count_map_word, map,
+                             wordcount, charcount);
+}
+
+int64_t
+count_stream(FILE* f, hashmap_map_t* map, uint64_t* wordcount,
+             uint64_t* charcount)
+{
+    return count_stream_each(f, count_map_word, map, wordcount, charcount);
+}
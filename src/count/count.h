@@ -0,0 +1,38 @@
+#ifndef MAPWORDS_COUNT_H
+#define MAPWORDS_COUNT_H
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "hashmap.h"
+
+// Size of the read buffer used by count_stream().
+#define COUNT_BUFFER_SIZE (256U * 1024U)
+
+// Called for every lowercase, null-terminated word found.
+// Any return value other than 0 stops counting and is passed on.
+typedef int64_t (* count_word_fn)(char* word, uint64_t len, void* ctx);
+
+// Call fn for all words in buffer.
+// Word and character counts are added to wordcount and charcount.
+int64_t
+count_buffer_each(const char* buf, uint64_t len, count_word_fn fn,
+                  void* ctx, uint64_t* wordcount, uint64_t* charcount);
+
+// Call fn for all words in stream f using large block reads.
+// Partial words at block ends are carried over to the next block.
+int64_t
+count_stream_each(FILE* f, count_word_fn fn, void* ctx,
+                  uint64_t* wordcount, uint64_t* charcount);
+
+// Count all words in buffer into map.
+int64_t
+count_buffer(const char* buf, uint64_t len, hashmap_map_t* map,
+             uint64_t* wordcount, uint64_t* charcount);
+
+// Count all words in stream f into map.
+int64_t
+count_stream(FILE* f, hashmap_map_t* map, uint64_t* wordcount,
+             uint64_t* charcount);
+
+#endif //MAPWORDS_COUNT_H
@@ -16,16 +16,7 @@ hash_djb2(const char* buffer)
     assert(buffer != NULL);
 #endif
 
-    uint64_t n = strlen(buffer);
-    hash_t hash = 5381;
-
-    for (uint64_t i = 0; i < n; ++i)
-    {
-        // hash * 33 + c
-        hash = ((hash << 5U) + hash) + buffer[i];
-    }
-
-    return hash;
+    return hash_djb2_len(buffer, strlen(buffer));
 }
 
 hash_t
@@ -35,15 +26,7 @@ hash_sdbm(const char* buffer)
     assert(buffer != NULL);
 #endif
 
-    uint64_t n = strlen(buffer);
-    hash_t hash = 0;
-
-    for (uint64_t i = 0; i < n; ++i)
-    {
-        hash = buffer[i] + (hash << 6U) + (hash << 16U) - hash;
-    }
-
-    return hash;
+    return hash_sdbm_len(buffer, strlen(buffer));
 }
 
 hash_t
@@ -53,14 +36,18 @@ hash_java(const char* buffer)
     assert(buffer != NULL);
 #endif
 
-    hash_t hash = 0;
-    uint64_t n = strlen(buffer);
-
-    for (uint64_t i = 0; i < n; ++i)
-    {
-        hash += buffer[i] + hash * 31;
-    }
+    return hash_java_len(buffer, strlen(buffer));
+}
 
+hash_t
+hash_mix(hash_t hash, uint64_t seed)
+{
+    hash ^= seed * 0x9E3779B97F4A7C15LU;
+    hash ^= hash >> 33U;
+    hash *= 0xFF51AFD7ED558CCDLU;
+    hash ^= hash >> 33U;
+    hash *= 0xC4CEB9FE1A85EC53LU;
+    hash ^= hash >> 33U;
     return hash;
 }
 
@@ -83,3 +70,24 @@ hash_t (* get_hashf(const char* hashf_name))(const char*)
         return NULL;
     }
 }
+
+const char*
+get_hashf_name(hash_t (* hashf)(const char*))
+{
+    if (hashf == hash_djb2)
+    {
+        return "hash_djb2";
+    }
+    else if (hashf == hash_java)
+    {
+        return "hash_java";
+    }
+    else if (hashf == hash_sdbm)
+    {
+        return "hash_sdbm";
+    }
+    else
+    {
+        return NULL;
+    }
+}
@@ -23,7 +23,55 @@ hash_sdbm(const char* buffer);
 hash_t
 hash_java(const char* buffer);
 
+// The hash functions above over len bytes of buffer, for callers that
+// know the length and want the hash inlined, e.g. hashmap_template.h.
+// Results are the same.
+
+static inline hash_t
+hash_djb2_len(const char* buffer, uint64_t len)
+{
+    hash_t hash = 5381;
+    for (uint64_t i = 0; i < len; ++i)
+    {
+        // hash * 33 + c
+        hash = ((hash << 5U) + hash) + buffer[i];
+    }
+    return hash;
+}
+
+static inline hash_t
+hash_sdbm_len(const char* buffer, uint64_t len)
+{
+    hash_t hash = 0;
+    for (uint64_t i = 0; i < len; ++i)
+    {
+        hash = buffer[i] + (hash << 6U) + (hash << 16U) - hash;
+    }
+    return hash;
+}
+
+static inline hash_t
+hash_java_len(const char* buffer, uint64_t len)
+{
+    hash_t hash = 0;
+    for (uint64_t i = 0; i < len; ++i)
+    {
+        hash += buffer[i] + hash * 31;
+    }
+    return hash;
+}
+
+// Derive an independent hash from hash and seed.
+// Uses the MurmurHash3 64-bit finalizer, which also spreads the
+// poorly mixed high bits of the string hashes above.
+hash_t
+hash_mix(hash_t hash, uint64_t seed);
+
 // Get hash function pointer from string.
 hash_t (* get_hashf(const char*))(const char*);
 
+// Get name of hash function, the inverse of get_hashf().
+const char*
+get_hashf_name(hash_t (* hashf)(const char*));
+
 #endif //MAPWORDS_HASH_H
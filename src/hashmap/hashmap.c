@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
+#include <pthread.h>
 
 #ifdef DEBUG
 
@@ -11,6 +12,7 @@
 
 #include "hash.h"
 #include "hashmap.h"
+#include "topk.h"
 
 #define RESIZE_FACTOR 0.75
 #define PERTURB_SHIFT 5U
@@ -56,20 +58,31 @@ else \
 #include <sys/random.h>
 #include <errno.h>
 
+// The urandom pool (no GRND_RANDOM) does not block once the kernel
+// is initialized, which matters for short lived processes.
 #define SEED() { \
-    void* buf = malloc(sizeof(int) * 32); \
-    if (getrandom(buf, 32, GRND_RANDOM) == -1) \
+    unsigned seed; \
+    if (getrandom(&seed, sizeof(seed), 0) != sizeof(seed)) \
     { \
         int e = errno; \
         puts("error reading random device"); \
         exit(e); \
     } \
-    srand(*(unsigned*) buf); \
-    free(buf); \
+    srand(seed); \
 }
 
 #endif
 
+// The seed only drives rand() for sort pivots, it is read once per
+// process instead of for every map.
+static pthread_once_t seed_once = PTHREAD_ONCE_INIT;
+
+static void
+hashmap_seed(void)
+{
+    SEED();
+}
+
 const uint64_t EMPTY_INDEX = 0LU;
 
 void
@@ -159,7 +172,7 @@ hashmap_init_cap(
     map->capacity = capacity;
     map->hashf = hashf;
 
-    SEED();
+    pthread_once(&seed_once, hashmap_seed);
 
     return map;
 }
@@ -170,6 +183,26 @@ hashmap_init(hash_t (* hashf)(const char*))
     return hashmap_init_cap(hashf, HASHMAP_INITIAL_CAPACITY);
 }
 
+void
+hashmap_clear(hashmap_map_t* map)
+{
+    for (uint64_t i = 0; i < map->capacity && map->size > 0; ++i)
+    {
+        hashmap_bucket_t* bucket = &map->buckets[i];
+        if (bucket->in_use)
+        {
+            bucket->in_use = false;
+            bucket->hash = 0;
+            bucket->value = 0;
+            bucket->df = 0;
+            bucket->last_doc = 0;
+            *bucket->key = '\0';
+            map->size--;
+        }
+    }
+    map->collisions = 0;
+}
+
 void
 hashmap_free(hashmap_map_t* map)
 {
@@ -233,12 +266,14 @@ hashmap_add(hashmap_map_t* map, char* key, int64_t value)
 }
 
 int64_t
-hashmap_add_knownhash(hashmap_map_t* map, char* key, int64_t value, hash_t hash)
+hashmap_insert(hashmap_map_t* map, char* key, int64_t value, hash_t hash,
+               uint64_t* out)
 {
     uint64_t index = 0;
     int64_t status = hashmap_lookup_index(map, hash, key, &index);
     if (status == HASHMAP_KEY_FOUND)
     {
+        *out = index;
         return status;
     }
 
@@ -289,10 +324,134 @@ hashmap_add_knownhash(hashmap_map_t* map, char* key, int64_t value, hash_t hash)
     bucket->value = value;
     bucket->in_use = true;
     bucket->hash = hash;
+    bucket->df = 0;
+    bucket->last_doc = 0;
     map->size++;
+    *out = index;
     return HASHMAP_OK;
 }
 
+int64_t
+hashmap_add_knownhash(hashmap_map_t* map, char* key, int64_t value, hash_t hash)
+{
+    uint64_t index = 0;
+    return hashmap_insert(map, key, value, hash, &index);
+}
+
+int64_t
+hashmap_increment(hashmap_map_t* map, char* key, int64_t delta)
+{
+    hash_t hash = map->hashf(key);
+    return hashmap_increment_knownhash(map, key, delta, hash);
+}
+
+int64_t
+hashmap_increment_knownhash(hashmap_map_t* map, char* key, int64_t delta,
+                            hash_t hash)
+{
+    uint64_t index = 0;
+    int64_t status = hashmap_lookup_index(map, hash, key, &index);
+    if (status == HASHMAP_KEY_FOUND)
+    {
+        map->buckets[index].value += delta;
+        return HASHMAP_OK;
+    }
+
+    return hashmap_add_knownhash(map, key, delta, hash);
+}
+
+int64_t
+hashmap_increment_doc(hashmap_map_t* map, char* key, hash_t hash,
+                      uint32_t doc)
+{
+    uint64_t index = 0;
+    int64_t status = hashmap_insert(map, key, 0, hash, &index);
+    if (status < 0)
+    {
+        return status;
+    }
+
+    hashmap_bucket_t* bucket = &map->buckets[index];
+    bucket->value++;
+    if (bucket->last_doc != doc)
+    {
+        bucket->last_doc = doc;
+        bucket->df++;
+    }
+    return HASHMAP_OK;
+}
+
+int64_t
+hashmap_merge(hashmap_map_t* dst, const hashmap_map_t* src)
+{
+    if (dst->hashf != src->hashf)
+    {
+        fprintf(stderr, "hashmap_merge(): error: hash functions differ\n");
+        return HASHMAP_ERROR;
+    }
+
+    // The merged map has at least as many keys as the larger map and at
+    // most the sum of both. Reserving the upper bound would double the
+    // capacity for maps sharing most keys; inserts grow dst if needed.
+    uint64_t size = (dst->size > src->size) ? dst->size : src->size;
+    int64_t status = hashmap_reserve(dst, size);
+    if (status != HASHMAP_OK)
+    {
+        return status;
+    }
+
+    for (uint64_t i = 0; i < src->capacity; ++i)
+    {
+        hashmap_bucket_t* bucket = &src->buckets[i];
+        if (!bucket->in_use)
+        {
+            continue;
+        }
+
+        uint64_t index = 0;
+        status = hashmap_insert(dst, bucket->key, 0, bucket->hash, &index);
+        if (status < 0)
+        {
+            fprintf(stderr, "hashmap_merge(): error: "
+                            "hashmap_insert() status=%"PRId64", "
+                            "key=%s\n", status, bucket->key);
+            return status;
+        }
+        dst->buckets[index].value += bucket->value;
+        dst->buckets[index].df += bucket->df;
+    }
+
+    return HASHMAP_OK;
+}
+
+uint64_t
+hashmap_capacity_for(uint64_t size)
+{
+    uint64_t capacity = HASHMAP_INITIAL_CAPACITY;
+    while (((float) size / (float) capacity) >= RESIZE_FACTOR)
+    {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+int64_t
+hashmap_reserve(hashmap_map_t* map, uint64_t size)
+{
+    uint64_t new_capacity = hashmap_capacity_for(size);
+    if (new_capacity < map->capacity)
+    {
+        new_capacity = map->capacity;
+    }
+
+    if (new_capacity == map->capacity)
+    {
+        return HASHMAP_OK;
+    }
+
+    return hashmap_rehash(map, new_capacity);
+}
+
 int64_t
 hashmap_get(hashmap_map_t* map, char* key, int64_t* out)
 {
@@ -308,6 +467,44 @@ hashmap_get(hashmap_map_t* map, char* key, int64_t* out)
     return status;
 }
 
+int64_t
+hashmap_find_shared(const hashmap_map_t* map, const char* key, hash_t hash,
+                    uint64_t* out)
+{
+    uint64_t index = hash & (map->capacity - 1);
+    uint64_t perturb = hash;
+    const hashmap_bucket_t* bucket = &map->buckets[index];
+
+    while (bucket->in_use)
+    {
+        if ((bucket->hash == hash) && (strcmp(bucket->key, key) == 0))
+        {
+            *out = index;
+            return HASHMAP_KEY_FOUND;
+        }
+
+        perturb >>= PERTURB_SHIFT;
+        index = (index * 5 + perturb + 1) & (map->capacity - 1);
+        bucket = &map->buckets[index];
+    }
+
+    *out = index;
+    return HASHMAP_KEY_NOT_FOUND;
+}
+
+int64_t
+hashmap_get_shared(const hashmap_map_t* map, const char* key, hash_t hash,
+                   int64_t* out)
+{
+    uint64_t index = 0;
+    int64_t status = hashmap_find_shared(map, key, hash, &index);
+    if (status == HASHMAP_KEY_FOUND)
+    {
+        *out = map->buckets[index].value;
+    }
+    return status;
+}
+
 int64_t
 hashmap_update(hashmap_map_t* map, char* key, int64_t new_value)
 {
@@ -369,8 +566,9 @@ hashmap_rehash(hashmap_map_t* map, uint64_t new_capacity)
                    old_bucket.key, old_bucket.value, old_bucket.hash);
 #endif
 
-            int64_t status = hashmap_add_knownhash(
-                map, old_bucket.key, old_bucket.value, old_bucket.hash);
+            uint64_t index = 0;
+            int64_t status = hashmap_insert(
+                map, old_bucket.key, old_bucket.value, old_bucket.hash, &index);
 
             if (status != HASHMAP_OK)
             {
@@ -383,6 +581,8 @@ hashmap_rehash(hashmap_map_t* map, uint64_t new_capacity)
                 hashmap_free_buckets(old_buckets, old_capacity);
                 return status;
             }
+            map->buckets[index].df = old_bucket.df;
+            map->buckets[index].last_doc = old_bucket.last_doc;
         }
     }
 
@@ -509,6 +709,7 @@ hashmap_sort_by_value(const hashmap_map_t* map, uint64_t low,
         out_bucket[i].hash = bucket->hash;
         out_bucket[i].in_use = bucket->in_use;
         out_bucket[i].value = bucket->value;
+        out_bucket[i].df = bucket->df;
 
         out_bucket[i].key = calloc(strlen(bucket->key) + 1, sizeof(char));
         if (!out_bucket[i].key)
@@ -530,6 +731,36 @@ hashmap_sort_by_value(const hashmap_map_t* map, uint64_t low,
     return HASHMAP_OK;
 }
 
+// Check if bucket a ranks below bucket b in top-k order.
+static bool
+hashmap_bucket_ranks_below(const void* a, const void* b, const void* ctx)
+{
+    (void) ctx;
+    const hashmap_bucket_t* x = a;
+    const hashmap_bucket_t* y = b;
+    if (x->value != y->value)
+    {
+        return x->value < y->value;
+    }
+    return strcmp(x->key, y->key) > 0;
+}
+
+uint64_t
+hashmap_top_k(const hashmap_map_t* map, uint64_t k,
+              const hashmap_bucket_t** out)
+{
+    topk_t top;
+    topk_init(&top, (const void**) out, k, hashmap_bucket_ranks_below, NULL);
+    for (uint64_t i = 0; i < map->capacity; ++i)
+    {
+        if (map->buckets[i].in_use)
+        {
+            topk_push(&top, &map->buckets[i]);
+        }
+    }
+    return topk_sort(&top);
+}
+
 void
 hashmap_print(const hashmap_map_t* const map)
 {
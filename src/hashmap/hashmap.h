@@ -40,8 +40,10 @@ typedef struct hashmap_bucket
 {
     hash_t hash;
     bool in_use;
+    uint32_t df; // Documents containing key, see hashmap_increment_doc().
     int64_t value;
     char* key;
+    uint32_t last_doc; // Last document counted for key, 0 if none.
 } hashmap_bucket_t;
 
 typedef struct hashmap_map
@@ -77,6 +79,11 @@ hashmap_init_cap(hash_t (* hashf)(const char*), uint64_t capacity);
 hashmap_map_t*
 hashmap_init(hash_t (* hashf)(const char* buffer));
 
+// Remove all entries, keeping capacity and key buffers allocated
+// for reuse of the map.
+void
+hashmap_clear(hashmap_map_t* map);
+
 // Free all memory allocated for map.
 void
 hashmap_free(hashmap_map_t* map);
@@ -95,10 +102,64 @@ hashmap_add(hashmap_map_t* map, char* key, int64_t value);
 int64_t
 hashmap_add_knownhash(hashmap_map_t* map, char* key, int64_t value, hash_t hash);
 
+// Add key with value and known hash unless it is in map already.
+// The index of its bucket is stored in out either way, valid until
+// the map is modified again. Return HASHMAP_KEY_FOUND if key was
+// in map, HASHMAP_OK if it was added.
+int64_t
+hashmap_insert(hashmap_map_t* map, char* key, int64_t value, hash_t hash,
+               uint64_t* out);
+
+// Add delta to value behind key in map.
+// Key is added with delta as value if it is not in map.
+int64_t
+hashmap_increment(hashmap_map_t* map, char* key, int64_t delta);
+
+// Add delta to value behind key in map with known hash.
+int64_t
+hashmap_increment_knownhash(hashmap_map_t* map, char* key, int64_t delta,
+                            hash_t hash);
+
+// Add 1 to value behind key counted in document doc (> 0) and add 1
+// to its document frequency if doc is not the last document counted
+// for key. Documents must be counted one after another.
+int64_t
+hashmap_increment_doc(hashmap_map_t* map, char* key, hash_t hash,
+                      uint32_t doc);
+
+// Add all entries of src to dst, summing values and document
+// frequencies of common keys.
+// Stored hashes are reused, keys are not hashed again.
+// Both maps must use the same hash function.
+int64_t
+hashmap_merge(hashmap_map_t* dst, const hashmap_map_t* src);
+
+// Smallest power of two capacity that holds size entries without
+// rehashing, for sizing maps with hashmap_init_cap().
+uint64_t
+hashmap_capacity_for(uint64_t size);
+
+// Grow map capacity so that size entries fit without rehashing.
+int64_t
+hashmap_reserve(hashmap_map_t* map, uint64_t size);
+
 // Get value from map with key.
 int64_t
 hashmap_get(hashmap_map_t* map, char* key, int64_t* out);
 
+// Find index of the bucket of key with known hash like
+// hashmap_lookup_index(), but without modifying the map (not even the
+// collision counter). Return HASHMAP_KEY_FOUND or HASHMAP_KEY_NOT_FOUND.
+int64_t
+hashmap_find_shared(const hashmap_map_t* map, const char* key, hash_t hash,
+                    uint64_t* out);
+
+// Get value of key with known hash without modifying the map (not
+// even the collision counter), safe for concurrent readers.
+int64_t
+hashmap_get_shared(const hashmap_map_t* map, const char* key, hash_t hash,
+                   int64_t* out);
+
 // Update value behind key in map.
 int64_t
 hashmap_update(hashmap_map_t* map, char* key, int64_t new_value);
@@ -118,6 +179,16 @@ int64_t
 hashmap_sort_by_value(const hashmap_map_t* map, uint64_t low,
                       uint64_t high, hashmap_bucket_t** out);
 
+// Select k entries with the largest values in descending order.
+// Ties are broken by key in ascending order.
+// Only in-use buckets are scanned into a bounded min-heap of
+// size k, O(n log k). Keys are not copied, 'out' points into map
+// and must have room for k pointers. Return number of entries
+// written, which is less than k if map has fewer entries.
+uint64_t
+hashmap_top_k(const hashmap_map_t* map, uint64_t k,
+              const hashmap_bucket_t** out);
+
 // Print map contents to stdout.
 void
 hashmap_print(const hashmap_map_t* map);
@@ -0,0 +1,176 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "hashmap.h"
+#include "hashmap_snapshot.h"
+#include "snapshot.h"
+
+int64_t
+hashmap_save(const hashmap_map_t* map, const char* path)
+{
+    snapshot_writer_t* writer = snapshot_writer_init(path, map->hashf,
+                                                     map->size);
+    if (!writer)
+    {
+        return HASHMAP_ERROR;
+    }
+
+    for (uint64_t i = 0; i < map->capacity; ++i)
+    {
+        const hashmap_bucket_t* bucket = &map->buckets[i];
+        if (bucket->in_use
+            && snapshot_writer_add(writer, bucket->key, strlen(bucket->key),
+                                   bucket->hash, bucket->value)
+               != SNAPSHOT_OK)
+        {
+            snapshot_writer_free(writer);
+            return HASHMAP_ERROR;
+        }
+    }
+
+    return (snapshot_writer_finish(writer) == SNAPSHOT_OK) ? HASHMAP_OK
+                                                            : HASHMAP_ERROR;
+}
+
+hashmap_map_t*
+hashmap_load(const char* path)
+{
+    snapshot_t* snap = snapshot_open(path, true);
+    if (!snap)
+    {
+        return NULL;
+    }
+
+    uint64_t count = snap->header->count;
+    hashmap_map_t* map = hashmap_init_cap(snap->hashf,
+                                          hashmap_capacity_for(count));
+    if (!map)
+    {
+        snapshot_close(snap);
+        return NULL;
+    }
+
+    if (hashmap_merge_snapshot(map, snap) != HASHMAP_OK)
+    {
+        hashmap_free(map);
+        snapshot_close(snap);
+        return NULL;
+    }
+
+    snapshot_close(snap);
+    return map;
+}
+
+int64_t
+hashmap_merge_snapshot(hashmap_map_t* dst, const snapshot_t* snap)
+{
+    if (dst->hashf != snap->hashf)
+    {
+        fprintf(stderr, "hashmap_merge_snapshot(): error: hash functions "
+                        "differ\n");
+        return HASHMAP_ERROR;
+    }
+
+    // Reserve for the lower bound of the merged size, like
+    // hashmap_merge().
+    uint64_t count = snap->header->count;
+    int64_t status = hashmap_reserve(dst, (dst->size > count) ? dst->size
+                                                              : count);
+    for (uint64_t i = 0; i < count && status == HASHMAP_OK; ++i)
+    {
+        const snapshot_entry_t* e = &snap->entries[i];
+        const char* key = snapshot_key(snap, e);
+        if (!key)
+        {
+            fprintf(stderr, "hashmap_merge_snapshot(): error: corrupt key\n");
+            return HASHMAP_ERROR;
+        }
+
+        status = hashmap_increment_knownhash(dst, (char*) key, e->value,
+                                             e->hash);
+        if (status != HASHMAP_OK)
+        {
+            fprintf(stderr, "hashmap_merge_snapshot(): error: "
+                            "hashmap_increment_knownhash() status=%"PRId64"\n",
+                    status);
+        }
+    }
+
+    return status;
+}
+
+int64_t
+hashmap_save_merged(const hashmap_map_t* map, const snapshot_t* base,
+                    const char* path)
+{
+    if (map->hashf != base->hashf)
+    {
+        fprintf(stderr, "hashmap_save_merged(): error: hash functions "
+                        "differ\n");
+        return HASHMAP_ERROR;
+    }
+
+    uint64_t count = base->header->count;
+    bool* merged = calloc(map->capacity, sizeof(bool));
+    snapshot_writer_t* writer = snapshot_writer_init(path, map->hashf,
+                                                     count + map->size);
+    if (!merged || !writer)
+    {
+        fprintf(stderr, "hashmap_save_merged(): error: allocating buffers\n");
+        free(merged);
+        snapshot_writer_free(writer);
+        return HASHMAP_ERROR;
+    }
+
+    // Snapshot entries first, summed with their counterparts in map.
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        const snapshot_entry_t* e = &base->entries[i];
+        const char* key = snapshot_key(base, e);
+        int64_t value = e->value;
+        uint64_t index = 0;
+        if (!key)
+        {
+            fprintf(stderr, "hashmap_save_merged(): error: corrupt key\n");
+            free(merged);
+            snapshot_writer_free(writer);
+            return HASHMAP_ERROR;
+        }
+
+        if (hashmap_find_shared(map, key, e->hash, &index)
+            == HASHMAP_KEY_FOUND)
+        {
+            value += map->buckets[index].value;
+            merged[index] = true;
+        }
+
+        if (snapshot_writer_add(writer, key, e->key_len, e->hash, value)
+            != SNAPSHOT_OK)
+        {
+            free(merged);
+            snapshot_writer_free(writer);
+            return HASHMAP_ERROR;
+        }
+    }
+
+    for (uint64_t i = 0; i < map->capacity; ++i)
+    {
+        const hashmap_bucket_t* bucket = &map->buckets[i];
+        if (bucket->in_use && !merged[i]
+            && snapshot_writer_add(writer, bucket->key, strlen(bucket->key),
+                                   bucket->hash, bucket->value)
+               != SNAPSHOT_OK)
+        {
+            free(merged);
+            snapshot_writer_free(writer);
+            return HASHMAP_ERROR;
+        }
+    }
+
+    free(merged);
+    return (snapshot_writer_finish(writer) == SNAPSHOT_OK) ? HASHMAP_OK
+                                                            : HASHMAP_ERROR;
+}
@@ -0,0 +1,39 @@
+#ifndef MAPWORDS_HASHMAP_SNAPSHOT_H
+#define MAPWORDS_HASHMAP_SNAPSHOT_H
+
+#include <inttypes.h>
+
+#include "hashmap.h"
+#include "snapshot.h"
+
+/*
+Conversion between hash maps and snapshot files (snapshot.h), kept
+out of hashmap.c so the map itself does not depend on the file
+format.
+*/
+
+// Write map as a snapshot file, see snapshot.h.
+// Stored hashes are written, keys are not hashed again.
+int64_t
+hashmap_save(const hashmap_map_t* map, const char* path);
+
+// Read map from a snapshot file written by hashmap_save(). The map
+// uses the hash function named in the snapshot and the stored hashes.
+hashmap_map_t*
+hashmap_load(const char* path);
+
+// Add all entries of snapshot to dst using their stored hashes.
+// Snapshot and map must use the same hash function.
+int64_t
+hashmap_merge_snapshot(hashmap_map_t* dst, const snapshot_t* snap);
+
+// Write snapshot of base with the counts of map added to path, which
+// may be the file base was opened from. Entries are taken from the
+// mapped snapshot and matched with map by their stored hashes, so no
+// key is hashed again and base is never loaded into a map. The new
+// snapshot replaces path atomically.
+int64_t
+hashmap_save_merged(const hashmap_map_t* map, const snapshot_t* base,
+                    const char* path);
+
+#endif //MAPWORDS_HASHMAP_SNAPSHOT_H
@@ -0,0 +1,254 @@
+#ifndef MAPWORDS_HASHMAP_TEMPLATE_H
+#define MAPWORDS_HASHMAP_TEMPLATE_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "hash.h"
+
+/*
+Compile-time specialized string hash maps.
+
+hashmap_map_t calls its hash function through map->hashf, which the
+compiler can not inline, and every bucket holds an int64_t value plus
+fields used only by some modes. DEFINE_HASHMAP(name, hashfn, value_t,
+max_load, probe) instead generates a map type name_t and static inline
+functions for it with all of these fixed:
+
+  hashfn    hash_t hashfn(const char* key, uint64_t len), called
+            directly and inlined, e.g. hash_djb2_len() of hash.h. The
+            length comes from the tokenizer, so keys are not strlen'd.
+  value_t   counter type. An entry is {key, 32-bit hash, value}, so
+            uint32_t counters make it 16 bytes, int64_t 24, against 40
+            of hashmap_bucket_t.
+  max_load  largest size / capacity before the capacity is doubled,
+            e.g. 0.75 like hashmap.h.
+  probe     HASHMAP_PROBE_PERTURB for the probe sequence of hashmap.h,
+            or HASHMAP_PROBE_LINEAR for linear probing (better cache
+            locality, needs a well mixed hashfn and a lower max_load).
+
+Only the low 32 bits of the hash are kept and probed with, which
+index up to 2^32 entries, so rehashing never hashes a key again.
+Capacity is a power of two and an entry with a NULL key is empty, so
+no flag is needed. Keys are copied with malloc() like hashmap.h. A
+counter overflowing value_t wraps around, so narrow types suit inputs
+where counts are known to be bounded.
+
+Generated functions, all returning HASHMAP_OK or HASHMAP_ERROR where
+they can fail:
+
+  name_t* name_init(void);
+  void name_free(name_t* map);
+  int64_t name_increment(name_t* map, const char* key, uint64_t len,
+                         value_t delta);
+  value_t name_get(const name_t* map, const char* key, uint64_t len);
+  int64_t name_each(const name_t* map, name_each_fn fn, void* ctx);
+
+Example:
+
+  DEFINE_HASHMAP(wordmap, hash_djb2_len, uint32_t, 0.75,
+                 HASHMAP_PROBE_PERTURB)
+
+  wordmap_t* map = wordmap_init();
+  wordmap_increment(map, word, len, 1);
+*/
+
+#ifndef HASHMAP_ERROR
+#define HASHMAP_ERROR -1
+#define HASHMAP_OK 0
+#endif
+
+#define HASHMAP_PROBE_PERTURB 0
+#define HASHMAP_PROBE_LINEAR 1
+
+#define HASHMAP_TEMPLATE_INITIAL_CAPACITY 16U
+#define HASHMAP_TEMPLATE_PERTURB_SHIFT 5U
+
+#define DEFINE_HASHMAP(name, hashfn, value_t, max_load, probe) \
+\
+typedef struct name##_entry \
+{ \
+    char* key; /* NULL if empty. */ \
+    uint32_t hash; \
+    value_t value; \
+} name##_entry_t; \
+\
+typedef struct name \
+{ \
+    name##_entry_t* entries; \
+    uint64_t capacity; \
+    uint64_t size; \
+    uint64_t grow_at; /* Size at which capacity is doubled. */ \
+    uint64_t collisions; \
+    uint64_t rehashes; \
+} name##_t; \
+\
+typedef int64_t (* name##_each_fn)(const char* key, value_t value, \
+                                   void* ctx); \
+\
+static inline name##_t* \
+name##_init(void) \
+{ \
+    name##_t* map = calloc(1, sizeof(name##_t)); \
+    name##_entry_t* entries = calloc(HASHMAP_TEMPLATE_INITIAL_CAPACITY, \
+                                     sizeof(name##_entry_t)); \
+    if (!map || !entries) \
+    { \
+        fprintf(stderr, #name "_init(): error: calloc()\n"); \
+        free(map); \
+        free(entries); \
+        return NULL; \
+    } \
+    map->entries = entries; \
+    map->capacity = HASHMAP_TEMPLATE_INITIAL_CAPACITY; \
+    map->grow_at = (uint64_t) ((double) map->capacity * (max_load)); \
+    return map; \
+} \
+\
+static inline void \
+name##_free(name##_t* map) \
+{ \
+    if (map == NULL) \
+    { \
+        return; \
+    } \
+    for (uint64_t i = 0; i < map->capacity; ++i) \
+    { \
+        free(map->entries[i].key); \
+    } \
+    free(map->entries); \
+    free(map); \
+} \
+\
+/* Return index of the entry of key, or of the empty entry it goes to. \
+   With key NULL, only an empty entry is searched for. */ \
+static inline uint64_t \
+name##_find(const name##_entry_t* entries, uint64_t capacity, \
+            uint32_t hash, const char* key, uint64_t* collisions) \
+{ \
+    uint64_t mask = capacity - 1; \
+    uint64_t index = hash & mask; \
+    uint32_t perturb = hash; \
+    while (entries[index].key != NULL) \
+    { \
+        /* strcmp() stops at the end of a shorter stored key. */ \
+        if (key != NULL && entries[index].hash == hash \
+            && strcmp(entries[index].key, key) == 0) \
+        { \
+            return index; \
+        } \
+        (*collisions)++; \
+        if ((probe) == HASHMAP_PROBE_LINEAR) \
+        { \
+            index = (index + 1) & mask; \
+        } \
+        else \
+        { \
+            perturb >>= HASHMAP_TEMPLATE_PERTURB_SHIFT; \
+            index = (index * 5 + perturb + 1) & mask; \
+        } \
+    } \
+    return index; \
+} \
+\
+static inline int64_t \
+name##_rehash(name##_t* map) \
+{ \
+    uint64_t capacity = map->capacity * 2; \
+    name##_entry_t* entries = calloc(capacity, sizeof(name##_entry_t)); \
+    if (!entries) \
+    { \
+        fprintf(stderr, #name "_rehash(): error: calloc(): entries\n"); \
+        return HASHMAP_ERROR; \
+    } \
+\
+    /* Keys are unique, so entries move without comparing keys. */ \
+    uint64_t collisions = 0; \
+    for (uint64_t i = 0; i < map->capacity; ++i) \
+    { \
+        const name##_entry_t* e = &map->entries[i]; \
+        if (e->key != NULL) \
+        { \
+            entries[name##_find(entries, capacity, e->hash, NULL, \
+                                &collisions)] = *e; \
+        } \
+    } \
+    free(map->entries); \
+    map->entries = entries; \
+    map->capacity = capacity; \
+    map->grow_at = (uint64_t) ((double) capacity * (max_load)); \
+    map->rehashes++; \
+    return HASHMAP_OK; \
+} \
+\
+static inline int64_t \
+name##_increment(name##_t* map, const char* key, uint64_t len, \
+                 value_t delta) \
+{ \
+    uint32_t hash = (uint32_t) hashfn(key, len); \
+    uint64_t index = name##_find(map->entries, map->capacity, hash, key, \
+                                 &map->collisions); \
+    name##_entry_t* e = &map->entries[index]; \
+    if (e->key != NULL) \
+    { \
+        e->value += delta; \
+        return HASHMAP_OK; \
+    } \
+\
+    if (map->size + 1 > map->grow_at) \
+    { \
+        if (name##_rehash(map) != HASHMAP_OK) \
+        { \
+            return HASHMAP_ERROR; \
+        } \
+        index = name##_find(map->entries, map->capacity, hash, NULL, \
+                            &map->collisions); \
+        e = &map->entries[index]; \
+    } \
+\
+    e->key = malloc(len + 1); \
+    if (!e->key) \
+    { \
+        fprintf(stderr, #name "_increment(): error: malloc(): key\n"); \
+        return HASHMAP_ERROR; \
+    } \
+    memcpy(e->key, key, len + 1); \
+    e->hash = hash; \
+    e->value = delta; \
+    map->size++; \
+    return HASHMAP_OK; \
+} \
+\
+static inline value_t \
+name##_get(const name##_t* map, const char* key, uint64_t len) \
+{ \
+    uint64_t collisions = 0; \
+    uint64_t index = name##_find(map->entries, map->capacity, \
+                                 (uint32_t) hashfn(key, len), key, \
+                                 &collisions); \
+    return (map->entries[index].key != NULL) ? map->entries[index].value \
+                                             : (value_t) 0; \
+} \
+\
+static inline int64_t \
+name##_each(const name##_t* map, name##_each_fn fn, void* ctx) \
+{ \
+    for (uint64_t i = 0; i < map->capacity; ++i) \
+    { \
+        const name##_entry_t* e = &map->entries[i]; \
+        if (e->key != NULL) \
+        { \
+            int64_t status = fn(e->key, e->value, ctx); \
+            if (status != 0) \
+            { \
+                return status; \
+            } \
+        } \
+    } \
+    return 0; \
+}
+
+#endif //MAPWORDS_HASHMAP_TEMPLATE_H
@@ -0,0 +1,360 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "hll.h"
+#include "hash.h"
+
+// Seed for hash_mix(), any constant works.
+#define HLL_SEED 0x5851F42D4C957F2DLU
+
+// Sparse pairs are encoded as (index << 6 | rank), rank <= 40.
+#define HLL_RANK_BITS 6U
+#define HLL_RANK_MASK ((1U << HLL_RANK_BITS) - 1U)
+
+hll_t*
+hll_init(uint64_t precision)
+{
+    if (precision < HLL_MIN_PRECISION || precision > HLL_MAX_PRECISION)
+    {
+        fprintf(stderr, "hll_init(): error: invalid precision: %"PRIu64"\n",
+                precision);
+        return NULL;
+    }
+
+    hll_t* hll = calloc(1, sizeof(hll_t));
+    if (!hll)
+    {
+        fprintf(stderr, "hll_init(): error: calloc(): hll\n");
+        return NULL;
+    }
+
+    hll->precision = precision;
+    hll->m = 1LU << precision;
+    hll->sparse = true;
+
+    return hll;
+}
+
+void
+hll_free(hll_t* hll)
+{
+    if (hll != NULL)
+    {
+        free(hll->registers);
+        free(hll->list);
+        free(hll);
+    }
+}
+
+// Rank of the bits below the top 'skip' bits of x: leading zeros + 1,
+// at most 64 - skip + 1.
+static inline uint8_t
+hll_rank(uint64_t x, uint64_t skip)
+{
+    uint64_t w = x << skip;
+    if (w == 0)
+    {
+        return (uint8_t) (64 - skip + 1);
+    }
+    return (uint8_t) (__builtin_clzll(w) + 1);
+}
+
+static inline void
+hll_dense_set(hll_t* hll, uint64_t index, uint8_t rank)
+{
+    if (hll->registers[index] < rank)
+    {
+        hll->registers[index] = rank;
+    }
+}
+
+// Fold sparse pair into the dense registers.
+static void
+hll_dense_add_sparse(hll_t* hll, uint32_t pair)
+{
+    uint64_t extra = HLL_SPARSE_PRECISION - hll->precision;
+    uint64_t sparse_index = pair >> HLL_RANK_BITS;
+    uint8_t rank = (uint8_t) (pair & HLL_RANK_MASK);
+
+    uint64_t index = sparse_index >> extra;
+    uint64_t low = sparse_index & ((1LU << extra) - 1);
+    if (low != 0)
+    {
+        // The rank is decided by the index bits dropped at precision p.
+        rank = (uint8_t) (__builtin_clzll(low) - (64 - extra) + 1);
+    }
+    else
+    {
+        rank = (uint8_t) (rank + extra);
+    }
+    hll_dense_set(hll, index, rank);
+}
+
+static int
+hll_pair_cmp(const void* a, const void* b)
+{
+    uint32_t pa = *(const uint32_t*) a;
+    uint32_t pb = *(const uint32_t*) b;
+    return (pa > pb) - (pa < pb);
+}
+
+// Sort buffered pairs and merge them into the sparse list, keeping
+// only the largest rank per index.
+static int64_t
+hll_sparse_flush(hll_t* hll)
+{
+    if (hll->buffer_size == 0)
+    {
+        return HLL_OK;
+    }
+
+    qsort(hll->buffer, hll->buffer_size, sizeof(uint32_t), hll_pair_cmp);
+
+    uint64_t needed = hll->list_size + hll->buffer_size;
+    uint32_t* merged = malloc(needed * sizeof(uint32_t));
+    if (!merged)
+    {
+        fprintf(stderr, "hll_sparse_flush(): error: malloc()\n");
+        return HLL_ERROR;
+    }
+
+    uint64_t i = 0;
+    uint64_t j = 0;
+    uint64_t n = 0;
+    while (i < hll->list_size || j < hll->buffer_size)
+    {
+        uint32_t pair;
+        if (j == hll->buffer_size
+            || (i < hll->list_size && hll->list[i] < hll->buffer[j]))
+        {
+            pair = hll->list[i++];
+        }
+        else
+        {
+            pair = hll->buffer[j++];
+        }
+
+        // Pairs sort by index, then rank: the last of a run wins.
+        if (n > 0 && (merged[n - 1] >> HLL_RANK_BITS) == (pair >> HLL_RANK_BITS))
+        {
+            merged[n - 1] = pair;
+        }
+        else
+        {
+            merged[n++] = pair;
+        }
+    }
+
+    free(hll->list);
+    hll->list = merged;
+    hll->list_size = n;
+    hll->list_capacity = needed;
+    hll->buffer_size = 0;
+    return HLL_OK;
+}
+
+// Convert sparse list to dense registers.
+static int64_t
+hll_to_dense(hll_t* hll)
+{
+    if (hll_sparse_flush(hll) != HLL_OK)
+    {
+        return HLL_ERROR;
+    }
+
+    hll->registers = calloc(hll->m, sizeof(uint8_t));
+    if (!hll->registers)
+    {
+        fprintf(stderr, "hll_to_dense(): error: calloc(): registers\n");
+        return HLL_ERROR;
+    }
+
+    for (uint64_t i = 0; i < hll->list_size; ++i)
+    {
+        hll_dense_add_sparse(hll, hll->list[i]);
+    }
+
+    free(hll->list);
+    hll->list = NULL;
+    hll->list_size = 0;
+    hll->list_capacity = 0;
+    hll->sparse = false;
+    return HLL_OK;
+}
+
+int64_t
+hll_add(hll_t* hll, hash_t hash)
+{
+    uint64_t x = hash_mix(hash, HLL_SEED);
+
+    if (!hll->sparse)
+    {
+        hll_dense_set(hll, x >> (64 - hll->precision),
+                      hll_rank(x, hll->precision));
+        return HLL_OK;
+    }
+
+    hll->buffer[hll->buffer_size++] =
+        (uint32_t) ((x >> (64 - HLL_SPARSE_PRECISION)) << HLL_RANK_BITS)
+        | hll_rank(x, HLL_SPARSE_PRECISION);
+    if (hll->buffer_size < HLL_SPARSE_BUFFER)
+    {
+        return HLL_OK;
+    }
+
+    if (hll_sparse_flush(hll) != HLL_OK)
+    {
+        return HLL_ERROR;
+    }
+
+    // Sparse list stops paying off once larger than the registers.
+    if (hll->list_size * sizeof(uint32_t) > hll->m)
+    {
+        return hll_to_dense(hll);
+    }
+    return HLL_OK;
+}
+
+int64_t
+hll_merge(hll_t* dst, hll_t* src)
+{
+    if (dst->precision != src->precision)
+    {
+        fprintf(stderr, "hll_merge(): error: precision mismatch\n");
+        return HLL_ERROR;
+    }
+
+    if (src->sparse)
+    {
+        if (hll_sparse_flush(src) != HLL_OK)
+        {
+            return HLL_ERROR;
+        }
+        for (uint64_t i = 0; i < src->list_size; ++i)
+        {
+            if (dst->sparse)
+            {
+                dst->buffer[dst->buffer_size++] = src->list[i];
+                if (dst->buffer_size == HLL_SPARSE_BUFFER
+                    && hll_sparse_flush(dst) != HLL_OK)
+                {
+                    return HLL_ERROR;
+                }
+            }
+            else
+            {
+                hll_dense_add_sparse(dst, src->list[i]);
+            }
+        }
+        if (dst->sparse && dst->list_size * sizeof(uint32_t) > dst->m)
+        {
+            return hll_to_dense(dst);
+        }
+        return HLL_OK;
+    }
+
+    if (dst->sparse && hll_to_dense(dst) != HLL_OK)
+    {
+        return HLL_ERROR;
+    }
+    for (uint64_t i = 0; i < dst->m; ++i)
+    {
+        hll_dense_set(dst, i, src->registers[i]);
+    }
+    return HLL_OK;
+}
+
+// Ertl's sigma(x) = x + sum_k x^(2^k) 2^(k-1).
+static double
+hll_sigma(double x)
+{
+    if (x == 1.0)
+    {
+        return INFINITY;
+    }
+
+    double y = 1.0;
+    double z = x;
+    double z_prev;
+    do
+    {
+        x *= x;
+        z_prev = z;
+        z += x * y;
+        y += y;
+    } while (z != z_prev);
+    return z;
+}
+
+// Ertl's tau(x) = (1 - x - sum_k (1 - x^(2^-k))^2 2^-k) / 3.
+static double
+hll_tau(double x)
+{
+    if (x == 0.0 || x == 1.0)
+    {
+        return 0.0;
+    }
+
+    double y = 1.0;
+    double z = 1.0 - x;
+    double z_prev;
+    do
+    {
+        x = sqrt(x);
+        z_prev = z;
+        y *= 0.5;
+        z -= (1.0 - x) * (1.0 - x) * y;
+    } while (z != z_prev);
+    return z / 3.0;
+}
+
+double
+hll_estimate(hll_t* hll)
+{
+    if (hll->sparse)
+    {
+        if (hll_sparse_flush(hll) != HLL_OK)
+        {
+            return NAN;
+        }
+
+        // Linear counting over the virtual sparse registers.
+        double m = (double) (1LU << HLL_SPARSE_PRECISION);
+        return m * log(m / (m - (double) hll->list_size));
+    }
+
+    uint64_t q = 64 - hll->precision;
+    uint64_t histogram[64 + 2] = {0};
+    for (uint64_t i = 0; i < hll->m; ++i)
+    {
+        histogram[hll->registers[i]]++;
+    }
+
+    double m = (double) hll->m;
+    double z = m * hll_tau(1.0 - (double) histogram[q + 1] / m);
+    for (uint64_t k = q; k >= 1; --k)
+    {
+        z = 0.5 * (z + (double) histogram[k]);
+    }
+    z += m * hll_sigma((double) histogram[0] / m);
+
+    return m * m / (2.0 * log(2.0) * z);
+}
+
+double
+hll_error(const hll_t* hll)
+{
+    return 1.04 / sqrt((double) hll->m);
+}
+
+uint64_t
+hll_memory(const hll_t* hll)
+{
+    if (hll->sparse)
+    {
+        return (hll->list_capacity + HLL_SPARSE_BUFFER) * sizeof(uint32_t);
+    }
+    return hll->m;
+}
@@ -0,0 +1,91 @@
+#ifndef MAPWORDS_HLL_H
+#define MAPWORDS_HLL_H
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "hash.h"
+
+/*
+HyperLogLog distinct count estimator with the HyperLogLog++ sparse
+representation (Heule, Nunkesser & Hall 2013) and the improved raw
+estimator of Ertl ("New cardinality estimation algorithms for
+HyperLogLog sketches", 2017), which needs neither bias correction
+tables nor a linear counting threshold.
+
+Words are added by their hash_t from the configured hash function.
+The hash is remixed with hash_mix() first, because the string hashes
+do not spread short words over the high bits.
+
+Dense mode uses m = 2^precision one byte registers. The first p bits
+of the mixed hash select a register, which keeps the maximum rank
+(leading zeros + 1) of the remaining 64 - p bits seen.
+
+Small sets start in sparse mode: a sorted list of (index, rank) pairs
+at precision HLL_SPARSE_PRECISION, with new pairs buffered unsorted
+and merged in batches. Sparse mode estimates with linear counting over
+2^25 virtual registers, which is nearly exact for small sets. The list
+converts to dense registers once it would use more memory than them.
+
+Relative standard error is about 1.04 / sqrt(m), e.g. 0.81 % with
+the default precision 14 and 16 KiB of registers.
+*/
+
+#define HLL_ERROR -1
+#define HLL_OK 0
+
+#define HLL_MIN_PRECISION 4U
+#define HLL_MAX_PRECISION 18U
+#define HLL_DEFAULT_PRECISION 14U
+#define HLL_SPARSE_PRECISION 25U
+
+// Unsorted sparse entries buffered before merging.
+#define HLL_SPARSE_BUFFER 1024U
+
+typedef struct hll
+{
+    uint64_t precision;
+    uint64_t m; // Dense register count.
+    bool sparse;
+
+    // Dense registers, NULL in sparse mode.
+    uint8_t* registers;
+
+    // Sorted sparse list and unsorted buffer of encoded pairs.
+    uint32_t* list;
+    uint64_t list_size;
+    uint64_t list_capacity;
+    uint32_t buffer[HLL_SPARSE_BUFFER];
+    uint64_t buffer_size;
+} hll_t;
+
+// Allocate estimator with precision in [HLL_MIN_PRECISION,
+// HLL_MAX_PRECISION].
+hll_t*
+hll_init(uint64_t precision);
+
+// Free all memory allocated for estimator.
+void
+hll_free(hll_t* hll);
+
+// Add word by its hash.
+int64_t
+hll_add(hll_t* hll, hash_t hash);
+
+// Add all words of src to dst. Both must have the same precision.
+int64_t
+hll_merge(hll_t* dst, hll_t* src);
+
+// Estimate number of distinct words added so far.
+double
+hll_estimate(hll_t* hll);
+
+// Relative standard error of dense estimates.
+double
+hll_error(const hll_t* hll);
+
+// Bytes of memory used by registers or the sparse list.
+uint64_t
+hll_memory(const hll_t* hll);
+
+#endif //MAPWORDS_HLL_H
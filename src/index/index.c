@@ -0,0 +1,877 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "count.h"
+#include "hash.h"
+#include "hashmap.h"
+#include "index.h"
+#include "multifile.h"
+#include "snapshot.h"
+#include "sort.h"
+
+// Round up to the section alignment.
+#define INDEX_ALIGN(x) (((x) + 7U) & ~(uint64_t) 7U)
+
+#define INDEX_LIST_INITIAL_CAPACITY 2U
+#define INDEX_BUFFER_INITIAL_CAPACITY (64U * 1024U)
+
+// Longest posting, two varints of uint32_t.
+#define INDEX_POSTING_MAX_BYTES 10U
+
+typedef struct index_posting
+{
+    uint32_t doc;
+    uint32_t count;
+} index_posting_t;
+
+typedef struct index_list
+{
+    index_posting_t* items;
+    uint32_t count;
+    uint32_t capacity;
+} index_list_t;
+
+typedef struct index_worker
+{
+    multifile_t* mf;
+    atomic_uint_fast64_t* next;
+    hashmap_map_t* terms; // Bucket value is the number of the list.
+    index_list_t* lists;
+    uint64_t list_count;
+    uint64_t list_capacity;
+    uint32_t doc; // Document being counted + 1, like last_doc.
+    int64_t status;
+} index_worker_t;
+
+// Encodes the posting lists of a range of terms.
+typedef struct index_encoder
+{
+    const index_worker_t* workers;
+    uint64_t worker_count;
+    const hashmap_map_t* vocab;
+    const uint64_t* order; // Vocabulary bucket indices by key.
+    uint64_t begin;
+    uint64_t end;
+    index_term_t* terms;
+    unsigned char* data;
+    uint64_t size;
+    uint64_t capacity;
+    uint64_t posting_count;
+    int64_t status;
+} index_encoder_t;
+
+static inline unsigned char*
+index_put_varint(unsigned char* p, uint64_t value)
+{
+    while (value >= 0x80U)
+    {
+        *p++ = (unsigned char) (value | 0x80U);
+        value >>= 7U;
+    }
+    *p++ = (unsigned char) value;
+    return p;
+}
+
+static inline bool
+index_get_varint(const unsigned char** pos, const unsigned char* end,
+                 uint64_t* out)
+{
+    uint64_t value = 0;
+    for (uint32_t shift = 0; shift < 64 && *pos < end; shift += 7)
+    {
+        unsigned char byte = *(*pos)++;
+        value |= (uint64_t) (byte & 0x7FU) << shift;
+        if (!(byte & 0x80U))
+        {
+            *out = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+static int64_t
+index_new_list(index_worker_t* w)
+{
+    if (w->list_count == w->list_capacity)
+    {
+        uint64_t capacity = w->list_capacity ? w->list_capacity * 2
+                                             : HASHMAP_INITIAL_CAPACITY;
+        index_list_t* lists = realloc(w->lists, capacity * sizeof(index_list_t));
+        if (!lists)
+        {
+            fprintf(stderr, "index_new_list(): error: realloc(): lists\n");
+            return INDEX_ERROR;
+        }
+        w->lists = lists;
+        w->list_capacity = capacity;
+    }
+
+    memset(&w->lists[w->list_count++], 0, sizeof(index_list_t));
+    return INDEX_OK;
+}
+
+static int64_t
+index_add_word(char* word, uint64_t len, void* arg)
+{
+    (void) len;
+    index_worker_t* w = arg;
+    uint64_t i = 0;
+    int64_t status = hashmap_insert(w->terms, word, (int64_t) w->list_count,
+                                    w->terms->hashf(word), &i);
+    if (status < 0 || (status == HASHMAP_OK && index_new_list(w) != INDEX_OK))
+    {
+        return INDEX_ERROR;
+    }
+
+    hashmap_bucket_t* bucket = &w->terms->buckets[i];
+    index_list_t* list = &w->lists[bucket->value];
+    if (bucket->last_doc == w->doc)
+    {
+        index_posting_t* last = &list->items[list->count - 1];
+        if (last->count == UINT32_MAX)
+        {
+            fprintf(stderr, "index_add_word(): error: count overflow: %s\n",
+                    word);
+            return INDEX_ERROR;
+        }
+        last->count++;
+        return INDEX_OK;
+    }
+
+    if (list->count == list->capacity)
+    {
+        uint32_t capacity = list->capacity ? list->capacity * 2
+                                           : INDEX_LIST_INITIAL_CAPACITY;
+        index_posting_t* items = realloc(list->items,
+                                         capacity * sizeof(index_posting_t));
+        if (!items)
+        {
+            fprintf(stderr, "index_add_word(): error: realloc(): items\n");
+            return INDEX_ERROR;
+        }
+        list->items = items;
+        list->capacity = capacity;
+    }
+
+    bucket->last_doc = w->doc;
+    list->items[list->count++] = (index_posting_t) {w->doc - 1, 1};
+    return INDEX_OK;
+}
+
+static void*
+index_worker(void* arg)
+{
+    index_worker_t* w = arg;
+    multifile_t* mf = w->mf;
+
+    uint64_t i;
+    while ((i = atomic_fetch_add(w->next, 1)) < mf->count)
+    {
+        multifile_entry_t* entry = &mf->files[i];
+        FILE* f = fopen(entry->path, "r");
+        if (!f)
+        {
+            fprintf(stderr, "index_worker(): error: fopen(): %s\n",
+                    entry->path);
+            entry->status = MULTIFILE_ERROR;
+            w->status = INDEX_ERROR;
+            continue;
+        }
+
+        w->doc = (uint32_t) i + 1;
+        entry->status = (count_stream_each(f, index_add_word, w,
+                                           &entry->wordcount,
+                                           &entry->charcount) == 0)
+                        ? MULTIFILE_OK : MULTIFILE_ERROR;
+        fclose(f);
+        if (entry->status != MULTIFILE_OK)
+        {
+            fprintf(stderr, "index_worker(): error: indexing %s\n",
+                    entry->path);
+            w->status = INDEX_ERROR;
+        }
+    }
+
+    return NULL;
+}
+
+static int64_t
+index_reserve(index_encoder_t* e, uint64_t len)
+{
+    if (e->size + len <= e->capacity)
+    {
+        return INDEX_OK;
+    }
+
+    uint64_t capacity = e->capacity ? e->capacity : INDEX_BUFFER_INITIAL_CAPACITY;
+    while (capacity < e->size + len)
+    {
+        capacity *= 2;
+    }
+    unsigned char* data = realloc(e->data, capacity);
+    if (!data)
+    {
+        fprintf(stderr, "index_reserve(): error: realloc(): data\n");
+        return INDEX_ERROR;
+    }
+    e->data = data;
+    e->capacity = capacity;
+    return INDEX_OK;
+}
+
+// Merge the lists of a term in all workers into one encoded list.
+// Documents of different workers never overlap.
+static int64_t
+index_encode_term(index_encoder_t* e, const hashmap_bucket_t* bucket,
+                  index_term_t* term)
+{
+    const index_list_t* lists[e->worker_count];
+    uint32_t pos[e->worker_count];
+    uint64_t n = 0;
+    for (uint64_t j = 0; j < e->worker_count; ++j)
+    {
+        int64_t list = 0;
+        if (hashmap_get_shared(e->workers[j].terms, bucket->key, bucket->hash,
+                               &list) == HASHMAP_KEY_FOUND)
+        {
+            lists[n] = &e->workers[j].lists[list];
+            pos[n++] = 0;
+        }
+    }
+
+    term->postings_offset = e->size;
+    term->key_len = (uint32_t) strlen(bucket->key);
+    term->total = 0;
+    term->df = 0;
+
+    uint64_t prev = 0;
+    while (n > 0)
+    {
+        uint64_t min = 0;
+        for (uint64_t j = 1; j < n; ++j)
+        {
+            if (lists[j]->items[pos[j]].doc < lists[min]->items[pos[min]].doc)
+            {
+                min = j;
+            }
+        }
+
+        const index_posting_t* p = &lists[min]->items[pos[min]];
+        if (index_reserve(e, INDEX_POSTING_MAX_BYTES) != INDEX_OK)
+        {
+            return INDEX_ERROR;
+        }
+        unsigned char* out = e->data + e->size;
+        out = index_put_varint(out, p->doc - prev);
+        out = index_put_varint(out, p->count);
+        e->size = (uint64_t) (out - e->data);
+        prev = p->doc;
+        term->total += p->count;
+        term->df++;
+
+        if (++pos[min] == lists[min]->count)
+        {
+            lists[min] = lists[n - 1];
+            pos[min] = pos[n - 1];
+            n--;
+        }
+    }
+
+    e->posting_count += term->df;
+    return INDEX_OK;
+}
+
+static void*
+index_encoder(void* arg)
+{
+    index_encoder_t* e = arg;
+    for (uint64_t t = e->begin; t < e->end && e->status == INDEX_OK; ++t)
+    {
+        e->status = index_encode_term(e, &e->vocab->buckets[e->order[t]],
+                                      &e->terms[t]);
+    }
+    return NULL;
+}
+
+static uint64_t
+index_body_checksum(const index_header_t* h, const void* docs,
+                    const void* terms, const void* postings, const void* pool)
+{
+    uint64_t c = snapshot_checksum(docs, h->doc_count * sizeof(index_doc_t),
+                                   INDEX_VERSION);
+    c = snapshot_checksum(terms, h->term_count * sizeof(index_term_t), c);
+    c = snapshot_checksum(postings, h->postings_size, c);
+    return snapshot_checksum(pool, h->pool_size, c);
+}
+
+static uint64_t
+index_header_checksum(const index_header_t* h)
+{
+    return snapshot_checksum(h, offsetof(index_header_t, header_checksum), 0);
+}
+
+static bool
+index_write_all(FILE* f, const void* data, uint64_t len)
+{
+    return len == 0 || fwrite(data, 1, len, f) == len;
+}
+
+static bool
+index_write_padding(FILE* f, uint64_t len)
+{
+    static const char padding[8] = {0};
+    return index_write_all(f, padding, len);
+}
+
+typedef struct index_write_ctx
+{
+    const index_header_t* h;
+    const index_doc_t* docs;
+    const index_term_t* terms;
+    const unsigned char* postings;
+    const char* pool;
+} index_write_ctx_t;
+
+static bool
+index_write_body(FILE* f, void* arg)
+{
+    const index_write_ctx_t* ctx = arg;
+    const index_header_t* h = ctx->h;
+    return index_write_all(f, h, sizeof(index_header_t))
+           && index_write_padding(f, h->docs_offset - sizeof(index_header_t))
+           && index_write_all(f, ctx->docs, h->doc_count * sizeof(index_doc_t))
+           && index_write_all(f, ctx->terms,
+                              h->term_count * sizeof(index_term_t))
+           && index_write_all(f, ctx->postings, h->postings_size)
+           && index_write_padding(f, h->pool_offset - h->postings_offset
+                                     - h->postings_size)
+           && index_write_all(f, ctx->pool, h->pool_size);
+}
+
+// Write index next to path and rename over it when complete.
+static int64_t
+index_write(const char* path, index_header_t* h, const index_doc_t* docs,
+            const index_term_t* terms, const unsigned char* postings,
+            const char* pool)
+{
+    h->docs_offset = INDEX_ALIGN(sizeof(index_header_t));
+    h->terms_offset = h->docs_offset + h->doc_count * sizeof(index_doc_t);
+    h->postings_offset = h->terms_offset + h->term_count * sizeof(index_term_t);
+    h->pool_offset = INDEX_ALIGN(h->postings_offset + h->postings_size);
+    h->file_size = h->pool_offset + h->pool_size;
+    h->body_checksum = index_body_checksum(h, docs, terms, postings, pool);
+    h->header_checksum = index_header_checksum(h);
+
+    index_write_ctx_t ctx = {.h = h, .docs = docs, .terms = terms,
+                             .postings = postings, .pool = pool};
+    return (snapshot_publish(path, index_write_body, &ctx) == SNAPSHOT_OK)
+           ? INDEX_OK : INDEX_ERROR;
+}
+
+// Merge worker vocabularies, encode all posting lists in parallel and
+// write the index file.
+static int64_t
+index_finish(multifile_t* mf, index_worker_t* workers, uint64_t jobs,
+             hash_t (* hashf)(const char*), const char* path)
+{
+    uint64_t largest = 0;
+    for (uint64_t j = 0; j < jobs; ++j)
+    {
+        largest = (workers[j].terms->size > largest) ? workers[j].terms->size
+                                                     : largest;
+    }
+
+    hashmap_map_t* vocab = hashmap_init_cap(hashf,
+                                            hashmap_capacity_for(largest));
+    if (!vocab)
+    {
+        return INDEX_ERROR;
+    }
+
+    int64_t status = INDEX_OK;
+    for (uint64_t j = 0; j < jobs && status == INDEX_OK; ++j)
+    {
+        const hashmap_map_t* terms = workers[j].terms;
+        for (uint64_t i = 0; i < terms->capacity && status == INDEX_OK; ++i)
+        {
+            const hashmap_bucket_t* b = &terms->buckets[i];
+            uint64_t index = 0;
+            if (b->in_use && hashmap_insert(vocab, b->key, 0, b->hash,
+                                            &index) < 0)
+            {
+                status = INDEX_ERROR;
+            }
+        }
+    }
+
+    uint64_t* order = NULL;
+    uint64_t term_count = 0;
+    if (status != INDEX_OK
+        || sort_by_key(vocab, jobs, &order, &term_count) != SORT_OK)
+    {
+        hashmap_free(vocab);
+        return INDEX_ERROR;
+    }
+
+    index_term_t* terms = calloc(term_count ? term_count : 1,
+                                 sizeof(index_term_t));
+    index_doc_t* docs = calloc(mf->count ? mf->count : 1, sizeof(index_doc_t));
+    if (!terms || !docs)
+    {
+        fprintf(stderr, "index_finish(): error: calloc(): terms\n");
+        free(terms);
+        free(docs);
+        free(order);
+        hashmap_free(vocab);
+        return INDEX_ERROR;
+    }
+
+    index_encoder_t encoders[jobs];
+    pthread_t threads[jobs];
+    uint64_t started = 0;
+    for (uint64_t j = 0; j < jobs; ++j)
+    {
+        encoders[j] = (index_encoder_t) {
+            .workers = workers,
+            .worker_count = jobs,
+            .vocab = vocab,
+            .order = order,
+            .begin = term_count * j / jobs,
+            .end = term_count * (j + 1) / jobs,
+            .terms = terms,
+            .status = INDEX_OK,
+        };
+    }
+    for (; started < jobs; ++started)
+    {
+        if (pthread_create(&threads[started], NULL, index_encoder,
+                           &encoders[started]) != 0)
+        {
+            break;
+        }
+    }
+    // Ranges of threads that did not start are encoded here.
+    for (uint64_t j = started; j < jobs; ++j)
+    {
+        index_encoder(&encoders[j]);
+    }
+    for (uint64_t j = 0; j < started; ++j)
+    {
+        pthread_join(threads[j], NULL);
+    }
+
+    index_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.version = INDEX_VERSION;
+    header.endian = INDEX_ENDIAN;
+    header.doc_count = mf->count;
+    header.term_count = term_count;
+
+    // Ranges are concatenated, their term offsets made absolute.
+    for (uint64_t j = 0; j < jobs; ++j)
+    {
+        status = (encoders[j].status != INDEX_OK) ? INDEX_ERROR : status;
+        for (uint64_t t = encoders[j].begin; t < encoders[j].end; ++t)
+        {
+            terms[t].postings_offset += header.postings_size;
+        }
+        header.postings_size += encoders[j].size;
+        header.posting_count += encoders[j].posting_count;
+    }
+
+    for (uint64_t t = 0; t < term_count; ++t)
+    {
+        header.pool_size += terms[t].key_len + 1;
+    }
+    for (uint64_t i = 0; i < mf->count; ++i)
+    {
+        header.pool_size += strlen(mf->files[i].path) + 1;
+        header.total += mf->files[i].wordcount;
+    }
+
+    unsigned char* postings = malloc(header.postings_size + 1);
+    char* pool = malloc(header.pool_size + 1);
+    if (status == INDEX_OK && postings && pool)
+    {
+        uint64_t offset = 0;
+        for (uint64_t j = 0; j < jobs; ++j)
+        {
+            if (encoders[j].size > 0)
+            {
+                memcpy(postings + offset, encoders[j].data, encoders[j].size);
+            }
+            offset += encoders[j].size;
+        }
+
+        offset = 0;
+        for (uint64_t t = 0; t < term_count; ++t)
+        {
+            terms[t].key_offset = offset;
+            memcpy(pool + offset, vocab->buckets[order[t]].key,
+                   terms[t].key_len + 1);
+            offset += terms[t].key_len + 1;
+        }
+        for (uint64_t i = 0; i < mf->count; ++i)
+        {
+            uint64_t len = strlen(mf->files[i].path);
+            docs[i].path_offset = offset;
+            docs[i].wordcount = mf->files[i].wordcount;
+            memcpy(pool + offset, mf->files[i].path, len + 1);
+            offset += len + 1;
+        }
+
+        status = index_write(path, &header, docs, terms, postings, pool);
+    }
+    else
+    {
+        fprintf(stderr, "index_finish(): error: encoding postings\n");
+        status = INDEX_ERROR;
+    }
+
+    for (uint64_t j = 0; j < jobs; ++j)
+    {
+        free(encoders[j].data);
+    }
+    free(postings);
+    free(pool);
+    free(docs);
+    free(terms);
+    free(order);
+    hashmap_free(vocab);
+    return status;
+}
+
+int64_t
+index_build(multifile_t* mf, hash_t (* hashf)(const char*), uint64_t jobs,
+            const char* path)
+{
+    if (mf->count >= UINT32_MAX)
+    {
+        fprintf(stderr, "index_build(): error: too many files: %"PRIu64"\n",
+                mf->count);
+        return INDEX_ERROR;
+    }
+    if (jobs == 0)
+    {
+        jobs = 1;
+    }
+    if (jobs > mf->count)
+    {
+        jobs = mf->count ? mf->count : 1;
+    }
+
+    atomic_uint_fast64_t next;
+    atomic_init(&next, 0);
+
+    pthread_t threads[jobs];
+    index_worker_t workers[jobs];
+    memset(workers, 0, sizeof(workers));
+    int64_t status = INDEX_OK;
+
+    for (uint64_t j = 0; j < jobs; ++j)
+    {
+        workers[j].mf = mf;
+        workers[j].next = &next;
+        workers[j].status = INDEX_OK;
+        workers[j].terms = hashmap_init(hashf);
+        if (!workers[j].terms)
+        {
+            status = INDEX_ERROR;
+        }
+    }
+
+    uint64_t started = 0;
+    for (; started < jobs && status == INDEX_OK; ++started)
+    {
+        if (pthread_create(&threads[started], NULL, index_worker,
+                           &workers[started]) != 0)
+        {
+            fprintf(stderr, "index_build(): error: pthread_create()\n");
+            break;
+        }
+    }
+
+    // Workers that did start drain the whole file list. Workers that
+    // did not keep empty vocabularies.
+    for (uint64_t j = 0; j < started; ++j)
+    {
+        pthread_join(threads[j], NULL);
+    }
+
+    bool failed = (started == 0);
+    for (uint64_t j = 0; j < jobs; ++j)
+    {
+        failed |= (workers[j].status != INDEX_OK);
+    }
+
+    if (started > 0 && status == INDEX_OK)
+    {
+        status = index_finish(mf, workers, jobs, hashf, path);
+    }
+
+    for (uint64_t j = 0; j < jobs; ++j)
+    {
+        for (uint64_t l = 0; l < workers[j].list_count; ++l)
+        {
+            free(workers[j].lists[l].items);
+        }
+        free(workers[j].lists);
+        hashmap_free(workers[j].terms);
+    }
+
+    return failed ? INDEX_ERROR : status;
+}
+
+// Check that count items of item_size bytes from offset lie within
+// size, without overflowing.
+static inline bool
+index_section_valid(uint64_t offset, uint64_t count, uint64_t item_size,
+                    uint64_t size)
+{
+    return offset <= size && count <= (size - offset) / item_size;
+}
+
+// Validate header fields and that all sections lie within size.
+static bool
+index_header_valid(const index_header_t* h, uint64_t size)
+{
+    if (memcmp(h->magic, INDEX_MAGIC, sizeof(h->magic)) != 0)
+    {
+        fprintf(stderr, "index_open(): error: not an index file\n");
+        return false;
+    }
+    if (h->endian != INDEX_ENDIAN || h->version != INDEX_VERSION)
+    {
+        fprintf(stderr, "index_open(): error: unsupported version %u "
+                        "or byte order\n", h->version);
+        return false;
+    }
+    if (h->header_checksum != index_header_checksum(h))
+    {
+        fprintf(stderr, "index_open(): error: header checksum mismatch\n");
+        return false;
+    }
+
+    // Every offset is checked against size before anything is added to
+    // it, so no sum can wrap around.
+    bool valid = h->file_size == size
+                 && h->doc_count < UINT32_MAX
+                 && h->term_count < UINT32_MAX
+                 && h->docs_offset == INDEX_ALIGN(sizeof(index_header_t))
+                 && index_section_valid(h->docs_offset, h->doc_count,
+                                        sizeof(index_doc_t), size)
+                 && h->terms_offset == h->docs_offset
+                                       + h->doc_count * sizeof(index_doc_t)
+                 && index_section_valid(h->terms_offset, h->term_count,
+                                        sizeof(index_term_t), size)
+                 && h->postings_offset == h->terms_offset
+                                          + h->term_count * sizeof(index_term_t)
+                 && index_section_valid(h->postings_offset, h->postings_size,
+                                        1, size)
+                 && h->pool_offset == INDEX_ALIGN(h->postings_offset
+                                                  + h->postings_size)
+                 && index_section_valid(h->pool_offset, h->pool_size, 1, size)
+                 && h->pool_offset + h->pool_size == size;
+    if (!valid)
+    {
+        fprintf(stderr, "index_open(): error: corrupt layout\n");
+    }
+    return valid;
+}
+
+// Check that string at offset of len bytes is null-terminated in pool.
+static inline bool
+index_pool_string_valid(const index_t* idx, uint64_t offset, uint64_t len)
+{
+    uint64_t size = idx->header->pool_size;
+    return offset < size && len < size - offset
+           && idx->pool[offset + len] == '\0';
+}
+
+// Check that term keys and document paths lie within the pool and that
+// posting list offsets are ordered and within the postings. Reads terms,
+// docs and document paths only, so every open can afford it.
+static bool
+index_bounds_valid(const index_t* idx)
+{
+    const index_header_t* h = idx->header;
+    uint64_t prev = 0;
+    for (uint64_t t = 0; t < h->term_count; ++t)
+    {
+        const index_term_t* term = &idx->terms[t];
+        if (term->postings_offset < prev || term->postings_offset
+                                            > h->postings_size
+            || !index_pool_string_valid(idx, term->key_offset, term->key_len))
+        {
+            return false;
+        }
+        prev = term->postings_offset;
+    }
+    for (uint64_t d = 0; d < h->doc_count; ++d)
+    {
+        uint64_t offset = idx->docs[d].path_offset;
+        if (offset >= h->pool_size
+            || !index_pool_string_valid(idx, offset, strnlen(
+                idx->pool + offset, h->pool_size - offset)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+index_t*
+index_open(const char* path, bool verify)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "index_open(): error: open(): %s\n", path);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t) st.st_size < sizeof(index_header_t))
+    {
+        fprintf(stderr, "index_open(): error: file too small: %s\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    void* data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        fprintf(stderr, "index_open(): error: mmap(): %s\n", path);
+        return NULL;
+    }
+
+    index_t* idx = calloc(1, sizeof(index_t));
+    if (!idx)
+    {
+        fprintf(stderr, "index_open(): error: calloc(): idx\n");
+        munmap(data, (size_t) st.st_size);
+        return NULL;
+    }
+
+    idx->data = data;
+    idx->size = (uint64_t) st.st_size;
+    idx->header = data;
+
+    const index_header_t* h = idx->header;
+    if (!index_header_valid(h, idx->size))
+    {
+        index_close(idx);
+        return NULL;
+    }
+
+    const char* base = data;
+    idx->docs = (const index_doc_t*) (base + h->docs_offset);
+    idx->terms = (const index_term_t*) (base + h->terms_offset);
+    idx->postings = (const unsigned char*) (base + h->postings_offset);
+    idx->pool = base + h->pool_offset;
+
+    if (!index_bounds_valid(idx))
+    {
+        fprintf(stderr, "index_open(): error: corrupt terms or documents\n");
+        index_close(idx);
+        return NULL;
+    }
+
+    if (verify && !index_verify(idx))
+    {
+        fprintf(stderr, "index_open(): error: body checksum mismatch\n");
+        index_close(idx);
+        return NULL;
+    }
+
+    return idx;
+}
+
+bool
+index_verify(const index_t* idx)
+{
+    const index_header_t* h = idx->header;
+    return index_body_checksum(h, idx->docs, idx->terms, idx->postings,
+                               idx->pool) == h->body_checksum;
+}
+
+void
+index_close(index_t* idx)
+{
+    if (idx != NULL)
+    {
+        munmap((void*) idx->data, idx->size);
+        free(idx);
+    }
+}
+
+const index_term_t*
+index_find(const index_t* idx, const char* key)
+{
+    uint64_t low = 0;
+    uint64_t high = idx->header->term_count;
+    while (low < high)
+    {
+        uint64_t mid = low + (high - low) / 2;
+        int cmp = strcmp(index_key(idx, &idx->terms[mid]), key);
+        if (cmp == 0)
+        {
+            return &idx->terms[mid];
+        }
+        if (cmp < 0)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return NULL;
+}
+
+void
+index_cursor_init(const index_t* idx, const index_term_t* term,
+                  index_cursor_t* cursor)
+{
+    const index_header_t* h = idx->header;
+    uint64_t t = (uint64_t) (term - idx->terms);
+    uint64_t end = (t + 1 < h->term_count)
+                   ? idx->terms[t + 1].postings_offset : h->postings_size;
+    uint64_t begin = term->postings_offset;
+
+    // Malformed offsets give an empty list.
+    end = (end > h->postings_size) ? h->postings_size : end;
+    begin = (begin > end) ? end : begin;
+
+    cursor->pos = idx->postings + begin;
+    cursor->end = idx->postings + end;
+    cursor->doc = 0;
+}
+
+bool
+index_cursor_next(index_cursor_t* cursor, uint64_t* doc, uint64_t* count)
+{
+    uint64_t delta = 0;
+    if (cursor->pos >= cursor->end
+        || !index_get_varint(&cursor->pos, cursor->end, &delta)
+        || !index_get_varint(&cursor->pos, cursor->end, count))
+    {
+        return false;
+    }
+
+    cursor->doc += delta;
+    *doc = cursor->doc;
+    return true;
+}
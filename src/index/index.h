@@ -0,0 +1,157 @@
+#ifndef MAPWORDS_INDEX_H
+#define MAPWORDS_INDEX_H
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "hash.h"
+#include "multifile.h"
+
+/*
+Inverted index of a file list: for every word, the documents (files)
+containing it and its count in each, readable in place with mmap.
+
+Building distributes files dynamically to worker threads like
+multifile_count(). Each worker tokenizes its files with the shared
+tokenizer straight into its own vocabulary map, whose bucket value
+is the word's posting list in the worker. The bucket remembers the
+last document counted (hashmap_bucket_t.last_doc), so a word either
+starts a new (document, count) posting or adds to the last one with
+a single map lookup and no per-file map. Workers take files in
+increasing order, so their lists are sorted by document.
+
+Worker vocabularies are merged into one map, sorted by key with
+sort_by_key() and split into ranges of terms. Each range is
+encoded in parallel by merging the term's lists of all workers.
+
+File layout, all integers in host byte order (an endianness marker
+in the header rejects foreign files), sections 8-byte aligned:
+
+  header    index_header_t
+  docs      doc_count x index_doc_t, in file list order
+  terms     term_count x index_term_t, sorted by key for binary search
+  postings  posting lists of all terms, one after another
+  pool      null-terminated keys and document paths
+
+A posting list is a sequence of (document delta, count) pairs, both
+unsigned LEB128 varints. The first delta is the document number
+itself, later ones the difference to the previous document. Lists
+end where the list of the next term begins.
+
+Checksums and the atomic write work like in snapshot.h.
+*/
+
+#define INDEX_ERROR -1
+#define INDEX_OK 0
+
+#define INDEX_MAGIC "MWINDX\r\n"
+#define INDEX_VERSION 1U
+#define INDEX_ENDIAN 0x01020304U
+
+typedef struct index_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    uint64_t doc_count;
+    uint64_t term_count;
+    uint64_t posting_count;
+    uint64_t total; // Words in all documents.
+    uint64_t docs_offset;
+    uint64_t terms_offset;
+    uint64_t postings_offset;
+    uint64_t postings_size;
+    uint64_t pool_offset;
+    uint64_t pool_size;
+    uint64_t file_size;
+    uint64_t body_checksum;
+    uint64_t header_checksum; // Of all preceding header bytes.
+} index_header_t;
+
+typedef struct index_doc
+{
+    uint64_t path_offset; // Into pool.
+    uint64_t wordcount;
+} index_doc_t;
+
+typedef struct index_term
+{
+    uint64_t key_offset; // Into pool.
+    uint64_t postings_offset; // Into postings.
+    uint64_t total; // Count in all documents.
+    uint32_t key_len;
+    uint32_t df; // Documents containing the term.
+} index_term_t;
+
+// Read-only view of a mapped index file.
+typedef struct index
+{
+    const void* data;
+    uint64_t size;
+    const index_header_t* header;
+    const index_doc_t* docs;
+    const index_term_t* terms;
+    const unsigned char* postings;
+    const char* pool;
+} index_t;
+
+// Position in the posting list of a term.
+typedef struct index_cursor
+{
+    const unsigned char* pos;
+    const unsigned char* end;
+    uint64_t doc;
+} index_cursor_t;
+
+// Index all files of mf into a new index file at path using jobs
+// threads. Status, word and character counts of every file are set
+// in its entry. Files that fail are reported and keep what was read
+// of them (nothing if they could not be opened). INDEX_ERROR is then
+// returned after the index is written.
+int64_t
+index_build(multifile_t* mf, hash_t (* hashf)(const char*), uint64_t jobs,
+            const char* path);
+
+// Map index file read-only and validate its header, layout and the
+// offsets of all terms and documents. With verify the body checksum is
+// checked as well.
+index_t*
+index_open(const char* path, bool verify);
+
+// Check the body checksum of an open index.
+bool
+index_verify(const index_t* idx);
+
+// Unmap index.
+void
+index_close(index_t* idx);
+
+// Find term of lowercase key, NULL if no document contains it.
+const index_term_t*
+index_find(const index_t* idx, const char* key);
+
+// Start reading the posting list of term.
+void
+index_cursor_init(const index_t* idx, const index_term_t* term,
+                  index_cursor_t* cursor);
+
+// Read next posting into doc and count. Return false at the end of
+// the list or if the list is malformed.
+bool
+index_cursor_next(index_cursor_t* cursor, uint64_t* doc, uint64_t* count);
+
+// Get key of term.
+static inline const char*
+index_key(const index_t* idx, const index_term_t* term)
+{
+    return idx->pool + term->key_offset;
+}
+
+// Get path of document.
+static inline const char*
+index_doc_path(const index_t* idx, uint64_t doc)
+{
+    return idx->pool + idx->docs[doc].path_offset;
+}
+
+#endif //MAPWORDS_INDEX_H
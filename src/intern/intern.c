@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hash.h"
+#include "hashmap.h"
+#include "intern.h"
+
+// Seed of the id hash mixing.
+#define INTERN_MIX_SEED 0x3C6EF372FE94F82BLU
+
+intern_t*
+intern_init(hash_t (* hashf)(const char*))
+{
+    intern_t* in = calloc(1, sizeof(intern_t));
+    if (!in)
+    {
+        fprintf(stderr, "intern_init(): error: calloc(): in\n");
+        return NULL;
+    }
+
+    in->map = hashmap_init(hashf);
+    if (!in->map)
+    {
+        free(in);
+        return NULL;
+    }
+    return in;
+}
+
+void
+intern_free(intern_t* in)
+{
+    if (in != NULL)
+    {
+        hashmap_free(in->map);
+        free(in->offsets);
+        free(in->hashes);
+        free(in->pool);
+        free(in);
+    }
+}
+
+// Make room for one more id with a key of len bytes.
+static int64_t
+intern_reserve(intern_t* in, uint64_t len)
+{
+    if (in->count == in->capacity)
+    {
+        uint64_t capacity = in->capacity ? in->capacity * 2
+                                         : INTERN_INITIAL_CAPACITY;
+        uint64_t* offsets = realloc(in->offsets, capacity * sizeof(uint64_t));
+        if (!offsets)
+        {
+            fprintf(stderr, "intern_reserve(): error: realloc(): offsets\n");
+            return INTERN_ERROR;
+        }
+        in->offsets = offsets;
+
+        hash_t* hashes = realloc(in->hashes, capacity * sizeof(hash_t));
+        if (!hashes)
+        {
+            fprintf(stderr, "intern_reserve(): error: realloc(): hashes\n");
+            return INTERN_ERROR;
+        }
+        in->hashes = hashes;
+        in->capacity = capacity;
+    }
+
+    if (in->pool_size + len + 1 > in->pool_capacity)
+    {
+        uint64_t capacity = in->pool_capacity ? in->pool_capacity
+                                              : INTERN_INITIAL_CAPACITY * 8;
+        while (capacity < in->pool_size + len + 1)
+        {
+            capacity *= 2;
+        }
+        char* pool = realloc(in->pool, capacity);
+        if (!pool)
+        {
+            fprintf(stderr, "intern_reserve(): error: realloc(): pool\n");
+            return INTERN_ERROR;
+        }
+        in->pool = pool;
+        in->pool_capacity = capacity;
+    }
+    return 0;
+}
+
+int64_t
+intern_id(intern_t* in, char* word, uint64_t len)
+{
+    if (in->count == UINT32_MAX)
+    {
+        fprintf(stderr, "intern_id(): error: too many words\n");
+        return INTERN_ERROR;
+    }
+
+    // Room is made first, so a word is never in the map without an id.
+    if (intern_reserve(in, len) != 0)
+    {
+        return INTERN_ERROR;
+    }
+
+    uint64_t index = 0;
+    hash_t hash = in->map->hashf(word);
+    int64_t status = hashmap_insert(in->map, word, (int64_t) in->count, hash,
+                                    &index);
+    if (status == HASHMAP_KEY_FOUND)
+    {
+        return in->map->buckets[index].value;
+    }
+    if (status != HASHMAP_OK)
+    {
+        return INTERN_ERROR;
+    }
+
+    memcpy(in->pool + in->pool_size, word, len + 1);
+    in->offsets[in->count] = in->pool_size;
+    in->hashes[in->count] = hash_mix(hash, INTERN_MIX_SEED);
+    in->pool_size += len + 1;
+    return (int64_t) in->count++;
+}
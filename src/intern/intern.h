@@ -0,0 +1,66 @@
+#ifndef MAPWORDS_INTERN_H
+#define MAPWORDS_INTERN_H
+
+#include <inttypes.h>
+
+#include "hash.h"
+#include "hashmap.h"
+
+/*
+Dense uint32_t ids for distinct words.
+
+The first time a word is seen it gets the next id: 0, 1, 2, ...
+Words are looked up through a string hashmap_map_t whose bucket
+values hold the ids. Keys are also copied once into an append-only
+pool, so the key of an id stays valid while the map rehashes (which
+copies its keys).
+
+Every id keeps the hash of its word mixed with hash_mix(), which is
+well distributed in all bits, so hashes of word sequences can be
+combined from the ids without hashing any string again.
+*/
+
+#define INTERN_ERROR -1
+
+#define INTERN_INITIAL_CAPACITY 1024U
+
+typedef struct intern
+{
+    hashmap_map_t* map; // Word -> id.
+    uint64_t* offsets; // Key of id in pool.
+    hash_t* hashes; // Mixed hash of id.
+    uint64_t count;
+    uint64_t capacity;
+    char* pool;
+    uint64_t pool_size;
+    uint64_t pool_capacity;
+} intern_t;
+
+// Allocate empty table using hash function hashf for words.
+intern_t*
+intern_init(hash_t (* hashf)(const char*));
+
+// Free table and all keys.
+void
+intern_free(intern_t* in);
+
+// Return id of null-terminated word of len bytes, adding it if new,
+// or INTERN_ERROR.
+int64_t
+intern_id(intern_t* in, char* word, uint64_t len);
+
+// Get word of id.
+static inline const char*
+intern_key(const intern_t* in, uint32_t id)
+{
+    return in->pool + in->offsets[id];
+}
+
+// Get mixed hash of id.
+static inline hash_t
+intern_hash(const intern_t* in, uint32_t id)
+{
+    return in->hashes[id];
+}
+
+#endif //MAPWORDS_INTERN_H
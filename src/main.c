@@ -2,11 +2,37 @@
 #include <stdlib.h>
 #include <string.h>
 #include <getopt.h>
+#include <poll.h>
 #include <inttypes.h>
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/stat.h>
 
+#include "backend.h"
+#include "bloom.h"
+#include "cache.h"
+#include "cms.h"
+#include "count.h"
 #include "hash.h"
 #include "hashmap.h"
+#include "hashmap_snapshot.h"
+#include "hll.h"
+#include "index.h"
+#include "intern.h"
+#include "multifile.h"
+#include "ngram.h"
+#include "output.h"
+#include "pipeline.h"
+#include "prefix.h"
+#include "sample.h"
+#include "server.h"
+#include "snapshot.h"
+#include "sort.h"
+#include "spacesaving.h"
+#include "u64map.h"
 #include "util.h"
+#include "watch.h"
 
 #ifdef _WIN32
 
@@ -48,161 +74,2288 @@ static struct timespec ts_stop;
 
 #endif
 
-// Assume generous 511 (+ '\0') maximum word length.
-#define WORD_SIZE 512
+// Long options without a short counterpart.
+enum
+{
+    OPT_TOKENIZERS = 256,
+    OPT_COUNTERS,
+    OPT_FILES_FROM,
+    OPT_JOBS,
+    OPT_PER_FILE,
+    OPT_TOP,
+    OPT_ALL,
+    OPT_FORMAT,
+    OPT_OUTPUT,
+    OPT_APPROX_TOPK,
+    OPT_MEMORY,
+    OPT_COUNT_MIN,
+    OPT_CMS_DEPTH,
+    OPT_QUERY,
+    OPT_DISTINCT_ONLY,
+    OPT_PRESIZE,
+    OPT_HLL_PRECISION,
+    OPT_ADMIT,
+    OPT_ADMIT_EXACT,
+    OPT_SAMPLE,
+    OPT_CONFIDENCE,
+    OPT_SAVE,
+    OPT_LOAD,
+    OPT_UPDATE,
+    OPT_CACHE_DIR,
+    OPT_WATCH,
+    OPT_SERVE,
+    OPT_CORPUS,
+    OPT_INDEX,
+    OPT_NGRAM,
+    OPT_COOCCUR,
+    OPT_PACKED_KEYS,
+    OPT_PREFIX_INDEX,
+    OPT_PREFIX,
+    OPT_BACKEND,
+};
 
-int
-main(int argc, char** argv)
+// Number of most common words printed by default.
+#define DEFAULT_TOP 100
+
+// Largest co-occurrence window, a power of two.
+#define COOCCUR_MAX_WINDOW 64U
+
+// Default memory budget for approximate modes.
+#define DEFAULT_MEMORY (16U * 1024U * 1024U)
+
+// Parsed command line options.
+typedef struct options
 {
-    TIMER_BEGIN();
+    hash_t (* hashf)(const char*);
+    char hashf_name[HASHF_NAME_MAX_LENGTH];
 
-    hash_t (* hashf)(const char*) = NULL;
-    char hashf_name[HASHF_NAME_MAX_LENGTH] = {'\0'};
+    // Paths given with -f and as positional arguments.
+    char** paths;
+    int path_count;
+    const char* files_from;
+    uint64_t jobs;
+    bool per_file;
 
-    char* fname1 = NULL;
-    int opt;
-    const char* short_opt = "f:h:";
-    struct option long_opt[] =
-        {
-            {"file",  required_argument, NULL, 'f'},
-            {"hashf", required_argument, NULL, 'h'},
-            {NULL, 0,                    NULL, 0}
-        };
+    bool pipeline;
+    uint64_t tokenizers;
+    uint64_t counters;
 
-    while ((opt = getopt_long(argc, argv, short_opt, long_opt, NULL)) != -1)
+    uint64_t top;
+    bool all;
+    const char* output_path;
+    output_format_t output_format;
+
+    uint64_t approx_topk;
+    uint64_t memory;
+
+    bool count_min;
+    uint64_t cms_depth;
+    const char** queries;
+    int query_count;
+
+    bool distinct_only;
+    bool presize;
+    uint64_t hll_precision;
+
+    bool admit;
+    bool admit_exact;
+
+    uint64_t sample;
+    double confidence;
+
+    const char* save_path;
+    const char* load_path;
+    const char* update_path;
+    const char* cache_dir;
+
+    bool watch;
+    const char* serve_path;
+    bool corpus;
+    const char* index_path;
+    uint64_t ngram;
+    uint64_t cooccur;
+    const char* prefix_path;
+    const char** prefixes;
+    int prefix_count;
+    const backend_t* backend; // Given with --backend, else NULL.
+} options_t;
+
+// Counter of a backend and its operations.
+typedef struct backend_ctx
+{
+    const backend_t* backend;
+    void* counter;
+} backend_ctx_t;
+
+// Write the n most common words of map in descending order.
+static int64_t
+print_most_common(output_t* out, const hashmap_map_t* map, uint64_t n)
+{
+    const hashmap_bucket_t** results = calloc(n, sizeof(hashmap_bucket_t*));
+    if (!results)
     {
-        switch (opt)
-        {
-            case -1:
-            case 0:
-                break;
-            case 'f':
-                fname1 = optarg;
-                break;
-            case 'h':
-                strcpy(hashf_name, optarg);
-                break;
-            case ':':
-            case '?':
-                return -2;
-            default:
-                return -2;
-        }
+        printf("main(): error allocating memory for 'results'\n");
+        return HASHMAP_ERROR;
+    }
+
+    char title[64];
+    sprintf(title, "%"PRIu64" most common words:", n);
+    output_title(out, title);
+
+    uint64_t count = hashmap_top_k(map, n, results);
+    for (uint64_t j = 0; j < count; ++j)
+    {
+        output_entry(out, j + 1, results[j]->key, results[j]->value);
+    }
+
+    free(results);
+    return output_flush(out);
+}
+
+// Write all words of map sorted by count (desc) and word (asc).
+static int64_t
+print_all(output_t* out, const hashmap_map_t* map, uint64_t threads)
+{
+    uint64_t* order = NULL;
+    uint64_t count = 0;
+    int64_t status = sort_by_value(map, threads, &order, &count);
+    if (status != SORT_OK)
+    {
+        printf("main(): sort_by_value(): error: %"PRId64"\n", status);
+        return status;
+    }
+
+    char title[64];
+    sprintf(title, "%"PRIu64" words by count:", count);
+    output_title(out, title);
+
+    for (uint64_t j = 0; j < count; ++j)
+    {
+        const hashmap_bucket_t* bucket = &map->buckets[order[j]];
+        output_entry(out, j + 1, bucket->key, bucket->value);
+    }
+
+    free(order);
+    return output_flush(out);
+}
+
+// Write either all words or the top words of map.
+static int64_t
+print_results(output_t* out, const hashmap_map_t* map, uint64_t top,
+              bool all, uint64_t threads)
+{
+    return all ? print_all(out, map, threads)
+               : print_most_common(out, map, top);
+}
+
+// Write words of map with document frequencies of a corpus of
+// documents, sorted by count (desc) and word (asc). Only the top words
+// unless all.
+static int64_t
+print_corpus(output_t* out, const hashmap_map_t* map, uint64_t documents,
+             uint64_t top, bool all, uint64_t threads)
+{
+    uint64_t* order = NULL;
+    uint64_t count = 0;
+    int64_t status = sort_by_value(map, threads, &order, &count);
+    if (status != SORT_OK)
+    {
+        printf("main(): sort_by_value(): error: %"PRId64"\n", status);
+        return status;
+    }
+
+    count = (all || top > count) ? count : top;
+    char title[96];
+    sprintf(title, "%"PRIu64" words by count in %"PRIu64" documents:",
+            count, documents);
+    output_title(out, title);
+
+    for (uint64_t j = 0; j < count; ++j)
+    {
+        const hashmap_bucket_t* bucket = &map->buckets[order[j]];
+        double idf = log((double) documents / (double) bucket->df);
+        output_corpus_entry(out, j + 1, bucket->key, bucket->value,
+                            bucket->df, idf);
+    }
+
+    free(order);
+    return output_flush(out);
+}
+
+// Check if path names a directory.
+static bool
+is_dir(const char* path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// Parse positive integer option argument. Return 0 on error.
+static uint64_t
+parse_count(const char* arg)
+{
+    char* end = NULL;
+    unsigned long long n = strtoull(arg, &end, 10);
+    if (end == arg || *end != '\0')
+    {
+        return 0;
+    }
+    return (uint64_t) n;
+}
+
+// Parse size option argument with optional K, M or G suffix.
+// Return 0 on error.
+static uint64_t
+parse_size(const char* arg)
+{
+    char* end = NULL;
+    unsigned long long n = strtoull(arg, &end, 10);
+    if (end == arg)
+    {
+        return 0;
     }
 
-    printf("main(): file to be read: %s\n", fname1);
-    FILE* f1 = fopen(fname1, "r");
+    switch (*end)
+    {
+        case '\0':
+            return (uint64_t) n;
+        case 'k':
+        case 'K':
+            n <<= 10U;
+            break;
+        case 'm':
+        case 'M':
+            n <<= 20U;
+            break;
+        case 'g':
+        case 'G':
+            n <<= 30U;
+            break;
+        default:
+            return 0;
+    }
+    return (end[1] == '\0') ? (uint64_t) n : 0;
+}
+
+// Open the single input file, or standard input if no file (or "-")
+// is given.
+static FILE*
+open_input(const options_t* opts)
+{
+    const char* fname1 = (opts->path_count == 1) ? opts->paths[0] : NULL;
+    FILE* f1;
+    if (!fname1 || strcmp(fname1, "-") == 0)
+    {
+        printf("main(): file to be read: <stdin>\n");
+        f1 = stdin;
+    }
+    else
+    {
+        printf("main(): file to be read: %s\n", fname1);
+        f1 = fopen(fname1, "r");
+    }
     if (!f1)
     {
         printf("main(): error opening file\n");
-        return EXIT_FAILURE;
+    }
+    return f1;
+}
+
+// Print the common stats lines of a counted map.
+static void
+print_map_stats(const options_t* opts, const hashmap_map_t* map,
+                uint64_t wordcount, uint64_t charcount)
+{
+    printf("stats: hashf=%s\n", opts->hashf_name);
+    printf("stats: map_size=%"PRIu64"\n", map->size);
+    printf("stats: collisions=%"PRIu64"\n", map->collisions);
+    printf("stats: word_count=%"PRIu64"\n", wordcount);
+    printf("stats: char_count=%"PRIu64"\n", charcount);
+    printf("stats: rehash_count=%"PRIu64"\n", map->rehashes);
+    printf("stats: capacity=%"PRIu64"\n", map->capacity);
+}
+
+// Check if stream is a regular file that can be read again from
+// its current position, which is stored in start.
+static bool
+is_seekable(FILE* f, long* start)
+{
+    struct stat st;
+    *start = ftell(f);
+    return fstat(fileno(f), &st) == 0 && S_ISREG(st.st_mode) && *start >= 0;
+}
+
+// Write map to opts->save_path if given, see snapshot.h, and its
+// prefix index to opts->prefix_path if given, see prefix.h.
+static int64_t
+save_map(const options_t* opts, const hashmap_map_t* map)
+{
+    int64_t status = HASHMAP_OK;
+    if (opts->save_path && hashmap_save(map, opts->save_path) != HASHMAP_OK)
+    {
+        printf("main(): error saving snapshot: %s\n", opts->save_path);
+        status = HASHMAP_ERROR;
+    }
+
+    if (opts->prefix_path)
+    {
+        prefix_t* p = prefix_build(map, opts->jobs);
+        if (!p || prefix_save(p, opts->prefix_path) != PREFIX_OK)
+        {
+            printf("main(): error saving prefix index: %s\n",
+                   opts->prefix_path);
+            status = HASHMAP_ERROR;
+        }
+        prefix_close(p);
+    }
+    return status;
+}
+
+typedef struct distinct_ctx
+{
+    hll_t* hll;
+    hash_t (* hashf)(const char*);
+} distinct_ctx_t;
+
+static int64_t
+distinct_add_word(char* word, uint64_t len, void* ctx)
+{
+    (void) len;
+    distinct_ctx_t* d = ctx;
+    return hll_add(d->hll, d->hashf(word));
+}
+
+// Estimate distinct words of stream with HyperLogLog, see hll.h.
+static int64_t
+estimate_distinct(FILE* f, const options_t* opts, hll_t* hll,
+                  uint64_t* wordcount, uint64_t* charcount)
+{
+    distinct_ctx_t ctx = {.hll = hll, .hashf = opts->hashf};
+    return count_stream_each(f, distinct_add_word, &ctx, wordcount,
+                             charcount);
+}
+
+// Pre-pass over a seekable input estimating the distinct words, so
+// the map can be allocated at its final capacity. The stream is
+// rewound afterwards. Return map capacity to use.
+static uint64_t
+presize_capacity(FILE* f, const options_t* opts, double* estimate)
+{
+    long start = 0;
+    if (!is_seekable(f, &start))
+    {
+        printf("main(): input is not seekable, skipping presize\n");
+        return HASHMAP_INITIAL_CAPACITY;
     }
 
-    char word_buffer[WORD_SIZE] = {'\0'};
+    hll_t* hll = hll_init(opts->hll_precision);
     uint64_t wordcount = 0;
     uint64_t charcount = 0;
+    if (!hll || estimate_distinct(f, opts, hll, &wordcount, &charcount) != 0
+        || fseek(f, start, SEEK_SET) != 0)
+    {
+        printf("main(): presize pass failed\n");
+        hll_free(hll);
+        fseek(f, start, SEEK_SET);
+        return HASHMAP_INITIAL_CAPACITY;
+    }
 
-    hashf = get_hashf(hashf_name);
-    if (hashf == NULL)
+    // Leave headroom for estimation error.
+    *estimate = hll_estimate(hll);
+    double size = *estimate * (1.0 + 3.0 * hll_error(hll));
+    hll_free(hll);
+    return hashmap_capacity_for((uint64_t) size);
+}
+
+typedef struct admit_ctx
+{
+    hashmap_map_t* map;
+    bloom_t* bloom;
+    uint64_t rejected; // First sightings, one per distinct word.
+} admit_ctx_t;
+
+static int64_t
+admit_add_word(char* word, uint64_t len, void* ctx)
+{
+    (void) len;
+    admit_ctx_t* a = ctx;
+    hash_t hash = a->map->hashf(word);
+    uint64_t index = 0;
+
+    if (hashmap_lookup_index(a->map, hash, word, &index) == HASHMAP_KEY_FOUND)
     {
-        strcpy(hashf_name, "hash_djb2");
-        hashf = hash_djb2;
+        a->map->buckets[index].value++;
+        return HASHMAP_OK;
     }
 
-    hashmap_map_t* map = hashmap_init(hashf);
-    if (!map)
+    if (!bloom_test_and_add(a->bloom, hash))
     {
-        printf("main(): error initializing map in\n");
-        return EXIT_FAILURE;
+        a->rejected++;
+        return HASHMAP_OK;
     }
 
-    int64_t* value = calloc(1, sizeof(int64_t));
-    if (!value)
+    // Second sighting: count the first one kept out of the map too.
+    return hashmap_increment_knownhash(a->map, word, 2, hash);
+}
+
+static int64_t
+admit_correct_word(char* word, uint64_t len, void* ctx)
+{
+    (void) len;
+    hashmap_map_t* map = ctx;
+    uint64_t index = 0;
+
+    if (hashmap_lookup_index(map, map->hashf(word), word, &index)
+        == HASHMAP_KEY_FOUND)
     {
-        printf("main(): error allocating memory for 'value'\n");
-        goto err;
+        map->buckets[index].value++;
+    }
+    return HASHMAP_OK;
+}
+
+// Count words into map only from their second sighting on, as told
+// by a blocked Bloom filter, which keeps most words occurring once
+// out of the map. Counts of admitted words are exact except for
+// Bloom false positives, which admit a new word with count 2. With
+// opts->admit_exact and a seekable input a second pass recounts the
+// admitted words exactly.
+static int64_t
+count_admit(FILE* f, const options_t* opts, hashmap_map_t* map,
+            uint64_t* wordcount, uint64_t* charcount, uint64_t* rejected)
+{
+    long start = 0;
+    bool seekable = is_seekable(f, &start);
+
+    admit_ctx_t ctx = {.map = map};
+    ctx.bloom = bloom_init(opts->memory, BLOOM_DEFAULT_K);
+    if (!ctx.bloom)
+    {
+        return HASHMAP_ERROR;
+    }
+
+    int64_t status = count_stream_each(f, admit_add_word, &ctx, wordcount,
+                                       charcount);
+    bloom_free(ctx.bloom);
+    *rejected = ctx.rejected;
+    if (status != HASHMAP_OK || !opts->admit_exact)
+    {
+        return status;
+    }
+
+    if (!seekable || fseek(f, start, SEEK_SET) != 0)
+    {
+        printf("main(): input is not seekable, skipping exact pass\n");
+        return status;
+    }
+
+    for (uint64_t i = 0; i < map->capacity; ++i)
+    {
+        map->buckets[i].value = 0;
     }
 
+    uint64_t words = 0;
+    uint64_t chars = 0;
+    return count_stream_each(f, admit_correct_word, map, &words, &chars);
+}
+
+// Count stream exactly into map with the counting method selected by
+// opts. Store first sightings of --admit in rejected.
+static int64_t
+count_input(FILE* f, const options_t* opts, hashmap_map_t* map,
+            uint64_t* wordcount, uint64_t* charcount, uint64_t* rejected)
+{
     int64_t status;
-    while (read_next_word(f1, word_buffer, WORD_SIZE) == 1)
+    if (opts->admit)
     {
-        str_tolower(word_buffer);
-        // printf("%s\n", word_buffer);
-        wordcount++;
-        charcount += strlen(word_buffer);
+        return count_admit(f, opts, map, wordcount, charcount, rejected);
+    }
 
-        status = hashmap_get(map, word_buffer, value);
-        if (status == HASHMAP_KEY_FOUND)
-        {
-            (*value)++;
-            status = hashmap_update(map, word_buffer, *value);
-            if (status != HASHMAP_OK)
-            {
-                printf("main(): hashmap_update(): error: %"PRId64", word: %s\n",
-                       status, word_buffer);
-                goto err;
-            }
-            continue;
-        }
-        else if (status == HASHMAP_ERROR)
-        {
-            printf("main(): hashmap_get(): error: %"PRId64", word: %s\n",
-                   status, word_buffer);
-            goto err;
-        }
+    if (opts->pipeline)
+    {
+        pipeline_config_t config;
+        pipeline_config_default(&config, opts->hashf);
+        config.tokenizers = opts->tokenizers ? opts->tokenizers
+                                             : config.tokenizers;
+        config.counters = opts->counters ? opts->counters : config.counters;
 
-        status = hashmap_add(map, word_buffer, 1);
-        if (status != HASHMAP_OK)
+        status = pipeline_count(f, &config, map, wordcount, charcount);
+        if (status != PIPELINE_OK)
         {
-            printf("main(): hashmap_add(): error: %"PRId64", word: %s\n",
-                   status, word_buffer);
-            goto err;
+            printf("main(): pipeline_count(): error: %"PRId64"\n", status);
+            return HASHMAP_ERROR;
         }
+        return HASHMAP_OK;
     }
 
-    hashmap_bucket_t* results = NULL;
-    status = hashmap_sort_by_value(map, 0, map->capacity - 1, &results);
-    if (status != HASHMAP_OK)
+    return count_stream(f, map, wordcount, charcount);
+}
+
+// Count a single file or stream exactly into the map with one of its
+// own methods: --pipeline, --admit or --presize.
+static int
+main_single(const options_t* opts)
+{
+    FILE* f1 = open_input(opts);
+    if (!f1)
     {
-        printf("main(): hashmap_sort_by_value(): error: %"PRId64"\n",
-               status);
+        return EXIT_FAILURE;
     }
-    else
+
+    uint64_t wordcount = 0;
+    uint64_t charcount = 0;
+
+    double estimate = 0;
+    uint64_t capacity = opts->presize
+                        ? presize_capacity(f1, opts, &estimate)
+                        : HASHMAP_INITIAL_CAPACITY;
+
+    hashmap_map_t* map = hashmap_init_cap(opts->hashf, capacity);
+    if (!map)
     {
-        uint64_t j = 1;
-        puts("100 most common words:");
-        uint64_t limit = (map->capacity >= 100) ? (map->capacity - 100) : (map->capacity - map->size);
-        for (uint64_t i = map->capacity - 1; i >= limit; --i)
-        {
-            printf("%-3lu: %-16s %16lu\n", j++, results[i].key, results[i].value);
-        }
+        printf("main(): error initializing map in\n");
+        fclose(f1);
+        return EXIT_FAILURE;
     }
 
-    TIMER_END();
+    uint64_t rejected = 0;
+    if (count_input(f1, opts, map, &wordcount, &charcount, &rejected)
+        != HASHMAP_OK)
+    {
+        goto err;
+    }
 
-    printf("stats: hashf=%s\n", hashf_name);
-    printf("stats: map_size=%"PRIu64"\n", map->size);
-    printf("stats: collisions=%"PRIu64"\n", map->collisions);
-    printf("stats: word_count=%"PRIu64"\n", wordcount);
-    printf("stats: char_count=%"PRIu64"\n", charcount);
-    printf("stats: rehash_count=%"PRIu64"\n", map->rehashes);
-    printf("stats: capacity=%"PRIu64"\n", map->capacity);
+    output_t* out = output_open(opts->output_path, opts->output_format);
+    if (out)
+    {
+        print_results(out, map, opts->top, opts->all, opts->jobs);
+    }
+    if (!out || output_close(out) != OUTPUT_OK
+        || save_map(opts, map) != HASHMAP_OK)
+    {
+        printf("main(): error writing results\n");
+        hashmap_free(map);
+        fclose(f1);
+        return EXIT_FAILURE;
+    }
 
-    // hashmap_print(map);
+    TIMER_END();
 
-    if (results)
+    print_map_stats(opts, map, wordcount, charcount);
+    if (opts->presize)
+    {
+        printf("stats: distinct_estimate=%f\n", estimate);
+    }
+    if (opts->admit)
     {
-        hashmap_free_buckets(results, map->capacity);
+        // Distinct words never admitted, off by Bloom false positives.
+        uint64_t filtered = (rejected > map->size) ? rejected - map->size : 0;
+        printf("stats: admit_filtered=%"PRIu64"\n", filtered);
     }
+
+    // hashmap_print(map);
+
     hashmap_free(map);
     fclose(f1);
-    free(value);
     return EXIT_SUCCESS;
 
     err:
     hashmap_print(map);
-    free(value);
     hashmap_free(map);
     fclose(f1);
     return EXIT_FAILURE;
 }
+
+// Count many files in one process, see multifile.h.
+// Collect input paths and the paths listed in --files-from.
+static multifile_t*
+collect_files(const options_t* opts)
+{
+    multifile_t* mf = multifile_init();
+    if (!mf)
+    {
+        return NULL;
+    }
+
+    for (int i = 0; i < opts->path_count; ++i)
+    {
+        if (multifile_add_path(mf, opts->paths[i]) != MULTIFILE_OK)
+        {
+            printf("main(): error adding path: %s\n", opts->paths[i]);
+            multifile_free(mf);
+            return NULL;
+        }
+    }
+
+    if (opts->files_from
+        && multifile_add_list(mf, opts->files_from) != MULTIFILE_OK)
+    {
+        printf("main(): error reading file list: %s\n", opts->files_from);
+        multifile_free(mf);
+        return NULL;
+    }
+
+    return mf;
+}
+
+static int
+main_multi(const options_t* opts)
+{
+    multifile_t* mf = collect_files(opts);
+    if (!mf)
+    {
+        return EXIT_FAILURE;
+    }
+
+    mf->doc_freq = opts->corpus;
+    if (opts->cache_dir && !(mf->cache = cache_init(opts->cache_dir)))
+    {
+        printf("main(): error opening cache: %s\n", opts->cache_dir);
+        multifile_free(mf);
+        return EXIT_FAILURE;
+    }
+
+    hashmap_map_t* map = hashmap_init(opts->hashf);
+    if (!map)
+    {
+        printf("main(): error initializing map in\n");
+        cache_free(mf->cache);
+        multifile_free(mf);
+        return EXIT_FAILURE;
+    }
+
+    printf("main(): files to be read: %"PRIu64"\n", mf->count);
+
+    uint64_t wordcount = 0;
+    uint64_t charcount = 0;
+    int64_t status = multifile_count(mf, map, opts->jobs, opts->per_file,
+                                     &wordcount, &charcount);
+
+    output_t* out = output_open(opts->output_path, opts->output_format);
+    if (!out)
+    {
+        hashmap_free(map);
+        cache_free(mf->cache);
+        multifile_free(mf);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t errors = 0;
+    for (uint64_t i = 0; i < mf->count; ++i)
+    {
+        multifile_entry_t* entry = &mf->files[i];
+        if (entry->status != MULTIFILE_OK)
+        {
+            printf("main(): error counting file: %s\n", entry->path);
+            errors++;
+            continue;
+        }
+
+        if (opts->per_file)
+        {
+            char title[WORD_SIZE + strlen(entry->path)];
+            sprintf(title, "file: %s word_count=%"PRIu64" char_count=%"PRIu64" "
+                           "map_size=%"PRIu64"", entry->path, entry->wordcount,
+                    entry->charcount, entry->map->size);
+            output_title(out, title);
+            print_results(out, entry->map, opts->top, opts->all, opts->jobs);
+        }
+    }
+
+    if (opts->corpus)
+    {
+        print_corpus(out, map, mf->count - errors, opts->top, opts->all,
+                     opts->jobs);
+    }
+    else
+    {
+        print_results(out, map, opts->top, opts->all, opts->jobs);
+    }
+    if (output_close(out) != OUTPUT_OK || save_map(opts, map) != HASHMAP_OK)
+    {
+        status = MULTIFILE_ERROR;
+    }
+
+    TIMER_END();
+
+    print_map_stats(opts, map, wordcount, charcount);
+    printf("stats: file_count=%"PRIu64"\n", mf->count);
+    printf("stats: file_errors=%"PRIu64"\n", errors);
+    if (mf->cache)
+    {
+        printf("stats: cache_hits=%"PRIu64"\n",
+               (uint64_t) atomic_load(&mf->cache->hits));
+        printf("stats: cache_misses=%"PRIu64"\n",
+               (uint64_t) atomic_load(&mf->cache->misses));
+    }
+
+    hashmap_free(map);
+    cache_free(mf->cache);
+    multifile_free(mf);
+    return (status == MULTIFILE_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Print postings of queried words, or the documents, of an index.
+static int
+main_index_query(const options_t* opts)
+{
+    index_t* idx = index_open(opts->index_path, false);
+    if (!idx)
+    {
+        printf("main(): error opening index: %s\n", opts->index_path);
+        return EXIT_FAILURE;
+    }
+
+    output_t* out = output_open(opts->output_path, opts->output_format);
+    if (!out)
+    {
+        index_close(idx);
+        return EXIT_FAILURE;
+    }
+
+    const index_header_t* h = idx->header;
+    char word[WORD_SIZE];
+    char title[WORD_SIZE + 64];
+    for (int j = 0; j < opts->query_count; ++j)
+    {
+        snprintf(word, WORD_SIZE, "%s", opts->queries[j]);
+        str_tolower(word);
+        const index_term_t* term = index_find(idx, word);
+        sprintf(title, "%s: df=%u total=%"PRIu64"", word,
+                term ? term->df : 0, term ? term->total : 0);
+        output_title(out, title);
+        if (!term)
+        {
+            continue;
+        }
+
+        index_cursor_t cursor;
+        uint64_t doc = 0;
+        uint64_t count = 0;
+        uint64_t rank = 0;
+        index_cursor_init(idx, term, &cursor);
+        while (index_cursor_next(&cursor, &doc, &count) && doc < h->doc_count
+               && (opts->all || rank < opts->top))
+        {
+            output_entry(out, ++rank, index_doc_path(idx, doc),
+                         (int64_t) count);
+        }
+    }
+
+    if (opts->query_count == 0)
+    {
+        sprintf(title, "%"PRIu64" documents by word count:", h->doc_count);
+        output_title(out, title);
+        for (uint64_t d = 0; d < h->doc_count; ++d)
+        {
+            output_entry(out, d + 1, index_doc_path(idx, d),
+                         (int64_t) idx->docs[d].wordcount);
+        }
+    }
+    int status = (output_close(out) == OUTPUT_OK) ? EXIT_SUCCESS
+                                                  : EXIT_FAILURE;
+
+    TIMER_END();
+
+    printf("stats: file_count=%"PRIu64"\n", h->doc_count);
+    printf("stats: term_count=%"PRIu64"\n", h->term_count);
+    printf("stats: posting_count=%"PRIu64"\n", h->posting_count);
+    printf("stats: word_count=%"PRIu64"\n", h->total);
+    printf("stats: index_bytes=%"PRIu64"\n", h->file_size);
+
+    index_close(idx);
+    return status;
+}
+
+// Build an inverted index of all input files, see index.h. Without
+// input files the index is queried instead.
+static int
+main_index(const options_t* opts)
+{
+    if (opts->path_count == 0 && !opts->files_from)
+    {
+        return main_index_query(opts);
+    }
+
+    multifile_t* mf = collect_files(opts);
+    if (!mf)
+    {
+        return EXIT_FAILURE;
+    }
+
+    printf("main(): files to be indexed: %"PRIu64"\n", mf->count);
+    int64_t status = index_build(mf, opts->hashf, opts->jobs,
+                                 opts->index_path);
+
+    uint64_t errors = 0;
+    uint64_t wordcount = 0;
+    uint64_t charcount = 0;
+    for (uint64_t i = 0; i < mf->count; ++i)
+    {
+        if (mf->files[i].status != MULTIFILE_OK)
+        {
+            printf("main(): error indexing file: %s\n", mf->files[i].path);
+            errors++;
+        }
+        wordcount += mf->files[i].wordcount;
+        charcount += mf->files[i].charcount;
+    }
+
+    TIMER_END();
+
+    printf("stats: hashf=%s\n", opts->hashf_name);
+    printf("stats: word_count=%"PRIu64"\n", wordcount);
+    printf("stats: char_count=%"PRIu64"\n", charcount);
+    printf("stats: file_count=%"PRIu64"\n", mf->count);
+    printf("stats: file_errors=%"PRIu64"\n", errors);
+
+    index_t* idx = index_open(opts->index_path, false);
+    bool opened = idx != NULL;
+    if (opened)
+    {
+        const index_header_t* h = idx->header;
+        printf("stats: term_count=%"PRIu64"\n", h->term_count);
+        printf("stats: posting_count=%"PRIu64"\n", h->posting_count);
+        printf("stats: postings_bytes=%"PRIu64"\n", h->postings_size);
+        printf("stats: index_bytes=%"PRIu64"\n", h->file_size);
+        index_close(idx);
+    }
+
+    multifile_free(mf);
+    return (status == INDEX_OK && opened) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Print the most common words starting with each queried prefix, or
+// the most common words overall, of a prefix index.
+static int
+main_prefix_query(const options_t* opts)
+{
+    prefix_t* p = prefix_open(opts->prefix_path, false);
+    if (!p)
+    {
+        printf("main(): error opening prefix index: %s\n", opts->prefix_path);
+        return EXIT_FAILURE;
+    }
+
+    const prefix_header_t* h = p->header;
+    uint64_t k = (opts->all || opts->top > h->count) ? h->count : opts->top;
+    prefix_word_t* words = malloc((k + 1) * sizeof(prefix_word_t));
+    output_t* out = words ? output_open(opts->output_path, opts->output_format)
+                          : NULL;
+    if (!out)
+    {
+        free(words);
+        prefix_close(p);
+        return EXIT_FAILURE;
+    }
+
+    const char* all_words[] = {""};
+    const char** prefixes = (opts->prefix_count > 0) ? opts->prefixes
+                                                     : all_words;
+    int prefix_count = (opts->prefix_count > 0) ? opts->prefix_count : 1;
+
+    int status = EXIT_SUCCESS;
+    char prefix[WORD_SIZE];
+    char title[WORD_SIZE + 64];
+    struct timespec begin;
+    struct timespec done;
+    timespec_get(&begin, TIME_UTC);
+    for (int j = 0; j < prefix_count && status == EXIT_SUCCESS; ++j)
+    {
+        snprintf(prefix, WORD_SIZE, "%s", prefixes[j]);
+        str_tolower(prefix);
+        int64_t n = prefix_top_k(p, prefix, k, words);
+        if (n < 0)
+        {
+            status = EXIT_FAILURE;
+            break;
+        }
+
+        sprintf(title, "%"PRId64" most common words starting with '%s':", n,
+                prefix);
+        output_title(out, title);
+        for (int64_t i = 0; i < n; ++i)
+        {
+            output_entry(out, (uint64_t) i + 1, words[i].key, words[i].value);
+        }
+    }
+    timespec_get(&done, TIME_UTC);
+    if (output_close(out) != OUTPUT_OK)
+    {
+        status = EXIT_FAILURE;
+    }
+
+    TIMER_END();
+
+    printf("stats: map_size=%"PRIu64"\n", h->count);
+    printf("stats: word_count=%"PRIu64"\n", h->total);
+    printf("stats: prefix_count=%d\n", prefix_count);
+    printf("stats: query_duration=%f\n",
+           (double) (done.tv_sec - begin.tv_sec)
+           + (double) (done.tv_nsec - begin.tv_nsec) / 1000000000L);
+    printf("stats: index_bytes=%"PRIu64"\n", h->file_size);
+
+    free(words);
+    prefix_close(p);
+    return status;
+}
+
+// Server stopped by SIGINT and SIGTERM.
+static server_t* serve_server = NULL;
+
+static void
+serve_signal(int sig)
+{
+    (void) sig;
+    if (serve_server)
+    {
+        server_stop(serve_server);
+    }
+}
+
+// Serve counts over a Unix socket, see server.h.
+static int
+main_serve(const options_t* opts)
+{
+    server_t* server = server_init(opts->serve_path, opts->hashf);
+    if (!server)
+    {
+        return EXIT_FAILURE;
+    }
+
+    serve_server = server;
+    struct sigaction sa = {0};
+    sa.sa_handler = serve_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    printf("main(): serving on: %s\n", opts->serve_path);
+    fflush(stdout);
+    int64_t status = server_run(server);
+    serve_server = NULL;
+
+    uint64_t distinct = 0;
+    for (uint64_t s = 0; s < SERVER_SHARDS; ++s)
+    {
+        distinct += server->shards[s].map->size;
+    }
+
+    TIMER_END();
+    printf("stats: hashf=%s\n", opts->hashf_name);
+    printf("stats: map_size=%"PRIu64"\n", distinct);
+    printf("stats: word_count=%"PRIu64"\n",
+           (uint64_t) atomic_load(&server->wordcount));
+    printf("stats: char_count=%"PRIu64"\n",
+           (uint64_t) atomic_load(&server->charcount));
+    printf("stats: connections=%"PRIu64"\n",
+           (uint64_t) atomic_load(&server->connections));
+    printf("stats: requests=%"PRIu64"\n",
+           (uint64_t) atomic_load(&server->requests));
+
+    server_free(server);
+    return (status == SERVER_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Set by SIGINT and SIGTERM to leave the watch loop.
+static volatile sig_atomic_t watch_stop = 0;
+
+static void
+watch_signal(int sig)
+{
+    (void) sig;
+    watch_stop = 1;
+}
+
+// Print the top words of the aggregate map of a watch. Words whose
+// counts were subtracted to 0 sort last and are left out.
+static int64_t
+watch_print(const options_t* opts, const watch_t* watch)
+{
+    const hashmap_bucket_t** results = calloc(opts->top,
+                                              sizeof(hashmap_bucket_t*));
+    output_t* out = output_open(opts->output_path, opts->output_format);
+    if (!results || !out)
+    {
+        printf("main(): error allocating memory for 'results'\n");
+        free(results);
+        output_close(out);
+        return HASHMAP_ERROR;
+    }
+
+    char title[128];
+    sprintf(title, "watch: files=%"PRIu64" word_count=%"PRIu64" "
+                   "char_count=%"PRIu64"", watch->file_count,
+            watch->wordcount, watch->charcount);
+    output_title(out, title);
+    sprintf(title, "%"PRIu64" most common words:", opts->top);
+    output_title(out, title);
+
+    uint64_t count = hashmap_top_k(watch->aggregate, opts->top, results);
+    for (uint64_t j = 0; j < count && results[j]->value > 0; ++j)
+    {
+        output_entry(out, j + 1, results[j]->key, results[j]->value);
+    }
+
+    free(results);
+    return output_close(out);
+}
+
+// Keep counts of growing files current, see watch.h.
+static int
+main_watch(const options_t* opts)
+{
+    watch_t* watch = watch_init(opts->hashf);
+    if (!watch)
+    {
+        return EXIT_FAILURE;
+    }
+
+    for (int i = 0; i < opts->path_count; ++i)
+    {
+        if (watch_add_path(watch, opts->paths[i]) != WATCH_OK)
+        {
+            printf("main(): error watching path: %s\n", opts->paths[i]);
+            watch_free(watch);
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct sigaction sa = {0};
+    sa.sa_handler = watch_signal;
+    sigemptyset(&sa.sa_mask);
+    // No SA_RESTART, a signal interrupts the wait in watch_poll().
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    int64_t status = watch_print(opts, watch);
+    TIMER_END();
+
+    uint64_t refreshes = 0;
+    while (!watch_stop && status == HASHMAP_OK)
+    {
+        // Wait here so the refresh time covers applying the changes
+        // and printing, not the idle time.
+        struct pollfd pfd = {.fd = watch->fd, .events = POLLIN};
+        if (poll(&pfd, 1, -1) <= 0)
+        {
+            continue;
+        }
+
+        struct timespec begin;
+        struct timespec done;
+        timespec_get(&begin, TIME_UTC);
+        int64_t changed = watch_poll(watch, 0);
+        if (changed < 0)
+        {
+            status = HASHMAP_ERROR;
+            break;
+        }
+        if (changed == 0)
+        {
+            continue;
+        }
+
+        status = watch_print(opts, watch);
+        timespec_get(&done, TIME_UTC);
+        refreshes++;
+        printf("stats: refresh=%"PRIu64" changes=%"PRId64" "
+               "refresh_duration=%f\n", refreshes, changed,
+               (double) (done.tv_sec - begin.tv_sec)
+               + (double) (done.tv_nsec - begin.tv_nsec) / 1000000000L);
+        fflush(stdout);
+    }
+
+    print_map_stats(opts, watch->aggregate, watch->wordcount,
+                    watch->charcount);
+    printf("stats: file_count=%"PRIu64"\n", watch->file_count);
+    printf("stats: appends=%"PRIu64"\n", watch->appends);
+    printf("stats: rewrites=%"PRIu64"\n", watch->rewrites);
+    printf("stats: refreshes=%"PRIu64"\n", refreshes);
+
+    watch_free(watch);
+    return (status == HASHMAP_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int64_t
+ngram_add(char* word, uint64_t len, void* ctx)
+{
+    return ngram_add_word(ctx, word, len);
+}
+
+// Count word n-grams, see ngram.h.
+static int
+main_ngram(const options_t* opts)
+{
+    FILE* f1 = open_input(opts);
+    if (!f1)
+    {
+        return EXIT_FAILURE;
+    }
+
+    ngram_t* ng = ngram_init(opts->hashf, (uint32_t) opts->ngram);
+    if (!ng)
+    {
+        printf("main(): error initializing n-gram counter\n");
+        fclose(f1);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t wordcount = 0;
+    uint64_t charcount = 0;
+    int64_t status = count_stream_each(f1, ngram_add, ng, &wordcount,
+                                       &charcount);
+
+    uint64_t k = opts->all ? ng->size : opts->top;
+    const ngram_entry_t** top = calloc(k ? k : 1, sizeof(ngram_entry_t*));
+    output_t* out = output_open(opts->output_path, opts->output_format);
+    if (!top || !out)
+    {
+        printf("main(): error allocating memory for 'results'\n");
+        free(top);
+        output_close(out);
+        ngram_free(ng);
+        fclose(f1);
+        return EXIT_FAILURE;
+    }
+
+    char title[64];
+    sprintf(title, "%"PRIu64" most common %"PRIu64"-grams:", k, opts->ngram);
+    output_title(out, title);
+
+    char key[NGRAM_KEY_SIZE];
+    uint64_t n = ngram_top_k(ng, k, top);
+    for (uint64_t j = 0; j < n; ++j)
+    {
+        ngram_key(ng, top[j], key);
+        output_entry(out, j + 1, key, (int64_t) top[j]->count);
+    }
+    if (output_close(out) != OUTPUT_OK)
+    {
+        status = NGRAM_ERROR;
+    }
+
+    TIMER_END();
+
+    printf("stats: hashf=%s\n", opts->hashf_name);
+    printf("stats: map_size=%"PRIu64"\n", ng->size);
+    printf("stats: collisions=%"PRIu64"\n", ng->collisions);
+    printf("stats: word_count=%"PRIu64"\n", wordcount);
+    printf("stats: char_count=%"PRIu64"\n", charcount);
+    printf("stats: rehash_count=%"PRIu64"\n", ng->rehashes);
+    printf("stats: capacity=%"PRIu64"\n", ng->capacity);
+    printf("stats: ngram_count=%"PRIu64"\n", ng->total);
+    printf("stats: vocabulary_size=%"PRIu64"\n", ng->words->count);
+
+    free(top);
+    ngram_free(ng);
+    fclose(f1);
+    return (status == NGRAM_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Word ids of the last words and counts of their pairs.
+typedef struct cooccur
+{
+    intern_t* words;
+    u64map_t* pairs;
+    uint32_t window[COOCCUR_MAX_WINDOW]; // Ring of the last ids.
+    uint64_t size; // Window size W.
+    uint64_t seen; // Words so far.
+} cooccur_t;
+
+// Count the pairs of word and each of the previous W words. Pairs are
+// unordered, packed with the smaller id first, and a word is never
+// paired with itself.
+static int64_t
+cooccur_add_word(char* word, uint64_t len, void* ctx)
+{
+    cooccur_t* c = ctx;
+    int64_t id = intern_id(c->words, word, len);
+    if (id < 0)
+    {
+        return INTERN_ERROR;
+    }
+
+    uint64_t n = (c->seen < c->size) ? c->seen : c->size;
+    for (uint64_t j = 1; j <= n; ++j)
+    {
+        uint32_t other = c->window[(c->seen - j) & (COOCCUR_MAX_WINDOW - 1)];
+        if (other == (uint32_t) id)
+        {
+            continue;
+        }
+        uint64_t key = (other < (uint32_t) id)
+                       ? u64map_pair(other, (uint32_t) id)
+                       : u64map_pair((uint32_t) id, other);
+        if (u64map_increment(c->pairs, key, 1) != U64MAP_OK)
+        {
+            return U64MAP_ERROR;
+        }
+    }
+
+    c->window[c->seen++ & (COOCCUR_MAX_WINDOW - 1)] = (uint32_t) id;
+    return 0;
+}
+
+// Count pairs of words within W words of each other.
+static int
+main_cooccur(const options_t* opts)
+{
+    FILE* f1 = open_input(opts);
+    if (!f1)
+    {
+        return EXIT_FAILURE;
+    }
+
+    cooccur_t c = {.size = opts->cooccur};
+    c.words = intern_init(opts->hashf);
+    c.pairs = u64map_init();
+    if (!c.words || !c.pairs)
+    {
+        printf("main(): error initializing co-occurrence counter\n");
+        intern_free(c.words);
+        u64map_free(c.pairs);
+        fclose(f1);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t wordcount = 0;
+    uint64_t charcount = 0;
+    int64_t status = count_stream_each(f1, cooccur_add_word, &c, &wordcount,
+                                       &charcount);
+
+    uint64_t k = opts->all ? c.pairs->size : opts->top;
+    const u64map_entry_t** top = calloc(k ? k : 1, sizeof(u64map_entry_t*));
+    output_t* out = output_open(opts->output_path, opts->output_format);
+    if (!top || !out)
+    {
+        printf("main(): error allocating memory for 'results'\n");
+        free(top);
+        output_close(out);
+        intern_free(c.words);
+        u64map_free(c.pairs);
+        fclose(f1);
+        return EXIT_FAILURE;
+    }
+
+    char title[64];
+    sprintf(title, "%"PRIu64" most common pairs within %"PRIu64" words:", k,
+            opts->cooccur);
+    output_title(out, title);
+
+    char key[2 * WORD_SIZE];
+    uint64_t total = 0;
+    uint64_t n = u64map_top_k(c.pairs, k, top);
+    for (uint64_t j = 0; j < n; ++j)
+    {
+        const char* a = intern_key(c.words, (uint32_t) (top[j]->key >> 32U));
+        const char* b = intern_key(c.words, (uint32_t) top[j]->key);
+        bool swap = strcmp(a, b) > 0;
+        sprintf(key, "%s %s", swap ? b : a, swap ? a : b);
+        output_entry(out, j + 1, key, (int64_t) top[j]->value);
+    }
+    if (output_close(out) != OUTPUT_OK)
+    {
+        status = U64MAP_ERROR;
+    }
+    for (uint64_t i = 0; i < c.pairs->capacity; ++i)
+    {
+        total += c.pairs->entries[i].value;
+    }
+
+    TIMER_END();
+
+    printf("stats: hashf=%s\n", opts->hashf_name);
+    printf("stats: map_size=%"PRIu64"\n", c.pairs->size);
+    printf("stats: collisions=%"PRIu64"\n", c.pairs->collisions);
+    printf("stats: word_count=%"PRIu64"\n", wordcount);
+    printf("stats: char_count=%"PRIu64"\n", charcount);
+    printf("stats: rehash_count=%"PRIu64"\n", c.pairs->rehashes);
+    printf("stats: capacity=%"PRIu64"\n", c.pairs->capacity);
+    printf("stats: pair_count=%"PRIu64"\n", total);
+    printf("stats: vocabulary_size=%"PRIu64"\n", c.words->count);
+
+    free(top);
+    intern_free(c.words);
+    u64map_free(c.pairs);
+    fclose(f1);
+    return (status == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int64_t
+backend_add_word(char* word, uint64_t len, void* ctx)
+{
+    const backend_ctx_t* c = ctx;
+    return c->backend->increment(c->counter, word, len, 1);
+}
+
+static int64_t
+backend_copy_word(const char* key, int64_t value, void* ctx)
+{
+    char word[WORD_SIZE];
+    snprintf(word, WORD_SIZE, "%s", key);
+    return hashmap_increment(ctx, word, value);
+}
+
+// Write counts of a backend other than the map like save_map(), by
+// copying them into a map first.
+static int64_t
+save_backend(const options_t* opts, const backend_ctx_t* c)
+{
+    if (!opts->save_path && !opts->prefix_path)
+    {
+        return BACKEND_OK;
+    }
+
+    hashmap_map_t* map = hashmap_init(opts->hashf);
+    int64_t status = map ? c->backend->each(c->counter, backend_copy_word, map)
+                         : BACKEND_ERROR;
+    if (status == 0)
+    {
+        status = save_map(opts, map);
+    }
+    hashmap_free(map);
+    return (status == 0) ? BACKEND_OK : BACKEND_ERROR;
+}
+
+// Count a single file or stream exactly with the backend selected by
+// --backend, or the default backend, see backend.h. Only the backend
+// operations are used, so any backend is counted and reported the same
+// way.
+static int
+main_backend(const options_t* opts)
+{
+    FILE* f1 = open_input(opts);
+    if (!f1)
+    {
+        return EXIT_FAILURE;
+    }
+
+    backend_ctx_t c = {
+        .backend = opts->backend,
+        .counter = opts->backend->init(opts->hashf),
+    };
+    if (!c.counter)
+    {
+        printf("main(): error initializing backend: %s\n", c.backend->name);
+        fclose(f1);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t wordcount = 0;
+    uint64_t charcount = 0;
+    int64_t status = count_stream_each(f1, backend_add_word, &c, &wordcount,
+                                       &charcount);
+
+    backend_stats_t stats;
+    c.backend->stats(c.counter, &stats);
+    uint64_t k = opts->all ? stats.size : opts->top;
+    backend_word_t* top = calloc(k ? k : 1, sizeof(backend_word_t));
+    output_t* out = output_open(opts->output_path, opts->output_format);
+    if (!top || !out)
+    {
+        printf("main(): error allocating memory for 'results'\n");
+        free(top);
+        output_close(out);
+        c.backend->free(c.counter);
+        fclose(f1);
+        return EXIT_FAILURE;
+    }
+
+    char title[64];
+    if (opts->all)
+    {
+        sprintf(title, "%"PRIu64" words by count:", stats.size);
+    }
+    else
+    {
+        sprintf(title, "%"PRIu64" most common words:", k);
+    }
+    output_title(out, title);
+
+    uint64_t n = c.backend->top_k(c.counter, k, top);
+    for (uint64_t j = 0; j < n; ++j)
+    {
+        output_entry(out, j + 1, top[j].key, top[j].value);
+    }
+    if (output_close(out) != OUTPUT_OK || (n == 0 && k > 0 && stats.size > 0)
+        || save_backend(opts, &c) != BACKEND_OK)
+    {
+        status = BACKEND_ERROR;
+    }
+
+    TIMER_END();
+
+    printf("stats: backend=%s\n", c.backend->name);
+    printf("stats: hashf=%s\n", c.backend->hashes ? opts->hashf_name : "none");
+    printf("stats: map_size=%"PRIu64"\n", stats.size);
+    printf("stats: collisions=%"PRIu64"\n", stats.collisions);
+    printf("stats: word_count=%"PRIu64"\n", wordcount);
+    printf("stats: char_count=%"PRIu64"\n", charcount);
+    printf("stats: rehash_count=%"PRIu64"\n", stats.rehashes);
+    printf("stats: capacity=%"PRIu64"\n", stats.capacity);
+    printf("stats: bytes=%"PRIu64"\n", stats.bytes);
+
+    free(top);
+    c.backend->free(c.counter);
+    fclose(f1);
+    return (status == BACKEND_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int64_t
+approx_add_word(char* word, uint64_t len, void* ctx)
+{
+    (void) len;
+    return spacesaving_add(ctx, word);
+}
+
+// Approximate top-k in fixed memory, see spacesaving.h.
+static int
+main_approx(const options_t* opts)
+{
+    FILE* f1 = open_input(opts);
+    if (!f1)
+    {
+        return EXIT_FAILURE;
+    }
+
+    uint64_t k = opts->approx_topk;
+    uint64_t counters = spacesaving_counters_for_memory(opts->memory);
+    if (counters < k)
+    {
+        printf("main(): memory for %"PRIu64" counters is less than "
+               "top count %"PRIu64"\n", counters, k);
+        fclose(f1);
+        return EXIT_FAILURE;
+    }
+
+    spacesaving_t* ss = spacesaving_init(opts->hashf, counters);
+    const spacesaving_counter_t** top = calloc(k + 1, sizeof(void*));
+    output_t* out = output_open(opts->output_path, opts->output_format);
+    if (!ss || !top || !out)
+    {
+        printf("main(): error initializing approximate top-k\n");
+        spacesaving_free(ss);
+        free(top);
+        output_close(out);
+        fclose(f1);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t wordcount = 0;
+    uint64_t charcount = 0;
+    int64_t status = count_stream_each(f1, approx_add_word, ss,
+                                       &wordcount, &charcount);
+
+    // One extra entry decides whether the last one is guaranteed.
+    uint64_t n = spacesaving_top_k(ss, k + 1, top);
+    uint64_t guaranteed = spacesaving_guaranteed(ss, top, n);
+    n = (n < k) ? n : k;
+    guaranteed = (guaranteed < n) ? guaranteed : n;
+
+    char title[64];
+    sprintf(title, "%"PRIu64" most common words (approximate):", k);
+    output_title(out, title);
+    for (uint64_t j = 0; j < n; ++j)
+    {
+        output_entry(out, j + 1, top[j]->key, (int64_t) top[j]->count);
+    }
+    if (output_close(out) != OUTPUT_OK)
+    {
+        status = SPACESAVING_ERROR;
+    }
+
+    TIMER_END();
+
+    printf("stats: hashf=%s\n", opts->hashf_name);
+    printf("stats: map_size=%"PRIu64"\n", ss->size);
+    printf("stats: collisions=%"PRIu64"\n", ss->collisions);
+    printf("stats: word_count=%"PRIu64"\n", wordcount);
+    printf("stats: char_count=%"PRIu64"\n", charcount);
+    printf("stats: rehash_count=0\n");
+    printf("stats: capacity=%"PRIu64"\n", ss->capacity);
+    printf("stats: error_bound=%"PRIu64"\n", spacesaving_error_bound(ss));
+    printf("stats: guaranteed_top=%"PRIu64"\n", guaranteed);
+
+    spacesaving_free(ss);
+    free(top);
+    fclose(f1);
+    return (status == SPACESAVING_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int64_t
+cms_add_word(char* word, uint64_t len, void* ctx)
+{
+    (void) len;
+    return cms_add(ctx, word);
+}
+
+// Estimate word frequencies in fixed memory, see cms.h.
+static int
+main_cms(const options_t* opts)
+{
+    FILE* f1 = open_input(opts);
+    if (!f1)
+    {
+        return EXIT_FAILURE;
+    }
+
+    cms_t* cms = cms_init_memory(opts->hashf, opts->memory, opts->cms_depth,
+                                 opts->top);
+    const cms_heavy_t** top = calloc(opts->top, sizeof(void*));
+    output_t* out = output_open(opts->output_path, opts->output_format);
+    if (!cms || !top || !out)
+    {
+        printf("main(): error initializing count-min sketch\n");
+        cms_free(cms);
+        free(top);
+        output_close(out);
+        fclose(f1);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t wordcount = 0;
+    uint64_t charcount = 0;
+    int64_t status = count_stream_each(f1, cms_add_word, cms,
+                                       &wordcount, &charcount);
+
+    char title[64];
+    char word[WORD_SIZE];
+    if (opts->query_count > 0)
+    {
+        sprintf(title, "%d queried words (estimate):", opts->query_count);
+        output_title(out, title);
+        for (int j = 0; j < opts->query_count; ++j)
+        {
+            // Queries are normalized like counted words.
+            snprintf(word, WORD_SIZE, "%s", opts->queries[j]);
+            str_tolower(word);
+            output_entry(out, (uint64_t) j + 1, word,
+                         (int64_t) cms_estimate(cms, word));
+        }
+    }
+    else
+    {
+        uint64_t n = cms_heavy_hitters(cms, top);
+        sprintf(title, "%"PRIu64" most common words (estimate):", opts->top);
+        output_title(out, title);
+        for (uint64_t j = 0; j < n; ++j)
+        {
+            output_entry(out, j + 1, top[j]->key, (int64_t) top[j]->estimate);
+        }
+    }
+    if (output_close(out) != OUTPUT_OK)
+    {
+        status = CMS_ERROR;
+    }
+
+    TIMER_END();
+
+    printf("stats: hashf=%s\n", opts->hashf_name);
+    printf("stats: map_size=%"PRIu64"\n", cms->heavy_size);
+    printf("stats: collisions=0\n");
+    printf("stats: word_count=%"PRIu64"\n", wordcount);
+    printf("stats: char_count=%"PRIu64"\n", charcount);
+    printf("stats: rehash_count=0\n");
+    printf("stats: capacity=%"PRIu64"\n", cms->width * cms->depth);
+    printf("stats: cms_width=%"PRIu64"\n", cms->width);
+    printf("stats: cms_depth=%"PRIu64"\n", cms->depth);
+    printf("stats: error_bound=%f\n", cms_error_bound(cms));
+
+    cms_free(cms);
+    free(top);
+    fclose(f1);
+    return (status == CMS_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Only estimate the number of distinct words.
+static int
+main_distinct(const options_t* opts)
+{
+    FILE* f1 = open_input(opts);
+    if (!f1)
+    {
+        return EXIT_FAILURE;
+    }
+
+    hll_t* hll = hll_init(opts->hll_precision);
+    if (!hll)
+    {
+        fclose(f1);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t wordcount = 0;
+    uint64_t charcount = 0;
+    int64_t status = estimate_distinct(f1, opts, hll, &wordcount, &charcount);
+    double estimate = hll_estimate(hll);
+
+    printf("distinct words (estimate): %.0f\n", estimate);
+
+    TIMER_END();
+
+    printf("stats: hashf=%s\n", opts->hashf_name);
+    printf("stats: map_size=%.0f\n", estimate);
+    printf("stats: collisions=0\n");
+    printf("stats: word_count=%"PRIu64"\n", wordcount);
+    printf("stats: char_count=%"PRIu64"\n", charcount);
+    printf("stats: rehash_count=0\n");
+    printf("stats: capacity=%"PRIu64"\n", hll->m);
+    printf("stats: distinct_estimate=%f\n", estimate);
+    printf("stats: distinct_error=%f\n", hll_error(hll));
+    printf("stats: hll_memory=%"PRIu64"\n", hll_memory(hll));
+
+    hll_free(hll);
+    fclose(f1);
+    return (status == HLL_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Estimate top words from random chunks of the input, see sample.h.
+static int
+main_sample(const options_t* opts)
+{
+    FILE* f1 = open_input(opts);
+    if (!f1)
+    {
+        return EXIT_FAILURE;
+    }
+
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+
+    sample_config_t config = {
+        .k = opts->sample,
+        .confidence = opts->confidence,
+        .chunk_size = 0,
+        .seed = (uint64_t) ts.tv_sec * 1000000000LU + (uint64_t) ts.tv_nsec,
+    };
+    sample_result_t result;
+
+    hashmap_map_t* map = hashmap_init(opts->hashf);
+    const hashmap_bucket_t** top = calloc(config.k, sizeof(void*));
+    if (!map || !top)
+    {
+        printf("main(): error initializing sampling\n");
+        hashmap_free(map);
+        free(top);
+        fclose(f1);
+        return EXIT_FAILURE;
+    }
+
+    int64_t status = sample_count(f1, &config, map, &result);
+    output_t* out = (status == SAMPLE_OK)
+                    ? output_open(opts->output_path, opts->output_format)
+                    : NULL;
+    if (!out)
+    {
+        printf("main(): error sampling input\n");
+        hashmap_free(map);
+        free(top);
+        fclose(f1);
+        return EXIT_FAILURE;
+    }
+
+    char title[64];
+    sprintf(title, "%"PRIu64" most common words (sampled):", config.k);
+    output_title(out, title);
+    uint64_t n = hashmap_top_k(map, config.k, top);
+    for (uint64_t j = 0; j < n; ++j)
+    {
+        output_entry(out, j + 1, top[j]->key,
+                     sample_scale(&result, top[j]->value));
+    }
+    if (output_close(out) != OUTPUT_OK)
+    {
+        status = SAMPLE_ERROR;
+    }
+
+    TIMER_END();
+
+    print_map_stats(opts, map, result.wordcount, result.charcount);
+    printf("stats: sampled_fraction=%f\n", result.fraction);
+    printf("stats: sampled_chunks=%"PRIu64"\n", result.chunks_read);
+    printf("stats: total_chunks=%"PRIu64"\n", result.chunks);
+    printf("stats: estimated_error=%f\n", result.error);
+    printf("stats: converged=%d\n", result.converged);
+
+    hashmap_free(map);
+    free(top);
+    fclose(f1);
+    return (status == SAMPLE_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Write the top words of snapshot, or all of them with --all.
+// Return false on a corrupt entry.
+static bool
+print_snapshot(output_t* out, const snapshot_t* snap, const options_t* opts)
+{
+    // Entries are stored in result order.
+    const snapshot_header_t* h = snap->header;
+    uint64_t n = opts->all ? h->count
+                           : (opts->top < h->count) ? opts->top : h->count;
+    char title[64];
+    if (opts->all)
+    {
+        sprintf(title, "%"PRIu64" words by count:", n);
+    }
+    else
+    {
+        sprintf(title, "%"PRIu64" most common words:", opts->top);
+    }
+    output_title(out, title);
+    for (uint64_t j = 0; j < n; ++j)
+    {
+        const snapshot_entry_t* e = &snap->entries[j];
+        const char* key = snapshot_key(snap, e);
+        if (!key)
+        {
+            printf("main(): error: corrupt snapshot entry %"PRIu64"\n", j);
+            return false;
+        }
+        output_entry(out, j + 1, key, e->value);
+    }
+    return true;
+}
+
+// Query a snapshot in place without counting, see snapshot.h.
+static int
+main_load(const options_t* opts)
+{
+    snapshot_t* snap = snapshot_open(opts->load_path, false);
+    if (!snap)
+    {
+        printf("main(): error opening snapshot: %s\n", opts->load_path);
+        return EXIT_FAILURE;
+    }
+
+    output_t* out = output_open(opts->output_path, opts->output_format);
+    if (!out)
+    {
+        snapshot_close(snap);
+        return EXIT_FAILURE;
+    }
+
+    const snapshot_header_t* h = snap->header;
+    char title[64];
+    char word[WORD_SIZE];
+    bool valid = true;
+    if (opts->query_count > 0)
+    {
+        sprintf(title, "%d queried words:", opts->query_count);
+        output_title(out, title);
+        for (int j = 0; j < opts->query_count; ++j)
+        {
+            int64_t value = 0;
+            snprintf(word, WORD_SIZE, "%s", opts->queries[j]);
+            str_tolower(word);
+            if (snapshot_get(snap, word, &value) == SNAPSHOT_ERROR)
+            {
+                valid = false;
+                break;
+            }
+            output_entry(out, (uint64_t) j + 1, word, value);
+        }
+    }
+    else
+    {
+        valid = print_snapshot(out, snap, opts);
+    }
+    int status = (output_close(out) == OUTPUT_OK && valid) ? EXIT_SUCCESS
+                                                           : EXIT_FAILURE;
+
+    TIMER_END();
+
+    printf("stats: hashf=%s\n", h->hashf);
+    printf("stats: map_size=%"PRIu64"\n", h->count);
+    printf("stats: collisions=0\n");
+    printf("stats: word_count=%"PRIu64"\n", h->total);
+    printf("stats: char_count=0\n");
+    printf("stats: rehash_count=0\n");
+    printf("stats: capacity=%"PRIu64"\n", h->index_capacity);
+    printf("stats: snapshot_bytes=%"PRIu64"\n", h->file_size);
+
+    snapshot_close(snap);
+    return status;
+}
+
+// Count new input, merge it with an existing snapshot into a new one
+// and publish that over the old file.
+static int
+main_update(const options_t* opts)
+{
+    snapshot_t* snap = snapshot_open(opts->update_path, true);
+    if (!snap)
+    {
+        printf("main(): error opening snapshot: %s\n", opts->update_path);
+        return EXIT_FAILURE;
+    }
+
+    // New counts must use the hashes stored in the snapshot.
+    options_t update_opts = *opts;
+    update_opts.hashf = snap->hashf;
+    strcpy(update_opts.hashf_name, snap->header->hashf);
+
+    FILE* f1 = open_input(&update_opts);
+    hashmap_map_t* map = hashmap_init(update_opts.hashf);
+    if (!f1 || !map)
+    {
+        printf("main(): error initializing update\n");
+        if (f1)
+        {
+            fclose(f1);
+        }
+        hashmap_free(map);
+        snapshot_close(snap);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t wordcount = 0;
+    uint64_t charcount = 0;
+    uint64_t rejected = 0;
+    int64_t status = count_input(f1, &update_opts, map, &wordcount,
+                                 &charcount, &rejected);
+    if (status == HASHMAP_OK)
+    {
+        status = hashmap_save_merged(map, snap, opts->update_path);
+    }
+    fclose(f1);
+
+    uint64_t old_size = snap->header->count;
+    snapshot_close(snap);
+    if (status != HASHMAP_OK)
+    {
+        printf("main(): error updating snapshot: %s\n", opts->update_path);
+        hashmap_free(map);
+        return EXIT_FAILURE;
+    }
+
+    // Print results from the published snapshot.
+    snap = snapshot_open(opts->update_path, false);
+    output_t* out = snap ? output_open(opts->output_path, opts->output_format)
+                         : NULL;
+    bool valid = out && print_snapshot(out, snap, opts);
+    int result = (out && output_close(out) == OUTPUT_OK && valid)
+                 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    TIMER_END();
+
+    print_map_stats(&update_opts, map, wordcount, charcount);
+    printf("stats: snapshot_size_before=%"PRIu64"\n", old_size);
+    printf("stats: snapshot_size=%"PRIu64"\n",
+           snap ? snap->header->count : 0);
+    printf("stats: snapshot_total=%"PRIu64"\n",
+           snap ? snap->header->total : 0);
+
+    snapshot_close(snap);
+    hashmap_free(map);
+    return result;
+}
+
+// Return the first option that the backend mode would ignore, NULL if
+// none. Only plain single input counting runs on a backend.
+static const char*
+backend_conflict(const options_t* opts)
+{
+    const struct
+    {
+        bool set;
+        const char* name;
+    } conflicts[] = {
+        {opts->pipeline || opts->tokenizers || opts->counters, "--pipeline"},
+        {opts->admit, "--admit"},
+        {opts->presize, "--presize"},
+        {opts->approx_topk > 0, "--approx-topk"},
+        {opts->count_min, "--count-min"},
+        {opts->sample > 0, "--sample"},
+        {opts->distinct_only, "--distinct-only"},
+        {opts->ngram > 0, "--ngram"},
+        {opts->cooccur > 0, "--cooccur"},
+        {opts->query_count > 0, "--query"},
+        {opts->load_path != NULL, "--load"},
+        {opts->update_path != NULL, "--update"},
+        {opts->cache_dir != NULL, "--cache-dir"},
+        {opts->corpus, "--corpus"},
+        {opts->per_file, "--per-file"},
+        {opts->files_from != NULL, "--files-from"},
+        {opts->path_count > 1 || (opts->path_count == 1
+                                  && is_dir(opts->paths[0])),
+         "a directory or multiple files"},
+        {opts->watch, "--watch"},
+        {opts->serve_path != NULL, "--serve"},
+        {opts->index_path != NULL, "--index"},
+        {opts->prefix_count > 0 || (opts->prefix_path
+                                    && opts->path_count == 0),
+         "--prefix"},
+    };
+
+    for (uint64_t i = 0; i < sizeof(conflicts) / sizeof(conflicts[0]); ++i)
+    {
+        if (conflicts[i].set)
+        {
+            return conflicts[i].name;
+        }
+    }
+    return NULL;
+}
+
+int
+main(int argc, char** argv)
+{
+    TIMER_BEGIN();
+
+    char* paths[argc];
+    const char* queries[argc];
+    const char* prefixes[argc];
+    options_t opts = {0};
+    opts.paths = paths;
+    opts.queries = queries;
+    opts.prefixes = prefixes;
+    opts.cms_depth = CMS_DEFAULT_DEPTH;
+    opts.hll_precision = HLL_DEFAULT_PRECISION;
+    opts.confidence = SAMPLE_DEFAULT_CONFIDENCE;
+    opts.top = DEFAULT_TOP;
+    opts.output_format = OUTPUT_TEXT;
+    opts.memory = DEFAULT_MEMORY;
+
+    int opt;
+    const char* short_opt = "f:h:p";
+    struct option long_opt[] =
+        {
+            {"file",        required_argument, NULL, 'f'},
+            {"hashf",       required_argument, NULL, 'h'},
+            {"pipeline",    no_argument,       NULL, 'p'},
+            {"tokenizers",  required_argument, NULL, OPT_TOKENIZERS},
+            {"counters",    required_argument, NULL, OPT_COUNTERS},
+            {"files-from",  required_argument, NULL, OPT_FILES_FROM},
+            {"jobs",        required_argument, NULL, OPT_JOBS},
+            {"per-file",    no_argument,       NULL, OPT_PER_FILE},
+            {"top",         required_argument, NULL, OPT_TOP},
+            {"all",         no_argument,       NULL, OPT_ALL},
+            {"format",      required_argument, NULL, OPT_FORMAT},
+            {"output",      required_argument, NULL, OPT_OUTPUT},
+            {"approx-topk", required_argument, NULL, OPT_APPROX_TOPK},
+            {"memory",      required_argument, NULL, OPT_MEMORY},
+            {"count-min",   no_argument,       NULL, OPT_COUNT_MIN},
+            {"cms-depth",   required_argument, NULL, OPT_CMS_DEPTH},
+            {"query",       required_argument, NULL, OPT_QUERY},
+            {"distinct-only", no_argument,     NULL, OPT_DISTINCT_ONLY},
+            {"presize",     no_argument,       NULL, OPT_PRESIZE},
+            {"hll-precision", required_argument, NULL, OPT_HLL_PRECISION},
+            {"admit",       no_argument,       NULL, OPT_ADMIT},
+            {"admit-exact", no_argument,       NULL, OPT_ADMIT_EXACT},
+            {"sample",      required_argument, NULL, OPT_SAMPLE},
+            {"confidence",  required_argument, NULL, OPT_CONFIDENCE},
+            {"save",        required_argument, NULL, OPT_SAVE},
+            {"load",        required_argument, NULL, OPT_LOAD},
+            {"update",      required_argument, NULL, OPT_UPDATE},
+            {"cache-dir",   required_argument, NULL, OPT_CACHE_DIR},
+            {"watch",       no_argument,       NULL, OPT_WATCH},
+            {"serve",       required_argument, NULL, OPT_SERVE},
+            {"corpus",      no_argument,       NULL, OPT_CORPUS},
+            {"index",       required_argument, NULL, OPT_INDEX},
+            {"ngram",       required_argument, NULL, OPT_NGRAM},
+            {"cooccur",     required_argument, NULL, OPT_COOCCUR},
+            {"packed-keys", no_argument,       NULL, OPT_PACKED_KEYS},
+            {"prefix-index", required_argument, NULL, OPT_PREFIX_INDEX},
+            {"prefix",      required_argument, NULL, OPT_PREFIX},
+            {"backend",     required_argument, NULL, OPT_BACKEND},
+            {NULL, 0,                          NULL, 0}
+        };
+
+    while ((opt = getopt_long(argc, argv, short_opt, long_opt, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case -1:
+            case 0:
+                break;
+            case 'f':
+                opts.paths[opts.path_count++] = optarg;
+                break;
+            case 'h':
+                strcpy(opts.hashf_name, optarg);
+                break;
+            case 'p':
+                opts.pipeline = true;
+                break;
+            case OPT_TOKENIZERS:
+                if ((opts.tokenizers = parse_count(optarg)) == 0)
+                {
+                    printf("main(): invalid tokenizer count: %s\n", optarg);
+                    return -2;
+                }
+                break;
+            case OPT_COUNTERS:
+                if ((opts.counters = parse_count(optarg)) == 0)
+                {
+                    printf("main(): invalid counter count: %s\n", optarg);
+                    return -2;
+                }
+                break;
+            case OPT_FILES_FROM:
+                opts.files_from = optarg;
+                break;
+            case OPT_JOBS:
+                if ((opts.jobs = parse_count(optarg)) == 0)
+                {
+                    printf("main(): invalid job count: %s\n", optarg);
+                    return -2;
+                }
+                break;
+            case OPT_PER_FILE:
+                opts.per_file = true;
+                break;
+            case OPT_TOP:
+                if ((opts.top = parse_count(optarg)) == 0)
+                {
+                    printf("main(): invalid top count: %s\n", optarg);
+                    return -2;
+                }
+                break;
+            case OPT_ALL:
+                opts.all = true;
+                break;
+            case OPT_FORMAT:
+                if (!output_parse_format(optarg, &opts.output_format))
+                {
+                    printf("main(): invalid output format: %s\n", optarg);
+                    return -2;
+                }
+                break;
+            case OPT_OUTPUT:
+                opts.output_path = optarg;
+                break;
+            case OPT_APPROX_TOPK:
+                if ((opts.approx_topk = parse_count(optarg)) == 0)
+                {
+                    printf("main(): invalid top count: %s\n", optarg);
+                    return -2;
+                }
+                break;
+            case OPT_MEMORY:
+                if ((opts.memory = parse_size(optarg)) == 0)
+                {
+                    printf("main(): invalid memory size: %s\n", optarg);
+                    return -2;
+                }
+                break;
+            case OPT_COUNT_MIN:
+                opts.count_min = true;
+                break;
+            case OPT_CMS_DEPTH:
+                opts.cms_depth = parse_count(optarg);
+                if (opts.cms_depth == 0 || opts.cms_depth > CMS_MAX_DEPTH)
+                {
+                    printf("main(): invalid sketch depth: %s\n", optarg);
+                    return -2;
+                }
+                break;
+            case OPT_QUERY:
+                opts.queries[opts.query_count++] = optarg;
+                break;
+            case OPT_DISTINCT_ONLY:
+                opts.distinct_only = true;
+                break;
+            case OPT_PRESIZE:
+                opts.presize = true;
+                break;
+            case OPT_HLL_PRECISION:
+                opts.hll_precision = parse_count(optarg);
+                if (opts.hll_precision < HLL_MIN_PRECISION
+                    || opts.hll_precision > HLL_MAX_PRECISION)
+                {
+                    printf("main(): invalid precision: %s\n", optarg);
+                    return -2;
+                }
+                break;
+            case OPT_ADMIT:
+                opts.admit = true;
+                break;
+            case OPT_ADMIT_EXACT:
+                opts.admit = true;
+                opts.admit_exact = true;
+                break;
+            case OPT_SAMPLE:
+                if ((opts.sample = parse_count(optarg)) == 0)
+                {
+                    printf("main(): invalid top count: %s\n", optarg);
+                    return -2;
+                }
+                break;
+            case OPT_CONFIDENCE:
+                opts.confidence = strtod(optarg, NULL);
+                if (!(opts.confidence > 0.0 && opts.confidence < 1.0))
+                {
+                    printf("main(): invalid confidence: %s\n", optarg);
+                    return -2;
+                }
+                break;
+            case OPT_SAVE:
+                opts.save_path = optarg;
+                break;
+            case OPT_LOAD:
+                opts.load_path = optarg;
+                break;
+            case OPT_UPDATE:
+                opts.update_path = optarg;
+                break;
+            case OPT_CACHE_DIR:
+                opts.cache_dir = optarg;
+                break;
+            case OPT_WATCH:
+                opts.watch = true;
+                break;
+            case OPT_SERVE:
+                opts.serve_path = optarg;
+                break;
+            case OPT_CORPUS:
+                opts.corpus = true;
+                break;
+            case OPT_INDEX:
+                opts.index_path = optarg;
+                break;
+            case OPT_NGRAM:
+                opts.ngram = parse_count(optarg);
+                if (opts.ngram == 0 || opts.ngram > NGRAM_MAX_N)
+                {
+                    printf("main(): invalid n-gram length: %s\n", optarg);
+                    return -2;
+                }
+                break;
+            case OPT_PACKED_KEYS:
+                opts.backend = backend_find("packed");
+                break;
+            case OPT_PREFIX_INDEX:
+                opts.prefix_path = optarg;
+                break;
+            case OPT_PREFIX:
+                opts.prefixes[opts.prefix_count++] = optarg;
+                break;
+            case OPT_BACKEND:
+                opts.backend = backend_find(optarg);
+                if (!opts.backend)
+                {
+                    printf("main(): unknown backend: %s, one of:", optarg);
+                    for (uint64_t i = 0; backend_list[i] != NULL; ++i)
+                    {
+                        printf(" %s", backend_list[i]->name);
+                    }
+                    printf("\n");
+                    return -2;
+                }
+                break;
+            case OPT_COOCCUR:
+                opts.cooccur = parse_count(optarg);
+                if (opts.cooccur == 0 || opts.cooccur > COOCCUR_MAX_WINDOW)
+                {
+                    printf("main(): invalid window: %s\n", optarg);
+                    return -2;
+                }
+                break;
+            case ':':
+            case '?':
+                return -2;
+            default:
+                return -2;
+        }
+    }
+
+    // Remaining arguments are more files, e.g. "-f a.txt b.txt dir/".
+    while (optind < argc)
+    {
+        opts.paths[opts.path_count++] = argv[optind++];
+    }
+
+    opts.hashf = get_hashf(opts.hashf_name);
+    if (opts.hashf == NULL)
+    {
+        strcpy(opts.hashf_name, "hash_djb2");
+        opts.hashf = hash_djb2;
+    }
+
+    opts.jobs = opts.jobs ? opts.jobs : cpu_count();
+
+    const char* conflict = opts.backend ? backend_conflict(&opts) : NULL;
+    if (conflict)
+    {
+        printf("main(): --backend %s can not be combined with %s\n",
+               opts.backend->name, conflict);
+        return -2;
+    }
+
+    if (opts.serve_path)
+    {
+        return main_serve(&opts);
+    }
+
+    if (opts.watch)
+    {
+        return main_watch(&opts);
+    }
+
+    if (opts.index_path)
+    {
+        return main_index(&opts);
+    }
+
+    if (opts.prefix_path && opts.path_count == 0 && !opts.files_from)
+    {
+        return main_prefix_query(&opts);
+    }
+
+    if (opts.update_path)
+    {
+        return main_update(&opts);
+    }
+
+    if (opts.load_path)
+    {
+        return main_load(&opts);
+    }
+
+    if (opts.distinct_only)
+    {
+        return main_distinct(&opts);
+    }
+
+    if (opts.ngram > 0)
+    {
+        return main_ngram(&opts);
+    }
+
+    if (opts.cooccur > 0)
+    {
+        return main_cooccur(&opts);
+    }
+
+    if (opts.approx_topk > 0)
+    {
+        return main_approx(&opts);
+    }
+
+    if (opts.sample > 0)
+    {
+        return main_sample(&opts);
+    }
+
+    if (opts.count_min)
+    {
+        return main_cms(&opts);
+    }
+
+    bool multi = opts.files_from || opts.path_count > 1
+                 || (opts.path_count == 1 && is_dir(opts.paths[0]))
+                 || (opts.path_count == 1 && opts.cache_dir)
+                 || opts.corpus;
+    if (multi)
+    {
+        return main_multi(&opts);
+    }
+
+    if (opts.pipeline || opts.admit || opts.presize)
+    {
+        return main_single(&opts);
+    }
+
+    opts.backend = opts.backend ? opts.backend : backend_list[0];
+    return main_backend(&opts);
+}
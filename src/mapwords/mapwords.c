@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "count.h"
+#include "hash.h"
+#include "hashmap.h"
+#include "mapwords.h"
+#include "util.h"
+
+struct mapwords_ctx
+{
+    hashmap_map_t* map;
+    uint64_t wordcount;
+    uint64_t charcount;
+
+    // Lowercased start of a word cut off by the end of a buffer.
+    char partial[WORD_SIZE];
+    uint64_t partial_len;
+
+    // Scratch for mapwords_top_k().
+    const hashmap_bucket_t** top;
+    uint64_t top_capacity;
+};
+
+mapwords_ctx_t*
+mapwords_ctx_new(const char* hashf_name)
+{
+    hash_t (* hashf)(const char*) = hash_djb2;
+    if (hashf_name && !(hashf = get_hashf(hashf_name)))
+    {
+        fprintf(stderr, "mapwords_ctx_new(): error: unknown hash function: "
+                        "%s\n", hashf_name);
+        return NULL;
+    }
+
+    mapwords_ctx_t* ctx = calloc(1, sizeof(mapwords_ctx_t));
+    if (!ctx)
+    {
+        fprintf(stderr, "mapwords_ctx_new(): error: calloc(): ctx\n");
+        return NULL;
+    }
+
+    ctx->map = hashmap_init(hashf);
+    if (!ctx->map)
+    {
+        free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+void
+mapwords_ctx_free(mapwords_ctx_t* ctx)
+{
+    if (ctx != NULL)
+    {
+        hashmap_free(ctx->map);
+        free(ctx->top);
+        free(ctx);
+    }
+}
+
+static int64_t
+mapwords_count_word(char* word, uint64_t len, void* arg)
+{
+    (void) len;
+    mapwords_ctx_t* ctx = arg;
+    return hashmap_increment(ctx->map, word, 1);
+}
+
+// Count the pending partial word.
+static int64_t
+mapwords_flush_partial(mapwords_ctx_t* ctx)
+{
+    if (ctx->partial_len == 0)
+    {
+        return MAPWORDS_OK;
+    }
+
+    ctx->partial[ctx->partial_len] = '\0';
+    ctx->wordcount++;
+    ctx->charcount += ctx->partial_len;
+    ctx->partial_len = 0;
+    return (hashmap_increment(ctx->map, ctx->partial, 1) == HASHMAP_OK)
+           ? MAPWORDS_OK : MAPWORDS_ERROR;
+}
+
+// Append word characters to the partial word. Words longer than
+// WORD_SIZE - 1 are split, like buffer_next_word() does.
+static int64_t
+mapwords_append_partial(mapwords_ctx_t* ctx, const char* buf, uint64_t len)
+{
+    for (uint64_t i = 0; i < len; ++i)
+    {
+        if (ctx->partial_len == WORD_SIZE - 1
+            && mapwords_flush_partial(ctx) != MAPWORDS_OK)
+        {
+            return MAPWORDS_ERROR;
+        }
+        ctx->partial[ctx->partial_len++] = (char) (buf[i] | 0x20);
+    }
+    return MAPWORDS_OK;
+}
+
+int64_t
+mapwords_feed(mapwords_ctx_t* ctx, const char* buf, uint64_t len)
+{
+    uint64_t pos = 0;
+
+    // Continue the word cut off by the previous buffer.
+    if (ctx->partial_len > 0)
+    {
+        while (pos < len && is_word_char(buf[pos]))
+        {
+            pos++;
+        }
+        if (mapwords_append_partial(ctx, buf, pos) != MAPWORDS_OK)
+        {
+            return MAPWORDS_ERROR;
+        }
+        if (pos == len)
+        {
+            return MAPWORDS_OK;
+        }
+        if (mapwords_flush_partial(ctx) != MAPWORDS_OK)
+        {
+            return MAPWORDS_ERROR;
+        }
+    }
+
+    // Complete words are counted in place, the cut off tail is kept.
+    uint64_t tail = buffer_partial_word_len(buf + pos, len - pos);
+    if (count_buffer_each(buf + pos, len - pos - tail, mapwords_count_word,
+                          ctx, &ctx->wordcount, &ctx->charcount) != 0)
+    {
+        return MAPWORDS_ERROR;
+    }
+
+    return mapwords_append_partial(ctx, buf + len - tail, tail);
+}
+
+int64_t
+mapwords_finish(mapwords_ctx_t* ctx)
+{
+    return mapwords_flush_partial(ctx);
+}
+
+uint64_t
+mapwords_top_k(mapwords_ctx_t* ctx, uint64_t k, mapwords_word_t* out)
+{
+    if (k > ctx->map->size)
+    {
+        k = ctx->map->size;
+    }
+
+    if (k > ctx->top_capacity)
+    {
+        const hashmap_bucket_t** top = realloc(ctx->top,
+                                               k * sizeof(hashmap_bucket_t*));
+        if (!top)
+        {
+            fprintf(stderr, "mapwords_top_k(): error: realloc(): top\n");
+            return 0;
+        }
+        ctx->top = top;
+        ctx->top_capacity = k;
+    }
+
+    uint64_t count = hashmap_top_k(ctx->map, k, ctx->top);
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        out[i].word = ctx->top[i]->key;
+        out[i].count = ctx->top[i]->value;
+    }
+    return count;
+}
+
+int64_t
+mapwords_count(mapwords_ctx_t* ctx, const char* word)
+{
+    uint64_t len = strlen(word);
+    if (len == 0 || len >= WORD_SIZE)
+    {
+        return 0;
+    }
+
+    char key[WORD_SIZE];
+    memcpy(key, word, len + 1);
+    str_tolower(key);
+
+    int64_t value = 0;
+    hashmap_get_shared(ctx->map, key, ctx->map->hashf(key), &value);
+    return value;
+}
+
+uint64_t
+mapwords_word_count(const mapwords_ctx_t* ctx)
+{
+    return ctx->wordcount;
+}
+
+uint64_t
+mapwords_distinct_count(const mapwords_ctx_t* ctx)
+{
+    return ctx->map->size;
+}
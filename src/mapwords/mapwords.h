@@ -0,0 +1,74 @@
+#ifndef MAPWORDS_MAPWORDS_H
+#define MAPWORDS_MAPWORDS_H
+
+#include <inttypes.h>
+
+/*
+Embeddable word counting API of libmapwords.
+
+Text is fed in buffers of any size. Words are counted straight from
+the caller's buffer, which is never copied and may be reused as soon
+as mapwords_feed() returns. A word cut off at the end of a buffer is
+the only thing kept (at most WORD_SIZE bytes, see util.h) and it is
+continued by the next buffer, so feeding a text in pieces counts the
+same words as feeding it at once. mapwords_finish() ends the text and
+counts a word still pending.
+
+Words are [a-zA-Z'] runs, lowercased, as in the mapwords executable.
+
+A context is not thread safe, use one context per thread.
+*/
+
+#if defined(__GNUC__)
+#define MAPWORDS_API __attribute__((visibility("default")))
+#else
+#define MAPWORDS_API
+#endif
+
+#define MAPWORDS_ERROR -1
+#define MAPWORDS_OK 0
+
+typedef struct mapwords_ctx mapwords_ctx_t;
+
+typedef struct mapwords_word
+{
+    const char* word; // Owned by the context, valid until the next feed.
+    int64_t count;
+} mapwords_word_t;
+
+// Create counting context using hash function hashf_name (see
+// hash.h), NULL for the default.
+MAPWORDS_API mapwords_ctx_t*
+mapwords_ctx_new(const char* hashf_name);
+
+// Free context and all counts.
+MAPWORDS_API void
+mapwords_ctx_free(mapwords_ctx_t* ctx);
+
+// Count words in len bytes of buf.
+MAPWORDS_API int64_t
+mapwords_feed(mapwords_ctx_t* ctx, const char* buf, uint64_t len);
+
+// End the text, counting a word pending from the last buffer. Feeding
+// more text afterwards starts a new word.
+MAPWORDS_API int64_t
+mapwords_finish(mapwords_ctx_t* ctx);
+
+// Write up to k most common words to out in descending order of count
+// and ascending order of word. Return number of words written.
+MAPWORDS_API uint64_t
+mapwords_top_k(mapwords_ctx_t* ctx, uint64_t k, mapwords_word_t* out);
+
+// Return count of word (any case), 0 if not seen.
+MAPWORDS_API int64_t
+mapwords_count(mapwords_ctx_t* ctx, const char* word);
+
+// Return total number of words counted.
+MAPWORDS_API uint64_t
+mapwords_word_count(const mapwords_ctx_t* ctx);
+
+// Return number of distinct words counted.
+MAPWORDS_API uint64_t
+mapwords_distinct_count(const mapwords_ctx_t* ctx);
+
+#endif //MAPWORDS_MAPWORDS_H
@@ -0,0 +1,486 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "count.h"
+#include "hash.h"
+#include "hashmap.h"
+#include "hashmap_snapshot.h"
+#include "multifile.h"
+#include "snapshot.h"
+
+#define MULTIFILE_INITIAL_CAPACITY 16U
+
+typedef struct multifile_worker
+{
+    multifile_t* mf;
+    atomic_uint_fast64_t* next;
+    hash_t (* hashf)(const char*);
+    bool keep_maps;
+    hashmap_map_t* map;
+    int64_t status;
+} multifile_worker_t;
+
+multifile_t*
+multifile_init(void)
+{
+    multifile_t* mf = calloc(1, sizeof(multifile_t));
+    if (!mf)
+    {
+        fprintf(stderr, "multifile_init(): error: calloc(): mf\n");
+        return NULL;
+    }
+    return mf;
+}
+
+void
+multifile_free(multifile_t* mf)
+{
+    if (mf == NULL)
+    {
+        return;
+    }
+
+    for (uint64_t i = 0; i < mf->count; ++i)
+    {
+        free(mf->files[i].path);
+        hashmap_free(mf->files[i].map);
+    }
+    free(mf->files);
+    free(mf);
+}
+
+static int64_t
+multifile_append(multifile_t* mf, const char* path)
+{
+    if (mf->count == mf->capacity)
+    {
+        uint64_t new_capacity = mf->capacity ? mf->capacity * 2
+                                             : MULTIFILE_INITIAL_CAPACITY;
+        multifile_entry_t* files = realloc(
+            mf->files, new_capacity * sizeof(multifile_entry_t));
+        if (!files)
+        {
+            fprintf(stderr, "multifile_append(): error: realloc(): files\n");
+            return MULTIFILE_ERROR;
+        }
+        mf->files = files;
+        mf->capacity = new_capacity;
+    }
+
+    multifile_entry_t* entry = &mf->files[mf->count];
+    memset(entry, 0, sizeof(multifile_entry_t));
+    entry->path = strdup(path);
+    if (!entry->path)
+    {
+        fprintf(stderr, "multifile_append(): error: strdup(): path\n");
+        return MULTIFILE_ERROR;
+    }
+
+    mf->count++;
+    return MULTIFILE_OK;
+}
+
+static int
+multifile_name_cmp(const void* a, const void* b)
+{
+    return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+static int64_t
+multifile_add_dir(multifile_t* mf, const char* path)
+{
+    DIR* dir = opendir(path);
+    if (!dir)
+    {
+        fprintf(stderr, "multifile_add_dir(): error: opendir(): %s\n", path);
+        return MULTIFILE_ERROR;
+    }
+
+    // Collect names first for a deterministic order.
+    char** names = NULL;
+    uint64_t count = 0;
+    uint64_t capacity = 0;
+    int64_t status = MULTIFILE_OK;
+    struct dirent* ent;
+
+    while ((ent = readdir(dir)) != NULL)
+    {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+        {
+            continue;
+        }
+
+        if (count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : MULTIFILE_INITIAL_CAPACITY;
+            char** new_names = realloc(names, capacity * sizeof(char*));
+            if (!new_names)
+            {
+                fprintf(stderr, "multifile_add_dir(): error: realloc()\n");
+                status = MULTIFILE_ERROR;
+                break;
+            }
+            names = new_names;
+        }
+
+        names[count] = strdup(ent->d_name);
+        if (!names[count])
+        {
+            status = MULTIFILE_ERROR;
+            break;
+        }
+        count++;
+    }
+    closedir(dir);
+
+    if (status == MULTIFILE_OK)
+    {
+        qsort(names, count, sizeof(char*), multifile_name_cmp);
+    }
+
+    uint64_t path_len = strlen(path);
+    for (uint64_t i = 0; i < count && status == MULTIFILE_OK; ++i)
+    {
+        char* child = malloc(path_len + strlen(names[i]) + 2);
+        if (!child)
+        {
+            status = MULTIFILE_ERROR;
+            break;
+        }
+
+        bool slash = path_len > 0 && path[path_len - 1] == '/';
+        sprintf(child, slash ? "%s%s" : "%s/%s", path, names[i]);
+        status = multifile_add_path(mf, child);
+        free(child);
+    }
+
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        free(names[i]);
+    }
+    free(names);
+    return status;
+}
+
+int64_t
+multifile_add_path(multifile_t* mf, const char* path)
+{
+    struct stat st;
+    if (lstat(path, &st) != 0)
+    {
+        fprintf(stderr, "multifile_add_path(): error: stat(): %s\n", path);
+        return MULTIFILE_ERROR;
+    }
+
+    // Symbolic links to directories are not followed to avoid cycles.
+    if (S_ISDIR(st.st_mode))
+    {
+        return multifile_add_dir(mf, path);
+    }
+
+    if (S_ISLNK(st.st_mode) && (stat(path, &st) != 0 || S_ISDIR(st.st_mode)))
+    {
+        return MULTIFILE_OK;
+    }
+
+    return multifile_append(mf, path);
+}
+
+int64_t
+multifile_add_list(multifile_t* mf, const char* list_path)
+{
+    bool use_stdin = strcmp(list_path, "-") == 0;
+    FILE* f = use_stdin ? stdin : fopen(list_path, "r");
+    if (!f)
+    {
+        fprintf(stderr, "multifile_add_list(): error: fopen(): %s\n",
+                list_path);
+        return MULTIFILE_ERROR;
+    }
+
+    char* line = NULL;
+    size_t line_cap = 0;
+    ssize_t len;
+    int64_t status = MULTIFILE_OK;
+
+    while (status == MULTIFILE_OK && (len = getline(&line, &line_cap, f)) != -1)
+    {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+        {
+            line[--len] = '\0';
+        }
+        if (len == 0)
+        {
+            continue;
+        }
+        status = multifile_add_path(mf, line);
+    }
+
+    free(line);
+    if (!use_stdin)
+    {
+        fclose(f);
+    }
+    return status;
+}
+
+// Document id of file, 0 means no document.
+static inline uint32_t
+multifile_doc_id(const multifile_t* mf, const multifile_entry_t* entry)
+{
+    return (uint32_t) (entry - mf->files) + 1;
+}
+
+typedef struct multifile_doc
+{
+    hashmap_map_t* map;
+    uint32_t doc;
+} multifile_doc_t;
+
+static int64_t
+multifile_count_doc_word(char* word, uint64_t len, void* arg)
+{
+    (void) len;
+    multifile_doc_t* ctx = arg;
+    return hashmap_increment_doc(ctx->map, word, ctx->map->hashf(word),
+                                 ctx->doc);
+}
+
+// Every word of a document map occurs in one document.
+static void
+multifile_set_doc(hashmap_map_t* map, uint32_t doc)
+{
+    for (uint64_t i = 0; i < map->capacity; ++i)
+    {
+        if (map->buckets[i].in_use)
+        {
+            map->buckets[i].df = 1;
+            map->buckets[i].last_doc = doc;
+        }
+    }
+}
+
+// Add counts of a cached file snapshot to the worker map.
+static int64_t
+multifile_add_snapshot(multifile_worker_t* worker, multifile_entry_t* entry,
+                       const snapshot_t* snap)
+{
+    entry->wordcount = snap->header->total;
+    for (uint64_t i = 0; i < snap->header->count; ++i)
+    {
+        entry->charcount += (uint64_t) snap->entries[i].value
+                            * snap->entries[i].key_len;
+    }
+
+    if (!worker->keep_maps && !worker->mf->doc_freq)
+    {
+        return (hashmap_merge_snapshot(worker->map, snap) == HASHMAP_OK)
+               ? MULTIFILE_OK : MULTIFILE_ERROR;
+    }
+
+    // Snapshots have no document frequencies, a map of the file has.
+    entry->map = hashmap_init(worker->hashf);
+    if (!entry->map || hashmap_merge_snapshot(entry->map, snap) != HASHMAP_OK)
+    {
+        return MULTIFILE_ERROR;
+    }
+    if (worker->mf->doc_freq)
+    {
+        multifile_set_doc(entry->map, multifile_doc_id(worker->mf, entry));
+    }
+    if (hashmap_merge(worker->map, entry->map) != HASHMAP_OK)
+    {
+        return MULTIFILE_ERROR;
+    }
+    if (!worker->keep_maps)
+    {
+        hashmap_free(entry->map);
+        entry->map = NULL;
+    }
+    return MULTIFILE_OK;
+}
+
+static int64_t
+multifile_count_file(multifile_worker_t* worker, multifile_entry_t* entry)
+{
+    FILE* f = fopen(entry->path, "r");
+    if (!f)
+    {
+        fprintf(stderr, "multifile_count_file(): error: fopen(): %s\n",
+                entry->path);
+        return MULTIFILE_ERROR;
+    }
+
+    cache_t* cache = worker->mf->cache;
+    cache_key_t key;
+    bool cached = cache && cache_key(fileno(f), worker->hashf, &key) == CACHE_OK;
+    snapshot_t* snap = NULL;
+    if (cached && cache_lookup(cache, &key, &snap) == CACHE_HIT)
+    {
+        fclose(f);
+        int64_t status = multifile_add_snapshot(worker, entry, snap);
+        snapshot_close(snap);
+        return status;
+    }
+
+    // Files to be cached need a map of their own.
+    hashmap_map_t* map = worker->map;
+    if (worker->keep_maps || cached)
+    {
+        entry->map = hashmap_init(worker->hashf);
+        if (!entry->map)
+        {
+            fclose(f);
+            return MULTIFILE_ERROR;
+        }
+        map = entry->map;
+    }
+
+    int64_t status;
+    if (worker->mf->doc_freq)
+    {
+        multifile_doc_t doc = {.map = map,
+                               .doc = multifile_doc_id(worker->mf, entry)};
+        status = count_stream_each(f, multifile_count_doc_word, &doc,
+                                   &entry->wordcount, &entry->charcount);
+    }
+    else
+    {
+        status = count_stream(f, map, &entry->wordcount, &entry->charcount);
+    }
+    if (status == HASHMAP_OK && cached
+        && cache_store(cache, &key, fileno(f), map) != CACHE_OK)
+    {
+        fprintf(stderr, "multifile_count_file(): error: caching %s\n",
+                entry->path);
+    }
+    fclose(f);
+    if (status != HASHMAP_OK)
+    {
+        return MULTIFILE_ERROR;
+    }
+
+    if (map != worker->map && hashmap_merge(worker->map, map) != HASHMAP_OK)
+    {
+        return MULTIFILE_ERROR;
+    }
+
+    if (!worker->keep_maps)
+    {
+        hashmap_free(entry->map);
+        entry->map = NULL;
+    }
+
+    return MULTIFILE_OK;
+}
+
+static void*
+multifile_worker(void* arg)
+{
+    multifile_worker_t* worker = arg;
+    multifile_t* mf = worker->mf;
+
+    uint64_t i;
+    while ((i = atomic_fetch_add(worker->next, 1)) < mf->count)
+    {
+        multifile_entry_t* entry = &mf->files[i];
+        entry->status = multifile_count_file(worker, entry);
+        if (entry->status != MULTIFILE_OK)
+        {
+            worker->status = MULTIFILE_ERROR;
+        }
+    }
+
+    return NULL;
+}
+
+int64_t
+multifile_count(multifile_t* mf, hashmap_map_t* aggregate, uint64_t jobs,
+                bool keep_maps, uint64_t* wordcount, uint64_t* charcount)
+{
+    if (jobs == 0)
+    {
+        jobs = 1;
+    }
+    if (jobs > mf->count)
+    {
+        jobs = mf->count ? mf->count : 1;
+    }
+
+    atomic_uint_fast64_t next;
+    atomic_init(&next, 0);
+
+    pthread_t threads[jobs];
+    multifile_worker_t workers[jobs];
+    int64_t status = MULTIFILE_OK;
+
+    for (uint64_t j = 0; j < jobs; ++j)
+    {
+        workers[j].mf = mf;
+        workers[j].next = &next;
+        workers[j].hashf = aggregate->hashf;
+        workers[j].keep_maps = keep_maps;
+        workers[j].status = MULTIFILE_OK;
+        workers[j].map = hashmap_init(aggregate->hashf);
+        if (!workers[j].map)
+        {
+            jobs = j;
+            status = MULTIFILE_ERROR;
+            break;
+        }
+    }
+
+    uint64_t started = 0;
+    for (; started < jobs && status == MULTIFILE_OK; ++started)
+    {
+        if (pthread_create(&threads[started], NULL, multifile_worker,
+                           &workers[started]) != 0)
+        {
+            fprintf(stderr, "multifile_count(): error: pthread_create()\n");
+            status = MULTIFILE_ERROR;
+            break;
+        }
+    }
+
+    // Workers that did start drain the whole file list.
+    for (uint64_t j = 0; j < started; ++j)
+    {
+        pthread_join(threads[j], NULL);
+    }
+
+    if (started > 0)
+    {
+        status = MULTIFILE_OK;
+    }
+
+    // Workers mostly count the same words, so the aggregate is not
+    // reserved for the sum of their sizes; hashmap_merge() grows it.
+    for (uint64_t j = 0; j < jobs; ++j)
+    {
+        if (started > 0)
+        {
+            if (workers[j].status != MULTIFILE_OK
+                || hashmap_merge(aggregate, workers[j].map) != HASHMAP_OK)
+            {
+                status = MULTIFILE_ERROR;
+            }
+            aggregate->collisions += workers[j].map->collisions;
+            aggregate->rehashes += workers[j].map->rehashes;
+        }
+        hashmap_free(workers[j].map);
+    }
+
+    for (uint64_t i = 0; i < mf->count; ++i)
+    {
+        *wordcount += mf->files[i].wordcount;
+        *charcount += mf->files[i].charcount;
+    }
+
+    return status;
+}
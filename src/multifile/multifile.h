@@ -0,0 +1,82 @@
+#ifndef MAPWORDS_MULTIFILE_H
+#define MAPWORDS_MULTIFILE_H
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "cache.h"
+#include "hash.h"
+#include "hashmap.h"
+
+/*
+Batch counting of many files in a single process.
+
+Input paths may be regular files or directories, which are walked
+recursively in name order. Files are distributed dynamically to
+worker threads. Each worker counts into its own long-lived map,
+so map growth and rehashing is paid once per worker instead of
+once per file. Worker maps are merged into the aggregate map with
+stored hashes at the end.
+
+If per-file results are requested, each file is counted into its
+own map, which is kept in the file entry and merged into the
+worker map after the file is done.
+
+With a cache (see cache.h) set in the file list, unchanged files are
+merged from their cached snapshots instead of being tokenized, and
+files that miss are counted into their own map and stored.
+
+With doc_freq set, every file is a document and maps also count the
+number of documents containing each word (hashmap_bucket_t.df). A
+word is counted once per document by remembering the last document
+(file index + 1) in its bucket, so documents need no maps of their
+own. Files of one worker are counted one after another and each file
+is counted by one worker only, so merging sums document frequencies.
+*/
+
+#define MULTIFILE_ERROR -1
+#define MULTIFILE_OK 0
+
+typedef struct multifile_entry
+{
+    char* path;
+    int64_t status;
+    uint64_t wordcount;
+    uint64_t charcount;
+    hashmap_map_t* map; // Per-file counts, only if kept.
+} multifile_entry_t;
+
+typedef struct multifile
+{
+    multifile_entry_t* files;
+    uint64_t count;
+    uint64_t capacity;
+    cache_t* cache; // Optional, not owned.
+    bool doc_freq; // Count document frequencies.
+} multifile_t;
+
+// Allocate empty file list.
+multifile_t*
+multifile_init(void);
+
+// Free file list and all per-file maps.
+void
+multifile_free(multifile_t* mf);
+
+// Add file or all files in directory tree to list.
+int64_t
+multifile_add_path(multifile_t* mf, const char* path);
+
+// Add paths listed one per line in list file ("-" for stdin).
+int64_t
+multifile_add_list(multifile_t* mf, const char* list_path);
+
+// Count all files in list into aggregate map using jobs threads.
+// Per-file maps are kept in file entries if keep_maps is set.
+// Return MULTIFILE_ERROR if any file failed. Failed files are
+// reported and skipped, their status is set in the file entry.
+int64_t
+multifile_count(multifile_t* mf, hashmap_map_t* aggregate, uint64_t jobs,
+                bool keep_maps, uint64_t* wordcount, uint64_t* charcount);
+
+#endif //MAPWORDS_MULTIFILE_H
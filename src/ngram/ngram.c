@@ -0,0 +1,278 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "hash.h"
+#include "hashmap.h"
+#include "intern.h"
+#include "ngram.h"
+#include "topk.h"
+
+// Odd multiplier of the rolling hash.
+#define NGRAM_BASE 0x100000001B3LU
+
+ngram_t*
+ngram_init(hash_t (* hashf)(const char*), uint32_t n)
+{
+    if (n == 0 || n > NGRAM_MAX_N)
+    {
+        fprintf(stderr, "ngram_init(): error: invalid n: %u\n", n);
+        return NULL;
+    }
+
+    ngram_t* ng = calloc(1, sizeof(ngram_t));
+    if (!ng)
+    {
+        fprintf(stderr, "ngram_init(): error: calloc(): ng\n");
+        return NULL;
+    }
+
+    ng->n = n;
+    ng->capacity = NGRAM_INITIAL_CAPACITY;
+    ng->entries = calloc(ng->capacity, sizeof(ngram_entry_t));
+    ng->words = intern_init(hashf);
+    if (!ng->entries || !ng->words)
+    {
+        fprintf(stderr, "ngram_init(): error: calloc(): entries\n");
+        ngram_free(ng);
+        return NULL;
+    }
+
+    ng->power = 1;
+    for (uint32_t i = 1; i < n; ++i)
+    {
+        ng->power *= NGRAM_BASE;
+    }
+    return ng;
+}
+
+void
+ngram_free(ngram_t* ng)
+{
+    if (ng != NULL)
+    {
+        intern_free(ng->words);
+        free(ng->entries);
+        free(ng->ids);
+        free(ng);
+    }
+}
+
+void
+ngram_reset(ngram_t* ng)
+{
+    ng->filled = 0;
+    ng->rolling = 0;
+}
+
+// Find entry of n-gram ids with hash, or the empty entry where it
+// belongs. Return true if found.
+static inline bool
+ngram_lookup(const ngram_t* ng, hash_t hash, const uint32_t* ids,
+             uint64_t* out, uint64_t* collisions)
+{
+    uint64_t mask = ng->capacity - 1;
+    uint64_t i = hash & mask;
+    while (true)
+    {
+        const ngram_entry_t* e = &ng->entries[i];
+        if (e->count == 0)
+        {
+            *out = i;
+            return false;
+        }
+        if (e->hash == hash
+            && memcmp(&ng->ids[e->ids], ids, ng->n * sizeof(uint32_t)) == 0)
+        {
+            *out = i;
+            return true;
+        }
+        (*collisions)++;
+        i = (i + 1) & mask;
+    }
+}
+
+static int64_t
+ngram_rehash(ngram_t* ng)
+{
+    uint64_t capacity = ng->capacity * 2;
+    ngram_entry_t* entries = calloc(capacity, sizeof(ngram_entry_t));
+    if (!entries)
+    {
+        fprintf(stderr, "ngram_rehash(): error: calloc(): entries\n");
+        return NGRAM_ERROR;
+    }
+
+    // Stored n-grams are distinct, only an empty entry is searched.
+    for (uint64_t i = 0; i < ng->capacity; ++i)
+    {
+        const ngram_entry_t* e = &ng->entries[i];
+        if (e->count > 0)
+        {
+            uint64_t j = e->hash & (capacity - 1);
+            while (entries[j].count != 0)
+            {
+                j = (j + 1) & (capacity - 1);
+            }
+            entries[j] = *e;
+        }
+    }
+
+    free(ng->entries);
+    ng->entries = entries;
+    ng->capacity = capacity;
+    ng->rehashes++;
+    return NGRAM_OK;
+}
+
+// Add 1 to the count of the n-gram in the window.
+static int64_t
+ngram_count_window(ngram_t* ng)
+{
+    if (2 * (ng->size + 1) > ng->capacity && ngram_rehash(ng) != NGRAM_OK)
+    {
+        return NGRAM_ERROR;
+    }
+
+    uint64_t i = 0;
+    if (ngram_lookup(ng, ng->rolling, ng->window, &i, &ng->collisions))
+    {
+        ng->entries[i].count++;
+        ng->total++;
+        return NGRAM_OK;
+    }
+
+    if (ng->ids_size + ng->n > ng->ids_capacity)
+    {
+        uint64_t capacity = ng->ids_capacity ? ng->ids_capacity * 2
+                                             : NGRAM_INITIAL_CAPACITY * ng->n;
+        uint32_t* ids = realloc(ng->ids, capacity * sizeof(uint32_t));
+        if (!ids)
+        {
+            fprintf(stderr, "ngram_count_window(): error: realloc(): ids\n");
+            return NGRAM_ERROR;
+        }
+        ng->ids = ids;
+        ng->ids_capacity = capacity;
+    }
+
+    memcpy(&ng->ids[ng->ids_size], ng->window, ng->n * sizeof(uint32_t));
+    ng->entries[i] = (ngram_entry_t) {ng->rolling, 1, ng->ids_size};
+    ng->ids_size += ng->n;
+    ng->size++;
+    ng->total++;
+    return NGRAM_OK;
+}
+
+int64_t
+ngram_add_word(ngram_t* ng, char* word, uint64_t len)
+{
+    int64_t id = intern_id(ng->words, word, len);
+    if (id < 0)
+    {
+        return NGRAM_ERROR;
+    }
+
+    // Slide the oldest word out of a full window.
+    if (ng->filled == ng->n)
+    {
+        ng->rolling -= intern_hash(ng->words, ng->window[0]) * ng->power;
+        memmove(ng->window, ng->window + 1, (ng->n - 1) * sizeof(uint32_t));
+        ng->filled--;
+    }
+
+    ng->rolling = ng->rolling * NGRAM_BASE + intern_hash(ng->words,
+                                                         (uint32_t) id);
+    ng->window[ng->filled++] = (uint32_t) id;
+    return (ng->filled == ng->n) ? ngram_count_window(ng) : NGRAM_OK;
+}
+
+uint64_t
+ngram_get(ngram_t* ng, const char* const* words)
+{
+    uint32_t ids[NGRAM_MAX_N];
+    hash_t hash = 0;
+    for (uint32_t i = 0; i < ng->n; ++i)
+    {
+        const hashmap_map_t* map = ng->words->map;
+        int64_t id = 0;
+        if (hashmap_get_shared(map, words[i], map->hashf(words[i]), &id)
+            != HASHMAP_KEY_FOUND)
+        {
+            return 0;
+        }
+        ids[i] = (uint32_t) id;
+        hash = hash * NGRAM_BASE + intern_hash(ng->words, ids[i]);
+    }
+
+    uint64_t i = 0;
+    uint64_t collisions = 0;
+    return ngram_lookup(ng, hash, ids, &i, &collisions)
+           ? ng->entries[i].count : 0;
+}
+
+// Compare n-grams by their words, which orders them like their
+// joined strings since words never contain the separator.
+static inline int
+ngram_compare_keys(const ngram_t* ng, const ngram_entry_t* a,
+                   const ngram_entry_t* b)
+{
+    for (uint32_t i = 0; i < ng->n; ++i)
+    {
+        uint32_t x = ng->ids[a->ids + i];
+        uint32_t y = ng->ids[b->ids + i];
+        if (x != y)
+        {
+            return strcmp(intern_key(ng->words, x), intern_key(ng->words, y));
+        }
+    }
+    return 0;
+}
+
+// Check if entry a ranks below entry b in top-k order.
+static bool
+ngram_ranks_below(const void* a, const void* b, const void* ctx)
+{
+    const ngram_entry_t* x = a;
+    const ngram_entry_t* y = b;
+    if (x->count != y->count)
+    {
+        return x->count < y->count;
+    }
+    return ngram_compare_keys(ctx, x, y) > 0;
+}
+
+uint64_t
+ngram_top_k(const ngram_t* ng, uint64_t k, const ngram_entry_t** out)
+{
+    topk_t top;
+    topk_init(&top, (const void**) out, k, ngram_ranks_below, ng);
+    for (uint64_t i = 0; i < ng->capacity; ++i)
+    {
+        if (ng->entries[i].count > 0)
+        {
+            topk_push(&top, &ng->entries[i]);
+        }
+    }
+    return topk_sort(&top);
+}
+
+uint64_t
+ngram_key(const ngram_t* ng, const ngram_entry_t* entry, char* out)
+{
+    uint64_t len = 0;
+    for (uint32_t i = 0; i < ng->n; ++i)
+    {
+        const char* word = intern_key(ng->words, ng->ids[entry->ids + i]);
+        uint64_t word_len = strlen(word);
+        if (i > 0)
+        {
+            out[len++] = ' ';
+        }
+        memcpy(out + len, word, word_len);
+        len += word_len;
+    }
+    out[len] = '\0';
+    return len;
+}
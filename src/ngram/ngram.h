@@ -0,0 +1,106 @@
+#ifndef MAPWORDS_NGRAM_H
+#define MAPWORDS_NGRAM_H
+
+#include <inttypes.h>
+
+#include "hash.h"
+#include "intern.h"
+#include "util.h"
+
+/*
+Word n-gram counting over interned word ids.
+
+Words are interned (see intern.h) and the ids of the last n words are
+kept in a window. The hash of the n-gram in the window is a rolling
+polynomial hash of the mixed word hashes h1 (oldest) ... hn:
+
+  H = h1 * B^(n-1) + h2 * B^(n-2) + ... + hn  (mod 2^64)
+
+which is updated in O(1) per word by removing the term of the word
+leaving the window and adding the word entering it. No string is
+built for an n-gram while counting.
+
+N-grams are counted in an open addressing table of entries holding
+the n-gram hash, its count and the position of its n ids in an
+append-only id array. Entries are probed linearly from the hash and
+a hit is checked by the stored hash, then by comparing n ids, never
+strings. The table doubles when over half full and stored hashes
+are reused.
+
+Strings of n-grams are only built for printing, by joining the words
+of their ids with spaces.
+*/
+
+#define NGRAM_ERROR -1
+#define NGRAM_OK 0
+
+#define NGRAM_MAX_N 8U
+#define NGRAM_INITIAL_CAPACITY 1024U
+
+// Longest n-gram string, n words joined with spaces.
+#define NGRAM_KEY_SIZE (NGRAM_MAX_N * WORD_SIZE)
+
+typedef struct ngram_entry
+{
+    hash_t hash;
+    uint64_t count; // 0 if empty.
+    uint64_t ids; // Offset of the n-gram's ids in ngram_t.ids.
+} ngram_entry_t;
+
+typedef struct ngram
+{
+    uint32_t n;
+    intern_t* words;
+
+    ngram_entry_t* entries;
+    uint64_t capacity;
+    uint64_t size;
+    uint64_t collisions;
+    uint64_t rehashes;
+
+    uint32_t* ids;
+    uint64_t ids_size;
+    uint64_t ids_capacity;
+
+    // Ids and rolling hash of the last n words.
+    uint32_t window[NGRAM_MAX_N];
+    uint32_t filled;
+    hash_t rolling;
+    hash_t power; // B^(n-1), to remove the oldest word.
+
+    uint64_t total; // N-grams counted.
+} ngram_t;
+
+// Allocate counter of n-grams (1 <= n <= NGRAM_MAX_N) using hashf
+// for words.
+ngram_t*
+ngram_init(hash_t (* hashf)(const char*), uint32_t n);
+
+// Free counter.
+void
+ngram_free(ngram_t* ng);
+
+// Add null-terminated word of len bytes and count the n-gram it ends.
+int64_t
+ngram_add_word(ngram_t* ng, char* word, uint64_t len);
+
+// Start a new text: n-grams never span the previous and next words.
+void
+ngram_reset(ngram_t* ng);
+
+// Get count of n-gram given as n words, 0 if not seen.
+uint64_t
+ngram_get(ngram_t* ng, const char* const* words);
+
+// Select k n-grams with the largest counts in descending order.
+// Ties are broken by the joined string in ascending order. 'out'
+// must have room for k pointers. Return number of entries written.
+uint64_t
+ngram_top_k(const ngram_t* ng, uint64_t k, const ngram_entry_t** out);
+
+// Write the words of entry joined with spaces into out, which must
+// have room for NGRAM_KEY_SIZE bytes. Return length.
+uint64_t
+ngram_key(const ngram_t* ng, const ngram_entry_t* entry, char* out);
+
+#endif //MAPWORDS_NGRAM_H
@@ -0,0 +1,424 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "output.h"
+
+// Room reserved for everything but the key in a single entry.
+#define OUTPUT_ENTRY_OVERHEAD 64U
+
+static const char DIGIT_PAIRS[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+bool
+output_parse_format(const char* name, output_format_t* out)
+{
+    if (strcmp(name, "text") == 0)
+    {
+        *out = OUTPUT_TEXT;
+    }
+    else if (strcmp(name, "tsv") == 0)
+    {
+        *out = OUTPUT_TSV;
+    }
+    else if (strcmp(name, "csv") == 0)
+    {
+        *out = OUTPUT_CSV;
+    }
+    else if (strcmp(name, "binary") == 0)
+    {
+        *out = OUTPUT_BINARY;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+output_t*
+output_open(const char* path, output_format_t format)
+{
+    output_t* out = calloc(1, sizeof(output_t));
+    if (!out)
+    {
+        fprintf(stderr, "output_open(): error: calloc(): out\n");
+        return NULL;
+    }
+
+    out->size = OUTPUT_BUFFER_SIZE;
+    out->buf = malloc(out->size);
+    if (!out->buf)
+    {
+        fprintf(stderr, "output_open(): error: malloc(): buf\n");
+        free(out);
+        return NULL;
+    }
+
+    if (!path || strcmp(path, "-") == 0)
+    {
+        out->f = stdout;
+    }
+    else
+    {
+        out->f = fopen(path, "wb");
+        out->close_f = true;
+        if (!out->f)
+        {
+            fprintf(stderr, "output_open(): error: fopen(): %s\n", path);
+            free(out->buf);
+            free(out);
+            return NULL;
+        }
+    }
+
+    out->format = format;
+    out->status = OUTPUT_OK;
+    return out;
+}
+
+uint64_t
+output_format_u64(char* buf, uint64_t value)
+{
+    char temp[20];
+    char* p = temp + sizeof(temp);
+
+    while (value >= 100)
+    {
+        uint64_t pair = (value % 100) * 2;
+        value /= 100;
+        p -= 2;
+        p[0] = DIGIT_PAIRS[pair];
+        p[1] = DIGIT_PAIRS[pair + 1];
+    }
+    if (value >= 10)
+    {
+        p -= 2;
+        p[0] = DIGIT_PAIRS[value * 2];
+        p[1] = DIGIT_PAIRS[value * 2 + 1];
+    }
+    else
+    {
+        *--p = (char) ('0' + value);
+    }
+
+    uint64_t len = (uint64_t) (temp + sizeof(temp) - p);
+    memcpy(buf, p, len);
+    return len;
+}
+
+static uint64_t
+output_format_i64(char* buf, int64_t value)
+{
+    if (value < 0)
+    {
+        *buf = '-';
+        return 1 + output_format_u64(buf + 1, -(uint64_t) value);
+    }
+    return output_format_u64(buf, (uint64_t) value);
+}
+
+static inline char*
+output_pad(char* p, uint64_t n)
+{
+    memset(p, ' ', n);
+    return p + n;
+}
+
+static inline char*
+output_le(char* p, uint64_t value, uint64_t bytes)
+{
+    for (uint64_t i = 0; i < bytes; ++i)
+    {
+        *p++ = (char) (value >> (8 * i));
+    }
+    return p;
+}
+
+int64_t
+output_flush(output_t* out)
+{
+    if (out->used > 0 && out->status == OUTPUT_OK)
+    {
+        if (fwrite(out->buf, 1, out->used, out->f) != out->used)
+        {
+            fprintf(stderr, "output_flush(): error: fwrite()\n");
+            out->status = OUTPUT_ERROR;
+        }
+    }
+    out->used = 0;
+    return out->status;
+}
+
+// Make room for n bytes in buffer. Larger writes grow the buffer.
+static int64_t
+output_reserve(output_t* out, uint64_t n)
+{
+    if (out->used + n <= out->size)
+    {
+        return OUTPUT_OK;
+    }
+
+    if (output_flush(out) != OUTPUT_OK)
+    {
+        return out->status;
+    }
+
+    if (n > out->size)
+    {
+        char* buf = realloc(out->buf, n);
+        if (!buf)
+        {
+            fprintf(stderr, "output_reserve(): error: realloc(): buf\n");
+            out->status = OUTPUT_ERROR;
+            return out->status;
+        }
+        out->buf = buf;
+        out->size = n;
+    }
+
+    return OUTPUT_OK;
+}
+
+// Write header on first use, depends on format and entry kind.
+static int64_t
+output_header(output_t* out, bool corpus)
+{
+    out->header_written = true;
+
+    const char* header = NULL;
+    switch (out->format)
+    {
+        case OUTPUT_TSV:
+            header = corpus ? "rank\tword\tcount\tdf\tidf\n"
+                            : "rank\tword\tcount\n";
+            break;
+        case OUTPUT_CSV:
+            header = corpus ? "rank,word,count,df,idf\n"
+                            : "rank,word,count\n";
+            break;
+        case OUTPUT_BINARY:
+            header = corpus ? OUTPUT_CORPUS_MAGIC : OUTPUT_BINARY_MAGIC;
+            break;
+        case OUTPUT_TEXT:
+        default:
+            return OUTPUT_OK;
+    }
+
+    uint64_t len = strlen(header);
+    if (output_reserve(out, len) != OUTPUT_OK)
+    {
+        return out->status;
+    }
+    memcpy(out->buf + out->used, header, len);
+    out->used += len;
+    return OUTPUT_OK;
+}
+
+int64_t
+output_title(output_t* out, const char* title)
+{
+    if (out->format != OUTPUT_TEXT)
+    {
+        return out->status;
+    }
+
+    uint64_t len = strlen(title);
+    if (output_reserve(out, len + 1) != OUTPUT_OK)
+    {
+        return out->status;
+    }
+    memcpy(out->buf + out->used, title, len);
+    out->buf[out->used + len] = '\n';
+    out->used += len + 1;
+    return OUTPUT_OK;
+}
+
+// Append key as CSV field, quoted if it contains special characters.
+static char*
+output_csv_field(char* p, const char* key, uint64_t len)
+{
+    if (strcspn(key, "\",\r\n") == len)
+    {
+        memcpy(p, key, len);
+        return p + len;
+    }
+
+    *p++ = '"';
+    for (uint64_t i = 0; i < len; ++i)
+    {
+        if (key[i] == '"')
+        {
+            *p++ = '"';
+        }
+        *p++ = key[i];
+    }
+    *p++ = '"';
+    return p;
+}
+
+int64_t
+output_entry(output_t* out, uint64_t rank, const char* key, int64_t value)
+{
+    if (!out->header_written && output_header(out, false) != OUTPUT_OK)
+    {
+        return out->status;
+    }
+
+    uint64_t key_len = strlen(key);
+
+    // CSV quoting may double every character.
+    if (output_reserve(out, 2 * key_len + OUTPUT_ENTRY_OVERHEAD) != OUTPUT_OK)
+    {
+        return out->status;
+    }
+
+    char* start = out->buf + out->used;
+    char* p = start;
+    uint64_t n;
+
+    switch (out->format)
+    {
+        case OUTPUT_TEXT:
+            // "%-3lu: %-16s %16lu\n"
+            n = output_format_u64(p, rank);
+            p = output_pad(p + n, (n < 3) ? 3 - n : 0);
+            *p++ = ':';
+            *p++ = ' ';
+            memcpy(p, key, key_len);
+            p = output_pad(p + key_len, (key_len < 16) ? 16 - key_len : 0);
+            *p++ = ' ';
+            {
+                char digits[21];
+                n = output_format_i64(digits, value);
+                p = output_pad(p, (n < 16) ? 16 - n : 0);
+                memcpy(p, digits, n);
+                p += n;
+            }
+            *p++ = '\n';
+            break;
+        case OUTPUT_TSV:
+            p += output_format_u64(p, rank);
+            *p++ = '\t';
+            memcpy(p, key, key_len);
+            p += key_len;
+            *p++ = '\t';
+            p += output_format_i64(p, value);
+            *p++ = '\n';
+            break;
+        case OUTPUT_CSV:
+            p += output_format_u64(p, rank);
+            *p++ = ',';
+            p = output_csv_field(p, key, key_len);
+            *p++ = ',';
+            p += output_format_i64(p, value);
+            *p++ = '\n';
+            break;
+        case OUTPUT_BINARY:
+            p = output_le(p, key_len, sizeof(uint32_t));
+            memcpy(p, key, key_len);
+            p = output_le(p + key_len, (uint64_t) value, sizeof(int64_t));
+            break;
+    }
+
+    out->used += (uint64_t) (p - start);
+    return OUTPUT_OK;
+}
+
+int64_t
+output_corpus_entry(output_t* out, uint64_t rank, const char* key,
+                    int64_t value, uint64_t df, double idf)
+{
+    if (!out->header_written && output_header(out, true) != OUTPUT_OK)
+    {
+        return out->status;
+    }
+
+    if (out->format == OUTPUT_BINARY)
+    {
+        uint64_t key_len = strlen(key);
+        if (output_reserve(out, key_len + OUTPUT_ENTRY_OVERHEAD) != OUTPUT_OK)
+        {
+            return out->status;
+        }
+
+        uint64_t idf_bits;
+        memcpy(&idf_bits, &idf, sizeof(idf_bits));
+        char* p = out->buf + out->used;
+        p = output_le(p, key_len, sizeof(uint32_t));
+        memcpy(p, key, key_len);
+        p = output_le(p + key_len, (uint64_t) value, sizeof(int64_t));
+        p = output_le(p, df, sizeof(uint64_t));
+        p = output_le(p, idf_bits, sizeof(uint64_t));
+        out->used = (uint64_t) (p - out->buf);
+        return OUTPUT_OK;
+    }
+
+    // Count columns as usual, without the line end.
+    if (output_entry(out, rank, key, value) != OUTPUT_OK)
+    {
+        return out->status;
+    }
+    out->used--;
+
+    if (output_reserve(out, OUTPUT_ENTRY_OVERHEAD) != OUTPUT_OK)
+    {
+        return out->status;
+    }
+
+    char* start = out->buf + out->used;
+    char* p = start;
+    char sep = (out->format == OUTPUT_TSV) ? '\t'
+               : (out->format == OUTPUT_CSV) ? ',' : ' ';
+    *p++ = sep;
+    char digits[21];
+    uint64_t n = output_format_u64(digits, df);
+    if (out->format == OUTPUT_TEXT && n < 10)
+    {
+        p = output_pad(p, 10 - n);
+    }
+    memcpy(p, digits, n);
+    p += n;
+    *p++ = sep;
+    p += sprintf(p, (out->format == OUTPUT_TEXT) ? "%10.6f\n" : "%.6f\n", idf);
+
+    out->used += (uint64_t) (p - start);
+    return OUTPUT_OK;
+}
+
+int64_t
+output_close(output_t* out)
+{
+    if (out == NULL)
+    {
+        return OUTPUT_OK;
+    }
+
+    output_flush(out);
+    if (out->close_f)
+    {
+        if (fclose(out->f) != 0)
+        {
+            fprintf(stderr, "output_close(): error: fclose()\n");
+            out->status = OUTPUT_ERROR;
+        }
+    }
+    else if (fflush(out->f) != 0)
+    {
+        out->status = OUTPUT_ERROR;
+    }
+
+    int64_t status = out->status;
+    free(out->buf);
+    free(out);
+    return status;
+}
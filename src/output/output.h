@@ -0,0 +1,94 @@
+#ifndef MAPWORDS_OUTPUT_H
+#define MAPWORDS_OUTPUT_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+/*
+Buffered result writer for large (full vocabulary) dumps.
+
+Entries are formatted by hand into a large user-space buffer,
+which is written out with a single fwrite() call whenever it
+fills up, so stdio locking and format string parsing are paid
+once per buffer instead of once per entry.
+
+Formats:
+  text:   "%-3lu: %-16s %16lu\n", same as the classic output.
+  tsv:    "rank\tword\tcount\n" header and rows.
+  csv:    "rank,word,count\n" header and rows, RFC 4180 quoting.
+  binary: OUTPUT_BINARY_MAGIC, then per entry a little-endian
+          uint32 key length, key bytes (no '\0') and int64 count.
+
+Corpus entries (output_corpus_entry()) add the document frequency
+and the inverse document frequency ln(documents / df) as columns
+"df" and "idf"; binary corpus dumps start with OUTPUT_CORPUS_MAGIC
+and add a uint64 df and the IEEE 754 bits of idf as uint64.
+*/
+
+#define OUTPUT_ERROR -1
+#define OUTPUT_OK 0
+
+// Default size of the output buffer.
+#define OUTPUT_BUFFER_SIZE (1U << 20U)
+
+#define OUTPUT_BINARY_MAGIC "MWDUMP01"
+#define OUTPUT_CORPUS_MAGIC "MWCORP01"
+
+typedef enum output_format
+{
+    OUTPUT_TEXT,
+    OUTPUT_TSV,
+    OUTPUT_CSV,
+    OUTPUT_BINARY,
+} output_format_t;
+
+typedef struct output
+{
+    FILE* f;
+    bool close_f;
+    output_format_t format;
+    bool header_written;
+    int64_t status;
+    uint64_t used;
+    uint64_t size;
+    char* buf;
+} output_t;
+
+// Get format from name ("text", "tsv", "csv", "binary").
+// Return false if name is unknown.
+bool
+output_parse_format(const char* name, output_format_t* out);
+
+// Open writer to file at path, or to stdout if path is NULL or "-".
+output_t*
+output_open(const char* path, output_format_t format);
+
+// Write section title line. Only text format shows titles.
+int64_t
+output_title(output_t* out, const char* title);
+
+// Write single result entry.
+int64_t
+output_entry(output_t* out, uint64_t rank, const char* key, int64_t value);
+
+// Write single corpus entry with document frequency and inverse
+// document frequency. Do not mix with output_entry().
+int64_t
+output_corpus_entry(output_t* out, uint64_t rank, const char* key,
+                    int64_t value, uint64_t df, double idf);
+
+// Write buffered data out.
+int64_t
+output_flush(output_t* out);
+
+// Flush, close file and free writer. Return first error, if any.
+int64_t
+output_close(output_t* out);
+
+// Format unsigned integer as decimal into buf without '\0'.
+// Buffer must have room for 20 characters. Return length.
+uint64_t
+output_format_u64(char* buf, uint64_t value);
+
+#endif //MAPWORDS_OUTPUT_H
@@ -0,0 +1,177 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "hash.h"
+#include "hashmap.h"
+#include "packed.h"
+#include "u64map.h"
+
+packed_t*
+packed_init(hash_t (* hashf)(const char*))
+{
+    packed_t* p = calloc(1, sizeof(packed_t));
+    if (!p)
+    {
+        fprintf(stderr, "packed_init(): error: calloc(): p\n");
+        return NULL;
+    }
+
+    p->short_words = u64map_init();
+    p->long_words = hashmap_init(hashf);
+    if (!p->short_words || !p->long_words)
+    {
+        packed_free(p);
+        return NULL;
+    }
+    return p;
+}
+
+void
+packed_free(packed_t* p)
+{
+    if (p != NULL)
+    {
+        u64map_free(p->short_words);
+        hashmap_free(p->long_words);
+        free(p);
+    }
+}
+
+void
+packed_unpack(uint64_t key, char* out)
+{
+    uint64_t len = 0;
+    for (; len < PACKED_MAX_LEN; ++len)
+    {
+        char c = (char) (key >> (56U - 8U * len));
+        if (c == '\0')
+        {
+            break;
+        }
+        out[len] = c;
+    }
+    out[len] = '\0';
+}
+
+int64_t
+packed_increment(packed_t* p, char* word, uint64_t len, int64_t delta)
+{
+    if (len <= PACKED_MAX_LEN)
+    {
+        return (u64map_increment(p->short_words, packed_key(word, len),
+                                 (uint64_t) delta) == U64MAP_OK)
+               ? PACKED_OK : PACKED_ERROR;
+    }
+    return (hashmap_increment(p->long_words, word, delta) == HASHMAP_OK)
+           ? PACKED_OK : PACKED_ERROR;
+}
+
+int64_t
+packed_get(const packed_t* p, const char* word)
+{
+    uint64_t len = strlen(word);
+    if (len <= PACKED_MAX_LEN)
+    {
+        return (int64_t) u64map_get(p->short_words, packed_key(word, len));
+    }
+
+    int64_t value = 0;
+    hashmap_get_shared(p->long_words, word, p->long_words->hashf(word),
+                       &value);
+    return value;
+}
+
+uint64_t
+packed_size(const packed_t* p)
+{
+    return p->short_words->size + p->long_words->size;
+}
+
+int64_t
+packed_each(const packed_t* p, packed_each_fn fn, void* ctx)
+{
+    char key[PACKED_MAX_LEN + 1];
+    const u64map_t* s = p->short_words;
+    for (uint64_t i = 0; i < s->capacity; ++i)
+    {
+        if (s->entries[i].key != U64MAP_EMPTY)
+        {
+            packed_unpack(s->entries[i].key, key);
+            int64_t status = fn(key, (int64_t) s->entries[i].value, ctx);
+            if (status != 0)
+            {
+                return status;
+            }
+        }
+    }
+
+    const hashmap_map_t* l = p->long_words;
+    for (uint64_t i = 0; i < l->capacity; ++i)
+    {
+        if (l->buckets[i].in_use)
+        {
+            int64_t status = fn(l->buckets[i].key, l->buckets[i].value, ctx);
+            if (status != 0)
+            {
+                return status;
+            }
+        }
+    }
+    return 0;
+}
+
+uint64_t
+packed_top_k(const packed_t* p, uint64_t k, packed_word_t* out)
+{
+    uint64_t k_short = (k < p->short_words->size) ? k : p->short_words->size;
+    uint64_t k_long = (k < p->long_words->size) ? k : p->long_words->size;
+    const u64map_entry_t** s = malloc((k_short + 1) * sizeof(u64map_entry_t*));
+    const hashmap_bucket_t** l = malloc((k_long + 1)
+                                        * sizeof(hashmap_bucket_t*));
+    if (!s || !l)
+    {
+        fprintf(stderr, "packed_top_k(): error: malloc()\n");
+        free(s);
+        free(l);
+        return 0;
+    }
+
+    uint64_t n_short = u64map_top_k(p->short_words, k_short, s);
+    uint64_t n_long = hashmap_top_k(p->long_words, k_long, l);
+
+    // Merge both ranked lists. A long word never equals a short one.
+    uint64_t i = 0;
+    uint64_t j = 0;
+    uint64_t n = 0;
+    for (; n < k && (i < n_short || j < n_long); ++n)
+    {
+        packed_word_t* w = &out[n];
+        bool take_short = (j == n_long);
+        if (i < n_short && j < n_long)
+        {
+            int64_t value = (int64_t) s[i]->value;
+            packed_unpack(s[i]->key, w->short_key);
+            take_short = value > l[j]->value
+                         || (value == l[j]->value
+                             && strcmp(w->short_key, l[j]->key) < 0);
+        }
+
+        if (take_short)
+        {
+            packed_unpack(s[i]->key, w->short_key);
+            w->key = w->short_key;
+            w->value = (int64_t) s[i++]->value;
+        }
+        else
+        {
+            w->key = l[j]->key;
+            w->value = l[j++]->value;
+        }
+    }
+
+    free(s);
+    free(l);
+    return n;
+}
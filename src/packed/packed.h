@@ -0,0 +1,96 @@
+#ifndef MAPWORDS_PACKED_H
+#define MAPWORDS_PACKED_H
+
+#include <inttypes.h>
+
+#include "hash.h"
+#include "hashmap.h"
+#include "u64map.h"
+
+/*
+Word counter with a packed integer tier for short words.
+
+Words of up to PACKED_MAX_LEN (8) bytes fit in a uint64_t. They are
+counted in a u64map_t (see u64map.h) keyed by their bytes, so hashing
+is a single multiply-mix and comparison a single integer compare,
+with no key pointer, key allocation or strcmp. Longer words are
+counted in a hashmap_map_t as usual.
+
+Bytes are packed big-endian, first character in the most significant
+byte and zero padded, so packed keys order like the strings. Top-k
+ties broken by key in u64map_top_k() then agree with hashmap_top_k(),
+and the top k words of both tiers are merged into the overall top k.
+Word characters are never zero or 0xFF, so no word packs to the empty
+marker U64MAP_EMPTY.
+*/
+
+#define PACKED_ERROR -1
+#define PACKED_OK 0
+
+#define PACKED_MAX_LEN 8U
+
+typedef struct packed
+{
+    u64map_t* short_words;
+    hashmap_map_t* long_words;
+} packed_t;
+
+// Word and count selected by packed_top_k().
+typedef struct packed_word
+{
+    const char* key; // Into short_key, or the key of a long word.
+    int64_t value;
+    char short_key[PACKED_MAX_LEN + 1];
+} packed_word_t;
+
+// Called for every word by packed_each(). Any return value other
+// than 0 stops the iteration and is passed on.
+typedef int64_t (* packed_each_fn)(const char* key, int64_t value, void* ctx);
+
+// Allocate counter using hash function hashf for long words.
+packed_t*
+packed_init(hash_t (* hashf)(const char*));
+
+// Free counter.
+void
+packed_free(packed_t* p);
+
+// Pack word of len <= PACKED_MAX_LEN bytes.
+static inline uint64_t
+packed_key(const char* word, uint64_t len)
+{
+    uint64_t key = 0;
+    for (uint64_t i = 0; i < PACKED_MAX_LEN; ++i)
+    {
+        key = (key << 8U) | ((i < len) ? (unsigned char) word[i] : 0U);
+    }
+    return key;
+}
+
+// Unpack key into null-terminated out of PACKED_MAX_LEN + 1 bytes.
+void
+packed_unpack(uint64_t key, char* out);
+
+// Add delta to the count of null-terminated word of len bytes.
+int64_t
+packed_increment(packed_t* p, char* word, uint64_t len, int64_t delta);
+
+// Get count of null-terminated word, 0 if not seen.
+int64_t
+packed_get(const packed_t* p, const char* word);
+
+// Return number of distinct words in both tiers.
+uint64_t
+packed_size(const packed_t* p);
+
+// Call fn for every word of both tiers, short words first.
+int64_t
+packed_each(const packed_t* p, packed_each_fn fn, void* ctx);
+
+// Select k words with the largest counts of both tiers in descending
+// order, ties broken by key in ascending order. 'out' must have room
+// for k words. Return number of words written, or 0 on error.
+uint64_t
+packed_top_k(const packed_t* p, uint64_t k, packed_word_t* out);
+
+#endif //MAPWORDS_PACKED_H
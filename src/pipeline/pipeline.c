@@ -0,0 +1,508 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "hash.h"
+#include "hashmap.h"
+#include "pipeline.h"
+#include "ring.h"
+#include "util.h"
+
+// Bytes reserved for word data in a single batch.
+#define PIPELINE_BATCH_BYTES (PIPELINE_BATCH_WORDS * 16U)
+
+// Fibonacci hashing multiplier for picking hash partitions.
+#define PIPELINE_PARTITION_MUL 0x9E3779B97F4A7C15LU
+
+typedef struct pipeline_buffer
+{
+    uint64_t len;
+    char data[];
+} pipeline_buffer_t;
+
+// Batch of null-terminated words and their hashes.
+typedef struct pipeline_batch
+{
+    uint64_t count;
+    uint64_t bytes;
+    hash_t hashes[PIPELINE_BATCH_WORDS];
+    char data[PIPELINE_BATCH_BYTES];
+} pipeline_batch_t;
+
+typedef struct pipeline
+{
+    const pipeline_config_t* config;
+    FILE* f;
+    atomic_bool error;
+
+    pipeline_buffer_t** buffers;
+    uint64_t buffer_count;
+    pipeline_batch_t** batches;
+    uint64_t batch_count;
+
+    // Indexed by tokenizer.
+    ring_t** buffers_full;
+    ring_t** buffers_free;
+
+    // Indexed by tokenizer * counters + counter.
+    ring_t** batches_full;
+    ring_t** batches_free;
+
+    uint64_t* wordcounts;
+    uint64_t* charcounts;
+    hashmap_map_t** maps;
+} pipeline_t;
+
+typedef struct pipeline_worker
+{
+    pipeline_t* pipeline;
+    uint64_t index;
+} pipeline_worker_t;
+
+static inline uint64_t
+pipeline_partition(hash_t hash, uint64_t partitions)
+{
+    return ((hash * PIPELINE_PARTITION_MUL) >> 32U) % partitions;
+}
+
+void
+pipeline_config_default(pipeline_config_t* config,
+                        hash_t (* hashf)(const char*))
+{
+    uint64_t cpus = cpu_count();
+    config->tokenizers = (cpus > 1) ? cpus / 2 : 1;
+    config->counters = (cpus > 1) ? cpus / 2 : 1;
+    config->buffer_size = PIPELINE_BUFFER_SIZE;
+    config->hashf = hashf;
+}
+
+static void*
+pipeline_tokenizer(void* arg)
+{
+    pipeline_worker_t* worker = arg;
+    pipeline_t* p = worker->pipeline;
+    uint64_t t = worker->index;
+    uint64_t counters = p->config->counters;
+    hash_t (* hashf)(const char*) = p->config->hashf;
+
+    pipeline_batch_t* current[counters];
+    memset(current, 0, sizeof(current));
+
+    char word[WORD_SIZE];
+    uint64_t wordcount = 0;
+    uint64_t charcount = 0;
+
+    pipeline_buffer_t* buf;
+    while ((buf = ring_pop(p->buffers_full[t])) != NULL)
+    {
+        uint64_t pos = 0;
+        uint64_t n;
+        while ((n = buffer_next_word(buf->data, buf->len, &pos,
+                                     word, WORD_SIZE)) > 0)
+        {
+            wordcount++;
+            charcount += n;
+
+            hash_t hash = hashf(word);
+            uint64_t c = pipeline_partition(hash, counters);
+            uint64_t pair = t * counters + c;
+
+            pipeline_batch_t* batch = current[c];
+            if (!batch)
+            {
+                batch = ring_pop(p->batches_free[pair]);
+                batch->count = 0;
+                batch->bytes = 0;
+                current[c] = batch;
+            }
+
+            memcpy(batch->data + batch->bytes, word, n + 1);
+            batch->bytes += n + 1;
+            batch->hashes[batch->count++] = hash;
+
+            if (batch->count == PIPELINE_BATCH_WORDS
+                || batch->bytes + WORD_SIZE > PIPELINE_BATCH_BYTES)
+            {
+                ring_push(p->batches_full[pair], batch);
+                current[c] = NULL;
+            }
+        }
+
+        ring_push(p->buffers_free[t], buf);
+    }
+
+    for (uint64_t c = 0; c < counters; ++c)
+    {
+        uint64_t pair = t * counters + c;
+        if (current[c])
+        {
+            ring_push(p->batches_full[pair], current[c]);
+        }
+        ring_push(p->batches_full[pair], NULL);
+    }
+
+    p->wordcounts[t] = wordcount;
+    p->charcounts[t] = charcount;
+    return NULL;
+}
+
+static void*
+pipeline_counter(void* arg)
+{
+    pipeline_worker_t* worker = arg;
+    pipeline_t* p = worker->pipeline;
+    uint64_t c = worker->index;
+    uint64_t tokenizers = p->config->tokenizers;
+    uint64_t counters = p->config->counters;
+    hashmap_map_t* map = p->maps[c];
+
+    bool done[tokenizers];
+    memset(done, 0, sizeof(done));
+    uint64_t active = tokenizers;
+    uint64_t spins = 0;
+
+    while (active > 0)
+    {
+        bool progress = false;
+        for (uint64_t t = 0; t < tokenizers; ++t)
+        {
+            uint64_t pair = t * counters + c;
+            void* item = NULL;
+            if (done[t] || !ring_try_pop(p->batches_full[pair], &item))
+            {
+                continue;
+            }
+
+            pipeline_batch_t* batch = item;
+            progress = true;
+            if (!batch)
+            {
+                done[t] = true;
+                active--;
+                continue;
+            }
+
+            char* key = batch->data;
+            for (uint64_t i = 0; i < batch->count
+                                 && !atomic_load(&p->error); ++i)
+            {
+                uint64_t len = strlen(key);
+                int64_t status = hashmap_increment_knownhash(
+                    map, key, 1, batch->hashes[i]);
+                if (status != HASHMAP_OK)
+                {
+                    fprintf(stderr, "pipeline_counter(): error: "
+                                    "hashmap_increment_knownhash(): "
+                                    "%"PRId64", word: %s\n", status, key);
+                    atomic_store(&p->error, true);
+                }
+                key += len + 1;
+            }
+
+            ring_push(p->batches_free[pair], batch);
+        }
+
+        if (progress)
+        {
+            spins = 0;
+        }
+        else
+        {
+            ring_backoff(&spins);
+        }
+    }
+
+    return NULL;
+}
+
+// Read input into buffers and hand them out round-robin to tokenizers.
+static void
+pipeline_reader(pipeline_t* p)
+{
+    uint64_t tokenizers = p->config->tokenizers;
+    uint64_t size = p->config->buffer_size;
+    char carry[WORD_SIZE];
+    uint64_t carry_len = 0;
+    bool eof = false;
+
+    for (uint64_t t = 0; !eof; t = (t + 1) % tokenizers)
+    {
+        pipeline_buffer_t* buf = ring_pop(p->buffers_free[t]);
+        memcpy(buf->data, carry, carry_len);
+
+        // Carry partial word over to the next buffer.
+        uint64_t len = read_word_block(p->f, buf->data, size, &carry_len,
+                                       &eof);
+        if (ferror(p->f))
+        {
+            fprintf(stderr, "pipeline_reader(): error: fread()\n");
+            atomic_store(&p->error, true);
+        }
+        memcpy(carry, buf->data + len, carry_len);
+
+        buf->len = len;
+        ring_push(p->buffers_full[t], buf);
+    }
+
+    for (uint64_t t = 0; t < tokenizers; ++t)
+    {
+        ring_push(p->buffers_full[t], NULL);
+    }
+}
+
+static void
+pipeline_free(pipeline_t* p)
+{
+    uint64_t tokenizers = p->config->tokenizers;
+    uint64_t pairs = tokenizers * p->config->counters;
+
+    for (uint64_t i = 0; p->buffers && i < p->buffer_count; ++i)
+    {
+        free(p->buffers[i]);
+    }
+    for (uint64_t i = 0; p->batches && i < p->batch_count; ++i)
+    {
+        free(p->batches[i]);
+    }
+    for (uint64_t t = 0; t < tokenizers; ++t)
+    {
+        ring_free(p->buffers_full ? p->buffers_full[t] : NULL);
+        ring_free(p->buffers_free ? p->buffers_free[t] : NULL);
+    }
+    for (uint64_t i = 0; i < pairs; ++i)
+    {
+        ring_free(p->batches_full ? p->batches_full[i] : NULL);
+        ring_free(p->batches_free ? p->batches_free[i] : NULL);
+    }
+    for (uint64_t c = 0; p->maps && c < p->config->counters; ++c)
+    {
+        hashmap_free(p->maps[c]);
+    }
+
+    free(p->buffers);
+    free(p->batches);
+    free(p->buffers_full);
+    free(p->buffers_free);
+    free(p->batches_full);
+    free(p->batches_free);
+    free(p->wordcounts);
+    free(p->charcounts);
+    free(p->maps);
+}
+
+static int64_t
+pipeline_setup(pipeline_t* p)
+{
+    uint64_t tokenizers = p->config->tokenizers;
+    uint64_t counters = p->config->counters;
+    uint64_t pairs = tokenizers * counters;
+
+    p->buffer_count = tokenizers * PIPELINE_BUFFERS_PER_TOKENIZER;
+    p->batch_count = pairs * PIPELINE_BATCHES_PER_PAIR;
+
+    p->buffers = calloc(p->buffer_count, sizeof(pipeline_buffer_t*));
+    p->batches = calloc(p->batch_count, sizeof(pipeline_batch_t*));
+    p->buffers_full = calloc(tokenizers, sizeof(ring_t*));
+    p->buffers_free = calloc(tokenizers, sizeof(ring_t*));
+    p->batches_full = calloc(pairs, sizeof(ring_t*));
+    p->batches_free = calloc(pairs, sizeof(ring_t*));
+    p->wordcounts = calloc(tokenizers, sizeof(uint64_t));
+    p->charcounts = calloc(tokenizers, sizeof(uint64_t));
+    p->maps = calloc(counters, sizeof(hashmap_map_t*));
+    if (!p->buffers || !p->batches || !p->buffers_full || !p->buffers_free
+        || !p->batches_full || !p->batches_free || !p->wordcounts
+        || !p->charcounts || !p->maps)
+    {
+        fprintf(stderr, "pipeline_setup(): error: calloc()\n");
+        return PIPELINE_ERROR;
+    }
+
+    // Rings can always hold every item in flight plus end marker.
+    for (uint64_t t = 0; t < tokenizers; ++t)
+    {
+        p->buffers_full[t] = ring_init(PIPELINE_BUFFERS_PER_TOKENIZER + 1);
+        p->buffers_free[t] = ring_init(PIPELINE_BUFFERS_PER_TOKENIZER + 1);
+        if (!p->buffers_full[t] || !p->buffers_free[t])
+        {
+            return PIPELINE_ERROR;
+        }
+
+        for (uint64_t i = 0; i < PIPELINE_BUFFERS_PER_TOKENIZER; ++i)
+        {
+            pipeline_buffer_t* buf = malloc(
+                sizeof(pipeline_buffer_t) + p->config->buffer_size);
+            if (!buf)
+            {
+                fprintf(stderr, "pipeline_setup(): error: malloc(): buffer\n");
+                return PIPELINE_ERROR;
+            }
+            p->buffers[t * PIPELINE_BUFFERS_PER_TOKENIZER + i] = buf;
+            ring_push(p->buffers_free[t], buf);
+        }
+    }
+
+    for (uint64_t pair = 0; pair < pairs; ++pair)
+    {
+        p->batches_full[pair] = ring_init(PIPELINE_BATCHES_PER_PAIR + 1);
+        p->batches_free[pair] = ring_init(PIPELINE_BATCHES_PER_PAIR + 1);
+        if (!p->batches_full[pair] || !p->batches_free[pair])
+        {
+            return PIPELINE_ERROR;
+        }
+
+        for (uint64_t i = 0; i < PIPELINE_BATCHES_PER_PAIR; ++i)
+        {
+            pipeline_batch_t* batch = malloc(sizeof(pipeline_batch_t));
+            if (!batch)
+            {
+                fprintf(stderr, "pipeline_setup(): error: malloc(): batch\n");
+                return PIPELINE_ERROR;
+            }
+            p->batches[pair * PIPELINE_BATCHES_PER_PAIR + i] = batch;
+            ring_push(p->batches_free[pair], batch);
+        }
+    }
+
+    for (uint64_t c = 0; c < counters; ++c)
+    {
+        p->maps[c] = hashmap_init(p->config->hashf);
+        if (!p->maps[c])
+        {
+            return PIPELINE_ERROR;
+        }
+    }
+
+    return PIPELINE_OK;
+}
+
+int64_t
+pipeline_count(FILE* f, const pipeline_config_t* config,
+               hashmap_map_t* map, uint64_t* wordcount,
+               uint64_t* charcount)
+{
+    if (config->tokenizers == 0 || config->counters == 0
+        || config->buffer_size < 2 * WORD_SIZE)
+    {
+        fprintf(stderr, "pipeline_count(): error: invalid config\n");
+        return PIPELINE_ERROR;
+    }
+
+    if (map->hashf != config->hashf)
+    {
+        fprintf(stderr, "pipeline_count(): error: hash functions differ\n");
+        return PIPELINE_ERROR;
+    }
+
+    pipeline_t p = {0};
+    p.config = config;
+    p.f = f;
+    atomic_init(&p.error, false);
+
+    if (pipeline_setup(&p) != PIPELINE_OK)
+    {
+        pipeline_free(&p);
+        return PIPELINE_ERROR;
+    }
+
+    uint64_t tokenizers = config->tokenizers;
+    uint64_t counters = config->counters;
+    pthread_t tokenizer_threads[tokenizers];
+    pthread_t counter_threads[counters];
+    pipeline_worker_t tokenizer_workers[tokenizers];
+    pipeline_worker_t counter_workers[counters];
+
+    uint64_t counters_started = 0;
+    for (uint64_t c = 0; c < counters; ++c)
+    {
+        counter_workers[c].pipeline = &p;
+        counter_workers[c].index = c;
+        if (pthread_create(&counter_threads[c], NULL, pipeline_counter,
+                           &counter_workers[c]) != 0)
+        {
+            break;
+        }
+        counters_started++;
+    }
+
+    uint64_t tokenizers_started = 0;
+    for (uint64_t t = 0; t < tokenizers && counters_started == counters; ++t)
+    {
+        tokenizer_workers[t].pipeline = &p;
+        tokenizer_workers[t].index = t;
+        if (pthread_create(&tokenizer_threads[t], NULL, pipeline_tokenizer,
+                           &tokenizer_workers[t]) != 0)
+        {
+            break;
+        }
+        tokenizers_started++;
+    }
+
+    if (tokenizers_started == tokenizers)
+    {
+        pipeline_reader(&p);
+    }
+    else
+    {
+        // Close the rings started threads wait on, in place of the
+        // reader and the missing tokenizers. Nothing has been pushed
+        // yet, so every ring has room for its end marker.
+        fprintf(stderr, "pipeline_count(): error: pthread_create()\n");
+        atomic_store(&p.error, true);
+        for (uint64_t t = 0; t < tokenizers; ++t)
+        {
+            if (t < tokenizers_started)
+            {
+                ring_push(p.buffers_full[t], NULL);
+                continue;
+            }
+            for (uint64_t c = 0; c < counters; ++c)
+            {
+                ring_push(p.batches_full[t * counters + c], NULL);
+            }
+        }
+    }
+
+    for (uint64_t t = 0; t < tokenizers_started; ++t)
+    {
+        pthread_join(tokenizer_threads[t], NULL);
+        *wordcount += p.wordcounts[t];
+        *charcount += p.charcounts[t];
+    }
+
+    for (uint64_t c = 0; c < counters_started; ++c)
+    {
+        pthread_join(counter_threads[c], NULL);
+    }
+
+    int64_t status = atomic_load(&p.error) ? PIPELINE_ERROR : PIPELINE_OK;
+
+    if (status == PIPELINE_OK)
+    {
+        uint64_t total = map->size;
+        for (uint64_t c = 0; c < counters; ++c)
+        {
+            total += p.maps[c]->size;
+        }
+
+        // Partitions are disjoint, a single grow is enough.
+        if (hashmap_reserve(map, total) != HASHMAP_OK)
+        {
+            status = PIPELINE_ERROR;
+        }
+
+        for (uint64_t c = 0; c < counters && status == PIPELINE_OK; ++c)
+        {
+            if (hashmap_merge(map, p.maps[c]) != HASHMAP_OK)
+            {
+                status = PIPELINE_ERROR;
+            }
+            map->collisions += p.maps[c]->collisions;
+            map->rehashes += p.maps[c]->rehashes;
+        }
+    }
+
+    pipeline_free(&p);
+    return status;
+}
@@ -0,0 +1,75 @@
+#ifndef MAPWORDS_PIPELINE_H
+#define MAPWORDS_PIPELINE_H
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "hash.h"
+#include "hashmap.h"
+
+/*
+Three stage word counting pipeline for streaming input (e.g. stdin).
+
+  reader --> tokenizer[T] --> counter[C]
+
+The reader thread fills large buffers from the input stream. Partial
+words at buffer ends are carried over to the next buffer, so
+tokenizers never see split words. Buffers are handed out round-robin
+to tokenizer threads.
+
+Tokenizer threads cut buffers into lowercase words, hash them and
+append each word into a batch of the counter thread owning the word's
+hash partition. Partitioning uses the mixed high bits of the hash,
+so it does not correlate with map indices (hash & (capacity - 1)).
+
+Counter threads own disjoint maps, so no locking is needed for the
+maps themselves. Counters use the hash computed by the tokenizer.
+
+Every stage pair is connected with SPSC rings (ring.h) in both
+directions: full buffers/batches flow forward and empty ones are
+returned back to the producer for reuse, so the pipeline runs in
+fixed memory after startup.
+
+After the input is exhausted counter maps are merged into the
+output map using stored hashes.
+*/
+
+#define PIPELINE_ERROR -1
+#define PIPELINE_OK 0
+
+// Default size of a single read buffer.
+#define PIPELINE_BUFFER_SIZE (1U << 20U)
+
+// Buffers in flight per tokenizer.
+#define PIPELINE_BUFFERS_PER_TOKENIZER 4U
+
+// Batches in flight per tokenizer-counter pair.
+#define PIPELINE_BATCHES_PER_PAIR 4U
+
+// Maximum words per batch.
+#define PIPELINE_BATCH_WORDS 4096U
+
+typedef struct pipeline_config
+{
+    uint64_t tokenizers;
+    uint64_t counters;
+    uint64_t buffer_size;
+    hash_t (* hashf)(const char*);
+} pipeline_config_t;
+
+// Fill config with defaults based on number of processors.
+void
+pipeline_config_default(pipeline_config_t* config,
+                        hash_t (* hashf)(const char*));
+
+// Count all words in stream f into map.
+// Word and character counts are added to wordcount and charcount.
+// Map must use the same hash function as config. If a thread can not
+// be started, those already running are stopped and joined and
+// PIPELINE_ERROR is returned.
+int64_t
+pipeline_count(FILE* f, const pipeline_config_t* config,
+               hashmap_map_t* map, uint64_t* wordcount,
+               uint64_t* charcount);
+
+#endif //MAPWORDS_PIPELINE_H
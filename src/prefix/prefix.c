@@ -0,0 +1,693 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "hashmap.h"
+#include "prefix.h"
+#include "snapshot.h"
+#include "sort.h"
+#include "util.h"
+
+// Round up to the section alignment.
+#define PREFIX_ALIGN(x) (((x) + 7U) & ~(uint64_t) 7U)
+
+// Longest encoded key, two varints and the bytes.
+#define PREFIX_KEY_MAX_BYTES (WORD_SIZE + 20U)
+
+#define PREFIX_HEAP_INITIAL_CAPACITY 64U
+
+// Search heap item: a word (node 0) or a tree node covering leaves
+// [leaf_lo, leaf_hi).
+typedef struct prefix_item
+{
+    int64_t value; // Count of word, maximum of node.
+    uint64_t first; // Lowest word number the item can hold.
+    uint64_t node;
+    uint64_t leaf_lo;
+    uint64_t leaf_hi;
+} prefix_item_t;
+
+typedef struct prefix_heap
+{
+    prefix_item_t* items;
+    uint64_t size;
+    uint64_t capacity;
+} prefix_heap_t;
+
+static inline unsigned char*
+prefix_put_varint(unsigned char* p, uint64_t value)
+{
+    while (value >= 0x80U)
+    {
+        *p++ = (unsigned char) (value | 0x80U);
+        value >>= 7U;
+    }
+    *p++ = (unsigned char) value;
+    return p;
+}
+
+static inline bool
+prefix_get_varint(const unsigned char** pos, const unsigned char* end,
+                  uint64_t* out)
+{
+    uint64_t value = 0;
+    for (uint32_t shift = 0; shift < 64 && *pos < end; shift += 7)
+    {
+        unsigned char byte = *(*pos)++;
+        value |= (uint64_t) (byte & 0x7FU) << shift;
+        if (!(byte & 0x80U))
+        {
+            *out = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint64_t
+prefix_body_checksum(const void* data, const prefix_header_t* h)
+{
+    return snapshot_checksum((const char*) data + h->blocks_offset,
+                             h->file_size - h->blocks_offset, PREFIX_VERSION);
+}
+
+static uint64_t
+prefix_header_checksum(const prefix_header_t* h)
+{
+    return snapshot_checksum(h, offsetof(prefix_header_t, header_checksum), 0);
+}
+
+// Point section pointers into data.
+static void
+prefix_set_sections(prefix_t* p)
+{
+    const char* base = p->data;
+    const prefix_header_t* h = p->header;
+    p->blocks = (const uint64_t*) (base + h->blocks_offset);
+    p->counts = (const int64_t*) (base + h->counts_offset);
+    p->tree = (const int64_t*) (base + h->tree_offset);
+    p->keys = (const unsigned char*) (base + h->keys_offset);
+}
+
+// Front-code keys of all words in key order into a new buffer.
+static unsigned char*
+prefix_encode_keys(const hashmap_map_t* map, const uint64_t* order,
+                   uint64_t count, uint64_t* blocks, uint64_t* size)
+{
+    uint64_t capacity = PREFIX_KEY_MAX_BYTES * PREFIX_BLOCK;
+    unsigned char* keys = malloc(capacity);
+    if (!keys)
+    {
+        fprintf(stderr, "prefix_encode_keys(): error: malloc(): keys\n");
+        return NULL;
+    }
+
+    uint64_t len = 0;
+    const char* prev = "";
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        if (len + PREFIX_KEY_MAX_BYTES > capacity)
+        {
+            capacity *= 2;
+            unsigned char* new_keys = realloc(keys, capacity);
+            if (!new_keys)
+            {
+                fprintf(stderr, "prefix_encode_keys(): error: realloc(): "
+                                "keys\n");
+                free(keys);
+                return NULL;
+            }
+            keys = new_keys;
+        }
+
+        const char* key = map->buckets[order[i]].key;
+        uint64_t shared = 0;
+        unsigned char* out = keys + len;
+        if (i % PREFIX_BLOCK == 0)
+        {
+            blocks[i / PREFIX_BLOCK] = len;
+        }
+        else
+        {
+            while (prev[shared] != '\0' && prev[shared] == key[shared])
+            {
+                shared++;
+            }
+            out = prefix_put_varint(out, shared);
+        }
+
+        uint64_t suffix = strlen(key + shared);
+        out = prefix_put_varint(out, suffix);
+        memcpy(out, key + shared, suffix);
+        len = (uint64_t) (out + suffix - keys);
+        prev = key;
+    }
+
+    *size = len;
+    return keys;
+}
+
+prefix_t*
+prefix_build(const hashmap_map_t* map, uint64_t threads)
+{
+    uint64_t* order = NULL;
+    uint64_t count = 0;
+    if (sort_by_key(map, threads, &order, &count) != SORT_OK)
+    {
+        return NULL;
+    }
+
+    prefix_header_t h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, PREFIX_MAGIC, sizeof(h.magic));
+    h.version = PREFIX_VERSION;
+    h.endian = PREFIX_ENDIAN;
+    h.count = count;
+    h.block_count = (count + PREFIX_BLOCK - 1) / PREFIX_BLOCK;
+    h.leaves = 1;
+    while (h.leaves < h.block_count)
+    {
+        h.leaves *= 2;
+    }
+
+    uint64_t* blocks = malloc((h.block_count + 1) * sizeof(uint64_t));
+    unsigned char* keys = blocks ? prefix_encode_keys(map, order, count,
+                                                      blocks, &h.keys_size)
+                                 : NULL;
+
+    h.blocks_offset = PREFIX_ALIGN(sizeof(prefix_header_t));
+    h.counts_offset = h.blocks_offset + h.block_count * sizeof(uint64_t);
+    h.tree_offset = h.counts_offset + count * sizeof(int64_t);
+    h.keys_offset = h.tree_offset + 2 * h.leaves * sizeof(int64_t);
+    h.file_size = h.keys_offset + h.keys_size;
+
+    prefix_t* p = calloc(1, sizeof(prefix_t));
+    char* data = keys ? calloc(1, h.file_size) : NULL;
+    if (!p || !data)
+    {
+        fprintf(stderr, "prefix_build(): error: allocating index\n");
+        free(p);
+        free(data);
+        free(keys);
+        free(blocks);
+        free(order);
+        return NULL;
+    }
+
+    memcpy(data + h.blocks_offset, blocks, h.block_count * sizeof(uint64_t));
+    memcpy(data + h.keys_offset, keys, h.keys_size);
+    free(keys);
+    free(blocks);
+
+    int64_t* counts = (int64_t*) (data + h.counts_offset);
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        counts[i] = map->buckets[order[i]].value;
+        h.total += (uint64_t) counts[i];
+    }
+    free(order);
+
+    // Leaves hold block maxima, padding leaves can never be reached.
+    int64_t* tree = (int64_t*) (data + h.tree_offset);
+    for (uint64_t j = 0; j < h.leaves; ++j)
+    {
+        int64_t max = INT64_MIN;
+        for (uint64_t i = j * PREFIX_BLOCK;
+             i < count && i < (j + 1) * PREFIX_BLOCK; ++i)
+        {
+            max = (counts[i] > max) ? counts[i] : max;
+        }
+        tree[h.leaves + j] = max;
+    }
+    tree[0] = INT64_MIN;
+    for (uint64_t i = h.leaves - 1; i > 0; --i)
+    {
+        tree[i] = (tree[2 * i] > tree[2 * i + 1]) ? tree[2 * i]
+                                                    : tree[2 * i + 1];
+    }
+
+    memcpy(data, &h, sizeof(h));
+    prefix_header_t* header = (prefix_header_t*) data;
+    header->body_checksum = prefix_body_checksum(data, header);
+    header->header_checksum = prefix_header_checksum(header);
+
+    p->data = data;
+    p->size = h.file_size;
+    p->mapped = false;
+    p->header = header;
+    prefix_set_sections(p);
+    return p;
+}
+
+static bool
+prefix_write_image(FILE* f, void* arg)
+{
+    const prefix_t* p = arg;
+    return fwrite(p->data, 1, p->size, f) == p->size;
+}
+
+int64_t
+prefix_save(const prefix_t* p, const char* path)
+{
+    return (snapshot_publish(path, prefix_write_image, (void*) p)
+            == SNAPSHOT_OK) ? PREFIX_OK : PREFIX_ERROR;
+}
+
+// Check that count items of item_size bytes from offset lie within
+// size, without overflowing.
+static inline bool
+prefix_section_valid(uint64_t offset, uint64_t count, uint64_t item_size,
+                     uint64_t size)
+{
+    return offset <= size && count <= (size - offset) / item_size;
+}
+
+// Validate header fields and that all sections lie within size.
+static bool
+prefix_header_valid(const prefix_header_t* h, uint64_t size)
+{
+    if (memcmp(h->magic, PREFIX_MAGIC, sizeof(h->magic)) != 0)
+    {
+        fprintf(stderr, "prefix_open(): error: not a prefix index file\n");
+        return false;
+    }
+    if (h->endian != PREFIX_ENDIAN || h->version != PREFIX_VERSION)
+    {
+        fprintf(stderr, "prefix_open(): error: unsupported version %u "
+                        "or byte order\n", h->version);
+        return false;
+    }
+    if (h->header_checksum != prefix_header_checksum(h))
+    {
+        fprintf(stderr, "prefix_open(): error: header checksum mismatch\n");
+        return false;
+    }
+
+    // Every offset is checked against size before anything is added to
+    // it, so no sum can wrap around.
+    bool valid = h->file_size == size
+                 && h->count < (UINT64_MAX >> 8U)
+                 && h->block_count == (h->count + PREFIX_BLOCK - 1)
+                                      / PREFIX_BLOCK
+                 && h->leaves > 0 && (h->leaves & (h->leaves - 1)) == 0
+                 && h->leaves >= h->block_count && h->leaves < size
+                 && h->blocks_offset == PREFIX_ALIGN(sizeof(prefix_header_t))
+                 && prefix_section_valid(h->blocks_offset, h->block_count,
+                                         sizeof(uint64_t), size)
+                 && h->counts_offset == h->blocks_offset
+                                        + h->block_count * sizeof(uint64_t)
+                 && prefix_section_valid(h->counts_offset, h->count,
+                                         sizeof(int64_t), size)
+                 && h->tree_offset == h->counts_offset
+                                      + h->count * sizeof(int64_t)
+                 && prefix_section_valid(h->tree_offset, 2 * h->leaves,
+                                         sizeof(int64_t), size)
+                 && h->keys_offset == h->tree_offset
+                                      + 2 * h->leaves * sizeof(int64_t)
+                 && prefix_section_valid(h->keys_offset, h->keys_size, 1,
+                                         size)
+                 && h->keys_offset + h->keys_size == size;
+    if (!valid)
+    {
+        fprintf(stderr, "prefix_open(): error: corrupt layout\n");
+    }
+    return valid;
+}
+
+// Check that block offsets increase and lie within the keys, so block
+// decoding starts inside them. Reads the block table only.
+static bool
+prefix_blocks_valid(const prefix_t* p)
+{
+    const prefix_header_t* h = p->header;
+    for (uint64_t b = 0; b < h->block_count; ++b)
+    {
+        if (p->blocks[b] >= h->keys_size
+            || (b > 0 && p->blocks[b] <= p->blocks[b - 1]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+prefix_t*
+prefix_open(const char* path, bool verify)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "prefix_open(): error: open(): %s\n", path);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t) st.st_size < sizeof(prefix_header_t))
+    {
+        fprintf(stderr, "prefix_open(): error: file too small: %s\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    void* data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        fprintf(stderr, "prefix_open(): error: mmap(): %s\n", path);
+        return NULL;
+    }
+
+    prefix_t* p = calloc(1, sizeof(prefix_t));
+    if (!p)
+    {
+        fprintf(stderr, "prefix_open(): error: calloc(): p\n");
+        munmap(data, (size_t) st.st_size);
+        return NULL;
+    }
+
+    p->data = data;
+    p->size = (uint64_t) st.st_size;
+    p->mapped = true;
+    p->header = data;
+    if (!prefix_header_valid(p->header, p->size))
+    {
+        prefix_close(p);
+        return NULL;
+    }
+    prefix_set_sections(p);
+
+    if (!prefix_blocks_valid(p))
+    {
+        fprintf(stderr, "prefix_open(): error: corrupt block offsets\n");
+        prefix_close(p);
+        return NULL;
+    }
+
+    if (verify && !prefix_verify(p))
+    {
+        fprintf(stderr, "prefix_open(): error: body checksum mismatch\n");
+        prefix_close(p);
+        return NULL;
+    }
+    return p;
+}
+
+bool
+prefix_verify(const prefix_t* p)
+{
+    return prefix_body_checksum(p->data, p->header)
+           == p->header->body_checksum;
+}
+
+void
+prefix_close(prefix_t* p)
+{
+    if (p == NULL)
+    {
+        return;
+    }
+    if (p->mapped)
+    {
+        munmap((void*) p->data, p->size);
+    }
+    else
+    {
+        free((void*) p->data);
+    }
+    free(p);
+}
+
+// Decode keys of block into keys. Return number of keys, 0 if the
+// block is malformed.
+static uint64_t
+prefix_decode_block(const prefix_t* p, uint64_t block,
+                    char keys[PREFIX_BLOCK][WORD_SIZE])
+{
+    const prefix_header_t* h = p->header;
+    uint64_t begin = p->blocks[block];
+    uint64_t end = (block + 1 < h->block_count) ? p->blocks[block + 1]
+                                                : h->keys_size;
+    if (begin >= end || end > h->keys_size)
+    {
+        return 0;
+    }
+
+    const unsigned char* pos = p->keys + begin;
+    const unsigned char* stop = p->keys + end;
+    uint64_t n = h->count - block * PREFIX_BLOCK;
+    n = (n < PREFIX_BLOCK) ? n : PREFIX_BLOCK;
+    uint64_t prev_len = 0;
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        uint64_t shared = 0;
+        uint64_t suffix = 0;
+        if ((i > 0 && !prefix_get_varint(&pos, stop, &shared))
+            || !prefix_get_varint(&pos, stop, &suffix)
+            || shared > prev_len || suffix > (uint64_t) (stop - pos)
+            || shared + suffix >= WORD_SIZE)
+        {
+            return 0;
+        }
+
+        if (i > 0)
+        {
+            memcpy(keys[i], keys[i - 1], shared);
+        }
+        memcpy(keys[i] + shared, pos, suffix);
+        keys[i][shared + suffix] = '\0';
+        pos += suffix;
+        prev_len = shared + suffix;
+    }
+    return n;
+}
+
+// Check if key sorts before the range searched: before the prefix,
+// or for the upper bound, before or starting with the prefix.
+static inline bool
+prefix_before(const char* key, const char* prefix, uint64_t len, bool upper)
+{
+    return upper ? strncmp(key, prefix, len) <= 0 : strcmp(key, prefix) < 0;
+}
+
+// Return number of the first word not before the range, or
+// PREFIX_ERROR for a malformed index.
+static int64_t
+prefix_bound(const prefix_t* p, const char* prefix, uint64_t len, bool upper)
+{
+    static _Thread_local char keys[PREFIX_BLOCK][WORD_SIZE];
+
+    // Find the first block whose first key is not before.
+    uint64_t low = 0;
+    uint64_t high = p->header->block_count;
+    while (low < high)
+    {
+        uint64_t mid = low + (high - low) / 2;
+        if (prefix_decode_block(p, mid, keys) == 0)
+        {
+            return PREFIX_ERROR;
+        }
+        if (prefix_before(keys[0], prefix, len, upper))
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    if (low == 0)
+    {
+        return 0;
+    }
+
+    // The bound is in the block before or at the start of block low.
+    uint64_t n = prefix_decode_block(p, low - 1, keys);
+    if (n == 0)
+    {
+        return PREFIX_ERROR;
+    }
+    uint64_t i = 1;
+    while (i < n && prefix_before(keys[i], prefix, len, upper))
+    {
+        i++;
+    }
+    return (int64_t) ((low - 1) * PREFIX_BLOCK + i);
+}
+
+// Check if item a comes out of the heap after item b.
+static inline bool
+prefix_item_below(const prefix_item_t* a, const prefix_item_t* b)
+{
+    if (a->value != b->value)
+    {
+        return a->value < b->value;
+    }
+    return a->first > b->first;
+}
+
+static int64_t
+prefix_heap_push(prefix_heap_t* heap, prefix_item_t item)
+{
+    if (heap->size == heap->capacity)
+    {
+        uint64_t capacity = heap->capacity ? heap->capacity * 2
+                                           : PREFIX_HEAP_INITIAL_CAPACITY;
+        prefix_item_t* items = realloc(heap->items,
+                                       capacity * sizeof(prefix_item_t));
+        if (!items)
+        {
+            fprintf(stderr, "prefix_heap_push(): error: realloc(): items\n");
+            return PREFIX_ERROR;
+        }
+        heap->items = items;
+        heap->capacity = capacity;
+    }
+
+    // Sift up new leaf.
+    uint64_t j = heap->size++;
+    while (j > 0 && prefix_item_below(&heap->items[(j - 1) / 2], &item))
+    {
+        heap->items[j] = heap->items[(j - 1) / 2];
+        j = (j - 1) / 2;
+    }
+    heap->items[j] = item;
+    return PREFIX_OK;
+}
+
+static prefix_item_t
+prefix_heap_pop(prefix_heap_t* heap)
+{
+    prefix_item_t top = heap->items[0];
+    prefix_item_t last = heap->items[--heap->size];
+    uint64_t i = 0;
+    while (true)
+    {
+        uint64_t child = 2 * i + 1;
+        if (child >= heap->size)
+        {
+            break;
+        }
+        if (child + 1 < heap->size
+            && prefix_item_below(&heap->items[child], &heap->items[child + 1]))
+        {
+            child++;
+        }
+        if (!prefix_item_below(&last, &heap->items[child]))
+        {
+            break;
+        }
+        heap->items[i] = heap->items[child];
+        i = child;
+    }
+    if (heap->size > 0)
+    {
+        heap->items[i] = last;
+    }
+    return top;
+}
+
+// Push node if its leaves overlap the blocks of words [lo, hi).
+static int64_t
+prefix_push_node(const prefix_t* p, prefix_heap_t* heap, uint64_t node,
+                 uint64_t leaf_lo, uint64_t leaf_hi, uint64_t lo, uint64_t hi)
+{
+    uint64_t first = leaf_lo * PREFIX_BLOCK;
+    if (first >= hi || leaf_hi * PREFIX_BLOCK <= lo
+        || p->tree[node] == INT64_MIN)
+    {
+        return PREFIX_OK;
+    }
+
+    prefix_item_t item = {
+        .value = p->tree[node],
+        .first = (first > lo) ? first : lo,
+        .node = node,
+        .leaf_lo = leaf_lo,
+        .leaf_hi = leaf_hi,
+    };
+    return prefix_heap_push(heap, item);
+}
+
+// Replace popped node by its children, or the words of its block.
+static int64_t
+prefix_expand(const prefix_t* p, prefix_heap_t* heap,
+              const prefix_item_t* item, uint64_t lo, uint64_t hi)
+{
+    if (item->node < p->header->leaves)
+    {
+        uint64_t mid = item->leaf_lo + (item->leaf_hi - item->leaf_lo) / 2;
+        if (prefix_push_node(p, heap, 2 * item->node, item->leaf_lo, mid,
+                             lo, hi) != PREFIX_OK)
+        {
+            return PREFIX_ERROR;
+        }
+        return prefix_push_node(p, heap, 2 * item->node + 1, mid,
+                                item->leaf_hi, lo, hi);
+    }
+
+    uint64_t begin = item->leaf_lo * PREFIX_BLOCK;
+    uint64_t end = begin + PREFIX_BLOCK;
+    begin = (begin > lo) ? begin : lo;
+    end = (end < hi) ? end : hi;
+    for (uint64_t w = begin; w < end; ++w)
+    {
+        prefix_item_t word = {.value = p->counts[w], .first = w};
+        if (prefix_heap_push(heap, word) != PREFIX_OK)
+        {
+            return PREFIX_ERROR;
+        }
+    }
+    return PREFIX_OK;
+}
+
+int64_t
+prefix_top_k(const prefix_t* p, const char* prefix, uint64_t k,
+             prefix_word_t* out)
+{
+    uint64_t len = strlen(prefix);
+    int64_t lo = prefix_bound(p, prefix, len, false);
+    int64_t hi = prefix_bound(p, prefix, len, true);
+    if (lo < 0 || hi < 0)
+    {
+        fprintf(stderr, "prefix_top_k(): error: malformed keys\n");
+        return PREFIX_ERROR;
+    }
+    if (lo >= hi || k == 0)
+    {
+        return 0;
+    }
+
+    prefix_heap_t heap = {0};
+    int64_t status = prefix_push_node(p, &heap, 1, 0, p->header->leaves,
+                                      (uint64_t) lo, (uint64_t) hi);
+
+    static _Thread_local char keys[PREFIX_BLOCK][WORD_SIZE];
+    uint64_t n = 0;
+    while (status == PREFIX_OK && n < k && heap.size > 0)
+    {
+        prefix_item_t item = prefix_heap_pop(&heap);
+        if (item.node != 0)
+        {
+            status = prefix_expand(p, &heap, &item, (uint64_t) lo,
+                                   (uint64_t) hi);
+            continue;
+        }
+
+        if (prefix_decode_block(p, item.first / PREFIX_BLOCK, keys) == 0)
+        {
+            fprintf(stderr, "prefix_top_k(): error: malformed keys\n");
+            status = PREFIX_ERROR;
+            break;
+        }
+        strcpy(out[n].key, keys[item.first % PREFIX_BLOCK]);
+        out[n++].value = item.value;
+    }
+
+    free(heap.items);
+    return (status == PREFIX_OK) ? (int64_t) n : PREFIX_ERROR;
+}
@@ -0,0 +1,125 @@
+#ifndef MAPWORDS_PREFIX_H
+#define MAPWORDS_PREFIX_H
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "hashmap.h"
+#include "util.h"
+
+/*
+Prefix index of counted words answering "top k words starting with
+prefix" without scanning the map.
+
+Words are sorted by key, so the words with a prefix form a range of
+word numbers, found by binary search. Keys are front-coded in blocks
+of PREFIX_BLOCK words: the first key of a block is stored whole and
+every other key as the length of the prefix it shares with the
+previous key and the rest. Blocks are decoded only when searched or
+printed.
+
+Counts are stored per word. A max tree (an implicit binary tree over
+the blocks, padded to a power of two leaves) annotates every node
+with the largest count below it. Top k of a range is a best-first
+search: a heap holds tree nodes covering the range, keyed by their
+maximum, and words of expanded blocks, keyed by their count. Popping
+a word outputs it, popping a node pushes its children or the words
+of its block. Only nodes whose maximum can still enter the top k are
+ever expanded, so a query touches O(k log n) nodes instead of the
+whole range. Ties are broken by word number, which is key order.
+
+File layout, all integers in host byte order (an endianness marker
+in the header rejects foreign files), sections 8-byte aligned:
+
+  header  prefix_header_t
+  blocks  block_count x uint64_t, offset of block in keys
+  counts  count x int64_t, in key order
+  tree    2 x leaves x int64_t, node i has children 2i and 2i + 1,
+          leaf j (block j) is node leaves + j
+  keys    front-coded blocks: varint length and bytes of the first
+          key, then varint shared length, varint suffix length and
+          suffix bytes of the others
+
+The index is built in memory as the same image that is saved, so a
+built index and a mapped file are used the same way. Checksums and
+the atomic write work like in snapshot.h.
+*/
+
+#define PREFIX_ERROR -1
+#define PREFIX_OK 0
+
+#define PREFIX_MAGIC "MWPRFX\r\n"
+#define PREFIX_VERSION 1U
+#define PREFIX_ENDIAN 0x01020304U
+
+// Words per front-coded block.
+#define PREFIX_BLOCK 16U
+
+typedef struct prefix_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    uint64_t count;
+    uint64_t block_count;
+    uint64_t leaves;
+    uint64_t blocks_offset;
+    uint64_t counts_offset;
+    uint64_t tree_offset;
+    uint64_t keys_offset;
+    uint64_t keys_size;
+    uint64_t file_size;
+    uint64_t total; // Sum of counts.
+    uint64_t body_checksum;
+    uint64_t header_checksum; // Of all preceding header bytes.
+} prefix_header_t;
+
+typedef struct prefix
+{
+    const void* data;
+    uint64_t size;
+    bool mapped; // Else data is owned and freed.
+    const prefix_header_t* header;
+    const uint64_t* blocks;
+    const int64_t* counts;
+    const int64_t* tree;
+    const unsigned char* keys;
+} prefix_t;
+
+typedef struct prefix_word
+{
+    char key[WORD_SIZE];
+    int64_t value;
+} prefix_word_t;
+
+// Build index of all words in map, sorting them with up to threads
+// threads.
+prefix_t*
+prefix_build(const hashmap_map_t* map, uint64_t threads);
+
+// Write index to path atomically.
+int64_t
+prefix_save(const prefix_t* p, const char* path);
+
+// Map index file read-only and validate its header, layout and block
+// offsets. With verify the body checksum is checked as well.
+prefix_t*
+prefix_open(const char* path, bool verify);
+
+// Check the body checksum of an index.
+bool
+prefix_verify(const prefix_t* p);
+
+// Free built or unmap opened index.
+void
+prefix_close(prefix_t* p);
+
+// Write up to k words starting with prefix ("" for all words) to out
+// by count (descending) and key (ascending). Return number of words
+// written, which is less than k if fewer words have the prefix, or
+// PREFIX_ERROR.
+int64_t
+prefix_top_k(const prefix_t* p, const char* prefix, uint64_t k,
+             prefix_word_t* out);
+
+#endif //MAPWORDS_PREFIX_H
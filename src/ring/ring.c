@@ -0,0 +1,126 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <sched.h>
+
+#include "ring.h"
+
+// Number of failed operations before yielding the processor.
+#define RING_SPIN_LIMIT 128U
+
+ring_t*
+ring_init(uint64_t capacity)
+{
+    uint64_t cap = 2;
+    while (cap < capacity)
+    {
+        cap *= 2;
+    }
+
+    // Size must be a multiple of alignment for aligned_alloc().
+    uint64_t size = (sizeof(ring_t) + RING_CACHE_LINE - 1)
+                    & ~((uint64_t) RING_CACHE_LINE - 1);
+    ring_t* ring = aligned_alloc(RING_CACHE_LINE, size);
+    if (!ring)
+    {
+        fprintf(stderr, "ring_init(): error: aligned_alloc(): ring\n");
+        return NULL;
+    }
+
+    ring->slots = calloc(cap, sizeof(void*));
+    if (!ring->slots)
+    {
+        fprintf(stderr, "ring_init(): error: calloc(): ring->slots\n");
+        free(ring);
+        return NULL;
+    }
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    ring->cached_head = 0;
+    ring->cached_tail = 0;
+    ring->capacity = cap;
+    return ring;
+}
+
+void
+ring_free(ring_t* ring)
+{
+    if (ring != NULL)
+    {
+        free(ring->slots);
+        free(ring);
+    }
+}
+
+bool
+ring_try_push(ring_t* ring, void* item)
+{
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (tail - ring->cached_head == ring->capacity)
+    {
+        ring->cached_head = atomic_load_explicit(
+            &ring->head, memory_order_acquire);
+        if (tail - ring->cached_head == ring->capacity)
+        {
+            return false;
+        }
+    }
+
+    ring->slots[tail & (ring->capacity - 1)] = item;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+bool
+ring_try_pop(ring_t* ring, void** out)
+{
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head == ring->cached_tail)
+    {
+        ring->cached_tail = atomic_load_explicit(
+            &ring->tail, memory_order_acquire);
+        if (head == ring->cached_tail)
+        {
+            return false;
+        }
+    }
+
+    *out = ring->slots[head & (ring->capacity - 1)];
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+void
+ring_push(ring_t* ring, void* item)
+{
+    uint64_t spins = 0;
+    while (!ring_try_push(ring, item))
+    {
+        ring_backoff(&spins);
+    }
+}
+
+void*
+ring_pop(ring_t* ring)
+{
+    uint64_t spins = 0;
+    void* item = NULL;
+    while (!ring_try_pop(ring, &item))
+    {
+        ring_backoff(&spins);
+    }
+    return item;
+}
+
+void
+ring_backoff(uint64_t* spins)
+{
+    if (++(*spins) < RING_SPIN_LIMIT)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+        return;
+    }
+    sched_yield();
+}
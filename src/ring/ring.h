@@ -0,0 +1,68 @@
+#ifndef MAPWORDS_RING_H
+#define MAPWORDS_RING_H
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+
+/*
+Lock-free single-producer/single-consumer ring buffer of pointers.
+
+Exactly one thread may push and exactly one thread may pop.
+Head and tail live on separate cache lines and both sides keep
+a cached copy of the other side's index, so the shared indices
+are only read when the ring looks full (or empty).
+
+NULL is reserved as end-of-stream marker by convention: producer
+pushes NULL once when done and consumer stops after popping it.
+*/
+
+// Capacity *must* be a power of two.
+#define RING_DEFAULT_CAPACITY 64U
+
+#define RING_CACHE_LINE 64
+
+typedef struct ring
+{
+    // Consumer side.
+    _Alignas(RING_CACHE_LINE) _Atomic uint64_t head;
+    uint64_t cached_tail;
+
+    // Producer side.
+    _Alignas(RING_CACHE_LINE) _Atomic uint64_t tail;
+    uint64_t cached_head;
+
+    _Alignas(RING_CACHE_LINE) uint64_t capacity;
+    void** slots;
+} ring_t;
+
+// Allocate ring with capacity (rounded up to a power of two).
+ring_t*
+ring_init(uint64_t capacity);
+
+// Free memory allocated for ring. Items are not freed.
+void
+ring_free(ring_t* ring);
+
+// Push item without blocking. Return false if ring is full.
+bool
+ring_try_push(ring_t* ring, void* item);
+
+// Pop item without blocking. Return false if ring is empty.
+bool
+ring_try_pop(ring_t* ring, void** out);
+
+// Push item, waiting while ring is full.
+void
+ring_push(ring_t* ring, void* item);
+
+// Pop item, waiting while ring is empty.
+void*
+ring_pop(ring_t* ring);
+
+// Back off after a failed ring operation.
+// Spins first and then yields the processor.
+void
+ring_backoff(uint64_t* spins);
+
+#endif //MAPWORDS_RING_H
@@ -0,0 +1,259 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+
+#include "count.h"
+#include "hashmap.h"
+#include "sample.h"
+#include "util.h"
+
+// Growth factor of the chunk count between stability checks.
+#define SAMPLE_CHECK_GROWTH 1.25
+
+// SplitMix64 step for the chunk order shuffle.
+static uint64_t
+sample_next_random(uint64_t* state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15LU);
+    z = (z ^ (z >> 30U)) * 0xBF58476D1CE4E5B9LU;
+    z = (z ^ (z >> 27U)) * 0x94D049BB133111EBLU;
+    return z ^ (z >> 31U);
+}
+
+double
+sample_z(double confidence)
+{
+    // Bisect 0.5 * erfc(z / sqrt(2)) = 1 - confidence.
+    double lo = 0.0;
+    double hi = 40.0;
+    double tail = 1.0 - confidence;
+    for (int i = 0; i < 100; ++i)
+    {
+        double mid = 0.5 * (lo + hi);
+        if (0.5 * erfc(mid / M_SQRT2) > tail)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return 0.5 * (lo + hi);
+}
+
+int64_t
+sample_scale(const sample_result_t* result, int64_t count)
+{
+    if (result->sampled_bytes == 0)
+    {
+        return 0;
+    }
+    return (int64_t) llround((double) count * (double) result->total_bytes
+                             / (double) result->sampled_bytes);
+}
+
+// Count words starting in chunk [offset, offset + size) of f.
+// buf must hold size + WORD_SIZE + 1 bytes.
+static int64_t
+sample_count_chunk(FILE* f, uint64_t offset, uint64_t size, char* buf,
+                   hashmap_map_t* map, sample_result_t* result)
+{
+    // One byte before the chunk tells if it starts inside a word,
+    // WORD_SIZE bytes after it complete the last word.
+    uint64_t begin = (offset > 0) ? offset - 1 : 0;
+    uint64_t want = (offset - begin) + size + WORD_SIZE;
+    if (fseeko(f, (off_t) begin, SEEK_SET) != 0)
+    {
+        fprintf(stderr, "sample_count_chunk(): error: fseeko()\n");
+        return SAMPLE_ERROR;
+    }
+
+    uint64_t len = fread(buf, 1, want, f);
+    if (len < want && ferror(f))
+    {
+        fprintf(stderr, "sample_count_chunk(): error: fread()\n");
+        return SAMPLE_ERROR;
+    }
+
+    uint64_t start = offset - begin;
+    if (start > 0 && is_word_char(buf[0]))
+    {
+        while (start < len && is_word_char(buf[start]))
+        {
+            start++;
+        }
+    }
+
+    uint64_t end = (offset - begin) + size;
+    end = (end < len) ? end : len;
+    while (end < len && is_word_char(buf[end]))
+    {
+        end++;
+    }
+
+    result->sampled_bytes += size;
+    if (start >= end)
+    {
+        return SAMPLE_OK;
+    }
+    return count_buffer(buf + start, end - start, map, &result->wordcount,
+                        &result->charcount);
+}
+
+static int
+sample_hash_cmp(const void* a, const void* b)
+{
+    hash_t ha = *(const hash_t*) a;
+    hash_t hb = *(const hash_t*) b;
+    return (ha > hb) - (ha < hb);
+}
+
+// Check whether the top k of map are stable, see sample.h.
+// prev holds the sorted top k hashes of the previous check and is
+// updated, hashes is scratch space of k hashes. Store relative error of
+// the k-th count in error.
+static bool
+sample_check(const hashmap_map_t* map, uint64_t k, double z,
+             const hashmap_bucket_t** top, hash_t* hashes, hash_t* prev,
+             uint64_t* prev_n, double* error)
+{
+    uint64_t n = hashmap_top_k(map, k + 1, top);
+    uint64_t kn = (n < k) ? n : k;
+    if (kn == 0)
+    {
+        *error = INFINITY;
+        return false;
+    }
+
+    double ck = (double) top[kn - 1]->value;
+    *error = z / sqrt(ck);
+
+    bool separated = true;
+    if (n > k)
+    {
+        double ck1 = (double) top[k]->value;
+        separated = (ck - ck1) >= z * sqrt(ck + ck1);
+    }
+
+    for (uint64_t i = 0; i < kn; ++i)
+    {
+        hashes[i] = top[i]->hash;
+    }
+    qsort(hashes, kn, sizeof(hash_t), sample_hash_cmp);
+
+    bool same = (*prev_n == kn)
+                && memcmp(prev, hashes, kn * sizeof(hash_t)) == 0;
+    memcpy(prev, hashes, kn * sizeof(hash_t));
+    *prev_n = kn;
+
+    return same && separated;
+}
+
+int64_t
+sample_count(FILE* f, const sample_config_t* config, hashmap_map_t* map,
+             sample_result_t* result)
+{
+    memset(result, 0, sizeof(sample_result_t));
+
+    struct stat st;
+    if (fstat(fileno(f), &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        fprintf(stderr, "sample_count(): error: input is not a regular "
+                        "file\n");
+        return SAMPLE_ERROR;
+    }
+    result->total_bytes = (uint64_t) st.st_size;
+
+    uint64_t chunk_size = config->chunk_size;
+    if (chunk_size == 0)
+    {
+        chunk_size = result->total_bytes / SAMPLE_TARGET_CHUNKS;
+        chunk_size = (chunk_size < SAMPLE_MIN_CHUNK_SIZE)
+                     ? SAMPLE_MIN_CHUNK_SIZE : chunk_size;
+        chunk_size = (chunk_size > SAMPLE_MAX_CHUNK_SIZE)
+                     ? SAMPLE_MAX_CHUNK_SIZE : chunk_size;
+    }
+    result->chunks = (result->total_bytes + chunk_size - 1) / chunk_size;
+
+    uint64_t* order = malloc((result->chunks + 1) * sizeof(uint64_t));
+    char* buf = malloc(chunk_size + WORD_SIZE + 1);
+    const hashmap_bucket_t** top = calloc(config->k + 1, sizeof(void*));
+    hash_t* hashes = calloc(config->k + 1, sizeof(hash_t));
+    hash_t* prev = calloc(config->k + 1, sizeof(hash_t));
+    if (!order || !buf || !top || !hashes || !prev)
+    {
+        fprintf(stderr, "sample_count(): error: allocating buffers\n");
+        free(order);
+        free(buf);
+        free(top);
+        free(hashes);
+        free(prev);
+        return SAMPLE_ERROR;
+    }
+
+    // Fisher-Yates shuffle of the chunk indices.
+    uint64_t state = config->seed;
+    for (uint64_t i = 0; i < result->chunks; ++i)
+    {
+        order[i] = i;
+    }
+    for (uint64_t i = result->chunks; i > 1; --i)
+    {
+        uint64_t j = sample_next_random(&state) % i;
+        uint64_t temp = order[i - 1];
+        order[i - 1] = order[j];
+        order[j] = temp;
+    }
+
+    double z = sample_z(config->confidence);
+    uint64_t prev_n = 0;
+    uint64_t next_check = SAMPLE_MIN_CHUNKS;
+    int64_t status = SAMPLE_OK;
+
+    while (result->chunks_read < result->chunks)
+    {
+        uint64_t offset = order[result->chunks_read] * chunk_size;
+        uint64_t size = result->total_bytes - offset;
+        size = (size < chunk_size) ? size : chunk_size;
+
+        status = sample_count_chunk(f, offset, size, buf, map, result);
+        if (status != SAMPLE_OK)
+        {
+            break;
+        }
+        result->chunks_read++;
+
+        if (result->chunks_read == next_check
+            && result->chunks_read < result->chunks)
+        {
+            if (sample_check(map, config->k, z, top, hashes, prev, &prev_n,
+                             &result->error))
+            {
+                result->converged = true;
+                break;
+            }
+            next_check = (uint64_t) ceil((double) next_check
+                                         * SAMPLE_CHECK_GROWTH);
+        }
+    }
+
+    if (!result->converged)
+    {
+        // Whole file was read, counts are exact.
+        result->error = 0.0;
+    }
+    result->fraction = result->total_bytes
+                       ? (double) result->sampled_bytes
+                         / (double) result->total_bytes
+                       : 1.0;
+
+    free(order);
+    free(buf);
+    free(top);
+    free(hashes);
+    free(prev);
+    return status;
+}
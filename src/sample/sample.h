@@ -0,0 +1,82 @@
+#ifndef MAPWORDS_SAMPLE_H
+#define MAPWORDS_SAMPLE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "hashmap.h"
+
+/*
+Sampling top-k estimation with early termination.
+
+A seekable file is split into equal chunks which are counted in a
+random order (sampling without replacement) into a map. Words cut by
+a chunk boundary belong to the chunk they start in.
+
+After a geometrically growing number of chunks the sample's top k + 1
+words are checked. Sampling stops once
+  - the top k set equals the one from the previous check, and
+  - the k-th and (k + 1)-th sample counts c_k, c_k1 differ
+    significantly: (c_k - c_k1) / sqrt(c_k + c_k1) >= z, where z is
+    the one-sided normal quantile of the requested confidence and
+    counts are treated as Poisson variables,
+or when the whole file has been read.
+
+Estimated counts are sample counts scaled by total / sampled bytes.
+The reported error is the relative half-width z / sqrt(c_k) of the
+confidence interval of the k-th count. Chunks are not independent
+word draws, so for bursty vocabularies the interval is optimistic;
+larger files split into more chunks fare better.
+*/
+
+#define SAMPLE_ERROR -1
+#define SAMPLE_OK 0
+
+#define SAMPLE_MAX_CHUNK_SIZE (1024U * 1024U)
+#define SAMPLE_MIN_CHUNK_SIZE (64U * 1024U)
+
+// Chunk count aimed for when choosing the chunk size.
+#define SAMPLE_TARGET_CHUNKS 256U
+
+// Chunks read before the first stability check.
+#define SAMPLE_MIN_CHUNKS 8U
+
+#define SAMPLE_DEFAULT_CONFIDENCE 0.95
+
+typedef struct sample_config
+{
+    uint64_t k;
+    double confidence;
+    uint64_t chunk_size; // 0 chooses one from the file size.
+    uint64_t seed;
+} sample_config_t;
+
+typedef struct sample_result
+{
+    uint64_t total_bytes;
+    uint64_t sampled_bytes;
+    uint64_t chunks;
+    uint64_t chunks_read;
+    uint64_t wordcount;
+    uint64_t charcount;
+    double fraction; // sampled_bytes / total_bytes.
+    double error; // Relative error of the k-th count estimate.
+    bool converged; // Stopped before reading the whole file.
+} sample_result_t;
+
+// One-sided standard normal quantile for confidence in (0, 1).
+double
+sample_z(double confidence);
+
+// Count random chunks of seekable file f into map until its top k
+// words are stable at the configured confidence.
+int64_t
+sample_count(FILE* f, const sample_config_t* config, hashmap_map_t* map,
+             sample_result_t* result);
+
+// Scale a sample count to an estimate for the whole file.
+int64_t
+sample_scale(const sample_result_t* result, int64_t count);
+
+#endif //MAPWORDS_SAMPLE_H
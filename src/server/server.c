@@ -0,0 +1,659 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "count.h"
+#include "hash.h"
+#include "hashmap.h"
+#include "server.h"
+#include "util.h"
+
+#define SERVER_SHARD_SEED 0xD6E8FEB86659FD93LU
+#define SERVER_BACKLOG 64
+
+// Connection state, reused by all requests of the connection.
+struct server_conn
+{
+    server_t* server;
+    int fd;
+    pthread_t thread;
+    atomic_bool done;
+
+    char* in; // Request payload.
+    uint64_t in_capacity;
+    char* out; // Response payload.
+    uint64_t out_capacity;
+
+    hashmap_map_t* scratch; // Counts of the request being ingested.
+    uint64_t* order; // Scratch bucket indices grouped by shard.
+    uint64_t order_capacity;
+
+    server_conn_t* next;
+};
+
+// Candidate for the merged top-k.
+typedef struct server_entry
+{
+    int64_t value;
+    char* key;
+} server_entry_t;
+
+static inline uint64_t
+server_shard_of(hash_t hash)
+{
+    return hash_mix(hash, SERVER_SHARD_SEED) & (SERVER_SHARDS - 1);
+}
+
+// Grow buffer to hold at least size bytes.
+static int64_t
+server_reserve(char** buf, uint64_t* capacity, uint64_t size)
+{
+    if (size <= *capacity)
+    {
+        return SERVER_OK;
+    }
+
+    uint64_t new_capacity = *capacity ? *capacity : 4096;
+    while (new_capacity < size)
+    {
+        new_capacity *= 2;
+    }
+
+    char* new_buf = realloc(*buf, new_capacity);
+    if (!new_buf)
+    {
+        fprintf(stderr, "server_reserve(): error: realloc()\n");
+        return SERVER_ERROR;
+    }
+    *buf = new_buf;
+    *capacity = new_capacity;
+    return SERVER_OK;
+}
+
+static int64_t
+server_read_full(int fd, void* buf, uint64_t len)
+{
+    char* p = buf;
+    while (len > 0)
+    {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return SERVER_ERROR;
+        }
+        p += n;
+        len -= (uint64_t) n;
+    }
+    return SERVER_OK;
+}
+
+static int64_t
+server_write_full(int fd, const void* buf, uint64_t len)
+{
+    const char* p = buf;
+    while (len > 0)
+    {
+        // No SIGPIPE from peers that went away.
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return SERVER_ERROR;
+        }
+        p += n;
+        len -= (uint64_t) n;
+    }
+    return SERVER_OK;
+}
+
+static int
+server_address(const char* path, struct sockaddr_un* addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path))
+    {
+        fprintf(stderr, "server_address(): error: path too long: %s\n", path);
+        return SERVER_ERROR;
+    }
+    strcpy(addr->sun_path, path);
+    return SERVER_OK;
+}
+
+server_t*
+server_init(const char* path, hash_t (* hashf)(const char*))
+{
+    server_t* server = calloc(1, sizeof(server_t));
+    if (!server)
+    {
+        fprintf(stderr, "server_init(): error: calloc(): server\n");
+        return NULL;
+    }
+
+    server->fd = -1;
+    server->hashf = hashf;
+    pthread_mutex_init(&server->conns_lock, NULL);
+    for (uint64_t i = 0; i < SERVER_SHARDS; ++i)
+    {
+        pthread_rwlock_init(&server->shards[i].lock, NULL);
+        server->shards[i].map = hashmap_init(hashf);
+        if (!server->shards[i].map)
+        {
+            server_free(server);
+            return NULL;
+        }
+    }
+
+    struct sockaddr_un addr;
+    if (server_address(path, &addr) != SERVER_OK)
+    {
+        server_free(server);
+        return NULL;
+    }
+
+    // Replace a socket left behind by a previous server, nothing else.
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+        unlink(path);
+    }
+
+    server->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server->fd < 0
+        || bind(server->fd, (struct sockaddr*) &addr, sizeof(addr)) != 0)
+    {
+        fprintf(stderr, "server_init(): error: bind(): %s\n", path);
+        server_free(server);
+        return NULL;
+    }
+
+    // Only unlink the socket file once it is ours.
+    server->path = strdup(path);
+    if (!server->path || listen(server->fd, SERVER_BACKLOG) != 0)
+    {
+        fprintf(stderr, "server_init(): error: listen(): %s\n", path);
+        server_free(server);
+        return NULL;
+    }
+
+    return server;
+}
+
+static int64_t
+server_count_word(char* word, uint64_t len, void* ctx)
+{
+    (void) len;
+    return hashmap_increment(ctx, word, 1);
+}
+
+// Count text into the scratch map, then merge it into the shards
+// taking each shard lock once.
+static int64_t
+server_ingest(server_conn_t* conn, uint64_t len, server_response_t* response)
+{
+    server_t* server = conn->server;
+    hashmap_map_t* scratch = conn->scratch;
+    uint64_t wordcount = 0;
+    uint64_t charcount = 0;
+
+    hashmap_clear(scratch);
+    if (count_buffer_each(conn->in, len, server_count_word,
+                          scratch, &wordcount, &charcount) != 0)
+    {
+        return SERVER_ERROR;
+    }
+
+    if (scratch->size > conn->order_capacity)
+    {
+        uint64_t* order = realloc(conn->order,
+                                  scratch->capacity * sizeof(uint64_t));
+        if (!order)
+        {
+            fprintf(stderr, "server_ingest(): error: realloc(): order\n");
+            return SERVER_ERROR;
+        }
+        conn->order = order;
+        conn->order_capacity = scratch->capacity;
+    }
+
+    // Counting sort of bucket indices by shard.
+    uint64_t start[SERVER_SHARDS + 1] = {0};
+    for (uint64_t i = 0; i < scratch->capacity; ++i)
+    {
+        if (scratch->buckets[i].in_use)
+        {
+            start[server_shard_of(scratch->buckets[i].hash) + 1]++;
+        }
+    }
+    for (uint64_t s = 0; s < SERVER_SHARDS; ++s)
+    {
+        start[s + 1] += start[s];
+    }
+    uint64_t next[SERVER_SHARDS];
+    memcpy(next, start, sizeof(next));
+    for (uint64_t i = 0; i < scratch->capacity; ++i)
+    {
+        if (scratch->buckets[i].in_use)
+        {
+            conn->order[next[server_shard_of(scratch->buckets[i].hash)]++] = i;
+        }
+    }
+
+    int64_t status = SERVER_OK;
+    for (uint64_t s = 0; s < SERVER_SHARDS && status == SERVER_OK; ++s)
+    {
+        if (start[s] == start[s + 1])
+        {
+            continue;
+        }
+
+        server_shard_t* shard = &server->shards[s];
+        pthread_rwlock_wrlock(&shard->lock);
+        for (uint64_t j = start[s]; j < start[s + 1]; ++j)
+        {
+            hashmap_bucket_t* bucket = &scratch->buckets[conn->order[j]];
+            if (hashmap_increment_knownhash(shard->map, bucket->key,
+                                            bucket->value, bucket->hash)
+                != HASHMAP_OK)
+            {
+                status = SERVER_ERROR;
+                break;
+            }
+        }
+        pthread_rwlock_unlock(&shard->lock);
+    }
+
+    atomic_fetch_add(&server->wordcount, wordcount);
+    atomic_fetch_add(&server->charcount, charcount);
+    response->value = wordcount;
+    return status;
+}
+
+static int64_t
+server_count(server_conn_t* conn, uint64_t len, server_response_t* response)
+{
+    response->value = 0;
+    if (len == 0 || len >= WORD_SIZE)
+    {
+        return SERVER_OK;
+    }
+
+    char word[WORD_SIZE];
+    memcpy(word, conn->in, len);
+    word[len] = '\0';
+    str_tolower(word);
+
+    server_t* server = conn->server;
+    hash_t hash = server->hashf(word);
+    server_shard_t* shard = &server->shards[server_shard_of(hash)];
+    int64_t value = 0;
+
+    pthread_rwlock_rdlock(&shard->lock);
+    if (hashmap_get_shared(shard->map, word, hash, &value)
+        == HASHMAP_KEY_FOUND)
+    {
+        response->value = (uint64_t) value;
+    }
+    pthread_rwlock_unlock(&shard->lock);
+    return SERVER_OK;
+}
+
+static int
+server_entry_compare(const void* a, const void* b)
+{
+    const server_entry_t* x = a;
+    const server_entry_t* y = b;
+    if (x->value != y->value)
+    {
+        return (x->value < y->value) ? 1 : -1;
+    }
+    return strcmp(x->key, y->key);
+}
+
+// Merge the top k of every shard into the response payload.
+static int64_t
+server_top_k(server_conn_t* conn, uint64_t k, server_response_t* response)
+{
+    server_t* server = conn->server;
+    k = (k > SERVER_MAX_TOPK) ? SERVER_MAX_TOPK : k;
+    response->count = 0;
+    if (k == 0)
+    {
+        return SERVER_OK;
+    }
+
+    const hashmap_bucket_t** top = calloc(k, sizeof(hashmap_bucket_t*));
+    server_entry_t* entries = calloc(k * SERVER_SHARDS, sizeof(server_entry_t));
+    if (!top || !entries)
+    {
+        fprintf(stderr, "server_top_k(): error: calloc()\n");
+        free(top);
+        free(entries);
+        return SERVER_ERROR;
+    }
+
+    int64_t status = SERVER_OK;
+    uint64_t count = 0;
+    for (uint64_t s = 0; s < SERVER_SHARDS; ++s)
+    {
+        server_shard_t* shard = &server->shards[s];
+        pthread_rwlock_rdlock(&shard->lock);
+        uint64_t n = hashmap_top_k(shard->map, k, top);
+        for (uint64_t i = 0; i < n; ++i)
+        {
+            // Keys are copied, the map may rehash after unlocking.
+            entries[count].value = top[i]->value;
+            entries[count].key = strdup(top[i]->key);
+            status = entries[count++].key ? status : SERVER_ERROR;
+        }
+        pthread_rwlock_unlock(&shard->lock);
+    }
+
+    if (status == SERVER_OK)
+    {
+        qsort(entries, count, sizeof(server_entry_t), server_entry_compare);
+    }
+
+    count = (count < k) ? count : k;
+    uint64_t size = 0;
+    for (uint64_t i = 0; i < count && status == SERVER_OK; ++i)
+    {
+        uint32_t len = (uint32_t) strlen(entries[i].key);
+        status = server_reserve(&conn->out, &conn->out_capacity,
+                                size + sizeof(int64_t) + sizeof(uint32_t) + len);
+        if (status == SERVER_OK)
+        {
+            memcpy(conn->out + size, &entries[i].value, sizeof(int64_t));
+            size += sizeof(int64_t);
+            memcpy(conn->out + size, &len, sizeof(uint32_t));
+            size += sizeof(uint32_t);
+            memcpy(conn->out + size, entries[i].key, len);
+            size += len;
+        }
+    }
+
+    for (uint64_t i = 0; i < k * SERVER_SHARDS; ++i)
+    {
+        free(entries[i].key);
+    }
+    free(entries);
+    free(top);
+
+    response->count = (uint32_t) count;
+    response->length = size;
+    return status;
+}
+
+static int64_t
+server_distinct(server_t* server, server_response_t* response)
+{
+    uint64_t size = 0;
+    for (uint64_t s = 0; s < SERVER_SHARDS; ++s)
+    {
+        pthread_rwlock_rdlock(&server->shards[s].lock);
+        size += server->shards[s].map->size;
+        pthread_rwlock_unlock(&server->shards[s].lock);
+    }
+    response->value = size;
+    return SERVER_OK;
+}
+
+static void*
+server_conn_run(void* arg)
+{
+    server_conn_t* conn = arg;
+    server_t* server = conn->server;
+    server_request_t request;
+
+    while (!atomic_load(&server->stop)
+           && server_read_full(conn->fd, &request, sizeof(request))
+              == SERVER_OK)
+    {
+        if (request.length > SERVER_MAX_PAYLOAD
+            || server_reserve(&conn->in, &conn->in_capacity,
+                              request.length) != SERVER_OK
+            || server_read_full(conn->fd, conn->in, request.length)
+               != SERVER_OK)
+        {
+            break;
+        }
+
+        server_response_t response = {0};
+        bool valid = true;
+        int64_t status;
+        switch (request.op)
+        {
+            case SERVER_OP_INGEST:
+                status = server_ingest(conn, request.length, &response);
+                break;
+            case SERVER_OP_COUNT:
+                status = server_count(conn, request.length, &response);
+                break;
+            case SERVER_OP_TOPK:
+                status = server_top_k(conn, request.arg, &response);
+                break;
+            case SERVER_OP_DISTINCT:
+                status = server_distinct(server, &response);
+                break;
+            case SERVER_OP_STATS:
+                response.value = atomic_load(&server->wordcount);
+                status = SERVER_OK;
+                break;
+            default:
+                fprintf(stderr, "server_conn_run(): error: unknown "
+                                "operation: %"PRIu32"\n", request.op);
+                valid = false;
+                status = SERVER_ERROR;
+                break;
+        }
+
+        if (status != SERVER_OK)
+        {
+            response.status = SERVER_ERROR;
+            response.length = 0;
+        }
+
+        atomic_fetch_add(&server->requests, 1);
+        if (server_write_full(conn->fd, &response, sizeof(response))
+            != SERVER_OK
+            || server_write_full(conn->fd, conn->out, response.length)
+               != SERVER_OK
+            || !valid)
+        {
+            break;
+        }
+    }
+
+    atomic_store(&conn->done, true);
+    return NULL;
+}
+
+static void
+server_conn_free(server_conn_t* conn)
+{
+    close(conn->fd);
+    hashmap_free(conn->scratch);
+    free(conn->in);
+    free(conn->out);
+    free(conn->order);
+    free(conn);
+}
+
+// Join and free finished connections, or all with wait.
+static void
+server_reap(server_t* server, bool wait)
+{
+    pthread_mutex_lock(&server->conns_lock);
+    server_conn_t** link = &server->conns;
+    while (*link)
+    {
+        server_conn_t* conn = *link;
+        if (wait || atomic_load(&conn->done))
+        {
+            if (wait)
+            {
+                // Wake a thread blocked reading from an idle client.
+                shutdown(conn->fd, SHUT_RDWR);
+            }
+            pthread_join(conn->thread, NULL);
+            *link = conn->next;
+            server_conn_free(conn);
+        }
+        else
+        {
+            link = &conn->next;
+        }
+    }
+    pthread_mutex_unlock(&server->conns_lock);
+}
+
+int64_t
+server_run(server_t* server)
+{
+    while (!atomic_load(&server->stop))
+    {
+        int fd = accept(server->fd, NULL, NULL);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            if (atomic_load(&server->stop))
+            {
+                break;
+            }
+            fprintf(stderr, "server_run(): error: accept()\n");
+            return SERVER_ERROR;
+        }
+
+        server_reap(server, false);
+
+        server_conn_t* conn = calloc(1, sizeof(server_conn_t));
+        if (!conn || !(conn->scratch = hashmap_init(server->hashf)))
+        {
+            fprintf(stderr, "server_run(): error: calloc(): conn\n");
+            free(conn);
+            close(fd);
+            continue;
+        }
+        conn->server = server;
+        conn->fd = fd;
+
+        pthread_mutex_lock(&server->conns_lock);
+        if (pthread_create(&conn->thread, NULL, server_conn_run, conn) != 0)
+        {
+            pthread_mutex_unlock(&server->conns_lock);
+            fprintf(stderr, "server_run(): error: pthread_create()\n");
+            server_conn_free(conn);
+            continue;
+        }
+        conn->next = server->conns;
+        server->conns = conn;
+        pthread_mutex_unlock(&server->conns_lock);
+        atomic_fetch_add(&server->connections, 1);
+    }
+
+    return SERVER_OK;
+}
+
+void
+server_stop(server_t* server)
+{
+    atomic_store(&server->stop, true);
+    // Makes a blocked accept() fail.
+    shutdown(server->fd, SHUT_RDWR);
+}
+
+void
+server_free(server_t* server)
+{
+    if (server == NULL)
+    {
+        return;
+    }
+
+    atomic_store(&server->stop, true);
+    server_reap(server, true);
+
+    if (server->fd >= 0)
+    {
+        close(server->fd);
+    }
+    if (server->path)
+    {
+        unlink(server->path);
+        free(server->path);
+    }
+
+    for (uint64_t i = 0; i < SERVER_SHARDS; ++i)
+    {
+        pthread_rwlock_destroy(&server->shards[i].lock);
+        hashmap_free(server->shards[i].map);
+    }
+    pthread_mutex_destroy(&server->conns_lock);
+    free(server);
+}
+
+int
+server_connect(const char* path)
+{
+    struct sockaddr_un addr;
+    if (server_address(path, &addr) != SERVER_OK)
+    {
+        return SERVER_ERROR;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0)
+    {
+        fprintf(stderr, "server_connect(): error: connect(): %s\n", path);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return SERVER_ERROR;
+    }
+    return fd;
+}
+
+int64_t
+server_call(int fd, uint32_t op, uint32_t arg, const void* payload,
+            uint64_t length, server_response_t* response, void** out)
+{
+    server_request_t request = {.op = op, .arg = arg, .length = length};
+    *out = NULL;
+
+    if (server_write_full(fd, &request, sizeof(request)) != SERVER_OK
+        || server_write_full(fd, payload, length) != SERVER_OK
+        || server_read_full(fd, response, sizeof(*response)) != SERVER_OK)
+    {
+        return SERVER_ERROR;
+    }
+
+    if (response->length > 0)
+    {
+        *out = malloc(response->length);
+        if (!*out
+            || server_read_full(fd, *out, response->length) != SERVER_OK)
+        {
+            free(*out);
+            *out = NULL;
+            return SERVER_ERROR;
+        }
+    }
+
+    return (response->status == SERVER_OK) ? SERVER_OK : SERVER_ERROR;
+}
@@ -0,0 +1,132 @@
+#ifndef MAPWORDS_SERVER_H
+#define MAPWORDS_SERVER_H
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "hash.h"
+#include "hashmap.h"
+
+/*
+Long-running word count server on a Unix domain stream socket.
+
+Counts live in SERVER_SHARDS maps, each behind a reader-writer lock.
+A word belongs to the shard picked by its mixed hash (the map itself
+indexes by the low hash bits, so those are not used for sharding).
+Maps, their key buffers and per-connection scratch memory stay
+allocated between requests, so repeated small requests pay neither
+process startup nor map growth.
+
+Every connection is served by its own thread. Ingesting a text
+counts it into the connection's scratch map without any lock, then
+merges the scratch map into the shards, holding each write lock once
+per request. Queries take read locks only, so they run concurrently
+with each other and with the counting part of ingestion.
+
+Protocol, integers in host byte order (the socket is local):
+
+  request   server_request_t, then length payload bytes
+  response  server_response_t, then length payload bytes
+
+  SERVER_OP_INGEST    payload is text, counted as one document: a
+                      word is never continued by the next request.
+                      value = words counted.
+  SERVER_OP_COUNT     payload is a word (not null-terminated).
+                      value = its count, 0 if never seen.
+  SERVER_OP_TOPK      arg = k. count entries follow as records of
+                      int64 value, uint32 length and key bytes, by
+                      value (descending) and key (ascending).
+  SERVER_OP_DISTINCT  value = number of distinct words.
+  SERVER_OP_STATS     value = total words ingested.
+
+Status is SERVER_OK or SERVER_ERROR. Malformed requests (unknown
+operation, payload over SERVER_MAX_PAYLOAD) close the connection.
+*/
+
+#define SERVER_ERROR -1
+#define SERVER_OK 0
+
+#define SERVER_SHARDS 16U
+#define SERVER_MAX_PAYLOAD (64U * 1024U * 1024U)
+#define SERVER_MAX_TOPK 65536U
+
+enum
+{
+    SERVER_OP_INGEST = 1,
+    SERVER_OP_COUNT,
+    SERVER_OP_TOPK,
+    SERVER_OP_DISTINCT,
+    SERVER_OP_STATS,
+};
+
+typedef struct server_request
+{
+    uint32_t op;
+    uint32_t arg;
+    uint64_t length;
+} server_request_t;
+
+typedef struct server_response
+{
+    int32_t status;
+    uint32_t count;
+    uint64_t value;
+    uint64_t length;
+} server_response_t;
+
+typedef struct server_shard
+{
+    pthread_rwlock_t lock;
+    hashmap_map_t* map;
+} server_shard_t;
+
+typedef struct server_conn server_conn_t;
+
+typedef struct server
+{
+    int fd; // Listening socket.
+    char* path;
+    hash_t (* hashf)(const char*);
+    server_shard_t shards[SERVER_SHARDS];
+
+    atomic_bool stop;
+    atomic_uint_fast64_t wordcount;
+    atomic_uint_fast64_t charcount;
+    atomic_uint_fast64_t requests;
+    atomic_uint_fast64_t connections;
+
+    // Connection threads, guarded by conns_lock.
+    pthread_mutex_t conns_lock;
+    server_conn_t* conns;
+} server_t;
+
+// Create server listening on socket path. A stale socket file at
+// path is replaced.
+server_t*
+server_init(const char* path, hash_t (* hashf)(const char*));
+
+// Accept and serve connections until server_stop() is called.
+int64_t
+server_run(server_t* server);
+
+// Make server_run() return. Async-signal-safe.
+void
+server_stop(server_t* server);
+
+// Close all connections, remove the socket file and free server.
+void
+server_free(server_t* server);
+
+// Connect to server socket. Return file descriptor or SERVER_ERROR.
+int
+server_connect(const char* path);
+
+// Send one request and read its response. A response payload is
+// allocated into *out (NULL if empty), caller frees it.
+int64_t
+server_call(int fd, uint32_t op, uint32_t arg, const void* payload,
+            uint64_t length, server_response_t* response, void** out);
+
+#endif //MAPWORDS_SERVER_H
@@ -0,0 +1,571 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "hash.h"
+#include "snapshot.h"
+
+#define SNAPSHOT_ALIGN(x) (((x) + 7U) & ~(uint64_t) 7U)
+
+#define SNAPSHOT_INITIAL_CAPACITY 1024U
+
+// Names tried for a temporary file before giving up.
+#define SNAPSHOT_TMP_ATTEMPTS 100U
+
+// Makes temporary file names of one process unique across threads.
+static atomic_uint_fast64_t snapshot_tmp_counter;
+
+// Multiplier of the checksum word mixing step.
+#define SNAPSHOT_CHECKSUM_PRIME 0x9E3779B97F4A7C15LU
+
+uint64_t
+snapshot_checksum(const void* data, uint64_t len, uint64_t seed)
+{
+    const unsigned char* bytes = data;
+    uint64_t h = seed ^ len;
+    uint64_t i = 0;
+
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        h = (h ^ word) * SNAPSHOT_CHECKSUM_PRIME;
+        h ^= h >> 29U;
+    }
+
+    uint64_t tail = 0;
+    for (uint64_t shift = 0; i < len; ++i, shift += 8)
+    {
+        tail |= (uint64_t) bytes[i] << shift;
+    }
+    h = (h ^ tail) * SNAPSHOT_CHECKSUM_PRIME;
+
+    return hash_mix(h, len);
+}
+
+static uint64_t
+snapshot_body_checksum(const snapshot_header_t* header,
+                       const snapshot_entry_t* entries, const uint32_t* index,
+                       const char* pool)
+{
+    uint64_t h = snapshot_checksum(entries,
+                                   header->count * sizeof(snapshot_entry_t),
+                                   SNAPSHOT_VERSION);
+    h = snapshot_checksum(index, header->index_capacity * sizeof(uint32_t), h);
+    return snapshot_checksum(pool, header->pool_size, h);
+}
+
+static uint64_t
+snapshot_header_checksum(const snapshot_header_t* header)
+{
+    return snapshot_checksum(header, offsetof(snapshot_header_t,
+                                              header_checksum), 0);
+}
+
+// Validate header fields and that all sections lie within size.
+static bool
+snapshot_header_valid(const snapshot_header_t* h, uint64_t size)
+{
+    if (memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic)) != 0)
+    {
+        fprintf(stderr, "snapshot_open(): error: not a snapshot file\n");
+        return false;
+    }
+    if (h->endian != SNAPSHOT_ENDIAN || h->version != SNAPSHOT_VERSION)
+    {
+        fprintf(stderr, "snapshot_open(): error: unsupported version %u "
+                        "or byte order\n", h->version);
+        return false;
+    }
+    if (h->header_checksum != snapshot_header_checksum(h))
+    {
+        fprintf(stderr, "snapshot_open(): error: header checksum mismatch\n");
+        return false;
+    }
+
+    uint64_t cap = h->index_capacity;
+    bool valid = h->file_size == size
+                 && h->count < UINT32_MAX
+                 && cap > 0 && (cap & (cap - 1)) == 0 && cap >= 2 * h->count
+                 && h->entries_offset == SNAPSHOT_ALIGN(sizeof(snapshot_header_t))
+                 && h->index_offset == h->entries_offset
+                                       + h->count * sizeof(snapshot_entry_t)
+                 && h->pool_offset == SNAPSHOT_ALIGN(h->index_offset
+                                                     + cap * sizeof(uint32_t))
+                 && h->pool_offset + h->pool_size <= size
+                 && h->hashf[SNAPSHOT_HASHF_LENGTH - 1] == '\0';
+    if (!valid)
+    {
+        fprintf(stderr, "snapshot_open(): error: corrupt layout\n");
+    }
+    return valid;
+}
+
+// Check that all keys lie within the pool, which must end each of
+// them, and that index slots name existing entries and leave empty
+// slots to end probing.
+static bool
+snapshot_bounds_valid(const snapshot_t* snap)
+{
+    const snapshot_header_t* h = snap->header;
+    for (uint64_t i = 0; i < h->count; ++i)
+    {
+        if (!snapshot_key(snap, &snap->entries[i]))
+        {
+            return false;
+        }
+    }
+
+    uint64_t used = 0;
+    for (uint64_t i = 0; i < h->index_capacity; ++i)
+    {
+        if (snap->index[i] > h->count)
+        {
+            return false;
+        }
+        used += (snap->index[i] != 0);
+    }
+    return used <= h->count;
+}
+
+snapshot_t*
+snapshot_open(const char* path, bool verify)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "snapshot_open(): error: open(): %s\n", path);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t) st.st_size < sizeof(snapshot_header_t))
+    {
+        fprintf(stderr, "snapshot_open(): error: file too small: %s\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    void* data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        fprintf(stderr, "snapshot_open(): error: mmap(): %s\n", path);
+        return NULL;
+    }
+
+    snapshot_t* snap = calloc(1, sizeof(snapshot_t));
+    if (!snap)
+    {
+        fprintf(stderr, "snapshot_open(): error: calloc(): snap\n");
+        munmap(data, (size_t) st.st_size);
+        return NULL;
+    }
+
+    snap->data = data;
+    snap->size = (uint64_t) st.st_size;
+    snap->header = data;
+
+    const snapshot_header_t* h = snap->header;
+    if (!snapshot_header_valid(h, snap->size))
+    {
+        snapshot_close(snap);
+        return NULL;
+    }
+
+    snap->entries = (const snapshot_entry_t*) ((const char*) data
+                                               + h->entries_offset);
+    snap->index = (const uint32_t*) ((const char*) data + h->index_offset);
+    snap->pool = (const char*) data + h->pool_offset;
+    snap->hashf = get_hashf(h->hashf);
+    if (!snap->hashf)
+    {
+        fprintf(stderr, "snapshot_open(): error: unknown hash function: %s\n",
+                h->hashf);
+        snapshot_close(snap);
+        return NULL;
+    }
+
+    if (verify && !snapshot_verify(snap))
+    {
+        snapshot_close(snap);
+        return NULL;
+    }
+
+    return snap;
+}
+
+bool
+snapshot_verify(const snapshot_t* snap)
+{
+    const snapshot_header_t* h = snap->header;
+    if (snapshot_body_checksum(h, snap->entries, snap->index, snap->pool)
+        != h->body_checksum)
+    {
+        fprintf(stderr, "snapshot_verify(): error: body checksum mismatch\n");
+        return false;
+    }
+    if (!snapshot_bounds_valid(snap))
+    {
+        fprintf(stderr, "snapshot_verify(): error: corrupt entries or index\n");
+        return false;
+    }
+    return true;
+}
+
+void
+snapshot_close(snapshot_t* snap)
+{
+    if (snap != NULL)
+    {
+        munmap((void*) snap->data, snap->size);
+        free(snap);
+    }
+}
+
+int64_t
+snapshot_get_knownhash(const snapshot_t* snap, const char* key, hash_t hash,
+                       int64_t* out)
+{
+    const snapshot_header_t* h = snap->header;
+    uint64_t mask = h->index_capacity - 1;
+    uint64_t slot = hash & mask;
+
+    // Slots are checked as they are probed, a valid index always has
+    // an empty slot within index_capacity probes.
+    for (uint64_t probes = 0; snap->index[slot] != 0; ++probes)
+    {
+        const snapshot_entry_t* e = (snap->index[slot] <= h->count)
+                                    ? &snap->entries[snap->index[slot] - 1]
+                                    : NULL;
+        const char* entry_key = e ? snapshot_key(snap, e) : NULL;
+        if (!entry_key || probes == h->index_capacity)
+        {
+            fprintf(stderr, "snapshot_get(): error: corrupt entries or "
+                            "index\n");
+            return SNAPSHOT_ERROR;
+        }
+
+        if (e->hash == hash && strcmp(entry_key, key) == 0)
+        {
+            *out = e->value;
+            return SNAPSHOT_KEY_FOUND;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    return SNAPSHOT_KEY_NOT_FOUND;
+}
+
+int64_t
+snapshot_get(const snapshot_t* snap, const char* key, int64_t* out)
+{
+    return snapshot_get_knownhash(snap, key, snap->hashf(key), out);
+}
+
+snapshot_writer_t*
+snapshot_writer_init(const char* path, hash_t (* hashf)(const char*),
+                     uint64_t capacity)
+{
+    if (!get_hashf_name(hashf))
+    {
+        fprintf(stderr, "snapshot_writer_init(): error: unknown hash "
+                        "function\n");
+        return NULL;
+    }
+
+    snapshot_writer_t* writer = calloc(1, sizeof(snapshot_writer_t));
+    if (!writer)
+    {
+        fprintf(stderr, "snapshot_writer_init(): error: calloc(): writer\n");
+        return NULL;
+    }
+
+    capacity = (capacity > 0) ? capacity : SNAPSHOT_INITIAL_CAPACITY;
+    writer->path = strdup(path);
+    writer->hashf = hashf;
+    writer->capacity = capacity;
+    writer->entries = malloc(capacity * sizeof(snapshot_entry_t));
+    writer->pool_capacity = capacity * 8;
+    writer->pool = malloc(writer->pool_capacity);
+    if (!writer->path || !writer->entries || !writer->pool)
+    {
+        fprintf(stderr, "snapshot_writer_init(): error: allocating "
+                        "buffers\n");
+        snapshot_writer_free(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+void
+snapshot_writer_free(snapshot_writer_t* writer)
+{
+    if (writer != NULL)
+    {
+        free(writer->path);
+        free(writer->entries);
+        free(writer->pool);
+        free(writer);
+    }
+}
+
+int64_t
+snapshot_writer_add(snapshot_writer_t* writer, const char* key,
+                    uint64_t len, hash_t hash, int64_t value)
+{
+    if (writer->count + 1 >= UINT32_MAX)
+    {
+        fprintf(stderr, "snapshot_writer_add(): error: too many entries\n");
+        return SNAPSHOT_ERROR;
+    }
+
+    if (writer->count == writer->capacity)
+    {
+        uint64_t capacity = writer->capacity * 2;
+        snapshot_entry_t* entries = realloc(
+            writer->entries, capacity * sizeof(snapshot_entry_t));
+        if (!entries)
+        {
+            fprintf(stderr, "snapshot_writer_add(): error: realloc(): "
+                            "entries\n");
+            return SNAPSHOT_ERROR;
+        }
+        writer->entries = entries;
+        writer->capacity = capacity;
+    }
+
+    if (writer->pool_size + len + 1 > writer->pool_capacity)
+    {
+        uint64_t capacity = writer->pool_capacity * 2 + len + 1;
+        char* pool = realloc(writer->pool, capacity);
+        if (!pool)
+        {
+            fprintf(stderr, "snapshot_writer_add(): error: realloc(): pool\n");
+            return SNAPSHOT_ERROR;
+        }
+        writer->pool = pool;
+        writer->pool_capacity = capacity;
+    }
+
+    snapshot_entry_t* e = &writer->entries[writer->count++];
+    e->hash = hash;
+    e->value = value;
+    e->key_offset = writer->pool_size;
+    e->key_len = (uint32_t) len;
+    e->reserved = 0;
+
+    memcpy(writer->pool + writer->pool_size, key, len);
+    writer->pool[writer->pool_size + len] = '\0';
+    writer->pool_size += len + 1;
+    writer->total += (uint64_t) value;
+
+    return SNAPSHOT_OK;
+}
+
+typedef struct snapshot_sort_item
+{
+    snapshot_entry_t entry;
+    const char* key;
+} snapshot_sort_item_t;
+
+static int
+snapshot_sort_cmp(const void* a, const void* b)
+{
+    const snapshot_sort_item_t* ia = a;
+    const snapshot_sort_item_t* ib = b;
+    if (ia->entry.value != ib->entry.value)
+    {
+        return (ia->entry.value < ib->entry.value) ? 1 : -1;
+    }
+    return strcmp(ia->key, ib->key);
+}
+
+// Sort entries by value (desc) and key (asc), rewriting the pool in
+// entry order so that top entries are also close in the pool.
+static int64_t
+snapshot_writer_sort(snapshot_writer_t* writer)
+{
+    uint64_t n = writer->count;
+    snapshot_sort_item_t* items = malloc((n + 1) * sizeof(snapshot_sort_item_t));
+    char* pool = malloc(writer->pool_size + 1);
+    if (!items || !pool)
+    {
+        fprintf(stderr, "snapshot_writer_sort(): error: malloc()\n");
+        free(items);
+        free(pool);
+        return SNAPSHOT_ERROR;
+    }
+
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        items[i].entry = writer->entries[i];
+        items[i].key = writer->pool + writer->entries[i].key_offset;
+    }
+    qsort(items, n, sizeof(snapshot_sort_item_t), snapshot_sort_cmp);
+
+    uint64_t offset = 0;
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        snapshot_entry_t* e = &writer->entries[i];
+        *e = items[i].entry;
+        memcpy(pool + offset, items[i].key, e->key_len + 1);
+        e->key_offset = offset;
+        offset += e->key_len + 1;
+    }
+
+    free(items);
+    free(writer->pool);
+    writer->pool = pool;
+    writer->pool_capacity = writer->pool_size + 1;
+    return SNAPSHOT_OK;
+}
+
+static bool
+snapshot_write_all(FILE* f, const void* data, uint64_t len)
+{
+    return len == 0 || fwrite(data, 1, len, f) == len;
+}
+
+int64_t
+snapshot_publish(const char* path, snapshot_write_fn fn, void* ctx)
+{
+    // open() applies the umask to 0666 itself. mkstemp() would create
+    // the file private and reading the umask to fix that races with
+    // other threads, so the name is made unique by pid and counter.
+    char tmp_path[strlen(path) + 48];
+    int fd = -1;
+    for (uint64_t i = 0; fd < 0 && i < SNAPSHOT_TMP_ATTEMPTS; ++i)
+    {
+        sprintf(tmp_path, "%s.tmp.%ld.%"PRIu64, path, (long) getpid(),
+                (uint64_t) atomic_fetch_add(&snapshot_tmp_counter, 1));
+        fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+        if (fd < 0 && errno != EEXIST)
+        {
+            break;
+        }
+    }
+
+    FILE* f = (fd >= 0) ? fdopen(fd, "wb") : NULL;
+    if (!f)
+    {
+        fprintf(stderr, "snapshot_publish(): error: creating %s\n",
+                tmp_path);
+        if (fd >= 0)
+        {
+            close(fd);
+            unlink(tmp_path);
+        }
+        return SNAPSHOT_ERROR;
+    }
+
+    bool ok = fn(f, ctx)
+              && fflush(f) == 0
+              && fsync(fileno(f)) == 0;
+    ok = (fclose(f) == 0) && ok;
+    ok = ok && rename(tmp_path, path) == 0;
+    if (!ok)
+    {
+        fprintf(stderr, "snapshot_publish(): error: writing %s\n", path);
+        unlink(tmp_path);
+        return SNAPSHOT_ERROR;
+    }
+    return SNAPSHOT_OK;
+}
+
+typedef struct snapshot_write_ctx
+{
+    const snapshot_header_t* header;
+    const snapshot_writer_t* writer;
+    const uint32_t* index;
+} snapshot_write_ctx_t;
+
+static bool
+snapshot_write_body(FILE* f, void* arg)
+{
+    const snapshot_write_ctx_t* ctx = arg;
+    const snapshot_header_t* h = ctx->header;
+    const snapshot_writer_t* writer = ctx->writer;
+    uint64_t index_size = h->index_capacity * sizeof(uint32_t);
+
+    static const char padding[8] = {0};
+    return snapshot_write_all(f, h, sizeof(*h))
+           && snapshot_write_all(f, padding, h->entries_offset - sizeof(*h))
+           && snapshot_write_all(f, writer->entries,
+                                 writer->count * sizeof(snapshot_entry_t))
+           && snapshot_write_all(f, ctx->index, index_size)
+           && snapshot_write_all(f, padding, h->pool_offset - h->index_offset
+                                             - index_size)
+           && snapshot_write_all(f, writer->pool, writer->pool_size);
+}
+
+int64_t
+snapshot_writer_finish(snapshot_writer_t* writer)
+{
+    int64_t status = snapshot_writer_sort(writer);
+    if (status != SNAPSHOT_OK)
+    {
+        snapshot_writer_free(writer);
+        return status;
+    }
+
+    uint64_t cap = 2;
+    while (cap < 2 * writer->count)
+    {
+        cap *= 2;
+    }
+
+    uint32_t* index = calloc(cap, sizeof(uint32_t));
+    if (!index)
+    {
+        fprintf(stderr, "snapshot_writer_finish(): error: calloc(): index\n");
+        snapshot_writer_free(writer);
+        return SNAPSHOT_ERROR;
+    }
+    for (uint64_t i = 0; i < writer->count; ++i)
+    {
+        uint64_t slot = writer->entries[i].hash & (cap - 1);
+        while (index[slot] != 0)
+        {
+            slot = (slot + 1) & (cap - 1);
+        }
+        index[slot] = (uint32_t) (i + 1);
+    }
+
+    snapshot_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.endian = SNAPSHOT_ENDIAN;
+    strncpy(header.hashf, get_hashf_name(writer->hashf),
+            SNAPSHOT_HASHF_LENGTH - 1);
+    header.count = writer->count;
+    header.index_capacity = cap;
+    header.entries_offset = SNAPSHOT_ALIGN(sizeof(snapshot_header_t));
+    header.index_offset = header.entries_offset
+                          + writer->count * sizeof(snapshot_entry_t);
+    header.pool_offset = SNAPSHOT_ALIGN(header.index_offset
+                                        + cap * sizeof(uint32_t));
+    header.pool_size = writer->pool_size;
+    header.file_size = header.pool_offset + header.pool_size;
+    header.total = writer->total;
+    header.body_checksum = snapshot_body_checksum(&header, writer->entries,
+                                                  index, writer->pool);
+    header.header_checksum = snapshot_header_checksum(&header);
+
+    snapshot_write_ctx_t ctx = {.header = &header, .writer = writer,
+                                .index = index};
+    status = snapshot_publish(writer->path, snapshot_write_body, &ctx);
+
+    free(index);
+    snapshot_writer_free(writer);
+    return status;
+}
@@ -0,0 +1,178 @@
+#ifndef MAPWORDS_SNAPSHOT_H
+#define MAPWORDS_SNAPSHOT_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "hash.h"
+
+/*
+Versioned, checksummed binary snapshot of word counts, readable
+in place with mmap.
+
+File layout, all integers in host byte order (an endianness marker
+in the header rejects foreign files), sections 8-byte aligned:
+
+  header    snapshot_header_t
+  entries   count x snapshot_entry_t, sorted by value (descending)
+            and key (ascending), so the top k words are a prefix
+  index     index_capacity x uint32_t, open addressing table of
+            entry number + 1 (0 is empty), linear probing from
+            hash & (index_capacity - 1), load factor <= 0.5
+  pool      null-terminated keys referenced by entries
+
+Entries keep the hash of the hash function named in the header, so
+neither lookups through the index nor loading into a hashmap hash a
+key again.
+
+The header has its own checksum, checked on every open. The body
+checksum covers entries, index and pool; verifying it reads the whole
+file, so it is optional for read-only views. Without it, opening costs
+O(1) and key offsets and index slots are bounds-checked as they are
+used: snapshot_key() returns NULL for a key outside the pool and
+lookups stop with SNAPSHOT_ERROR on a corrupt index.
+
+Snapshots are written by collecting entries into a snapshot_writer_t
+and finishing it, which writes a temporary file in the destination
+directory, syncs it and renames it over the destination. Readers
+never observe a partially written snapshot. snapshot_publish() does
+the same for the other file formats.
+*/
+
+#define SNAPSHOT_ERROR -1
+#define SNAPSHOT_OK 0
+#define SNAPSHOT_KEY_NOT_FOUND 1
+#define SNAPSHOT_KEY_FOUND 2
+
+#define SNAPSHOT_MAGIC "MWSNAP\r\n"
+#define SNAPSHOT_VERSION 1U
+#define SNAPSHOT_ENDIAN 0x01020304U
+#define SNAPSHOT_HASHF_LENGTH 32U
+
+typedef struct snapshot_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    char hashf[SNAPSHOT_HASHF_LENGTH];
+    uint64_t count;
+    uint64_t index_capacity;
+    uint64_t entries_offset;
+    uint64_t index_offset;
+    uint64_t pool_offset;
+    uint64_t pool_size;
+    uint64_t file_size;
+    uint64_t total; // Sum of values.
+    uint64_t body_checksum;
+    uint64_t header_checksum; // Of all preceding header bytes.
+} snapshot_header_t;
+
+typedef struct snapshot_entry
+{
+    hash_t hash;
+    int64_t value;
+    uint64_t key_offset; // Into pool.
+    uint32_t key_len;
+    uint32_t reserved;
+} snapshot_entry_t;
+
+// Read-only view of a mapped snapshot file.
+typedef struct snapshot
+{
+    const void* data;
+    uint64_t size;
+    const snapshot_header_t* header;
+    const snapshot_entry_t* entries;
+    const uint32_t* index;
+    const char* pool;
+    hash_t (* hashf)(const char*);
+} snapshot_t;
+
+// Snapshot being collected for writing.
+typedef struct snapshot_writer
+{
+    char* path;
+    hash_t (* hashf)(const char*);
+    snapshot_entry_t* entries;
+    uint64_t count;
+    uint64_t capacity;
+    char* pool;
+    uint64_t pool_size;
+    uint64_t pool_capacity;
+    uint64_t total;
+} snapshot_writer_t;
+
+// Write the contents of a file to f, return false on error.
+typedef bool (* snapshot_write_fn)(FILE* f, void* ctx);
+
+// Checksum of len bytes, chained through seed.
+uint64_t
+snapshot_checksum(const void* data, uint64_t len, uint64_t seed);
+
+// Map snapshot file read-only and validate its header and layout.
+// With verify the body checksum, the key offsets of all entries and
+// the index are checked as well.
+snapshot_t*
+snapshot_open(const char* path, bool verify);
+
+// Check the body checksum, key offsets and index of an open snapshot.
+bool
+snapshot_verify(const snapshot_t* snap);
+
+// Unmap snapshot.
+void
+snapshot_close(snapshot_t* snap);
+
+// Get value of key from snapshot. Return SNAPSHOT_KEY_FOUND,
+// SNAPSHOT_KEY_NOT_FOUND or SNAPSHOT_ERROR for a corrupt index.
+int64_t
+snapshot_get(const snapshot_t* snap, const char* key, int64_t* out);
+
+// Get value of key with known hash from snapshot.
+int64_t
+snapshot_get_knownhash(const snapshot_t* snap, const char* key, hash_t hash,
+                       int64_t* out);
+
+// Get key of entry, or NULL if it does not lie within the pool
+// (a corrupt snapshot opened without verify).
+static inline const char*
+snapshot_key(const snapshot_t* snap, const snapshot_entry_t* entry)
+{
+    uint64_t pool_size = snap->header->pool_size;
+    if (entry->key_offset >= pool_size
+        || entry->key_len >= pool_size - entry->key_offset
+        || snap->pool[entry->key_offset + entry->key_len] != '\0')
+    {
+        return NULL;
+    }
+    return snap->pool + entry->key_offset;
+}
+
+// Start collecting a snapshot to be written to path. Capacity is
+// a hint for the number of entries.
+snapshot_writer_t*
+snapshot_writer_init(const char* path, hash_t (* hashf)(const char*),
+                     uint64_t capacity);
+
+// Add entry with key of len bytes and its hash.
+int64_t
+snapshot_writer_add(snapshot_writer_t* writer, const char* key,
+                    uint64_t len, hash_t hash, int64_t value);
+
+// Sort entries, build the index, write and atomically publish the
+// snapshot and free the writer.
+int64_t
+snapshot_writer_finish(snapshot_writer_t* writer);
+
+// Create a temporary file next to path with mode 0666 & ~umask, write
+// it with fn, sync it and rename it over path. Safe to call from
+// several threads. On error the temporary file is removed.
+int64_t
+snapshot_publish(const char* path, snapshot_write_fn fn, void* ctx);
+
+// Free writer without writing anything.
+void
+snapshot_writer_free(snapshot_writer_t* writer);
+
+#endif //MAPWORDS_SNAPSHOT_H
@@ -0,0 +1,400 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "hashmap.h"
+#include "sort.h"
+
+#define SORT_RADIX_BITS 8U
+#define SORT_RADIX (1U << SORT_RADIX_BITS)
+
+// Runs of this length are insertion sorted before merging.
+#define SORT_INSERTION_RUN 16U
+
+typedef struct sort_job
+{
+    const hashmap_map_t* map;
+    uint64_t threads;
+    uint64_t n;
+
+    // Ping-pong index buffers, 'src' holds the current order.
+    uint64_t* src;
+    uint64_t* dst;
+
+    // Collect phase.
+    uint64_t* live; // Per thread.
+    int64_t* min_value; // Per thread.
+    int64_t* max_value; // Per thread.
+
+    // Merge phase.
+    uint64_t segments;
+    uint64_t width;
+
+    // Radix phase.
+    uint64_t* hist; // threads * SORT_RADIX.
+    int64_t max;
+    uint64_t shift;
+} sort_job_t;
+
+typedef struct sort_worker
+{
+    sort_job_t* job;
+    uint64_t index;
+    void (* fn)(sort_job_t*, uint64_t);
+} sort_worker_t;
+
+static void*
+sort_worker_main(void* arg)
+{
+    sort_worker_t* worker = arg;
+    worker->fn(worker->job, worker->index);
+    return NULL;
+}
+
+// Run fn for every thread index and wait for all of them.
+static int64_t
+sort_parallel(sort_job_t* job, void (* fn)(sort_job_t*, uint64_t))
+{
+    uint64_t threads = job->threads;
+    if (threads == 1)
+    {
+        fn(job, 0);
+        return SORT_OK;
+    }
+
+    pthread_t tids[threads];
+    sort_worker_t workers[threads];
+    int64_t status = SORT_OK;
+
+    // Calling thread runs index 0 itself.
+    uint64_t started = 1;
+    for (; started < threads; ++started)
+    {
+        workers[started].job = job;
+        workers[started].index = started;
+        workers[started].fn = fn;
+        if (pthread_create(&tids[started], NULL, sort_worker_main,
+                           &workers[started]) != 0)
+        {
+            fprintf(stderr, "sort_parallel(): error: pthread_create()\n");
+            status = SORT_ERROR;
+            break;
+        }
+    }
+
+    fn(job, 0);
+
+    // Run the slices of threads that could not be started here.
+    for (uint64_t t = started; t < threads && status != SORT_OK; ++t)
+    {
+        fn(job, t);
+    }
+
+    for (uint64_t t = 1; t < started; ++t)
+    {
+        pthread_join(tids[t], NULL);
+    }
+
+    return SORT_OK;
+}
+
+// Start of slice t when splitting n items to parts slices.
+static inline uint64_t
+sort_slice(uint64_t n, uint64_t parts, uint64_t t)
+{
+    return n / parts * t + (n % parts) * t / parts;
+}
+
+static inline int
+sort_key_cmp(const hashmap_map_t* map, uint64_t a, uint64_t b)
+{
+    return strcmp(map->buckets[a].key, map->buckets[b].key);
+}
+
+static void
+sort_count_live(sort_job_t* job, uint64_t t)
+{
+    const hashmap_map_t* map = job->map;
+    uint64_t lo = sort_slice(map->capacity, job->threads, t);
+    uint64_t hi = sort_slice(map->capacity, job->threads, t + 1);
+    uint64_t live = 0;
+
+    for (uint64_t i = lo; i < hi; ++i)
+    {
+        live += map->buckets[i].in_use;
+    }
+    job->live[t] = live;
+}
+
+static void
+sort_collect_live(sort_job_t* job, uint64_t t)
+{
+    const hashmap_map_t* map = job->map;
+    uint64_t lo = sort_slice(map->capacity, job->threads, t);
+    uint64_t hi = sort_slice(map->capacity, job->threads, t + 1);
+    uint64_t pos = 0;
+    int64_t min = INT64_MAX;
+    int64_t max = INT64_MIN;
+
+    for (uint64_t u = 0; u < t; ++u)
+    {
+        pos += job->live[u];
+    }
+
+    for (uint64_t i = lo; i < hi; ++i)
+    {
+        const hashmap_bucket_t* bucket = &map->buckets[i];
+        if (bucket->in_use)
+        {
+            job->src[pos++] = i;
+            min = (bucket->value < min) ? bucket->value : min;
+            max = (bucket->value > max) ? bucket->value : max;
+        }
+    }
+
+    job->min_value[t] = min;
+    job->max_value[t] = max;
+}
+
+// Stable merge of src[lo, mid) and src[mid, hi) into dst by key.
+static void
+sort_merge(const hashmap_map_t* map, const uint64_t* src, uint64_t* dst,
+           uint64_t lo, uint64_t mid, uint64_t hi)
+{
+    uint64_t i = lo;
+    uint64_t j = mid;
+    uint64_t k = lo;
+
+    while (i < mid && j < hi)
+    {
+        dst[k++] = (sort_key_cmp(map, src[j], src[i]) < 0) ? src[j++] : src[i++];
+    }
+    while (i < mid)
+    {
+        dst[k++] = src[i++];
+    }
+    while (j < hi)
+    {
+        dst[k++] = src[j++];
+    }
+}
+
+// Bottom-up merge sort of src[lo, hi) by key, dst[lo, hi) is scratch.
+static void
+sort_keys_segment(sort_job_t* job, uint64_t t)
+{
+    const hashmap_map_t* map = job->map;
+    uint64_t lo = sort_slice(job->n, job->segments, t);
+    uint64_t hi = sort_slice(job->n, job->segments, t + 1);
+    uint64_t* a = job->src;
+    uint64_t* b = job->dst;
+
+    for (uint64_t run = lo; run < hi; run += SORT_INSERTION_RUN)
+    {
+        uint64_t end = (run + SORT_INSERTION_RUN < hi)
+                       ? run + SORT_INSERTION_RUN : hi;
+        for (uint64_t i = run + 1; i < end; ++i)
+        {
+            uint64_t x = a[i];
+            uint64_t j = i;
+            while (j > run && sort_key_cmp(map, x, a[j - 1]) < 0)
+            {
+                a[j] = a[j - 1];
+                --j;
+            }
+            a[j] = x;
+        }
+    }
+
+    for (uint64_t w = SORT_INSERTION_RUN; w < hi - lo; w *= 2)
+    {
+        for (uint64_t i = lo; i < hi; i += 2 * w)
+        {
+            uint64_t mid = (i + w < hi) ? i + w : hi;
+            uint64_t end = (i + 2 * w < hi) ? i + 2 * w : hi;
+            sort_merge(map, a, b, i, mid, end);
+        }
+
+        uint64_t* temp = a;
+        a = b;
+        b = temp;
+    }
+
+    if (a != job->src)
+    {
+        memcpy(job->src + lo, a + lo, (hi - lo) * sizeof(uint64_t));
+    }
+}
+
+// Merge segment pair t of the current level from src to dst.
+static void
+sort_keys_merge_level(sort_job_t* job, uint64_t t)
+{
+    uint64_t first = t * 2 * job->width;
+    if (first >= job->segments)
+    {
+        return;
+    }
+
+    uint64_t mid_seg = first + job->width;
+    uint64_t end_seg = first + 2 * job->width;
+    mid_seg = (mid_seg < job->segments) ? mid_seg : job->segments;
+    end_seg = (end_seg < job->segments) ? end_seg : job->segments;
+
+    uint64_t lo = sort_slice(job->n, job->segments, first);
+    uint64_t mid = sort_slice(job->n, job->segments, mid_seg);
+    uint64_t hi = sort_slice(job->n, job->segments, end_seg);
+    sort_merge(job->map, job->src, job->dst, lo, mid, hi);
+}
+
+static void
+sort_radix_histogram(sort_job_t* job, uint64_t t)
+{
+    const hashmap_bucket_t* buckets = job->map->buckets;
+    uint64_t lo = sort_slice(job->n, job->threads, t);
+    uint64_t hi = sort_slice(job->n, job->threads, t + 1);
+    uint64_t* hist = &job->hist[t * SORT_RADIX];
+
+    memset(hist, 0, SORT_RADIX * sizeof(uint64_t));
+    for (uint64_t i = lo; i < hi; ++i)
+    {
+        // Distance from max turns descending values into ascending keys.
+        uint64_t key = (uint64_t) job->max - (uint64_t) buckets[job->src[i]].value;
+        hist[(key >> job->shift) & (SORT_RADIX - 1)]++;
+    }
+}
+
+static void
+sort_radix_scatter(sort_job_t* job, uint64_t t)
+{
+    const hashmap_bucket_t* buckets = job->map->buckets;
+    uint64_t lo = sort_slice(job->n, job->threads, t);
+    uint64_t hi = sort_slice(job->n, job->threads, t + 1);
+    uint64_t* offsets = &job->hist[t * SORT_RADIX];
+
+    for (uint64_t i = lo; i < hi; ++i)
+    {
+        uint64_t index = job->src[i];
+        uint64_t key = (uint64_t) job->max - (uint64_t) buckets[index].value;
+        job->dst[offsets[(key >> job->shift) & (SORT_RADIX - 1)]++] = index;
+    }
+}
+
+static void
+sort_swap_buffers(sort_job_t* job)
+{
+    uint64_t* temp = job->src;
+    job->src = job->dst;
+    job->dst = temp;
+}
+
+static void
+sort_job_free(sort_job_t* job)
+{
+    free(job->src);
+    free(job->dst);
+    free(job->live);
+    free(job->min_value);
+    free(job->max_value);
+    free(job->hist);
+}
+
+// Sort in-use buckets by key, and by value (stable) if by_value.
+static int64_t
+sort_run(const hashmap_map_t* map, uint64_t threads, bool by_value,
+         uint64_t** out, uint64_t* count)
+{
+    if (*out != NULL)
+    {
+        fprintf(stderr, "sort_by_value(): expected 'out' == NULL\n");
+        return SORT_ERROR;
+    }
+
+    sort_job_t job = {0};
+    job.map = map;
+    job.n = map->size;
+    job.threads = (threads == 0 || map->size < SORT_PARALLEL_MIN) ? 1 : threads;
+
+    job.src = malloc((map->size + 1) * sizeof(uint64_t));
+    job.dst = malloc((map->size + 1) * sizeof(uint64_t));
+    job.live = calloc(job.threads, sizeof(uint64_t));
+    job.min_value = calloc(job.threads, sizeof(int64_t));
+    job.max_value = calloc(job.threads, sizeof(int64_t));
+    job.hist = calloc(job.threads * SORT_RADIX, sizeof(uint64_t));
+    if (!job.src || !job.dst || !job.live || !job.min_value
+        || !job.max_value || !job.hist)
+    {
+        fprintf(stderr, "sort_by_value(): error: allocating buffers\n");
+        sort_job_free(&job);
+        return SORT_ERROR;
+    }
+
+    // 1. Collect in-use indices in bucket order.
+    sort_parallel(&job, sort_count_live);
+    sort_parallel(&job, sort_collect_live);
+
+    int64_t min = INT64_MAX;
+    job.max = INT64_MIN;
+    for (uint64_t t = 0; t < job.threads; ++t)
+    {
+        min = (job.min_value[t] < min) ? job.min_value[t] : min;
+        job.max = (job.max_value[t] > job.max) ? job.max_value[t] : job.max;
+    }
+
+    // 2. Sort by key, one segment per thread, then merge levels.
+    job.segments = job.threads;
+    sort_parallel(&job, sort_keys_segment);
+    for (job.width = 1; job.width < job.segments; job.width *= 2)
+    {
+        // Segments past the last pair are copied as they are.
+        memcpy(job.dst, job.src, job.n * sizeof(uint64_t));
+        sort_parallel(&job, sort_keys_merge_level);
+        sort_swap_buffers(&job);
+    }
+
+    // 3. Stable LSD radix sort by value, descending.
+    uint64_t range = (job.n > 0 && by_value) ? (uint64_t) job.max
+                                               - (uint64_t) min : 0;
+    for (job.shift = 0; job.shift < 64 && (range >> job.shift) > 0;
+         job.shift += SORT_RADIX_BITS)
+    {
+        sort_parallel(&job, sort_radix_histogram);
+
+        // Exclusive prefix sums in (digit, thread) order keep it stable.
+        uint64_t sum = 0;
+        for (uint64_t d = 0; d < SORT_RADIX; ++d)
+        {
+            for (uint64_t t = 0; t < job.threads; ++t)
+            {
+                uint64_t c = job.hist[t * SORT_RADIX + d];
+                job.hist[t * SORT_RADIX + d] = sum;
+                sum += c;
+            }
+        }
+
+        sort_parallel(&job, sort_radix_scatter);
+        sort_swap_buffers(&job);
+    }
+
+    *out = job.src;
+    *count = job.n;
+    job.src = NULL;
+    sort_job_free(&job);
+    return SORT_OK;
+}
+
+int64_t
+sort_by_value(const hashmap_map_t* map, uint64_t threads,
+              uint64_t** out, uint64_t* count)
+{
+    return sort_run(map, threads, true, out, count);
+}
+
+int64_t
+sort_by_key(const hashmap_map_t* map, uint64_t threads,
+            uint64_t** out, uint64_t* count)
+{
+    return sort_run(map, threads, false, out, count);
+}
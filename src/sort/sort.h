@@ -0,0 +1,49 @@
+#ifndef MAPWORDS_SORT_H
+#define MAPWORDS_SORT_H
+
+#include <inttypes.h>
+
+#include "hashmap.h"
+
+/*
+Full sort of map entries by (value descending, key ascending).
+
+Entries are not copied, a permutation of in-use bucket indices is
+sorted instead. Keys are only read for comparisons.
+
+  1. In-use bucket indices are collected.
+  2. Indices are sorted by key with a bottom-up merge sort.
+     Each thread sorts a segment and segments are merged
+     pairwise, pairs of a level in parallel.
+  3. Indices are sorted by value with a stable LSD radix sort,
+     one byte per pass, only as many passes as the value range
+     needs. Each pass builds per-thread histograms over
+     contiguous slices and scatters in parallel.
+
+Since the radix sort is stable, entries with equal values stay
+in key order. sort_by_key() stops after step 2. No recursion is
+used, so sorted input can not overflow the stack.
+*/
+
+#define SORT_ERROR -1
+#define SORT_OK 0
+
+// Below this many entries sorting is done on a single thread.
+#ifndef SORT_PARALLEL_MIN
+#define SORT_PARALLEL_MIN (1U << 16U)
+#endif
+
+// Sort in-use buckets of map by (value desc, key asc) using up to
+// threads threads. Memory for 'out' is allocated in the function
+// and holds 'count' bucket indices, which must be freed by caller.
+int64_t
+sort_by_value(const hashmap_map_t* map, uint64_t threads,
+              uint64_t** out, uint64_t* count);
+
+// Sort in-use buckets of map by key (ascending) only, like
+// sort_by_value().
+int64_t
+sort_by_key(const hashmap_map_t* map, uint64_t threads,
+            uint64_t** out, uint64_t* count);
+
+#endif //MAPWORDS_SORT_H
@@ -0,0 +1,388 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hash.h"
+#include "spacesaving.h"
+#include "topk.h"
+
+uint64_t
+spacesaving_counters_for_memory(uint64_t bytes)
+{
+    // Hash table has up to two heads per counter.
+    uint64_t per_counter = sizeof(spacesaving_counter_t)
+                           + sizeof(spacesaving_group_t)
+                           + 2 * sizeof(uint32_t);
+    uint64_t counters = bytes / per_counter;
+    return (counters > 0) ? counters : 1;
+}
+
+spacesaving_t*
+spacesaving_init(hash_t (* hashf)(const char*), uint64_t counters)
+{
+    if (hashf == NULL || counters == 0 || counters >= SPACESAVING_NONE)
+    {
+        fprintf(stderr, "spacesaving_init(): error: invalid arguments\n");
+        return NULL;
+    }
+
+    spacesaving_t* ss = calloc(1, sizeof(spacesaving_t));
+    if (!ss)
+    {
+        fprintf(stderr, "spacesaving_init(): error: calloc(): ss\n");
+        return NULL;
+    }
+
+    uint64_t table_size = 1;
+    while (table_size < counters)
+    {
+        table_size *= 2;
+    }
+
+    ss->capacity = counters;
+    ss->hashf = hashf;
+    ss->table_mask = table_size - 1;
+    ss->counters = calloc(counters, sizeof(spacesaving_counter_t));
+    ss->groups = calloc(counters, sizeof(spacesaving_group_t));
+    ss->table = malloc(table_size * sizeof(uint32_t));
+    if (!ss->counters || !ss->groups || !ss->table)
+    {
+        fprintf(stderr, "spacesaving_init(): error: allocating tables\n");
+        spacesaving_free(ss);
+        return NULL;
+    }
+
+    memset(ss->table, 0xFF, table_size * sizeof(uint32_t));
+    for (uint64_t i = 0; i < counters; ++i)
+    {
+        ss->groups[i].next = (i + 1 < counters) ? (uint32_t) (i + 1)
+                                                : SPACESAVING_NONE;
+        ss->counters[i].key = ss->counters[i].inline_key;
+        ss->counters[i].key_capacity = SPACESAVING_KEY_INLINE;
+    }
+    ss->free_group = 0;
+    ss->min_group = SPACESAVING_NONE;
+    ss->max_group = SPACESAVING_NONE;
+    return ss;
+}
+
+void
+spacesaving_free(spacesaving_t* ss)
+{
+    if (ss == NULL)
+    {
+        return;
+    }
+
+    for (uint64_t i = 0; ss->counters && i < ss->capacity; ++i)
+    {
+        if (ss->counters[i].key != ss->counters[i].inline_key)
+        {
+            free(ss->counters[i].key);
+        }
+    }
+    free(ss->counters);
+    free(ss->groups);
+    free(ss->table);
+    free(ss);
+}
+
+static uint32_t
+spacesaving_find(spacesaving_t* ss, const char* key, hash_t hash)
+{
+    uint32_t i = ss->table[hash & ss->table_mask];
+    while (i != SPACESAVING_NONE)
+    {
+        spacesaving_counter_t* c = &ss->counters[i];
+        if (c->hash == hash && strcmp(c->key, key) == 0)
+        {
+            return i;
+        }
+        ss->collisions++;
+        i = c->chain;
+    }
+    return SPACESAVING_NONE;
+}
+
+static void
+spacesaving_unchain(spacesaving_t* ss, uint32_t ci)
+{
+    uint32_t* link = &ss->table[ss->counters[ci].hash & ss->table_mask];
+    while (*link != ci)
+    {
+        link = &ss->counters[*link].chain;
+    }
+    *link = ss->counters[ci].chain;
+}
+
+// Allocate group with count and link it after group 'after'
+// (or as the new minimum if 'after' is SPACESAVING_NONE).
+static uint32_t
+spacesaving_group_new(spacesaving_t* ss, uint64_t count, uint32_t after)
+{
+    uint32_t gi = ss->free_group;
+    spacesaving_group_t* g = &ss->groups[gi];
+    ss->free_group = g->next;
+
+    g->count = count;
+    g->first = SPACESAVING_NONE;
+    g->prev = after;
+    g->next = (after == SPACESAVING_NONE) ? ss->min_group
+                                          : ss->groups[after].next;
+
+    if (g->next != SPACESAVING_NONE)
+    {
+        ss->groups[g->next].prev = gi;
+    }
+    else
+    {
+        ss->max_group = gi;
+    }
+
+    if (after != SPACESAVING_NONE)
+    {
+        ss->groups[after].next = gi;
+    }
+    else
+    {
+        ss->min_group = gi;
+    }
+
+    return gi;
+}
+
+static void
+spacesaving_group_attach(spacesaving_t* ss, uint32_t gi, uint32_t ci)
+{
+    spacesaving_group_t* g = &ss->groups[gi];
+    spacesaving_counter_t* c = &ss->counters[ci];
+
+    c->group = gi;
+    c->count = g->count;
+    c->prev = SPACESAVING_NONE;
+    c->next = g->first;
+    if (g->first != SPACESAVING_NONE)
+    {
+        ss->counters[g->first].prev = ci;
+    }
+    g->first = ci;
+}
+
+// Detach counter from its group, freeing the group if it empties.
+static void
+spacesaving_group_detach(spacesaving_t* ss, uint32_t ci)
+{
+    spacesaving_counter_t* c = &ss->counters[ci];
+    uint32_t gi = c->group;
+    spacesaving_group_t* g = &ss->groups[gi];
+
+    if (c->prev != SPACESAVING_NONE)
+    {
+        ss->counters[c->prev].next = c->next;
+    }
+    else
+    {
+        g->first = c->next;
+    }
+    if (c->next != SPACESAVING_NONE)
+    {
+        ss->counters[c->next].prev = c->prev;
+    }
+
+    if (g->first != SPACESAVING_NONE)
+    {
+        return;
+    }
+
+    if (g->prev != SPACESAVING_NONE)
+    {
+        ss->groups[g->prev].next = g->next;
+    }
+    else
+    {
+        ss->min_group = g->next;
+    }
+    if (g->next != SPACESAVING_NONE)
+    {
+        ss->groups[g->next].prev = g->prev;
+    }
+    else
+    {
+        ss->max_group = g->prev;
+    }
+
+    g->next = ss->free_group;
+    ss->free_group = gi;
+}
+
+static void
+spacesaving_increment(spacesaving_t* ss, uint32_t ci)
+{
+    spacesaving_counter_t* c = &ss->counters[ci];
+    uint32_t gi = c->group;
+    spacesaving_group_t* g = &ss->groups[gi];
+    uint64_t count = c->count + 1;
+    uint32_t next = g->next;
+    bool next_matches = next != SPACESAVING_NONE
+                        && ss->groups[next].count == count;
+
+    // Sole member moving to a count nobody has: bump group in place.
+    if (g->first == ci && c->next == SPACESAVING_NONE && !next_matches)
+    {
+        g->count = count;
+        c->count = count;
+        return;
+    }
+
+    uint32_t target = next_matches ? next : spacesaving_group_new(ss, count, gi);
+    spacesaving_group_detach(ss, ci);
+    spacesaving_group_attach(ss, target, ci);
+}
+
+static int64_t
+spacesaving_set_key(spacesaving_counter_t* c, const char* key)
+{
+    uint64_t len = strlen(key);
+    if (len + 1 > c->key_capacity)
+    {
+        char* heap = (c->key == c->inline_key) ? NULL : c->key;
+        heap = realloc(heap, len + 1);
+        if (!heap)
+        {
+            fprintf(stderr, "spacesaving_set_key(): error: realloc()\n");
+            return SPACESAVING_ERROR;
+        }
+        c->key = heap;
+        c->key_capacity = len + 1;
+    }
+    memcpy(c->key, key, len + 1);
+    return SPACESAVING_OK;
+}
+
+int64_t
+spacesaving_add(spacesaving_t* ss, const char* key)
+{
+    return spacesaving_add_knownhash(ss, key, ss->hashf(key));
+}
+
+int64_t
+spacesaving_add_knownhash(spacesaving_t* ss, const char* key, hash_t hash)
+{
+    ss->words++;
+
+    uint32_t ci = spacesaving_find(ss, key, hash);
+    if (ci != SPACESAVING_NONE)
+    {
+        spacesaving_increment(ss, ci);
+        return SPACESAVING_OK;
+    }
+
+    spacesaving_counter_t* c;
+    if (ss->size < ss->capacity)
+    {
+        // Take a free counter with count 1.
+        ci = (uint32_t) ss->size++;
+        c = &ss->counters[ci];
+        c->error = 0;
+
+        uint32_t target = ss->min_group;
+        if (target == SPACESAVING_NONE || ss->groups[target].count != 1)
+        {
+            target = spacesaving_group_new(ss, 1, SPACESAVING_NONE);
+        }
+        spacesaving_group_attach(ss, target, ci);
+    }
+    else
+    {
+        // Replace a counter with the minimum count.
+        ci = ss->groups[ss->min_group].first;
+        c = &ss->counters[ci];
+        spacesaving_unchain(ss, ci);
+        c->error = c->count;
+        spacesaving_increment(ss, ci);
+    }
+
+    if (spacesaving_set_key(c, key) != SPACESAVING_OK)
+    {
+        // Keep structure consistent, counter keeps an empty key.
+        c->key[0] = '\0';
+    }
+
+    c->hash = hash;
+    c->chain = ss->table[hash & ss->table_mask];
+    ss->table[hash & ss->table_mask] = ci;
+    return SPACESAVING_OK;
+}
+
+uint64_t
+spacesaving_error_bound(const spacesaving_t* ss)
+{
+    if (ss->size < ss->capacity || ss->min_group == SPACESAVING_NONE)
+    {
+        return 0;
+    }
+    return ss->groups[ss->min_group].count;
+}
+
+static bool
+spacesaving_ranks_below(const void* a, const void* b, const void* ctx)
+{
+    (void) ctx;
+    const spacesaving_counter_t* x = a;
+    const spacesaving_counter_t* y = b;
+    if (x->count != y->count)
+    {
+        return x->count < y->count;
+    }
+    return strcmp(x->key, y->key) > 0;
+}
+
+uint64_t
+spacesaving_top_k(const spacesaving_t* ss, uint64_t k,
+                  const spacesaving_counter_t** out)
+{
+    topk_t top;
+    topk_init(&top, (const void**) out, k, spacesaving_ranks_below, NULL);
+    for (uint64_t i = 0; i < ss->size; ++i)
+    {
+        topk_push(&top, &ss->counters[i]);
+    }
+    return topk_sort(&top);
+}
+
+uint64_t
+spacesaving_guaranteed(const spacesaving_t* ss,
+                       const spacesaving_counter_t** top, uint64_t n)
+{
+    uint64_t guaranteed = 0;
+    uint64_t min_lower = UINT64_MAX;
+
+    for (uint64_t j = 1; j <= n; ++j)
+    {
+        uint64_t lower = top[j - 1]->count - top[j - 1]->error;
+        min_lower = (lower < min_lower) ? lower : min_lower;
+
+        // Anything not in top[0, j) has at most this count. Past the
+        // last monitored word only unmonitored words remain.
+        uint64_t next;
+        if (j < n)
+        {
+            next = top[j]->count;
+        }
+        else if (n == ss->size)
+        {
+            next = spacesaving_error_bound(ss);
+        }
+        else
+        {
+            break;
+        }
+
+        if (min_lower >= next)
+        {
+            guaranteed = j;
+        }
+    }
+
+    return guaranteed;
+}
@@ -0,0 +1,119 @@
+#ifndef MAPWORDS_SPACESAVING_H
+#define MAPWORDS_SPACESAVING_H
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "hash.h"
+
+/*
+Space-Saving approximate top-k counter (Metwally et al. 2005) with
+the stream-summary structure.
+
+A fixed number of counters m is allocated up front. A word that is
+already monitored has its counter incremented. A new word takes a
+free counter, or when all counters are in use, replaces the word of
+a counter with the minimum count, inheriting that count as its
+error. Memory use does not depend on input size.
+
+Counters with equal counts share a group. Groups form a doubly
+linked list in ascending count order, so the minimum counter is
+found and every increment is done in O(1).
+
+Guarantees after n words:
+  - count - error <= true count <= count for every counter,
+  - every error <= minimum count <= n / m,
+  - every word with true count > minimum count is monitored.
+
+Keys up to SPACESAVING_KEY_INLINE - 1 characters are stored inline
+in the counter, longer keys get a heap buffer which is reused.
+*/
+
+#define SPACESAVING_ERROR -1
+#define SPACESAVING_OK 0
+
+#define SPACESAVING_KEY_INLINE 24U
+
+#define SPACESAVING_NONE UINT32_MAX
+
+typedef struct spacesaving_counter
+{
+    hash_t hash;
+    uint64_t count;
+    uint64_t error;
+    uint32_t group;
+    uint32_t prev; // Within group.
+    uint32_t next; // Within group.
+    uint32_t chain; // Next counter in hash chain.
+    char* key; // Points to inline or heap buffer.
+    uint64_t key_capacity;
+    char inline_key[SPACESAVING_KEY_INLINE];
+} spacesaving_counter_t;
+
+typedef struct spacesaving_group
+{
+    uint64_t count;
+    uint32_t prev; // Group with next smaller count.
+    uint32_t next; // Group with next larger count.
+    uint32_t first; // First counter in group.
+} spacesaving_group_t;
+
+typedef struct spacesaving
+{
+    uint64_t capacity; // Number of counters m.
+    uint64_t size; // Counters in use.
+    uint64_t words; // Words seen, n.
+    uint64_t collisions; // Hash chain steps on lookups.
+    hash_t (* hashf)(const char*);
+
+    spacesaving_counter_t* counters;
+    spacesaving_group_t* groups;
+    uint32_t min_group; // Group with minimum count.
+    uint32_t max_group; // Group with maximum count.
+    uint32_t free_group; // Free list of groups linked by 'next'.
+
+    uint64_t table_mask;
+    uint32_t* table; // Hash table heads.
+} spacesaving_t;
+
+// Number of counters that fit in memory budget of bytes.
+uint64_t
+spacesaving_counters_for_memory(uint64_t bytes);
+
+// Allocate summary with a fixed number of counters.
+spacesaving_t*
+spacesaving_init(hash_t (* hashf)(const char*), uint64_t counters);
+
+// Free all memory allocated for summary.
+void
+spacesaving_free(spacesaving_t* ss);
+
+// Count one occurrence of key.
+int64_t
+spacesaving_add(spacesaving_t* ss, const char* key);
+
+// Count one occurrence of key with known hash.
+int64_t
+spacesaving_add_knownhash(spacesaving_t* ss, const char* key, hash_t hash);
+
+// Largest possible overestimation of any reported count.
+// This is the minimum count when all counters are in use, else 0.
+uint64_t
+spacesaving_error_bound(const spacesaving_t* ss);
+
+// Select k counters with the largest counts in descending order,
+// ties broken by key. 'out' must have room for k pointers.
+// Return number of counters written.
+uint64_t
+spacesaving_top_k(const spacesaving_t* ss, uint64_t k,
+                  const spacesaving_counter_t** out);
+
+// Number of leading entries of a top-k result of n entries, which
+// are guaranteed to be exactly the true top entries, i.e. their
+// smallest lower bound (count - error) is not below the next count.
+// Select one entry more than needed to decide about the last one.
+uint64_t
+spacesaving_guaranteed(const spacesaving_t* ss,
+                       const spacesaving_counter_t** top, uint64_t n);
+
+#endif //MAPWORDS_SPACESAVING_H
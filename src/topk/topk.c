@@ -0,0 +1,82 @@
+#include "topk.h"
+
+void
+topk_init(topk_t* top, const void** heap, uint64_t k,
+          topk_ranks_below_fn ranks_below, const void* ctx)
+{
+    top->heap = heap;
+    top->size = 0;
+    top->k = k;
+    top->ranks_below = ranks_below;
+    top->ctx = ctx;
+}
+
+// Restore min-heap order of the first size elements from index i
+// downwards.
+static void
+topk_sift_down(const topk_t* top, uint64_t size, uint64_t i)
+{
+    const void** heap = top->heap;
+    while (true)
+    {
+        uint64_t lowest = i;
+        uint64_t left = 2 * i + 1;
+        uint64_t right = left + 1;
+
+        if (left < size
+            && top->ranks_below(heap[left], heap[lowest], top->ctx))
+        {
+            lowest = left;
+        }
+        if (right < size
+            && top->ranks_below(heap[right], heap[lowest], top->ctx))
+        {
+            lowest = right;
+        }
+        if (lowest == i)
+        {
+            return;
+        }
+
+        const void* temp = heap[i];
+        heap[i] = heap[lowest];
+        heap[lowest] = temp;
+        i = lowest;
+    }
+}
+
+void
+topk_push(topk_t* top, const void* element)
+{
+    if (top->size < top->k)
+    {
+        // Sift up new leaf.
+        uint64_t j = top->size++;
+        while (j > 0
+               && top->ranks_below(element, top->heap[(j - 1) / 2], top->ctx))
+        {
+            top->heap[j] = top->heap[(j - 1) / 2];
+            j = (j - 1) / 2;
+        }
+        top->heap[j] = element;
+    }
+    else if (top->k > 0 && top->ranks_below(top->heap[0], element, top->ctx))
+    {
+        top->heap[0] = element;
+        topk_sift_down(top, top->size, 0);
+    }
+}
+
+uint64_t
+topk_sort(topk_t* top)
+{
+    // Heap sort: move the lowest element to the back repeatedly.
+    for (uint64_t end = top->size; end > 1; --end)
+    {
+        const void* temp = top->heap[0];
+        top->heap[0] = top->heap[end - 1];
+        top->heap[end - 1] = temp;
+        topk_sift_down(top, end - 1, 0);
+    }
+    return top->size;
+}
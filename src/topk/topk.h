@@ -0,0 +1,56 @@
+#ifndef MAPWORDS_TOPK_H
+#define MAPWORDS_TOPK_H
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+/*
+Bounded heap selection of the k highest ranking elements.
+
+Shared by the top-k functions of the counting structures. Elements
+are pointers into the structure and are pushed one by one, so it
+works for a scan over an entry array as well as for a callback
+traversal. The caller's output array is the heap: a min-heap of at
+most k elements under ranks_below(), whose root is the lowest
+ranking element kept and is replaced when a higher one is pushed.
+topk_sort() then heap sorts it highest first.
+
+n pushes take O(n log k) time and no memory besides the k slots.
+
+  topk_t top;
+  topk_init(&top, (const void**) out, k, entry_ranks_below, NULL);
+  for (uint64_t i = 0; i < capacity; ++i)
+  {
+      topk_push(&top, &entries[i]);
+  }
+  uint64_t count = topk_sort(&top);
+*/
+
+// Check if element a ranks below element b, ties must be broken so
+// that the order is total. ctx is that given to topk_init().
+typedef bool (* topk_ranks_below_fn)(const void* a, const void* b,
+                                     const void* ctx);
+
+typedef struct topk
+{
+    const void** heap; // k slots.
+    uint64_t size;
+    uint64_t k;
+    topk_ranks_below_fn ranks_below;
+    const void* ctx;
+} topk_t;
+
+// Start selecting up to k elements into the array heap.
+void
+topk_init(topk_t* top, const void** heap, uint64_t k,
+          topk_ranks_below_fn ranks_below, const void* ctx);
+
+// Keep element if it ranks among the k highest pushed so far.
+void
+topk_push(topk_t* top, const void* element);
+
+// Sort kept elements highest first and return their number.
+uint64_t
+topk_sort(topk_t* top);
+
+#endif //MAPWORDS_TOPK_H
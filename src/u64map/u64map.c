@@ -0,0 +1,182 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "topk.h"
+#include "u64map.h"
+
+// MurmurHash3 64-bit finalizer, as in hash_mix(), inlined into the
+// probe loops.
+static inline uint64_t
+u64map_mix(uint64_t key)
+{
+    key ^= key >> 33U;
+    key *= 0xFF51AFD7ED558CCDLU;
+    key ^= key >> 33U;
+    key *= 0xC4CEB9FE1A85EC53LU;
+    key ^= key >> 33U;
+    return key;
+}
+
+static u64map_entry_t*
+u64map_alloc_entries(uint64_t capacity)
+{
+    u64map_entry_t* entries = malloc(capacity * sizeof(u64map_entry_t));
+    if (!entries)
+    {
+        fprintf(stderr, "u64map_alloc_entries(): error: malloc(): entries\n");
+        return NULL;
+    }
+    for (uint64_t i = 0; i < capacity; ++i)
+    {
+        entries[i].key = U64MAP_EMPTY;
+        entries[i].value = 0;
+    }
+    return entries;
+}
+
+u64map_t*
+u64map_init(void)
+{
+    u64map_t* map = calloc(1, sizeof(u64map_t));
+    if (!map)
+    {
+        fprintf(stderr, "u64map_init(): error: calloc(): map\n");
+        return NULL;
+    }
+
+    map->capacity = U64MAP_INITIAL_CAPACITY;
+    map->entries = u64map_alloc_entries(map->capacity);
+    if (!map->entries)
+    {
+        free(map);
+        return NULL;
+    }
+    return map;
+}
+
+void
+u64map_free(u64map_t* map)
+{
+    if (map != NULL)
+    {
+        free(map->entries);
+        free(map);
+    }
+}
+
+static int64_t
+u64map_rehash(u64map_t* map)
+{
+    uint64_t capacity = map->capacity * 2;
+    u64map_entry_t* entries = u64map_alloc_entries(capacity);
+    if (!entries)
+    {
+        return U64MAP_ERROR;
+    }
+
+    for (uint64_t i = 0; i < map->capacity; ++i)
+    {
+        const u64map_entry_t* e = &map->entries[i];
+        if (e->key != U64MAP_EMPTY)
+        {
+            uint64_t j = u64map_mix(e->key) & (capacity - 1);
+            while (entries[j].key != U64MAP_EMPTY)
+            {
+                j = (j + 1) & (capacity - 1);
+            }
+            entries[j] = *e;
+        }
+    }
+
+    free(map->entries);
+    map->entries = entries;
+    map->capacity = capacity;
+    map->rehashes++;
+    return U64MAP_OK;
+}
+
+int64_t
+u64map_increment(u64map_t* map, uint64_t key, uint64_t delta)
+{
+    if (key == U64MAP_EMPTY)
+    {
+        fprintf(stderr, "u64map_increment(): error: reserved key\n");
+        return U64MAP_ERROR;
+    }
+    if (2 * (map->size + 1) > map->capacity && u64map_rehash(map) != U64MAP_OK)
+    {
+        return U64MAP_ERROR;
+    }
+
+    uint64_t mask = map->capacity - 1;
+    uint64_t i = u64map_mix(key) & mask;
+    while (true)
+    {
+        u64map_entry_t* e = &map->entries[i];
+        if (e->key == key)
+        {
+            e->value += delta;
+            return U64MAP_OK;
+        }
+        if (e->key == U64MAP_EMPTY)
+        {
+            e->key = key;
+            e->value = delta;
+            map->size++;
+            return U64MAP_OK;
+        }
+        map->collisions++;
+        i = (i + 1) & mask;
+    }
+}
+
+uint64_t
+u64map_get(const u64map_t* map, uint64_t key)
+{
+    if (key == U64MAP_EMPTY)
+    {
+        return 0;
+    }
+
+    uint64_t mask = map->capacity - 1;
+    uint64_t i = u64map_mix(key) & mask;
+    while (map->entries[i].key != U64MAP_EMPTY)
+    {
+        if (map->entries[i].key == key)
+        {
+            return map->entries[i].value;
+        }
+        i = (i + 1) & mask;
+    }
+    return 0;
+}
+
+// Check if entry a ranks below entry b in top-k order.
+static bool
+u64map_ranks_below(const void* a, const void* b, const void* ctx)
+{
+    (void) ctx;
+    const u64map_entry_t* x = a;
+    const u64map_entry_t* y = b;
+    if (x->value != y->value)
+    {
+        return x->value < y->value;
+    }
+    return x->key > y->key;
+}
+
+uint64_t
+u64map_top_k(const u64map_t* map, uint64_t k, const u64map_entry_t** out)
+{
+    topk_t top;
+    topk_init(&top, (const void**) out, k, u64map_ranks_below, NULL);
+    for (uint64_t i = 0; i < map->capacity; ++i)
+    {
+        if (map->entries[i].key != U64MAP_EMPTY)
+        {
+            topk_push(&top, &map->entries[i]);
+        }
+    }
+    return topk_sort(&top);
+}
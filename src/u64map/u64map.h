@@ -0,0 +1,71 @@
+#ifndef MAPWORDS_U64MAP_H
+#define MAPWORDS_U64MAP_H
+
+#include <inttypes.h>
+
+/*
+Open addressing map from uint64_t keys to uint64_t counts.
+
+For integer keys such as packed pairs of word ids (see intern.h),
+where hashmap_map_t would need a key string per entry and a strcmp
+per probe. An entry is just the key and its count, 16 bytes, kept
+inline in the table. Keys are hashed with the MurmurHash3 64-bit
+finalizer and probed linearly, so a lookup is a multiply-mix and
+integer compares over adjacent entries.
+
+U64MAP_EMPTY (UINT64_MAX) marks empty entries and can not be used as
+a key. The table doubles when over half full.
+*/
+
+#define U64MAP_ERROR -1
+#define U64MAP_OK 0
+
+#define U64MAP_EMPTY UINT64_MAX
+#define U64MAP_INITIAL_CAPACITY 1024U
+
+typedef struct u64map_entry
+{
+    uint64_t key;
+    uint64_t value;
+} u64map_entry_t;
+
+typedef struct u64map
+{
+    u64map_entry_t* entries;
+    uint64_t capacity;
+    uint64_t size;
+    uint64_t collisions;
+    uint64_t rehashes;
+} u64map_t;
+
+// Allocate empty map.
+u64map_t*
+u64map_init(void);
+
+// Free map.
+void
+u64map_free(u64map_t* map);
+
+// Add delta to value of key, adding key with value delta if new.
+int64_t
+u64map_increment(u64map_t* map, uint64_t key, uint64_t delta);
+
+// Get value of key, 0 if not in map.
+uint64_t
+u64map_get(const u64map_t* map, uint64_t key);
+
+// Select k entries with the largest values in descending order.
+// Ties are broken by key in ascending order. 'out' must have room
+// for k pointers. Return number of entries written.
+uint64_t
+u64map_top_k(const u64map_t* map, uint64_t k, const u64map_entry_t** out);
+
+// Pack pair of 32-bit ids into a key, never U64MAP_EMPTY for ids
+// below UINT32_MAX.
+static inline uint64_t
+u64map_pair(uint32_t a, uint32_t b)
+{
+    return ((uint64_t) a << 32U) | b;
+}
+
+#endif //MAPWORDS_U64MAP_H
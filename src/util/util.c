@@ -1,5 +1,6 @@
 #include <ctype.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #include "util.h"
 
@@ -7,6 +8,26 @@
 #define STR_(X)
 #define STR(X) STR_(X)
 
+const bool WORD_CHARS[256] =
+    {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0,
+        0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    };
+
 int
 read_next_word(FILE* f, char* buf, int len)
 {
@@ -15,6 +36,64 @@ read_next_word(FILE* f, char* buf, int len)
     return fscanf(f, "%" STR(len) "[a-zA-Z']", buf);
 }
 
+uint64_t
+buffer_next_word(const char* buf, uint64_t buf_len, uint64_t* pos,
+                 char* out, uint64_t len)
+{
+    uint64_t i = *pos;
+
+    // Consume all non-allowed characters.
+    while (i < buf_len && !is_word_char(buf[i]))
+    {
+        ++i;
+    }
+
+    uint64_t n = 0;
+    while (i < buf_len && n < len - 1 && is_word_char(buf[i]))
+    {
+        // Setting bit 5 lowercases letters and keeps '\'' intact.
+        out[n++] = (char) (buf[i++] | 0x20);
+    }
+
+    out[n] = '\0';
+    *pos = i;
+    return n;
+}
+
+uint64_t
+buffer_partial_word_len(const char* buf, uint64_t buf_len)
+{
+    uint64_t n = 0;
+    while (n < buf_len && is_word_char(buf[buf_len - n - 1]))
+    {
+        ++n;
+    }
+    return n;
+}
+
+uint64_t
+read_word_block(FILE* f, char* buf, uint64_t size, uint64_t* carry,
+                bool* eof)
+{
+    uint64_t want = size - *carry;
+    uint64_t n = fread(buf + *carry, 1, want, f);
+    uint64_t len = *carry + n;
+    *carry = 0;
+
+    if (n < want)
+    {
+        *eof = true;
+        return len;
+    }
+
+    uint64_t partial = buffer_partial_word_len(buf, len);
+    if (partial < len && partial < WORD_SIZE)
+    {
+        *carry = partial;
+    }
+    return len - *carry;
+}
+
 void
 str_tolower(char* str)
 {
@@ -24,3 +103,10 @@ str_tolower(char* str)
         str++;
     }
 }
+
+uint64_t
+cpu_count(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0) ? (uint64_t) n : 1;
+}
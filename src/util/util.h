@@ -1,12 +1,60 @@
 #ifndef MAPWORDS_UTIL_H
 #define MAPWORDS_UTIL_H
 
+#include <stdio.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+// Assume generous 511 (+ '\0') maximum word length.
+#define WORD_SIZE 512
+
+// Lookup table for word characters [a-zA-Z'].
+extern const bool WORD_CHARS[256];
+
+// Check if character belongs to a word.
+static inline bool
+is_word_char(char c)
+{
+    return WORD_CHARS[(unsigned char) c];
+}
+
 // Read next word from file into buffer (limited by len).
 int
 read_next_word(FILE* f, char* buf, int len);
 
+// Find next word in buffer starting from *pos.
+// On success the word is copied in lowercase and null-terminated
+// into out (limited by len) and *pos is advanced past the word.
+// A word longer than len - 1 bytes is split: its first len - 1 bytes
+// are returned and *pos is left inside the word, so the next call
+// returns the rest as a separate word.
+// Return word length or 0 if no more words are found.
+uint64_t
+buffer_next_word(const char* buf, uint64_t buf_len, uint64_t* pos,
+                 char* out, uint64_t len);
+
+// Return length of the trailing partial word in buffer, i.e.
+// number of word characters after the last non-word character.
+uint64_t
+buffer_partial_word_len(const char* buf, uint64_t buf_len);
+
+// Read stream f into buf (size bytes) after the *carry bytes already
+// at its start. Return the number of bytes holding whole words only.
+// A partial word cut off by the end of buf follows them and its
+// length is stored in *carry, to be moved to the start of the next
+// block. Partial words of WORD_SIZE or more bytes are not carried and
+// get split as by buffer_next_word(). At end of stream or on error
+// (check ferror(f)) *eof is set and nothing is carried.
+uint64_t
+read_word_block(FILE* f, char* buf, uint64_t size, uint64_t* carry,
+                bool* eof);
+
 // Convert string to lowercase inplace.
 void
 str_tolower(char* str);
 
+// Return number of online processors (at least 1).
+uint64_t
+cpu_count(void);
+
 #endif //MAPWORDS_UTIL_H
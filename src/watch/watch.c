@@ -0,0 +1,579 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include "count.h"
+#include "hash.h"
+#include "hashmap.h"
+#include "multifile.h"
+#include "snapshot.h"
+#include "util.h"
+#include "watch.h"
+
+#define WATCH_INITIAL_CAPACITY 16U
+
+#define WATCH_DIR_EVENTS (IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE \
+    | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE)
+
+// Bytes before the counted offset compared to detect rewrites.
+#define WATCH_FINGERPRINT_BLOCK 4096U
+
+// Room for many events per read().
+#define WATCH_EVENT_BUFFER (64U * 1024U)
+
+typedef struct watch_count_ctx
+{
+    watch_t* watch;
+    watch_file_t* file;
+    char last[WORD_SIZE];
+    uint64_t last_len;
+} watch_count_ctx_t;
+
+watch_t*
+watch_init(hash_t (* hashf)(const char*))
+{
+    watch_t* watch = calloc(1, sizeof(watch_t));
+    if (!watch)
+    {
+        fprintf(stderr, "watch_init(): error: calloc(): watch\n");
+        return NULL;
+    }
+
+    watch->hashf = hashf;
+    watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    watch->aggregate = hashmap_init(hashf);
+    if (watch->fd < 0 || !watch->aggregate)
+    {
+        fprintf(stderr, "watch_init(): error: inotify_init1()\n");
+        watch_free(watch);
+        return NULL;
+    }
+
+    return watch;
+}
+
+static void
+watch_file_free(watch_file_t* file)
+{
+    free(file->path);
+    free(file->tail);
+    hashmap_free(file->map);
+}
+
+void
+watch_free(watch_t* watch)
+{
+    if (watch == NULL)
+    {
+        return;
+    }
+
+    for (uint64_t i = 0; i < watch->file_count; ++i)
+    {
+        watch_file_free(&watch->files[i]);
+    }
+    for (uint64_t i = 0; i < watch->dir_count; ++i)
+    {
+        free(watch->dirs[i].path);
+    }
+    if (watch->fd >= 0)
+    {
+        close(watch->fd);
+    }
+    hashmap_free(watch->aggregate);
+    free(watch->files);
+    free(watch->dirs);
+    free(watch);
+}
+
+static int64_t
+watch_count_word(char* word, uint64_t len, void* arg)
+{
+    watch_count_ctx_t* ctx = arg;
+    hash_t hash = ctx->watch->hashf(word);
+
+    if (hashmap_increment_knownhash(ctx->file->map, word, 1, hash) != HASHMAP_OK
+        || hashmap_increment_knownhash(ctx->watch->aggregate, word, 1, hash)
+           != HASHMAP_OK)
+    {
+        return WATCH_ERROR;
+    }
+
+    memcpy(ctx->last, word, len + 1);
+    ctx->last_len = len;
+    return WATCH_OK;
+}
+
+// Add delta of key to file map and aggregate.
+static int64_t
+watch_increment(watch_t* watch, watch_file_t* file, char* key, int64_t delta)
+{
+    hash_t hash = watch->hashf(key);
+    if (hashmap_increment_knownhash(file->map, key, delta, hash) != HASHMAP_OK
+        || hashmap_increment_knownhash(watch->aggregate, key, delta, hash)
+           != HASHMAP_OK)
+    {
+        return WATCH_ERROR;
+    }
+    return WATCH_OK;
+}
+
+// Remove all counts of file from the aggregate and reset file.
+static int64_t
+watch_file_subtract(watch_t* watch, watch_file_t* file)
+{
+    hashmap_map_t* map = file->map;
+    for (uint64_t i = 0; i < map->capacity; ++i)
+    {
+        hashmap_bucket_t* bucket = &map->buckets[i];
+        if (bucket->in_use && bucket->value != 0
+            && hashmap_increment_knownhash(watch->aggregate, bucket->key,
+                                           -bucket->value, bucket->hash)
+               != HASHMAP_OK)
+        {
+            return WATCH_ERROR;
+        }
+    }
+
+    hashmap_free(file->map);
+    file->map = hashmap_init(watch->hashf);
+    watch->wordcount -= file->wordcount;
+    watch->charcount -= file->charcount;
+    file->wordcount = 0;
+    file->charcount = 0;
+    file->offset = 0;
+    free(file->tail);
+    file->tail = NULL;
+    return file->map ? WATCH_OK : WATCH_ERROR;
+}
+
+// Checksum the counted block of up to WATCH_FINGERPRINT_BLOCK bytes
+// ending at offset of file fd.
+static bool
+watch_fingerprint(int fd, uint64_t offset, uint64_t* out)
+{
+    char block[WATCH_FINGERPRINT_BLOCK];
+    uint64_t start = (offset > sizeof(block)) ? offset - sizeof(block) : 0;
+    uint64_t len = offset - start;
+    if (pread(fd, block, len, (off_t) start) != (ssize_t) len)
+    {
+        return false;
+    }
+    *out = snapshot_checksum(block, len, 0);
+    return true;
+}
+
+// Count file from its counted offset to the current end.
+static int64_t
+watch_file_read(watch_t* watch, watch_file_t* file)
+{
+    FILE* f = fopen(file->path, "r");
+    if (!f)
+    {
+        // Gone between the event and now, a delete event follows.
+        return WATCH_OK;
+    }
+
+    struct stat st;
+    if (fstat(fileno(f), &st) != 0)
+    {
+        fclose(f);
+        return WATCH_ERROR;
+    }
+
+    // Content rewritten in place keeps the inode and may not shrink,
+    // the bytes before the counted offset then differ.
+    uint64_t fingerprint = 0;
+    if ((uint64_t) st.st_ino != file->inode
+        || (uint64_t) st.st_size < file->offset
+        || !watch_fingerprint(fileno(f), file->offset, &fingerprint)
+        || fingerprint != file->fingerprint)
+    {
+        if (watch_file_subtract(watch, file) != WATCH_OK)
+        {
+            fclose(f);
+            return WATCH_ERROR;
+        }
+        file->inode = (uint64_t) st.st_ino;
+        watch->rewrites++;
+    }
+    else if ((uint64_t) st.st_size == file->offset)
+    {
+        fclose(f);
+        return WATCH_OK;
+    }
+    else
+    {
+        watch->appends++;
+    }
+
+    // The word at the old end of file may continue, count it again.
+    uint64_t start = file->offset;
+    if (file->tail)
+    {
+        uint64_t len = strlen(file->tail);
+        if (watch_increment(watch, file, file->tail, -1) != WATCH_OK)
+        {
+            fclose(f);
+            return WATCH_ERROR;
+        }
+        file->wordcount--;
+        file->charcount -= len;
+        watch->wordcount--;
+        watch->charcount -= len;
+        start = file->tail_start;
+        free(file->tail);
+        file->tail = NULL;
+    }
+
+    watch_count_ctx_t ctx = {.watch = watch, .file = file, .last_len = 0};
+    uint64_t wordcount = 0;
+    uint64_t charcount = 0;
+    int64_t status = WATCH_OK;
+    if (fseeko(f, (off_t) start, SEEK_SET) != 0
+        || count_stream_each(f, watch_count_word, &ctx, &wordcount,
+                             &charcount) != 0)
+    {
+        status = WATCH_ERROR;
+    }
+
+    off_t end = ftello(f);
+    char last_char = '\0';
+    if (status == WATCH_OK && end > 0)
+    {
+        fseeko(f, end - 1, SEEK_SET);
+        last_char = (char) fgetc(f);
+    }
+
+    file->offset = (end > 0) ? (uint64_t) end : start;
+    if (status == WATCH_OK
+        && !watch_fingerprint(fileno(f), file->offset, &file->fingerprint))
+    {
+        status = WATCH_ERROR;
+    }
+    fclose(f);
+    file->wordcount += wordcount;
+    file->charcount += charcount;
+    watch->wordcount += wordcount;
+    watch->charcount += charcount;
+
+    if (status == WATCH_OK && ctx.last_len > 0 && is_word_char(last_char))
+    {
+        file->tail = strdup(ctx.last);
+        file->tail_start = file->offset - ctx.last_len;
+    }
+
+    return status;
+}
+
+static watch_file_t*
+watch_find_file(watch_t* watch, const char* path)
+{
+    for (uint64_t i = 0; i < watch->file_count; ++i)
+    {
+        if (strcmp(watch->files[i].path, path) == 0)
+        {
+            return &watch->files[i];
+        }
+    }
+    return NULL;
+}
+
+static void
+watch_remove_file(watch_t* watch, watch_file_t* file)
+{
+    watch_file_subtract(watch, file);
+    watch_file_free(file);
+    *file = watch->files[--watch->file_count];
+}
+
+// Return path as the real path of its directory plus its name, so the
+// same file given as "a.txt", "./a.txt" or through a symlinked
+// directory is found by the path built from events. NULL on error.
+static char*
+watch_canonical(const char* path)
+{
+    const char* slash = strrchr(path, '/');
+    const char* name = slash ? slash + 1 : path;
+    char dir[strlen(path) + 2];
+    if (!slash)
+    {
+        strcpy(dir, ".");
+    }
+    else
+    {
+        // Keep the slash of the root directory.
+        uint64_t len = (slash == path) ? 1 : (uint64_t) (slash - path);
+        memcpy(dir, path, len);
+        dir[len] = '\0';
+    }
+
+    char* real = realpath(dir, NULL);
+    if (!real)
+    {
+        fprintf(stderr, "watch_canonical(): error: realpath(): %s\n", dir);
+        return NULL;
+    }
+
+    uint64_t len = strlen(real);
+    const char* sep = (real[len - 1] == '/') ? "" : "/";
+    char* canonical = malloc(len + strlen(name) + 2);
+    if (canonical)
+    {
+        sprintf(canonical, "%s%s%s", real, sep, name);
+    }
+    free(real);
+    return canonical;
+}
+
+// Watch directory of canonical path unless it is watched already. With
+// tree set, files created in it are counted too.
+static int64_t
+watch_add_dir(watch_t* watch, const char* path, bool tree)
+{
+    char dir[strlen(path) + 1];
+    strcpy(dir, path);
+    char* slash = strrchr(dir, '/');
+    if (slash == dir)
+    {
+        dir[1] = '\0';
+    }
+    else
+    {
+        *slash = '\0';
+    }
+
+    int wd = inotify_add_watch(watch->fd, dir, WATCH_DIR_EVENTS);
+    if (wd < 0)
+    {
+        fprintf(stderr, "watch_add_dir(): error: inotify_add_watch(): %s\n",
+                dir);
+        return WATCH_ERROR;
+    }
+
+    for (uint64_t i = 0; i < watch->dir_count; ++i)
+    {
+        if (watch->dirs[i].wd == wd)
+        {
+            watch->dirs[i].tree |= tree;
+            return WATCH_OK;
+        }
+    }
+
+    if (watch->dir_count == watch->dir_capacity)
+    {
+        uint64_t capacity = watch->dir_capacity ? watch->dir_capacity * 2
+                                                : WATCH_INITIAL_CAPACITY;
+        watch_dir_t* dirs = realloc(watch->dirs, capacity * sizeof(watch_dir_t));
+        if (!dirs)
+        {
+            fprintf(stderr, "watch_add_dir(): error: realloc()\n");
+            return WATCH_ERROR;
+        }
+        watch->dirs = dirs;
+        watch->dir_capacity = capacity;
+    }
+
+    watch->dirs[watch->dir_count].wd = wd;
+    watch->dirs[watch->dir_count].tree = tree;
+    watch->dirs[watch->dir_count].path = strdup(dir);
+    if (!watch->dirs[watch->dir_count].path)
+    {
+        return WATCH_ERROR;
+    }
+    watch->dir_count++;
+    return WATCH_OK;
+}
+
+// Start tracking a single regular file and count it.
+static int64_t
+watch_add_file(watch_t* watch, const char* path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        return WATCH_OK;
+    }
+
+    if (watch->file_count == watch->file_capacity)
+    {
+        uint64_t capacity = watch->file_capacity ? watch->file_capacity * 2
+                                                 : WATCH_INITIAL_CAPACITY;
+        watch_file_t* files = realloc(watch->files,
+                                      capacity * sizeof(watch_file_t));
+        if (!files)
+        {
+            fprintf(stderr, "watch_add_file(): error: realloc()\n");
+            return WATCH_ERROR;
+        }
+        watch->files = files;
+        watch->file_capacity = capacity;
+    }
+
+    watch_file_t* file = &watch->files[watch->file_count];
+    memset(file, 0, sizeof(watch_file_t));
+    file->path = strdup(path);
+    file->inode = (uint64_t) st.st_ino;
+    file->map = hashmap_init(watch->hashf);
+    if (!file->path || !file->map)
+    {
+        watch_file_free(file);
+        return WATCH_ERROR;
+    }
+    watch->file_count++;
+
+    return watch_file_read(watch, file);
+}
+
+int64_t
+watch_add_path(watch_t* watch, const char* path)
+{
+    // Reuse the directory walk of the multi-file mode.
+    multifile_t* mf = multifile_init();
+    if (!mf || multifile_add_path(mf, path) != MULTIFILE_OK)
+    {
+        multifile_free(mf);
+        return WATCH_ERROR;
+    }
+
+    // Files found under a directory argument belong to its tree, so new
+    // files next to them are counted. A file argument only watches itself.
+    struct stat st;
+    bool tree = stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+    int64_t status = WATCH_OK;
+    if (tree)
+    {
+        // Also watch the (possibly empty) directory itself.
+        char child[strlen(path) + 3];
+        sprintf(child, "%s/.", path);
+        char* canonical = watch_canonical(child);
+        status = canonical ? watch_add_dir(watch, canonical, true)
+                           : WATCH_ERROR;
+        free(canonical);
+    }
+
+    for (uint64_t i = 0; i < mf->count && status == WATCH_OK; ++i)
+    {
+        char* file = watch_canonical(mf->files[i].path);
+        status = file ? watch_add_dir(watch, file, tree) : WATCH_ERROR;
+        if (status == WATCH_OK && !watch_find_file(watch, file))
+        {
+            status = watch_add_file(watch, file);
+        }
+        free(file);
+    }
+
+    multifile_free(mf);
+    return status;
+}
+
+static const watch_dir_t*
+watch_find_dir(const watch_t* watch, int wd)
+{
+    for (uint64_t i = 0; i < watch->dir_count; ++i)
+    {
+        if (watch->dirs[i].wd == wd)
+        {
+            return &watch->dirs[i];
+        }
+    }
+    return NULL;
+}
+
+static int64_t
+watch_handle_event(watch_t* watch, const struct inotify_event* event)
+{
+    const watch_dir_t* dir = watch_find_dir(watch, event->wd);
+    if (!dir || event->len == 0 || (event->mask & IN_ISDIR))
+    {
+        return 0;
+    }
+
+    // Directory paths are canonical, so this is the path files are
+    // registered with.
+    const char* sep = (strcmp(dir->path, "/") == 0) ? "" : "/";
+    char path[strlen(dir->path) + strlen(event->name) + 2];
+    sprintf(path, "%s%s%s", dir->path, sep, event->name);
+    watch_file_t* file = watch_find_file(watch, path);
+
+    if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+    {
+        if (file)
+        {
+            watch_remove_file(watch, file);
+            return 1;
+        }
+        return 0;
+    }
+
+    if (!file)
+    {
+        // Siblings of watched files are not counted.
+        if (!dir->tree)
+        {
+            return 0;
+        }
+        uint64_t count = watch->file_count;
+        if (watch_add_file(watch, path) != WATCH_OK)
+        {
+            return WATCH_ERROR;
+        }
+        return (int64_t) (watch->file_count - count);
+    }
+
+    // Close events after already counted writes change nothing.
+    uint64_t reads = watch->appends + watch->rewrites;
+    if (watch_file_read(watch, file) != WATCH_OK)
+    {
+        return WATCH_ERROR;
+    }
+    return (watch->appends + watch->rewrites > reads) ? 1 : 0;
+}
+
+int64_t
+watch_poll(watch_t* watch, int timeout_ms)
+{
+    struct pollfd pfd = {.fd = watch->fd, .events = POLLIN};
+    int ready = poll(&pfd, 1, timeout_ms);
+    if (ready <= 0)
+    {
+        if (ready < 0 && errno != EINTR)
+        {
+            fprintf(stderr, "watch_poll(): error: poll()\n");
+            return WATCH_ERROR;
+        }
+        return 0;
+    }
+
+    _Alignas(struct inotify_event) char buf[WATCH_EVENT_BUFFER];
+    int64_t changed = 0;
+    ssize_t len;
+
+    // Drain all queued events, a burst of writes becomes one refresh.
+    while ((len = read(watch->fd, buf, sizeof(buf))) > 0)
+    {
+        for (char* p = buf; p < buf + len;)
+        {
+            const struct inotify_event* event = (const struct inotify_event*) p;
+            int64_t n = watch_handle_event(watch, event);
+            if (n < 0)
+            {
+                return WATCH_ERROR;
+            }
+            changed += n;
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    if (len < 0 && errno != EAGAIN && errno != EINTR)
+    {
+        fprintf(stderr, "watch_poll(): error: read()\n");
+        return WATCH_ERROR;
+    }
+    return changed;
+}
@@ -0,0 +1,100 @@
+#ifndef MAPWORDS_WATCH_H
+#define MAPWORDS_WATCH_H
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "hash.h"
+#include "hashmap.h"
+
+/*
+Incremental counting of growing files with inotify (Linux only).
+
+Every watched file keeps its own resident map and the number of
+bytes already counted. Counts go to the file map and the aggregate
+map at once, so the aggregate is always current and reading it
+costs no merge.
+
+Watches are placed on the directories containing the files. Files
+created or moved into a directory given to watch_add_path() (or one
+below it) are counted too; other files next to a watched file are
+ignored. Files are kept by the real path of their directory plus
+their name, so "a.txt" and "./a.txt" are the same file. On a change:
+  - a file that grew is read from its counted offset only. If the
+    previous read ended inside a word (no delimiter at the end of
+    file yet), that word is subtracted and read again, so a word
+    split across two writes is counted once.
+  - a file that shrank, was replaced (new inode) or whose last
+    counted block (4 KiB before the counted offset) changed is
+    rewritten: its map is subtracted from the aggregate, dropped and
+    the whole file is counted again. A rewrite keeping that block
+    and only changing earlier bytes goes unnoticed.
+  - a deleted or moved away file is subtracted and forgotten.
+
+Subtracted words stay in the aggregate map with count 0 (the map
+has no delete), so readers of hashmap_top_k() stop at the first
+count of 0. Subdirectories created after start are not watched.
+*/
+
+#define WATCH_ERROR -1
+#define WATCH_OK 0
+
+typedef struct watch_file
+{
+    char* path; // Canonical.
+    uint64_t inode;
+    uint64_t offset; // Bytes counted.
+    uint64_t fingerprint; // Checksum of the last block before offset.
+    char* tail; // Word counted at end of file, NULL if none.
+    uint64_t tail_start; // File offset of tail.
+    uint64_t wordcount;
+    uint64_t charcount;
+    hashmap_map_t* map;
+} watch_file_t;
+
+typedef struct watch_dir
+{
+    int wd;
+    char* path; // Canonical.
+    bool tree; // Below a watched directory, new files are counted.
+} watch_dir_t;
+
+typedef struct watch
+{
+    int fd; // inotify instance.
+    hash_t (* hashf)(const char*);
+    hashmap_map_t* aggregate;
+    uint64_t wordcount;
+    uint64_t charcount;
+
+    watch_file_t* files;
+    uint64_t file_count;
+    uint64_t file_capacity;
+
+    watch_dir_t* dirs;
+    uint64_t dir_count;
+    uint64_t dir_capacity;
+
+    uint64_t appends; // Incremental reads.
+    uint64_t rewrites; // Full recounts after truncation or replacement.
+} watch_t;
+
+// Create inotify instance and empty aggregate map.
+watch_t*
+watch_init(hash_t (* hashf)(const char*));
+
+// Free watch and all maps.
+void
+watch_free(watch_t* watch);
+
+// Watch file or all files in directory tree and count them.
+int64_t
+watch_add_path(watch_t* watch, const char* path);
+
+// Wait up to timeout_ms (-1 waits forever) for changes and apply
+// all pending ones. Return number of changes applied, 0 on timeout or
+// WATCH_ERROR. Interrupted waits return 0.
+int64_t
+watch_poll(watch_t* watch, int timeout_ms);
+
+#endif //MAPWORDS_WATCH_H
@@ -1,7 +1,39 @@
+#include <dirent.h>
+#include <fcntl.h>
 #include <inttypes.h>
-
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "art.h"
+#include "backend.h"
+#include "bloom.h"
+#include "cache.h"
+#include "cms.h"
 #include "hash.h"
 #include "hashmap.h"
+#include "hashmap_snapshot.h"
+#include "hashmap_template.h"
+#include "hll.h"
+#include "index.h"
+#include "intern.h"
+#include "mapwords.h"
+#include "multifile.h"
+#include "ngram.h"
+#include "output.h"
+#include "packed.h"
+#include "pipeline.h"
+#include "prefix.h"
+#include "ring.h"
+#include "sample.h"
+#include "server.h"
+#include "snapshot.h"
+#include "sort.h"
+#include "spacesaving.h"
+#include "u64map.h"
+#include "util.h"
+#include "watch.h"
 #include "greatest.h"
 
 static hashmap_map_t* MAP;
@@ -252,6 +284,139 @@ TEST swap(void)
     PASS();
 }
 
+TEST increment_merge(void)
+{
+    int64_t out = 0;
+    ASSERT_EQ(HASHMAP_OK, hashmap_increment(MAP, "test_key1", 1));
+    ASSERT_EQ(HASHMAP_OK, hashmap_increment(MAP, "test_key1", 2));
+    ASSERT_EQ(HASHMAP_OK, hashmap_increment(MAP, "test_key2", 5));
+    ASSERT_EQ(HASHMAP_KEY_FOUND, hashmap_get(MAP, "test_key1", &out));
+    ASSERT_EQ(3, out);
+
+    hashmap_map_t* other = hashmap_init(hash_djb2);
+    ASSERT_EQ(HASHMAP_OK, hashmap_increment(other, "test_key1", 10));
+    ASSERT_EQ(HASHMAP_OK, hashmap_increment(other, "test_key3", 7));
+    ASSERT_EQ(HASHMAP_OK, hashmap_merge(MAP, other));
+    hashmap_free(other);
+
+    ASSERT_EQ(3, MAP->size);
+    ASSERT_EQ(HASHMAP_KEY_FOUND, hashmap_get(MAP, "test_key1", &out));
+    ASSERT_EQ(13, out);
+    ASSERT_EQ(HASHMAP_KEY_FOUND, hashmap_get(MAP, "test_key2", &out));
+    ASSERT_EQ(5, out);
+    ASSERT_EQ(HASHMAP_KEY_FOUND, hashmap_get(MAP, "test_key3", &out));
+    ASSERT_EQ(7, out);
+
+    PASS();
+}
+
+TEST top_k(void)
+{
+    char new_key[256] = {'\0'};
+    for (uint64_t i = 0; i < 50; ++i)
+    {
+        sprintf(new_key, "blob%"PRIu64"", i);
+        ASSERT_EQ(HASHMAP_OK, hashmap_add(MAP, new_key, i % 10));
+    }
+
+    const hashmap_bucket_t* top[8];
+    ASSERT_EQ(8, hashmap_top_k(MAP, 8, top));
+
+    // Five keys have value 9 and five have value 8, ties by key.
+    const char* expected[8] = {"blob19", "blob29", "blob39", "blob49",
+                               "blob9", "blob18", "blob28", "blob38"};
+    for (uint64_t i = 0; i < 8; ++i)
+    {
+        ASSERT_STR_EQ(expected[i], top[i]->key);
+    }
+
+    const hashmap_bucket_t* all[64];
+    ASSERT_EQ(50, hashmap_top_k(MAP, 64, all));
+    for (uint64_t i = 1; i < 50; ++i)
+    {
+        ASSERT(all[i - 1]->value >= all[i]->value);
+    }
+    ASSERT_EQ(0, all[49]->value);
+    ASSERT_EQ(0, hashmap_top_k(MAP, 0, all));
+
+    PASS();
+}
+
+DEFINE_HASHMAP(test_map, hash_java_len, uint32_t, 0.5, HASHMAP_PROBE_LINEAR)
+
+static int64_t
+test_map_sum_value(const char* key, uint32_t value, void* ctx)
+{
+    (void) key;
+    *(uint64_t*) ctx += value;
+    return 0;
+}
+
+static hash_t
+test_hash_constant(const char* key, uint64_t len)
+{
+    (void) key;
+    (void) len;
+    return 7;
+}
+
+DEFINE_HASHMAP(test_collide, test_hash_constant, uint32_t, 0.5,
+               HASHMAP_PROBE_PERTURB)
+
+TEST hashmap_template_counts(void)
+{
+    ASSERT_EQ(hash_djb2("counter"), hash_djb2_len("counter", 7));
+    ASSERT_EQ(hash_sdbm("counter"), hash_sdbm_len("counter", 7));
+    ASSERT_EQ(hash_java("counter"), hash_java_len("counter", 7));
+
+    test_map_t* map = test_map_init();
+    ASSERT(map != NULL);
+    ASSERT_EQ(16, sizeof(test_map_entry_t));
+
+    // Enough words to rehash several times.
+    char word[16];
+    for (int round = 0; round < 3; ++round)
+    {
+        for (int i = 0; i < 1000; ++i)
+        {
+            int len = sprintf(word, "w%d", i);
+            ASSERT_EQ(HASHMAP_OK, test_map_increment(map, word, (uint64_t) len,
+                                                     (uint32_t) (i % 7)));
+        }
+    }
+    ASSERT_EQ(1000, map->size);
+    ASSERT(map->rehashes > 0);
+    ASSERT(map->size <= map->capacity / 2);
+    ASSERT_EQ(3 * 6, test_map_get(map, "w6", 2));
+    ASSERT_EQ(0, test_map_get(map, "w7", 2));
+    ASSERT_EQ(0, test_map_get(map, "w1000", 5));
+
+    uint64_t sum = 0;
+    ASSERT_EQ(0, test_map_each(map, test_map_sum_value, &sum));
+    uint64_t expected = 0;
+    for (int i = 0; i < 1000; ++i)
+    {
+        expected += 3 * (uint64_t) (i % 7);
+    }
+    ASSERT_EQ(expected, sum);
+
+    test_map_free(map);
+
+    // Keys of different lengths sharing one hash.
+    test_collide_t* collide = test_collide_init();
+    ASSERT(collide != NULL);
+    ASSERT_EQ(HASHMAP_OK, test_collide_increment(collide, "a", 1, 1));
+    ASSERT_EQ(HASHMAP_OK, test_collide_increment(collide, "ab", 2, 2));
+    ASSERT_EQ(HASHMAP_OK, test_collide_increment(collide, "abcdefgh", 8, 3));
+    ASSERT_EQ(3, collide->size);
+    ASSERT_EQ(1, test_collide_get(collide, "a", 1));
+    ASSERT_EQ(2, test_collide_get(collide, "ab", 2));
+    ASSERT_EQ(3, test_collide_get(collide, "abcdefgh", 8));
+    ASSERT_EQ(0, test_collide_get(collide, "abc", 3));
+    test_collide_free(collide);
+    PASS();
+}
+
 SUITE (hashmap_suite)
 {
     MAP = hashmap_init(hash_djb2);
@@ -285,6 +450,1660 @@ SUITE (hashmap_suite)
     MAP = hashmap_init(hash_djb2);
     RUN_TEST(swap);
     hashmap_free(MAP);
+
+    MAP = hashmap_init(hash_djb2);
+    RUN_TEST(increment_merge);
+    hashmap_free(MAP);
+
+    MAP = hashmap_init(hash_djb2);
+    RUN_TEST(top_k);
+    hashmap_free(MAP);
+
+    RUN_TEST(hashmap_template_counts);
+}
+
+TEST ring_push_pop(void)
+{
+    ring_t* ring = ring_init(3);
+    ASSERT(ring != NULL);
+    ASSERT_EQ(4, ring->capacity);
+
+    uint64_t items[5] = {1, 2, 3, 4, 5};
+    void* out = NULL;
+
+    ASSERT_FALSE(ring_try_pop(ring, &out));
+    for (uint64_t i = 0; i < 4; ++i)
+    {
+        ASSERT(ring_try_push(ring, &items[i]));
+    }
+    ASSERT_FALSE(ring_try_push(ring, &items[4]));
+
+    // Wrap around a few times to check index masking.
+    for (uint64_t round = 0; round < 10; ++round)
+    {
+        ASSERT(ring_try_pop(ring, &out));
+        ASSERT_EQ(items[round % 4], *(uint64_t*) out);
+        ASSERT(ring_try_push(ring, out));
+    }
+
+    ring_free(ring);
+    PASS();
+}
+
+#define RING_THREAD_ITEMS 100000U
+
+static void*
+ring_producer(void* arg)
+{
+    ring_t* ring = arg;
+    for (uintptr_t i = 1; i <= RING_THREAD_ITEMS; ++i)
+    {
+        ring_push(ring, (void*) i);
+    }
+    ring_push(ring, NULL);
+    return NULL;
+}
+
+TEST ring_threads(void)
+{
+    ring_t* ring = ring_init(8);
+    pthread_t producer;
+    ASSERT_EQ(0, pthread_create(&producer, NULL, ring_producer, ring));
+
+    uintptr_t expected = 1;
+    void* item;
+    while ((item = ring_pop(ring)) != NULL)
+    {
+        ASSERT_EQ(expected, (uintptr_t) item);
+        ++expected;
+    }
+    ASSERT_EQ(RING_THREAD_ITEMS + 1, expected);
+
+    pthread_join(producer, NULL);
+    ring_free(ring);
+    PASS();
+}
+
+SUITE (ring_suite)
+{
+    RUN_TEST(ring_push_pop);
+    RUN_TEST(ring_threads);
+}
+
+// Count words of buffer with the buffer tokenizer on a single thread.
+static hashmap_map_t*
+count_buffer(const char* buf, uint64_t len)
+{
+    hashmap_map_t* map = hashmap_init(hash_djb2);
+    char word[WORD_SIZE];
+    uint64_t pos = 0;
+    while (buffer_next_word(buf, len, &pos, word, WORD_SIZE) > 0)
+    {
+        hashmap_increment(map, word, 1);
+    }
+    return map;
+}
+
+TEST pipeline_matches_serial(void)
+{
+    // Text with words straddling every small buffer boundary.
+    char text[64 * 1024];
+    uint64_t len = 0;
+    for (uint64_t i = 0; len < sizeof(text) - 64; ++i)
+    {
+        len += sprintf(text + len, "Word%c%"PRIu64"x it's, ",
+                       (char) ('a' + i % 26), i % 97);
+    }
+
+    FILE* f = tmpfile();
+    ASSERT(f != NULL);
+    ASSERT_EQ(len, fwrite(text, 1, len, f));
+    rewind(f);
+
+    pipeline_config_t config;
+    pipeline_config_default(&config, hash_djb2);
+    config.tokenizers = 3;
+    config.counters = 2;
+    config.buffer_size = 2 * WORD_SIZE;
+
+    uint64_t wordcount = 0;
+    uint64_t charcount = 0;
+    ASSERT_EQ(PIPELINE_OK, pipeline_count(f, &config, MAP,
+                                          &wordcount, &charcount));
+    fclose(f);
+
+    hashmap_map_t* expected = count_buffer(text, len);
+    ASSERT_EQ(expected->size, MAP->size);
+
+    uint64_t expected_words = 0;
+    for (uint64_t i = 0; i < expected->capacity; ++i)
+    {
+        hashmap_bucket_t* bucket = &expected->buckets[i];
+        if (bucket->in_use)
+        {
+            int64_t out = 0;
+            ASSERT_EQ(HASHMAP_KEY_FOUND, hashmap_get(MAP, bucket->key, &out));
+            ASSERT_EQm(bucket->key, bucket->value, out);
+            expected_words += bucket->value;
+        }
+    }
+    ASSERT_EQ(expected_words, wordcount);
+
+    hashmap_free(expected);
+    PASS();
+}
+
+SUITE (pipeline_suite)
+{
+    MAP = hashmap_init(hash_djb2);
+    RUN_TEST(pipeline_matches_serial);
+    hashmap_free(MAP);
+}
+
+TEST multifile_dir(void)
+{
+    char dir[] = "/tmp/mapwords_test_XXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+
+    char path_a[64];
+    char path_b[64];
+    sprintf(path_a, "%s/a.txt", dir);
+    sprintf(path_b, "%s/b.txt", dir);
+
+    FILE* f = fopen(path_a, "w");
+    ASSERT(f != NULL);
+    fputs("the cat and the hat", f);
+    fclose(f);
+
+    f = fopen(path_b, "w");
+    ASSERT(f != NULL);
+    fputs("The dog, the cat.", f);
+    fclose(f);
+
+    multifile_t* mf = multifile_init();
+    ASSERT_EQ(MULTIFILE_OK, multifile_add_path(mf, dir));
+    ASSERT_EQ(2, mf->count);
+    ASSERT_STR_EQ(path_a, mf->files[0].path);
+
+    uint64_t wordcount = 0;
+    uint64_t charcount = 0;
+    ASSERT_EQ(MULTIFILE_OK, multifile_count(mf, MAP, 2, true,
+                                            &wordcount, &charcount));
+    ASSERT_EQ(9, wordcount);
+    ASSERT_EQ(5, MAP->size);
+
+    int64_t out = 0;
+    ASSERT_EQ(HASHMAP_KEY_FOUND, hashmap_get(MAP, "the", &out));
+    ASSERT_EQ(4, out);
+    ASSERT_EQ(HASHMAP_KEY_FOUND, hashmap_get(MAP, "cat", &out));
+    ASSERT_EQ(2, out);
+
+    // Per-file maps are kept.
+    ASSERT_EQ(HASHMAP_KEY_FOUND, hashmap_get(mf->files[1].map, "the", &out));
+    ASSERT_EQ(2, out);
+    ASSERT_EQ(HASHMAP_KEY_NOT_FOUND,
+              hashmap_get(mf->files[1].map, "hat", &out));
+
+    multifile_free(mf);
+    remove(path_a);
+    remove(path_b);
+    remove(dir);
+    PASS();
+}
+
+// Remove directory and the files in it.
+static void
+remove_dir(const char* dir)
+{
+    DIR* d = opendir(dir);
+    struct dirent* ent;
+    char path[512];
+    while (d && (ent = readdir(d)) != NULL)
+    {
+        if (ent->d_name[0] != '.')
+        {
+            snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+            remove(path);
+        }
+    }
+    if (d)
+    {
+        closedir(d);
+    }
+    remove(dir);
+}
+
+TEST multifile_cache(void)
+{
+    char dir[] = "/tmp/mapwords_test_XXXXXX";
+    char cache_dir[] = "/tmp/mapwords_cache_XXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+    ASSERT(mkdtemp(cache_dir) != NULL);
+
+    char path[64];
+    for (int i = 0; i < 3; ++i)
+    {
+        sprintf(path, "%s/%d.txt", dir, i);
+        FILE* f = fopen(path, "w");
+        ASSERT(f != NULL);
+        fprintf(f, "file%c shared words shared\n", 'a' + i);
+        fclose(f);
+    }
+
+    cache_t* cache = cache_init(cache_dir);
+    ASSERT(cache != NULL);
+
+    // First run fills the cache, second run is served from it.
+    for (int run = 0; run < 2; ++run)
+    {
+        hashmap_map_t* map = hashmap_init(hash_djb2);
+        multifile_t* mf = multifile_init();
+        mf->cache = cache;
+        ASSERT_EQ(MULTIFILE_OK, multifile_add_path(mf, dir));
+
+        uint64_t wordcount = 0;
+        uint64_t charcount = 0;
+        ASSERT_EQ(MULTIFILE_OK, multifile_count(mf, map, 2, run == 1,
+                                                &wordcount, &charcount));
+        ASSERT_EQ(12, wordcount);
+        ASSERT_EQ(3 * (5 + 6 + 5 + 6), charcount);
+        ASSERT_EQ(5, map->size);
+
+        int64_t out = 0;
+        ASSERT_EQ(HASHMAP_KEY_FOUND, hashmap_get(map, "shared", &out));
+        ASSERT_EQ(6, out);
+        ASSERT_EQ(3, atomic_load(&cache->misses));
+        ASSERT_EQ(run ? 3 : 0, atomic_load(&cache->hits));
+        if (run == 1)
+        {
+            ASSERT_EQ(HASHMAP_KEY_FOUND,
+                      hashmap_get(mf->files[2].map, "filec", &out));
+        }
+
+        multifile_free(mf);
+        hashmap_free(map);
+    }
+
+    // A modified file misses.
+    sprintf(path, "%s/0.txt", dir);
+    FILE* f = fopen(path, "a");
+    ASSERT(f != NULL);
+    fputs("more\n", f);
+    fclose(f);
+
+    int fd = open(path, O_RDONLY);
+    cache_key_t key;
+    snapshot_t* snap = NULL;
+    ASSERT_EQ(CACHE_OK, cache_key(fd, hash_djb2, &key));
+    ASSERT_EQ(CACHE_MISS, cache_lookup(cache, &key, &snap));
+    ASSERT_EQ(NULL, snap);
+    close(fd);
+
+    cache_free(cache);
+    remove_dir(dir);
+    remove_dir(cache_dir);
+    PASS();
+}
+
+TEST multifile_doc_freq(void)
+{
+    char dir[] = "/tmp/mapwords_test_XXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+
+    const char* docs[] = {"common rare common", "common other", "common"};
+    char path[64];
+    for (int i = 0; i < 3; ++i)
+    {
+        sprintf(path, "%s/%d.txt", dir, i);
+        FILE* f = fopen(path, "w");
+        ASSERT(f != NULL);
+        fputs(docs[i], f);
+        fclose(f);
+    }
+
+    // Shared worker maps and per-file maps give the same frequencies.
+    for (int keep_maps = 0; keep_maps < 2; ++keep_maps)
+    {
+        hashmap_map_t* map = hashmap_init(hash_djb2);
+        multifile_t* mf = multifile_init();
+        mf->doc_freq = true;
+        ASSERT_EQ(MULTIFILE_OK, multifile_add_path(mf, dir));
+
+        uint64_t wordcount = 0;
+        uint64_t charcount = 0;
+        ASSERT_EQ(MULTIFILE_OK, multifile_count(mf, map, 2, keep_maps,
+                                                &wordcount, &charcount));
+        ASSERT_EQ(6, wordcount);
+        ASSERT_EQ(3, map->size);
+
+        const char* words[] = {"common", "rare", "other"};
+        const int64_t counts[] = {4, 1, 1};
+        const uint32_t dfs[] = {3, 1, 1};
+        for (uint64_t i = 0; i < map->capacity; ++i)
+        {
+            hashmap_bucket_t* bucket = &map->buckets[i];
+            for (int w = 0; w < 3 && bucket->in_use; ++w)
+            {
+                if (strcmp(words[w], bucket->key) == 0)
+                {
+                    ASSERT_EQ(counts[w], bucket->value);
+                    ASSERT_EQ(dfs[w], bucket->df);
+                }
+            }
+        }
+
+        multifile_free(mf);
+        hashmap_free(map);
+    }
+
+    remove_dir(dir);
+    PASS();
+}
+
+SUITE (multifile_suite)
+{
+    MAP = hashmap_init(hash_djb2);
+    RUN_TEST(multifile_dir);
+    RUN_TEST(multifile_cache);
+    RUN_TEST(multifile_doc_freq);
+    hashmap_free(MAP);
+}
+
+TEST sort_value_key(void)
+{
+    char new_key[256] = {'\0'};
+    for (uint64_t i = 0; i < 1000; ++i)
+    {
+        sprintf(new_key, "blob%"PRIu64"", i);
+        ASSERT_EQ(HASHMAP_OK, hashmap_add(MAP, new_key, (i * 7919) % 300));
+    }
+
+    for (uint64_t threads = 1; threads <= 5; ++threads)
+    {
+        uint64_t* order = NULL;
+        uint64_t count = 0;
+        ASSERT_EQ(SORT_OK, sort_by_value(MAP, threads, &order, &count));
+        ASSERT_EQ(MAP->size, count);
+
+        for (uint64_t i = 1; i < count; ++i)
+        {
+            hashmap_bucket_t* a = &MAP->buckets[order[i - 1]];
+            hashmap_bucket_t* b = &MAP->buckets[order[i]];
+            ASSERT(a->in_use && b->in_use);
+            ASSERT(a->value >= b->value);
+            if (a->value == b->value)
+            {
+                ASSERT(strcmp(a->key, b->key) < 0);
+            }
+        }
+        free(order);
+    }
+
+    PASS();
+}
+
+SUITE (sort_suite)
+{
+    MAP = hashmap_init(hash_djb2);
+    RUN_TEST(sort_value_key);
+    hashmap_free(MAP);
+}
+
+TEST output_text_matches_printf(void)
+{
+    char path[] = "/tmp/mapwords_output_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(fd != -1);
+    close(fd);
+
+    const char* keys[4] = {"a", "it's", "averyveryverylongword", ""};
+    int64_t values[4] = {0, 9, 1234567890123LL, 100};
+    uint64_t ranks[4] = {1, 99, 100, 12345};
+
+    output_t* out = output_open(path, OUTPUT_TEXT);
+    ASSERT(out != NULL);
+    ASSERT_EQ(OUTPUT_OK, output_title(out, "title:"));
+    for (uint64_t i = 0; i < 4; ++i)
+    {
+        ASSERT_EQ(OUTPUT_OK, output_entry(out, ranks[i], keys[i], values[i]));
+    }
+    ASSERT_EQ(OUTPUT_OK, output_close(out));
+
+    char expected[512] = "title:\n";
+    for (uint64_t i = 0; i < 4; ++i)
+    {
+        sprintf(expected + strlen(expected), "%-3lu: %-16s %16lu\n",
+                ranks[i], keys[i], values[i]);
+    }
+
+    char actual[512] = {'\0'};
+    FILE* f = fopen(path, "r");
+    ASSERT(f != NULL);
+    actual[fread(actual, 1, sizeof(actual) - 1, f)] = '\0';
+    fclose(f);
+    remove(path);
+
+    ASSERT_STR_EQ(expected, actual);
+    PASS();
+}
+
+TEST output_u64(void)
+{
+    char buf[21] = {'\0'};
+    uint64_t values[5] = {0, 7, 10, 4096, UINT64_MAX};
+    for (uint64_t i = 0; i < 5; ++i)
+    {
+        char expected[21];
+        sprintf(expected, "%"PRIu64"", values[i]);
+        buf[output_format_u64(buf, values[i])] = '\0';
+        ASSERT_STR_EQ(expected, buf);
+    }
+    PASS();
+}
+
+SUITE (output_suite)
+{
+    RUN_TEST(output_text_matches_printf);
+    RUN_TEST(output_u64);
+}
+
+TEST spacesaving_bounds(void)
+{
+    spacesaving_t* ss = spacesaving_init(hash_djb2, 16);
+    ASSERT(ss != NULL);
+
+    // Skewed stream: word i appears about 1000 / (i + 1) times,
+    // interleaved so heavy words keep getting evicted candidates.
+    char key[32];
+    uint64_t n = 0;
+    for (uint64_t round = 0; round < 1000; ++round)
+    {
+        for (uint64_t i = 0; i < 200; ++i)
+        {
+            if (round % (i + 1) == 0)
+            {
+                sprintf(key, "w%"PRIu64"", i);
+                ASSERT_EQ(SPACESAVING_OK, spacesaving_add(ss, key));
+                ASSERT_EQ(HASHMAP_OK, hashmap_increment(MAP, key, 1));
+                ++n;
+            }
+        }
+    }
+
+    ASSERT_EQ(n, ss->words);
+    ASSERT_EQ(16, ss->size);
+    ASSERT(spacesaving_error_bound(ss) <= n / 16);
+
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < ss->size; ++i)
+    {
+        spacesaving_counter_t* c = &ss->counters[i];
+        int64_t exact = 0;
+        ASSERT_EQ(HASHMAP_KEY_FOUND, hashmap_get(MAP, c->key, &exact));
+        ASSERT((int64_t) c->count >= exact);
+        ASSERT((int64_t) (c->count - c->error) <= exact);
+        total += c->count;
+    }
+    ASSERT_EQ(n, total);
+
+    const spacesaving_counter_t* top[4];
+    ASSERT_EQ(4, spacesaving_top_k(ss, 4, top));
+    ASSERT_STR_EQ("w0", top[0]->key);
+    ASSERT_STR_EQ("w1", top[1]->key);
+    ASSERT(top[0]->count >= 1000);
+    ASSERT(spacesaving_guaranteed(ss, top, 4) >= 2);
+
+    spacesaving_free(ss);
+    PASS();
+}
+
+SUITE (spacesaving_suite)
+{
+    MAP = hashmap_init(hash_djb2);
+    RUN_TEST(spacesaving_bounds);
+    hashmap_free(MAP);
+}
+
+TEST cms_estimates(void)
+{
+    cms_t* cms = cms_init(hash_djb2, 1024, 4, 4);
+    ASSERT(cms != NULL);
+    ASSERT_EQ(1024, cms->width);
+
+    // Same skewed stream as spacesaving_bounds.
+    char key[32];
+    uint64_t n = 0;
+    for (uint64_t round = 0; round < 1000; ++round)
+    {
+        for (uint64_t i = 0; i < 200; ++i)
+        {
+            if (round % (i + 1) == 0)
+            {
+                sprintf(key, "w%"PRIu64"", i);
+                ASSERT_EQ(CMS_OK, cms_add(cms, key));
+                ASSERT_EQ(HASHMAP_OK, hashmap_increment(MAP, key, 1));
+                ++n;
+            }
+        }
+    }
+    ASSERT_EQ(n, cms->words);
+
+    for (uint64_t i = 0; i < MAP->capacity; ++i)
+    {
+        hashmap_bucket_t* bucket = &MAP->buckets[i];
+        if (bucket->in_use)
+        {
+            uint64_t estimate = cms_estimate(cms, bucket->key);
+            ASSERT(estimate >= (uint64_t) bucket->value);
+            ASSERT(estimate <= bucket->value + cms_error_bound(cms));
+        }
+    }
+    ASSERT_EQ(0, cms_estimate(cms, "missing"));
+
+    const cms_heavy_t* top[4];
+    ASSERT_EQ(4, cms_heavy_hitters(cms, top));
+    ASSERT_STR_EQ("w0", top[0]->key);
+    ASSERT_STR_EQ("w1", top[1]->key);
+    ASSERT_STR_EQ("w2", top[2]->key);
+    ASSERT_STR_EQ("w3", top[3]->key);
+    ASSERT(top[0]->estimate >= 1000);
+
+    cms_free(cms);
+    PASS();
+}
+
+SUITE (cms_suite)
+{
+    MAP = hashmap_init(hash_djb2);
+    RUN_TEST(cms_estimates);
+    hashmap_free(MAP);
+}
+
+TEST hll_estimates(void)
+{
+    hll_t* a = hll_init(HLL_DEFAULT_PRECISION);
+    hll_t* b = hll_init(HLL_DEFAULT_PRECISION);
+    ASSERT(a != NULL && b != NULL);
+    ASSERT_EQ(0, (uint64_t) hll_estimate(a));
+
+    // Small sets stay sparse and are nearly exact.
+    char key[32];
+    for (uint64_t i = 0; i < 1000; ++i)
+    {
+        sprintf(key, "w%"PRIu64"", i);
+        ASSERT_EQ(HLL_OK, hll_add(a, hash_djb2(key)));
+        ASSERT_EQ(HLL_OK, hll_add(a, hash_djb2(key)));
+    }
+    ASSERT(a->sparse);
+    ASSERT_IN_RANGE(1000.0, hll_estimate(a), 5.0);
+
+    // Large sets go dense and stay within a few standard errors.
+    for (uint64_t i = 0; i < 200000; ++i)
+    {
+        sprintf(key, "w%"PRIu64"", i);
+        ASSERT_EQ(HLL_OK, hll_add(b, hash_djb2(key)));
+    }
+    ASSERT_FALSE(b->sparse);
+    ASSERT_IN_RANGE(200000.0, hll_estimate(b), 200000.0 * 3 * hll_error(b));
+
+    // Merging a subset changes nothing, merging into sparse goes dense.
+    ASSERT_EQ(HLL_OK, hll_merge(b, a));
+    ASSERT_IN_RANGE(200000.0, hll_estimate(b), 200000.0 * 3 * hll_error(b));
+    ASSERT_EQ(HLL_OK, hll_merge(a, b));
+    ASSERT_FALSE(a->sparse);
+    ASSERT_IN_RANGE(hll_estimate(b), hll_estimate(a), 0.001);
+
+    hll_free(a);
+    hll_free(b);
+    PASS();
+}
+
+SUITE (hll_suite)
+{
+    RUN_TEST(hll_estimates);
+}
+
+TEST bloom_no_false_negatives(void)
+{
+    // 64 KiB, about 26 bits per item.
+    bloom_t* bloom = bloom_init(64U * 1024U, BLOOM_DEFAULT_K);
+    ASSERT(bloom != NULL);
+    ASSERT_EQ(64U * 1024U, bloom_bytes(bloom));
+
+    char key[32];
+    for (uint64_t i = 0; i < 20000; ++i)
+    {
+        sprintf(key, "w%"PRIu64"", i);
+        bloom_add(bloom, hash_djb2(key));
+        ASSERT(bloom_test_and_add(bloom, hash_djb2(key)));
+    }
+
+    uint64_t false_positives = 0;
+    for (uint64_t i = 0; i < 20000; ++i)
+    {
+        sprintf(key, "w%"PRIu64"", i);
+        ASSERT(bloom_test(bloom, hash_djb2(key)));
+        sprintf(key, "x%"PRIu64"", i);
+        false_positives += bloom_test(bloom, hash_djb2(key));
+    }
+    ASSERT(false_positives < 200);
+
+    bloom_free(bloom);
+    PASS();
+}
+
+SUITE (bloom_suite)
+{
+    RUN_TEST(bloom_no_false_negatives);
+}
+
+TEST sample_top_words(void)
+{
+    ASSERT_IN_RANGE(1.645, sample_z(0.95), 0.001);
+    ASSERT_IN_RANGE(2.326, sample_z(0.99), 0.001);
+
+    // Three clearly separated words over a long tail.
+    FILE* f = tmpfile();
+    ASSERT(f != NULL);
+    for (uint64_t i = 0; i < 100000; ++i)
+    {
+        uint64_t t = i % 5000;
+        fprintf(f, "%s t%c%c%c\n",
+                (i % 2 == 0) ? "alpha" : (i % 3 == 0) ? "beta" : "gamma",
+                (char) ('a' + t % 26), (char) ('a' + t / 26 % 26),
+                (char) ('a' + t / 676));
+    }
+    fflush(f);
+
+    sample_config_t config = {.k = 3, .confidence = 0.99,
+                              .chunk_size = 4096, .seed = 1};
+    sample_result_t result;
+    ASSERT_EQ(SAMPLE_OK, sample_count(f, &config, MAP, &result));
+    ASSERT(result.converged);
+    ASSERT(result.fraction < 0.5);
+    ASSERT(result.error > 0.0);
+
+    const hashmap_bucket_t* top[3];
+    ASSERT_EQ(3, hashmap_top_k(MAP, 3, top));
+    ASSERT_STR_EQ("alpha", top[0]->key);
+    ASSERT_STR_EQ("gamma", top[1]->key);
+    ASSERT_STR_EQ("beta", top[2]->key);
+    ASSERT_IN_RANGE(50000, sample_scale(&result, top[0]->value), 5000);
+
+    fclose(f);
+    PASS();
+}
+
+SUITE (sample_suite)
+{
+    MAP = hashmap_init(hash_djb2);
+    RUN_TEST(sample_top_words);
+    hashmap_free(MAP);
+}
+
+TEST snapshot_roundtrip(void)
+{
+    char dir[] = "/tmp/mapwords_snapshot_XXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+    char path[64];
+    sprintf(path, "%s/map.snap", dir);
+
+    char key[32];
+    for (uint64_t i = 0; i < 1000; ++i)
+    {
+        sprintf(key, "w%"PRIu64"", i);
+        ASSERT_EQ(HASHMAP_OK, hashmap_increment(MAP, key, (int64_t) i % 7));
+    }
+    ASSERT_EQ(HASHMAP_OK, hashmap_save(MAP, path));
+
+    snapshot_t* snap = snapshot_open(path, true);
+    ASSERT(snap != NULL);
+    ASSERT_EQ(1000, snap->header->count);
+    ASSERT_STR_EQ("hash_djb2", snap->header->hashf);
+
+    // Entries are ordered by value (desc) and key (asc).
+    ASSERT_STR_EQ("w104", snapshot_key(snap, &snap->entries[0]));
+    ASSERT_EQ(6, snap->entries[0].value);
+    ASSERT_STR_EQ("w994", snapshot_key(snap, &snap->entries[999]));
+
+    int64_t value = -1;
+    ASSERT_EQ(SNAPSHOT_KEY_FOUND, snapshot_get(snap, "w500", &value));
+    ASSERT_EQ(500 % 7, value);
+    ASSERT_EQ(SNAPSHOT_KEY_NOT_FOUND, snapshot_get(snap, "w1000", &value));
+    snapshot_close(snap);
+
+    hashmap_map_t* loaded = hashmap_load(path);
+    ASSERT(loaded != NULL);
+    ASSERT_EQ(MAP->size, loaded->size);
+    ASSERT_EQ(0, loaded->rehashes);
+    for (uint64_t i = 0; i < 1000; ++i)
+    {
+        sprintf(key, "w%"PRIu64"", i);
+        ASSERT_EQ(HASHMAP_KEY_FOUND, hashmap_get(loaded, key, &value));
+        ASSERT_EQ((int64_t) i % 7, value);
+    }
+    hashmap_free(loaded);
+
+    // Flip one byte of the pool: header still opens, body does not.
+    FILE* f = fopen(path, "r+b");
+    ASSERT(f != NULL);
+    fseek(f, -2, SEEK_END);
+    fputc('x', f);
+    fclose(f);
+    snap = snapshot_open(path, false);
+    ASSERT(snap != NULL);
+    ASSERT_FALSE(snapshot_verify(snap));
+    snapshot_close(snap);
+    ASSERT_EQ(NULL, hashmap_load(path));
+
+    // A key offset out of the pool is caught when the entry is used
+    // without verify, and on open with verify.
+    uint64_t offset = UINT64_MAX / 2;
+    f = fopen(path, "r+b");
+    ASSERT(f != NULL);
+    fseek(f, (long) (sizeof(snapshot_header_t)
+                     + offsetof(snapshot_entry_t, key_offset)), SEEK_SET);
+    fwrite(&offset, sizeof(offset), 1, f);
+    fclose(f);
+    snap = snapshot_open(path, false);
+    ASSERT(snap != NULL);
+    ASSERT_EQ(NULL, snapshot_key(snap, &snap->entries[0]));
+    ASSERT_STR_EQ("w99x", snapshot_key(snap, &snap->entries[999]));
+    ASSERT_EQ(SNAPSHOT_ERROR, snapshot_get(snap, "w104", &value));
+    snapshot_close(snap);
+    ASSERT_EQ(NULL, snapshot_open(path, true));
+
+    unlink(path);
+    rmdir(dir);
+    PASS();
+}
+
+TEST snapshot_merge_update(void)
+{
+    char dir[] = "/tmp/mapwords_snapshot_XXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+    char path[64];
+    sprintf(path, "%s/map.snap", dir);
+
+    hashmap_map_t* base = hashmap_init(hash_djb2);
+    hashmap_map_t* update = hashmap_init(hash_djb2);
+    char key[32];
+    for (uint64_t i = 0; i < 100; ++i)
+    {
+        sprintf(key, "w%"PRIu64"", i);
+        ASSERT_EQ(HASHMAP_OK, hashmap_increment(base, key, 1));
+        sprintf(key, "w%"PRIu64"", i + 50);
+        ASSERT_EQ(HASHMAP_OK, hashmap_increment(update, key, 2));
+    }
+    ASSERT_EQ(HASHMAP_OK, hashmap_save(base, path));
+
+    // Merge into the file the snapshot is mapped from.
+    snapshot_t* snap = snapshot_open(path, true);
+    ASSERT(snap != NULL);
+    uint64_t collisions = update->collisions;
+    ASSERT_EQ(HASHMAP_OK, hashmap_save_merged(update, snap, path));
+    ASSERT_EQ(collisions, update->collisions);
+    snapshot_close(snap);
+
+    snap = snapshot_open(path, true);
+    ASSERT(snap != NULL);
+    ASSERT_EQ(150, snap->header->count);
+    ASSERT_EQ(300, snap->header->total);
+    int64_t value = 0;
+    ASSERT_EQ(SNAPSHOT_KEY_FOUND, snapshot_get(snap, "w0", &value));
+    ASSERT_EQ(1, value);
+    ASSERT_EQ(SNAPSHOT_KEY_FOUND, snapshot_get(snap, "w50", &value));
+    ASSERT_EQ(3, value);
+    ASSERT_EQ(SNAPSHOT_KEY_FOUND, snapshot_get(snap, "w149", &value));
+    ASSERT_EQ(2, value);
+    snapshot_close(snap);
+
+    hashmap_free(base);
+    hashmap_free(update);
+    unlink(path);
+    rmdir(dir);
+    PASS();
+}
+
+SUITE (snapshot_suite)
+{
+    MAP = hashmap_init(hash_djb2);
+    RUN_TEST(snapshot_roundtrip);
+    RUN_TEST(snapshot_merge_update);
+    hashmap_free(MAP);
+}
+
+// Write text to path with mode "w" or "a".
+static void
+write_file(const char* path, const char* mode, const char* text)
+{
+    FILE* f = fopen(path, mode);
+    if (f)
+    {
+        fputs(text, f);
+        fclose(f);
+    }
+}
+
+// Apply changes until none are pending.
+static int64_t
+watch_settle(watch_t* watch)
+{
+    int64_t total = 0;
+    int64_t n;
+    while ((n = watch_poll(watch, 100)) > 0)
+    {
+        total += n;
+    }
+    return (n < 0) ? n : total;
+}
+
+TEST watch_append_rewrite(void)
+{
+    char dir[] = "/tmp/mapwords_watch_XXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+
+    char a[64];
+    char b[64];
+    char c[64];
+    sprintf(a, "%s/a.txt", dir);
+    sprintf(b, "%s/b.txt", dir);
+    sprintf(c, "%s/c.txt", dir);
+    write_file(a, "w", "one two ");
+    write_file(b, "w", "two ");
+
+    watch_t* watch = watch_init(hash_djb2);
+    ASSERT(watch != NULL);
+    ASSERT_EQ(WATCH_OK, watch_add_path(watch, dir));
+    ASSERT_EQ(2, watch->file_count);
+    ASSERT_EQ(3, watch->wordcount);
+
+    int64_t out = 0;
+    ASSERT_EQ(HASHMAP_KEY_FOUND, hashmap_get(watch->aggregate, "two", &out));
+    ASSERT_EQ(2, out);
+
+    // Appends are read from the counted offset, a word split over two
+    // writes is counted once.
+    write_file(b, "a", "th");
+    ASSERT(watch_settle(watch) > 0);
+    write_file(a, "a", "four\n");
+    write_file(b, "a", "ree\n");
+    ASSERT(watch_settle(watch) > 0);
+    ASSERT_EQ(5, watch->wordcount);
+    ASSERT_EQ(3 + 3 + 3 + 5 + 4, watch->charcount);
+    ASSERT_EQ(HASHMAP_KEY_FOUND, hashmap_get(watch->aggregate, "three", &out));
+    ASSERT_EQ(1, out);
+    ASSERT_EQ(HASHMAP_KEY_FOUND, hashmap_get(watch->aggregate, "th", &out));
+    ASSERT_EQ(0, out);
+    ASSERT_EQ(HASHMAP_KEY_FOUND, hashmap_get(watch->aggregate, "four", &out));
+    ASSERT_EQ(1, out);
+    ASSERT_EQ(0, watch->rewrites);
+
+    // Truncation replaces the counts of the file.
+    write_file(a, "w", "five\n");
+    ASSERT(watch_settle(watch) > 0);
+    ASSERT(watch->rewrites >= 1);
+    ASSERT_EQ(3, watch->wordcount);
+    ASSERT_EQ(HASHMAP_KEY_FOUND, hashmap_get(watch->aggregate, "two", &out));
+    ASSERT_EQ(1, out);
+    ASSERT_EQ(HASHMAP_KEY_FOUND, hashmap_get(watch->aggregate, "one", &out));
+    ASSERT_EQ(0, out);
+
+    // So does rewriting it in place with longer content.
+    uint64_t rewrites = watch->rewrites;
+    write_file(a, "w", "zeta zeta zeta zeta\n");
+    ASSERT(watch_settle(watch) > 0);
+    ASSERT(watch->rewrites > rewrites);
+    ASSERT_EQ(6, watch->wordcount);
+    ASSERT_EQ(HASHMAP_KEY_FOUND, hashmap_get(watch->aggregate, "zeta", &out));
+    ASSERT_EQ(4, out);
+    ASSERT_EQ(HASHMAP_KEY_FOUND, hashmap_get(watch->aggregate, "five", &out));
+    ASSERT_EQ(0, out);
+    write_file(a, "w", "five\n");
+    ASSERT(watch_settle(watch) > 0);
+
+    // New files are added, deleted files subtracted.
+    write_file(c, "w", "five five\n");
+    remove(b);
+    ASSERT(watch_settle(watch) > 0);
+    ASSERT_EQ(2, watch->file_count);
+    ASSERT_EQ(3, watch->wordcount);
+    ASSERT_EQ(HASHMAP_KEY_FOUND, hashmap_get(watch->aggregate, "five", &out));
+    ASSERT_EQ(3, out);
+    ASSERT_EQ(HASHMAP_KEY_FOUND, hashmap_get(watch->aggregate, "two", &out));
+    ASSERT_EQ(0, out);
+
+    const hashmap_bucket_t* top[1];
+    ASSERT_EQ(1, hashmap_top_k(watch->aggregate, 1, top));
+    ASSERT_STR_EQ("five", top[0]->key);
+
+    watch_free(watch);
+    remove_dir(dir);
+    PASS();
+}
+
+TEST watch_bare_file(void)
+{
+    char dir[] = "/tmp/mapwords_watch_XXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+    char cwd[4096];
+    ASSERT(getcwd(cwd, sizeof(cwd)) != NULL);
+    ASSERT_EQ(0, chdir(dir));
+
+    // A file without directory is the same file as the one events name.
+    write_file("a.txt", "w", "alpha ");
+    watch_t* watch = watch_init(hash_djb2);
+    ASSERT(watch != NULL);
+    ASSERT_EQ(WATCH_OK, watch_add_path(watch, "a.txt"));
+    ASSERT_EQ(WATCH_OK, watch_add_path(watch, "./a.txt"));
+    ASSERT_EQ(1, watch->file_count);
+
+    write_file("a.txt", "a", "beta\n");
+    ASSERT(watch_settle(watch) > 0);
+    ASSERT_EQ(1, watch->file_count);
+    ASSERT_EQ(2, watch->wordcount);
+    int64_t out = 0;
+    ASSERT_EQ(HASHMAP_KEY_FOUND, hashmap_get(watch->aggregate, "alpha", &out));
+    ASSERT_EQ(1, out);
+    ASSERT_EQ(HASHMAP_KEY_FOUND, hashmap_get(watch->aggregate, "beta", &out));
+    ASSERT_EQ(1, out);
+
+    // Siblings of a watched file are not counted.
+    write_file("b.txt", "w", "gamma\n");
+    ASSERT_EQ(0, watch_settle(watch));
+    ASSERT_EQ(1, watch->file_count);
+    ASSERT_EQ(HASHMAP_KEY_NOT_FOUND, hashmap_get(watch->aggregate, "gamma",
+                                                 &out));
+
+    watch_free(watch);
+    ASSERT_EQ(0, chdir(cwd));
+    remove_dir(dir);
+    PASS();
+}
+
+SUITE (watch_suite)
+{
+    MAP = hashmap_init(hash_djb2);
+    RUN_TEST(watch_append_rewrite);
+    RUN_TEST(watch_bare_file);
+    hashmap_free(MAP);
+}
+
+static void*
+serve_thread(void* arg)
+{
+    server_run(arg);
+    return NULL;
+}
+
+TEST server_requests(void)
+{
+    char path[64];
+    sprintf(path, "/tmp/mapwords_test_%ld.sock", (long) getpid());
+    server_t* server = server_init(path, hash_djb2);
+    ASSERT(server != NULL);
+
+    pthread_t thread;
+    ASSERT_EQ(0, pthread_create(&thread, NULL, serve_thread, server));
+
+    int fd = server_connect(path);
+    ASSERT(fd >= 0);
+
+    server_response_t response;
+    void* out = NULL;
+    const char* docs[] = {"The cat and the dog", "cat"};
+    for (int i = 0; i < 2; ++i)
+    {
+        ASSERT_EQ(SERVER_OK, server_call(fd, SERVER_OP_INGEST, 0, docs[i],
+                                         strlen(docs[i]), &response, &out));
+    }
+    ASSERT_EQ(1, response.value);
+
+    ASSERT_EQ(SERVER_OK, server_call(fd, SERVER_OP_COUNT, 0, "THE", 3,
+                                     &response, &out));
+    ASSERT_EQ(2, response.value);
+    ASSERT_EQ(SERVER_OK, server_call(fd, SERVER_OP_COUNT, 0, "cow", 3,
+                                     &response, &out));
+    ASSERT_EQ(0, response.value);
+
+    ASSERT_EQ(SERVER_OK, server_call(fd, SERVER_OP_DISTINCT, 0, NULL, 0,
+                                     &response, &out));
+    ASSERT_EQ(4, response.value);
+    ASSERT_EQ(SERVER_OK, server_call(fd, SERVER_OP_STATS, 0, NULL, 0,
+                                     &response, &out));
+    ASSERT_EQ(6, response.value);
+
+    // Records of int64 value, uint32 length and key, ties by key.
+    ASSERT_EQ(SERVER_OK, server_call(fd, SERVER_OP_TOPK, 3, NULL, 0,
+                                     &response, &out));
+    ASSERT_EQ(3, response.count);
+    const char* expected[] = {"cat", "the", "and"};
+    const int64_t values[] = {2, 2, 1};
+    const char* p = out;
+    for (int i = 0; i < 3; ++i)
+    {
+        int64_t value;
+        uint32_t len;
+        memcpy(&value, p, sizeof(value));
+        memcpy(&len, p + sizeof(value), sizeof(len));
+        p += sizeof(value) + sizeof(len);
+        ASSERT_EQ(values[i], value);
+        ASSERT_EQ(strlen(expected[i]), len);
+        ASSERT_EQ(0, memcmp(expected[i], p, len));
+        p += len;
+    }
+    ASSERT_EQ(response.length, (uint64_t) (p - (const char*) out));
+    free(out);
+
+    // Unknown operations close the connection.
+    ASSERT_EQ(SERVER_ERROR, server_call(fd, 99, 0, NULL, 0, &response, &out));
+    close(fd);
+
+    server_stop(server);
+    ASSERT_EQ(0, pthread_join(thread, NULL));
+    server_free(server);
+    ASSERT_EQ(-1, access(path, F_OK));
+    PASS();
+}
+
+SUITE (server_suite)
+{
+    RUN_TEST(server_requests);
+}
+
+TEST mapwords_feed_pieces(void)
+{
+    // Long words are split at WORD_SIZE - 1 characters.
+    char text[4096];
+    char long_word[WORD_SIZE + 100];
+    memset(long_word, 'x', sizeof(long_word) - 1);
+    long_word[sizeof(long_word) - 1] = '\0';
+    sprintf(text, "It's the cat, THE hat; the end. %s tail", long_word);
+    uint64_t len = strlen(text);
+
+    hashmap_map_t* expected = count_buffer(text, len);
+    uint64_t wordcount = 0;
+    for (uint64_t i = 0; i < expected->capacity; ++i)
+    {
+        wordcount += expected->buckets[i].in_use ? expected->buckets[i].value : 0;
+    }
+
+    // Feed in pieces of every size from 1 byte to the whole text.
+    for (uint64_t piece = 1; piece <= len; piece += (piece < 16) ? 1 : 97)
+    {
+        mapwords_ctx_t* ctx = mapwords_ctx_new(NULL);
+        ASSERT(ctx != NULL);
+        for (uint64_t pos = 0; pos < len; pos += piece)
+        {
+            uint64_t n = (len - pos < piece) ? len - pos : piece;
+            ASSERT_EQ(MAPWORDS_OK, mapwords_feed(ctx, text + pos, n));
+        }
+        ASSERT_EQ(MAPWORDS_OK, mapwords_finish(ctx));
+
+        ASSERT_EQ(wordcount, mapwords_word_count(ctx));
+        ASSERT_EQ(expected->size, mapwords_distinct_count(ctx));
+        for (uint64_t i = 0; i < expected->capacity; ++i)
+        {
+            hashmap_bucket_t* bucket = &expected->buckets[i];
+            if (bucket->in_use)
+            {
+                ASSERT_EQ(bucket->value, mapwords_count(ctx, bucket->key));
+            }
+        }
+
+        mapwords_word_t top[2];
+        ASSERT_EQ(2, mapwords_top_k(ctx, 2, top));
+        ASSERT_STR_EQ("the", top[0].word);
+        ASSERT_EQ(3, top[0].count);
+        ASSERT_EQ(1, mapwords_count(ctx, "It's"));
+        mapwords_ctx_free(ctx);
+    }
+
+    hashmap_free(expected);
+    PASS();
+}
+
+SUITE (mapwords_suite)
+{
+    RUN_TEST(mapwords_feed_pieces);
+}
+
+TEST index_postings(void)
+{
+    char dir[] = "/tmp/mapwords_test_XXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+
+    // Document 3 repeats "many" 200 times for a two-byte count.
+    const char* docs[] = {"apple banana apple", "cherry", "Apple cherry", ""};
+    char path[64];
+    for (int i = 0; i < 4; ++i)
+    {
+        sprintf(path, "%s/%d.txt", dir, i);
+        FILE* f = fopen(path, "w");
+        ASSERT(f != NULL);
+        fputs(docs[i], f);
+        for (int j = 0; i == 3 && j < 200; ++j)
+        {
+            fputs(" many", f);
+        }
+        fclose(f);
+    }
+
+    char index_path[64];
+    sprintf(index_path, "%s.idx", dir);
+    for (uint64_t jobs = 1; jobs <= 3; ++jobs)
+    {
+        multifile_t* mf = multifile_init();
+        ASSERT_EQ(MULTIFILE_OK, multifile_add_path(mf, dir));
+        ASSERT_EQ(INDEX_OK, index_build(mf, hash_djb2, jobs, index_path));
+        multifile_free(mf);
+
+        index_t* idx = index_open(index_path, true);
+        ASSERT(idx != NULL);
+        ASSERT_EQ(4, idx->header->doc_count);
+        ASSERT_EQ(4, idx->header->term_count);
+        ASSERT_EQ(206, idx->header->total);
+        ASSERT_EQ(200, idx->docs[3].wordcount);
+        sprintf(path, "%s/2.txt", dir);
+        ASSERT_STR_EQ(path, index_doc_path(idx, 2));
+
+        const char* words[] = {"apple", "banana", "cherry", "many"};
+        const uint64_t expected[][3] = {{0, 2, 1}, {0, 1, 0}, {1, 1, 1},
+                                        {3, 200, 0}};
+        const uint64_t expected_len[] = {2, 1, 2, 1};
+        for (uint64_t t = 0; t < 4; ++t)
+        {
+            ASSERT_STR_EQ(words[t], index_key(idx, &idx->terms[t]));
+            const index_term_t* term = index_find(idx, words[t]);
+            ASSERT_EQ(&idx->terms[t], term);
+            ASSERT_EQ(expected_len[t], term->df);
+
+            // Postings as (doc, count), then (doc, count) if two.
+            index_cursor_t cursor;
+            uint64_t doc = 0;
+            uint64_t count = 0;
+            uint64_t n = 0;
+            index_cursor_init(idx, term, &cursor);
+            while (index_cursor_next(&cursor, &doc, &count))
+            {
+                if (n == 0)
+                {
+                    ASSERT_EQ(expected[t][0], doc);
+                    ASSERT_EQ(expected[t][1], count);
+                }
+                else
+                {
+                    ASSERT_EQ(2, doc);
+                    ASSERT_EQ(expected[t][2], count);
+                }
+                n++;
+            }
+            ASSERT_EQ(expected_len[t], n);
+        }
+        ASSERT_EQ(NULL, index_find(idx, "durian"));
+        index_close(idx);
+    }
+
+    // A pool past the end of file whose size wraps the sum of offset
+    // and size around to the file size is rejected.
+    index_header_t header;
+    FILE* f = fopen(index_path, "r+b");
+    ASSERT(f != NULL);
+    ASSERT_EQ(1, fread(&header, sizeof(header), 1, f));
+    index_header_t wrapped = header;
+    wrapped.postings_size = header.file_size;
+    wrapped.pool_offset = (wrapped.postings_offset + wrapped.postings_size
+                           + 7U) & ~(uint64_t) 7U;
+    wrapped.pool_size = header.file_size - wrapped.pool_offset;
+    wrapped.header_checksum = snapshot_checksum(
+        &wrapped, offsetof(index_header_t, header_checksum), 0);
+    rewind(f);
+    fwrite(&wrapped, sizeof(wrapped), 1, f);
+    fflush(f);
+    ASSERT_EQ(NULL, index_open(index_path, false));
+    rewind(f);
+    fwrite(&header, sizeof(header), 1, f);
+    fclose(f);
+
+    // A key offset out of the pool is rejected even without verify.
+    index_t* idx = index_open(index_path, false);
+    ASSERT(idx != NULL);
+    long offset = (long) (idx->header->terms_offset
+                          + offsetof(index_term_t, key_offset));
+    index_close(idx);
+    uint64_t bad = UINT64_MAX / 2;
+    f = fopen(index_path, "r+b");
+    ASSERT(f != NULL);
+    fseek(f, offset, SEEK_SET);
+    fwrite(&bad, sizeof(bad), 1, f);
+    fclose(f);
+    ASSERT_EQ(NULL, index_open(index_path, false));
+
+    unlink(index_path);
+    remove_dir(dir);
+    PASS();
+}
+
+SUITE (index_suite)
+{
+    RUN_TEST(index_postings);
+}
+
+TEST intern_dense_ids(void)
+{
+    intern_t* in = intern_init(hash_djb2);
+    ASSERT(in != NULL);
+
+    // Enough words for the map and the pool to grow.
+    char word[32];
+    for (int64_t i = 0; i < 5000; ++i)
+    {
+        sprintf(word, "word%"PRId64"", i);
+        ASSERT_EQ(i, intern_id(in, word, strlen(word)));
+    }
+    for (int64_t i = 4999; i >= 0; --i)
+    {
+        sprintf(word, "word%"PRId64"", i);
+        ASSERT_EQ(i, intern_id(in, word, strlen(word)));
+        ASSERT_STR_EQ(word, intern_key(in, (uint32_t) i));
+    }
+    ASSERT_EQ(5000, in->count);
+
+    intern_free(in);
+    PASS();
+}
+
+TEST ngram_rolling_counts(void)
+{
+    const char* text = "the cat saw the cat saw the dog";
+    uint64_t len = strlen(text);
+    for (uint32_t n = 1; n <= 3; ++n)
+    {
+        ngram_t* ng = ngram_init(hash_djb2, n);
+        ASSERT(ng != NULL);
+
+        // The rolling hash must match a hash computed from scratch,
+        // so repeated n-grams are found again.
+        uint64_t pos = 0;
+        char word[WORD_SIZE];
+        uint64_t word_len;
+        while ((word_len = buffer_next_word(text, len, &pos, word, WORD_SIZE)))
+        {
+            ASSERT_EQ(NGRAM_OK, ngram_add_word(ng, word, word_len));
+        }
+        ASSERT_EQ(9 - n, ng->total);
+
+        const char* words[] = {"the", "cat", "saw"};
+        const uint64_t counts[] = {3, 2, 2};
+        ASSERT_EQ(counts[n - 1], ngram_get(ng, words));
+
+        const ngram_entry_t* top[2];
+        char key[NGRAM_KEY_SIZE];
+        ASSERT_EQ(2, ngram_top_k(ng, 2, top));
+        ngram_key(ng, top[0], key);
+        const char* first[] = {"the", "cat saw", "cat saw the"};
+        ASSERT_STR_EQ(first[n - 1], key);
+        ngram_free(ng);
+    }
+
+    // Windows do not span a reset.
+    ngram_t* ng = ngram_init(hash_djb2, 2);
+    char a[] = "a";
+    char b[] = "b";
+    ASSERT_EQ(NGRAM_OK, ngram_add_word(ng, a, 1));
+    ngram_reset(ng);
+    ASSERT_EQ(NGRAM_OK, ngram_add_word(ng, b, 1));
+    ASSERT_EQ(0, ng->total);
+    ngram_free(ng);
+
+    PASS();
+}
+
+SUITE (ngram_suite)
+{
+    RUN_TEST(intern_dense_ids);
+    RUN_TEST(ngram_rolling_counts);
+}
+
+TEST u64map_counts(void)
+{
+    u64map_t* map = u64map_init();
+    ASSERT(map != NULL);
+
+    // Enough keys to rehash several times, key 0 included.
+    for (uint32_t a = 0; a < 100; ++a)
+    {
+        for (uint32_t b = 0; b <= a; ++b)
+        {
+            ASSERT_EQ(U64MAP_OK, u64map_increment(map, u64map_pair(a, b),
+                                                  a % 7 + 1));
+        }
+    }
+    ASSERT_EQ(U64MAP_OK, u64map_increment(map, u64map_pair(3, 1), 10));
+    ASSERT_EQ(U64MAP_ERROR, u64map_increment(map, U64MAP_EMPTY, 1));
+
+    ASSERT_EQ(5050, map->size);
+    ASSERT(map->rehashes > 0);
+    ASSERT_EQ(14, u64map_get(map, u64map_pair(3, 1)));
+    ASSERT_EQ(7, u64map_get(map, u64map_pair(6, 0)));
+    ASSERT_EQ(0, u64map_get(map, u64map_pair(0, 6)));
+
+    // Ties in key order.
+    const u64map_entry_t* top[3];
+    ASSERT_EQ(3, u64map_top_k(map, 3, top));
+    ASSERT_EQ(u64map_pair(3, 1), top[0]->key);
+    ASSERT_EQ(u64map_pair(6, 0), top[1]->key);
+    ASSERT_EQ(u64map_pair(6, 1), top[2]->key);
+
+    u64map_free(map);
+    PASS();
+}
+
+SUITE (u64map_suite)
+{
+    RUN_TEST(u64map_counts);
+}
+
+static int64_t
+packed_sum_value(const char* key, int64_t value, void* ctx)
+{
+    (void) key;
+    *(int64_t*) ctx += value;
+    return 0;
+}
+
+TEST packed_two_tiers(void)
+{
+    packed_t* p = packed_init(hash_djb2);
+    ASSERT(p != NULL);
+
+    // Packed keys order like their strings.
+    ASSERT(packed_key("a", 1) < packed_key("ab", 2));
+    ASSERT(packed_key("ab", 2) < packed_key("b", 1));
+    char key[PACKED_MAX_LEN + 1];
+    packed_unpack(packed_key("it's", 4), key);
+    ASSERT_STR_EQ("it's", key);
+
+    const char* words[] = {"zebra", "abcdefgh", "abcdefghi", "a",
+                           "longerwords"};
+    const int64_t counts[] = {5, 3, 5, 3, 7};
+    char word[16];
+    for (int i = 0; i < 5; ++i)
+    {
+        strcpy(word, words[i]);
+        ASSERT_EQ(PACKED_OK, packed_increment(p, word, strlen(word),
+                                              counts[i]));
+    }
+    ASSERT_EQ(3, p->short_words->size);
+    ASSERT_EQ(2, p->long_words->size);
+    ASSERT_EQ(5, packed_size(p));
+    ASSERT_EQ(5, packed_get(p, "abcdefghi"));
+    ASSERT_EQ(3, packed_get(p, "abcdefgh"));
+    ASSERT_EQ(0, packed_get(p, "abc"));
+
+    // Ties across tiers are broken by key.
+    const char* expected[] = {"longerwords", "abcdefghi", "zebra", "a",
+                              "abcdefgh"};
+    packed_word_t top[5];
+    ASSERT_EQ(5, packed_top_k(p, 5, top));
+    for (int i = 0; i < 5; ++i)
+    {
+        ASSERT_STR_EQ(expected[i], top[i].key);
+    }
+    ASSERT_EQ(2, packed_top_k(p, 2, top));
+    ASSERT_STR_EQ("abcdefghi", top[1].key);
+
+    int64_t sum = 0;
+    ASSERT_EQ(0, packed_each(p, packed_sum_value, &sum));
+    ASSERT_EQ(23, sum);
+
+    packed_free(p);
+    PASS();
+}
+
+SUITE (packed_suite)
+{
+    RUN_TEST(packed_two_tiers);
+}
+
+TEST prefix_top_k_by_prefix(void)
+{
+    hashmap_map_t* map = hashmap_init(hash_djb2);
+    ASSERT(map != NULL);
+
+    // 26 x 6 words "aa" to "zf" span several blocks, the count of a
+    // word is its second letter, so ties are broken by key.
+    char word[WORD_SIZE];
+    for (char a = 'a'; a <= 'z'; ++a)
+    {
+        for (char b = 'a'; b <= 'f'; ++b)
+        {
+            sprintf(word, "%c%c", a, b);
+            ASSERT_EQ(HASHMAP_OK, hashmap_increment(map, word, b - 'a' + 1));
+        }
+    }
+    strcpy(word, "m");
+    ASSERT_EQ(HASHMAP_OK, hashmap_increment(map, word, 100));
+    strcpy(word, "mfa");
+    ASSERT_EQ(HASHMAP_OK, hashmap_increment(map, word, 6));
+
+    prefix_t* built = prefix_build(map, 2);
+    ASSERT(built != NULL);
+    ASSERT_EQ(158, built->header->count);
+    ASSERT(built->header->block_count > 1);
+
+    char path[] = "/tmp/mapwords_prefix_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    close(fd);
+    ASSERT_EQ(PREFIX_OK, prefix_save(built, path));
+    prefix_close(built);
+
+    prefix_t* p = prefix_open(path, true);
+    ASSERT(p != NULL);
+
+    prefix_word_t top[8];
+    ASSERT_EQ(4, prefix_top_k(p, "m", 4, top));
+    const char* expected[] = {"m", "mf", "mfa", "me"};
+    for (int i = 0; i < 4; ++i)
+    {
+        ASSERT_STR_EQ(expected[i], top[i].key);
+    }
+    ASSERT_EQ(100, top[0].value);
+    ASSERT_EQ(6, top[2].value);
+
+    ASSERT_EQ(2, prefix_top_k(p, "mf", 8, top));
+    ASSERT_STR_EQ("mf", top[0].key);
+    ASSERT_STR_EQ("mfa", top[1].key);
+    ASSERT_EQ(1, prefix_top_k(p, "zf", 8, top));
+    ASSERT_STR_EQ("zf", top[0].key);
+    ASSERT_EQ(0, prefix_top_k(p, "zz", 8, top));
+    ASSERT_EQ(0, prefix_top_k(p, "0", 8, top));
+
+    // The empty prefix ranks all words.
+    ASSERT_EQ(3, prefix_top_k(p, "", 3, top));
+    ASSERT_STR_EQ("m", top[0].key);
+    ASSERT_STR_EQ("af", top[1].key);
+    ASSERT_STR_EQ("bf", top[2].key);
+
+    // A max tree running past the end of file, with a keys size that
+    // wraps the sum of offset and size around to the file size, is
+    // rejected.
+    prefix_header_t header = *p->header;
+    prefix_header_t wrapped = header;
+    wrapped.leaves = 1;
+    while (2 * wrapped.leaves < header.file_size)
+    {
+        wrapped.leaves *= 2;
+    }
+    wrapped.keys_offset = wrapped.tree_offset
+                          + 2 * wrapped.leaves * sizeof(int64_t);
+    wrapped.keys_size = header.file_size - wrapped.keys_offset;
+    wrapped.header_checksum = snapshot_checksum(
+        &wrapped, offsetof(prefix_header_t, header_checksum), 0);
+    FILE* f = fopen(path, "r+b");
+    ASSERT(f != NULL);
+    fwrite(&wrapped, sizeof(wrapped), 1, f);
+    fflush(f);
+    ASSERT_EQ(NULL, prefix_open(path, false));
+    rewind(f);
+    fwrite(&header, sizeof(header), 1, f);
+    fclose(f);
+
+    // A block offset out of the keys is rejected even without verify.
+    long offset = (long) (p->header->blocks_offset + sizeof(uint64_t));
+    uint64_t bad = p->header->keys_size;
+    prefix_close(p);
+    f = fopen(path, "r+b");
+    ASSERT(f != NULL);
+    fseek(f, offset, SEEK_SET);
+    fwrite(&bad, sizeof(bad), 1, f);
+    fclose(f);
+    ASSERT_EQ(NULL, prefix_open(path, false));
+
+    remove(path);
+    hashmap_free(map);
+    PASS();
+}
+
+SUITE (prefix_suite)
+{
+    RUN_TEST(prefix_top_k_by_prefix);
+}
+
+typedef struct art_order_ctx
+{
+    char last[WORD_SIZE];
+    uint64_t count;
+    bool sorted;
+} art_order_ctx_t;
+
+static int64_t
+art_check_order(const char* key, int64_t value, void* ctx)
+{
+    (void) value;
+    art_order_ctx_t* order = ctx;
+    order->sorted = order->sorted
+                    && (order->count == 0 || strcmp(order->last, key) < 0);
+    strcpy(order->last, key);
+    order->count++;
+    return 0;
+}
+
+TEST art_counts_in_key_order(void)
+{
+    art_t* t = art_init();
+    ASSERT(t != NULL);
+
+    // Long shared prefixes split past the stored prefix bytes, and
+    // a word may end where another one goes on.
+    const char* words[] = {"internationalization", "internationalism",
+                           "international", "intern", "in", "i", "zebra",
+                           "internationalization"};
+    for (int i = 0; i < 8; ++i)
+    {
+        ASSERT_EQ(ART_OK, art_increment(t, words[i], strlen(words[i]), 1));
+    }
+    ASSERT_EQ(7, t->size);
+    ASSERT_EQ(2, art_get(t, "internationalization"));
+    ASSERT_EQ(1, art_get(t, "intern"));
+    ASSERT_EQ(0, art_get(t, "inter"));
+    ASSERT_EQ(0, art_get(t, "internationalizations"));
+    ASSERT_EQ(0, art_get(t, "internationalizatiom"));
+    ASSERT_EQ(ART_OK, art_update(t, "in", 2, 5));
+    ASSERT_EQ(5, art_get(t, "in"));
+
+    // Every byte value under one node grows it up to a node256.
+    char word[4] = "q";
+    for (int c = 1; c < 256; ++c)
+    {
+        word[1] = (char) c;
+        ASSERT_EQ(ART_OK, art_increment(t, word, 2, c % 3));
+    }
+    ASSERT_EQ(7 + 255, t->size);
+    ASSERT_EQ(1, t->nodes[3]);
+    word[1] = (char) 200;
+    ASSERT_EQ(2, art_get(t, word));
+
+    art_order_ctx_t order = {.count = 0, .sorted = true};
+    ASSERT_EQ(0, art_each(t, art_check_order, &order));
+    ASSERT_EQ(t->size, order.count);
+    ASSERT(order.sorted);
+
+    // Ties are broken by key.
+    const art_leaf_t* top[4];
+    ASSERT_EQ(4, art_top_k(t, 4, top));
+    ASSERT_STR_EQ("in", top[0]->key);
+    ASSERT_STR_EQ("internationalization", top[1]->key);
+    ASSERT_EQ(2, top[2]->value);
+    ASSERT_EQ(2, top[3]->value);
+    ASSERT(strcmp(top[2]->key, top[3]->key) < 0);
+
+    art_free(t);
+    PASS();
+}
+
+SUITE (art_suite)
+{
+    RUN_TEST(art_counts_in_key_order);
+}
+
+static int64_t
+backend_sum_value(const char* key, int64_t value, void* ctx)
+{
+    (void) key;
+    *(int64_t*) ctx += value;
+    return 0;
+}
+
+TEST backend_all_agree(void)
+{
+    ASSERT_STR_EQ("hashmap", backend_list[0]->name);
+    ASSERT(backend_find("art") != NULL);
+    ASSERT(backend_find("nope") == NULL);
+
+    const char* words[] = {"the", "internationalization", "a", "the", "cat",
+                           "internationalization", "the", "b"};
+    const char* expected[] = {"the", "internationalization", "a", "b"};
+    for (uint64_t i = 0; backend_list[i] != NULL; ++i)
+    {
+        const backend_t* b = backend_list[i];
+        void* counter = b->init(hash_djb2);
+        ASSERT(counter != NULL);
+
+        char word[WORD_SIZE];
+        for (int j = 0; j < 8; ++j)
+        {
+            strcpy(word, words[j]);
+            ASSERT_EQ(BACKEND_OK, b->increment(counter, word, strlen(word),
+                                               1));
+        }
+
+        backend_stats_t stats;
+        b->stats(counter, &stats);
+        ASSERT_EQ(5, stats.size);
+        ASSERT(stats.bytes > 0);
+
+        int64_t sum = 0;
+        ASSERT_EQ(0, b->each(counter, backend_sum_value, &sum));
+        ASSERT_EQ(8, sum);
+
+        backend_word_t top[4];
+        ASSERT_EQ(4, b->top_k(counter, 4, top));
+        for (int j = 0; j < 4; ++j)
+        {
+            ASSERT_STR_EQ(expected[j], top[j].key);
+        }
+        ASSERT_EQ(3, top[0].value);
+
+        b->free(counter);
+    }
+    PASS();
+}
+
+SUITE (backend_suite)
+{
+    RUN_TEST(backend_all_agree);
 }
 
 GREATEST_MAIN_DEFS();
@@ -294,6 +2113,27 @@ int main(int argc, char** argv)
     GREATEST_MAIN_BEGIN();
 
     RUN_SUITE(hashmap_suite);
+    RUN_SUITE(ring_suite);
+    RUN_SUITE(pipeline_suite);
+    RUN_SUITE(multifile_suite);
+    RUN_SUITE(sort_suite);
+    RUN_SUITE(output_suite);
+    RUN_SUITE(spacesaving_suite);
+    RUN_SUITE(cms_suite);
+    RUN_SUITE(hll_suite);
+    RUN_SUITE(bloom_suite);
+    RUN_SUITE(sample_suite);
+    RUN_SUITE(snapshot_suite);
+    RUN_SUITE(mapwords_suite);
+    RUN_SUITE(server_suite);
+    RUN_SUITE(watch_suite);
+    RUN_SUITE(index_suite);
+    RUN_SUITE(ngram_suite);
+    RUN_SUITE(u64map_suite);
+    RUN_SUITE(packed_suite);
+    RUN_SUITE(prefix_suite);
+    RUN_SUITE(art_suite);
+    RUN_SUITE(backend_suite);
 
     GREATEST_MAIN_END();
 }